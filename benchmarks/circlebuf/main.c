@@ -0,0 +1,139 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/* This is a micro benchmark for searching the end of HTTP header in circlebuf.
+ *
+ * Each HTTP request is appended to the circlebuf piece by piece (as it trickles in from
+ * the network), and the "\r\n\r\n" is searched after each piece. The "memmem" column is
+ * the traditional way which searches from the beginning of the data every time. */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "svx_circlebuf.h"
+
+#define BENCH_BUF_LEN   (64 * 1024)
+#define BENCH_BYTES     (256 * 1024 * 1024) /* the total HTTP header bytes for each test */
+
+static const char *bench_header_lines[] = {
+    "Host: www.example.com\r\n",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",
+    "Accept-Language: en-US,en;q=0.5\r\n",
+    "Accept-Encoding: gzip, deflate, br\r\n",
+    "Connection: keep-alive\r\n",
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en-US\r\n",
+    "Upgrade-Insecure-Requests: 1\r\n",
+    "Cache-Control: max-age=0\r\n",
+    NULL
+};
+
+/* build a HTTP request header which is about "len" bytes */
+static size_t bench_build_req(char *req, size_t len)
+{
+    size_t n = 0, i = 0, line_len;
+
+    n += (size_t)sprintf(req, "GET /index.html HTTP/1.1\r\n");
+    while(1)
+    {
+        line_len = strlen(bench_header_lines[i]);
+        if(n + line_len + 2 > len) break;
+        memcpy(req + n, bench_header_lines[i], line_len);
+        n += line_len;
+        if(NULL == bench_header_lines[++i]) i = 0;
+    }
+    memcpy(req + n, "\r\n", 2);
+
+    return n + 2;
+}
+
+static double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+/* search with memmem() from the beginning of the data every time */
+static int bench_search_memmem(svx_circlebuf_t *cb, uint8_t *out, size_t out_len, size_t *ret_len)
+{
+    uint8_t *buf1, *buf2, *p;
+    size_t   buf1_len, buf2_len;
+
+    /* the data never wraps around, because each request is taken out as a whole */
+    if(svx_circlebuf_get_data_ptr(cb, &buf1, &buf1_len, &buf2, &buf2_len)) exit(1);
+    if(buf2_len > 0) exit(1);
+
+    if(NULL == (p = memmem(buf1, buf1_len, "\r\n\r\n", 4))) return 1;
+    *ret_len = (size_t)(p + 4 - buf1);
+    if(*ret_len > out_len) exit(1);
+    return svx_circlebuf_get_data(cb, out, *ret_len);
+}
+
+static double bench_run(const char *req, size_t req_len, size_t piece_len, int use_memmem)
+{
+    svx_circlebuf_t *cb = NULL;
+    uint8_t          out[BENCH_BUF_LEN];
+    size_t           reqs = BENCH_BYTES / req_len, i, sent, len, ret_len;
+    double           start;
+    int              r;
+
+    if(svx_circlebuf_create(&cb, BENCH_BUF_LEN, BENCH_BUF_LEN, 1024)) exit(1);
+
+    start = bench_now();
+    for(i = 0; i < reqs; i++)
+    {
+        for(sent = 0; sent < req_len; sent += len)
+        {
+            len = (req_len - sent < piece_len ? req_len - sent : piece_len);
+            if(svx_circlebuf_append_data(cb, (const uint8_t *)req + sent, len)) exit(1);
+
+            if(use_memmem)
+                r = bench_search_memmem(cb, out, sizeof(out), &ret_len);
+            else
+                r = svx_circlebuf_get_data_by_ending(cb, (const uint8_t *)"\r\n\r\n", 4, out, sizeof(out), &ret_len);
+
+            if(0 == r && ret_len != req_len) exit(1);
+            if(0 != r && sent + len == req_len) exit(1);
+        }
+    }
+
+    svx_circlebuf_destroy(&cb);
+
+    /* nanoseconds per request */
+    return (bench_now() - start) * 1000000000.0 / (double)reqs;
+}
+
+int main()
+{
+    size_t req_lens[]   = {256, 512, 1024, 2048, 4096};
+    size_t piece_lens[] = {1024 * 1024, 64, 16};
+    char   req[8192];
+    size_t req_len, i, j;
+    double ns_svx, ns_memmem;
+
+    printf("%-10s %-10s %15s %15s %10s\n", "header", "piece", "svx(ns/req)", "memmem(ns/req)", "speedup");
+    for(i = 0; i < sizeof(req_lens) / sizeof(req_lens[0]); i++)
+    {
+        req_len = bench_build_req(req, req_lens[i]);
+        for(j = 0; j < sizeof(piece_lens) / sizeof(piece_lens[0]); j++)
+        {
+            ns_svx    = bench_run(req, req_len, piece_lens[j], 0);
+            ns_memmem = bench_run(req, req_len, piece_lens[j], 1);
+            if(piece_lens[j] >= req_len)
+                printf("%-10zu %-10s %15.1f %15.1f %9.2fx\n", req_len, "whole", ns_svx, ns_memmem, ns_memmem / ns_svx);
+            else
+                printf("%-10zu %-10zu %15.1f %15.1f %9.2fx\n", req_len, piece_lens[j], ns_svx, ns_memmem, ns_memmem / ns_svx);
+        }
+    }
+
+    return 0;
+}
@@ -31,26 +31,76 @@ static void server_established_cb(svx_tcp_connection_t *conn, void *arg)
     if(svx_tcp_connection_set_nodelay(conn, 1)) exit(1);
 }
 
+/* Find a pattern in the current HTTP request [0, req_len) in place. The request may be split into
+   two spans in the read buffer, so the pattern may also cross them. */
+static int server_find_in_request(svx_circlebuf_t *buf, size_t req_len, const char *pattern, size_t *pos)
+{
+    const uint8_t *buf1, *buf2, *p;
+    size_t         buf1_len, buf2_len, head, tail;
+    size_t         pattern_len = strlen(pattern);
+    uint8_t        seam[64];
+
+    if(svx_circlebuf_get_spans(buf, 0, req_len, &buf1, &buf1_len, &buf2, &buf2_len)) return 0;
+
+    if(NULL != (p = memmem(buf1, buf1_len, pattern, pattern_len)))
+    {
+        *pos = (size_t)(p - buf1);
+        return 1;
+    }
+    if(NULL == buf2) return 0;
+
+    head = (buf1_len < pattern_len - 1 ? buf1_len : pattern_len - 1);
+    tail = (buf2_len < pattern_len - 1 ? buf2_len : pattern_len - 1);
+    memcpy(seam, buf1 + buf1_len - head, head);
+    memcpy(seam + head, buf2, tail);
+    if(NULL != (p = memmem(seam, head + tail, pattern, pattern_len)))
+    {
+        *pos = buf1_len - head + (size_t)(p - seam);
+        return 1;
+    }
+
+    if(NULL != (p = memmem(buf2, buf2_len, pattern, pattern_len)))
+    {
+        *pos = buf1_len + (size_t)(p - buf2);
+        return 1;
+    }
+    return 0;
+}
+
 /* The callback to handle HTTP request */
 static void server_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
 {
     SVX_UTIL_UNUSED(arg);
     
-    /* Get the current HTTP request. */
-    char   req[1024];
+    /* Find the end of the current HTTP request. The request is parsed in the read buffer,
+       nothing is copied out. This is the only pattern searched by svx_circlebuf_search(),
+       so the next call only scans the newly arrived data. */
     size_t req_len;
-    if(svx_circlebuf_get_data_by_ending(buf, (const uint8_t *)"\r\n\r\n", 4,
-                                        (uint8_t *)req, sizeof(req), &req_len)) return;
+    if(svx_circlebuf_search(buf, 0, (const uint8_t *)"\r\n\r\n", 4, &req_len)) return;
+    req_len += 4;
 
     /* We only deal with the /hello for test. */
-    if(0 != memcmp(req, "GET /hello HTTP/1.", 18))
+    int cmp;
+    if(svx_circlebuf_compare(buf, 0, (const uint8_t *)"GET /hello HTTP/1.", 18, &cmp) || 0 != cmp)
         svx_tcp_connection_shutdown_wr(conn);
 
-    /* If we should keep the TCP connection? */
-    int keep_alive = 1;
-    if(strcasestr(req, "Connection: close\r\n") ||
-       (!strcasestr(req, "Connection: keep-alive") && ('0' == req[18])/* HTTP 1.0 */))
-        keep_alive = 0;
+    /* If we should keep the TCP connection? HTTP 1.0 closes it by default.
+       The header name is case-sensitive here, which is enough for the benchmarking tools.
+       Only the current request is scanned, not the pipelined ones after it. */
+    size_t  pos;
+    uint8_t version = '1';
+    svx_circlebuf_peek(buf, 18, &version, 1);
+    int keep_alive = ('0' != version);
+    if(server_find_in_request(buf, req_len, "\r\nConnection: ", &pos))
+    {
+        if(0 == svx_circlebuf_compare(buf, pos + 14, (const uint8_t *)"close", 5, &cmp) && 0 == cmp)
+            keep_alive = 0;
+        else if(0 == svx_circlebuf_compare(buf, pos + 14, (const uint8_t *)"keep-alive", 10, &cmp) && 0 == cmp)
+            keep_alive = 1;
+    }
+
+    /* The request has been parsed, consume it. */
+    svx_circlebuf_erase_data(buf, req_len);
 
     /* Build the HTTP response. */
     char   resp[1024];
@@ -0,0 +1,223 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+
+/* the size of each allocation is recorded in front of it when the counters are enabled,
+   16 bytes for keeping the alignment of malloc() */
+#define SVX_ALLOC_HEADER_SIZE 16
+
+/* one cache line for each subsystem's counters, to avoid the false sharing */
+typedef struct
+{
+    svx_alloc_stats_t stats;
+} __attribute__((aligned(64))) svx_alloc_counter_t;
+
+static svx_alloc_hooks_t   svx_alloc_hooks      = {NULL, NULL, NULL, NULL}; /* NULL: use the libc */
+static int                 svx_alloc_stats_on   = 0;
+static int                 svx_alloc_started    = 0; /* the hooks and the counters can not be changed any more */
+static svx_alloc_counter_t svx_alloc_counters[SVX_ALLOC_TAG_COUNT];
+
+static const char *svx_alloc_tag_names[SVX_ALLOC_TAG_COUNT] = {
+    "misc", "looper", "timer", "pending", "channel", "tcp", "tcp_connection",
+    "udp", "circlebuf", "buf", "threadpool", "log"
+};
+
+static __inline__ void *svx_alloc_raw_malloc(svx_alloc_tag_t tag, size_t size)
+{
+    if(0 == svx_alloc_started) svx_alloc_started = 1;
+
+    return (svx_alloc_hooks.malloc_cb ? svx_alloc_hooks.malloc_cb(size, tag, svx_alloc_hooks.arg) : malloc(size));
+}
+
+static __inline__ void *svx_alloc_raw_realloc(svx_alloc_tag_t tag, void *ptr, size_t size)
+{
+    if(0 == svx_alloc_started) svx_alloc_started = 1;
+
+    return (svx_alloc_hooks.realloc_cb ? svx_alloc_hooks.realloc_cb(ptr, size, tag, svx_alloc_hooks.arg) : realloc(ptr, size));
+}
+
+static __inline__ void svx_alloc_raw_free(svx_alloc_tag_t tag, void *ptr)
+{
+    if(svx_alloc_hooks.free_cb)
+        svx_alloc_hooks.free_cb(ptr, tag, svx_alloc_hooks.arg);
+    else
+        free(ptr);
+}
+
+int svx_alloc_set_hooks(const svx_alloc_hooks_t *hooks)
+{
+    if(NULL != hooks && (NULL == hooks->malloc_cb || NULL == hooks->realloc_cb || NULL == hooks->free_cb))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "hooks:%p\n", hooks);
+
+    if(svx_alloc_started) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "the memory has been allocated\n");
+
+    if(hooks)
+        svx_alloc_hooks = *hooks;
+    else
+        memset(&svx_alloc_hooks, 0, sizeof(svx_alloc_hooks));
+
+    return 0;
+}
+
+int svx_alloc_enable_stats(int on)
+{
+    if(svx_alloc_started) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "the memory has been allocated\n");
+
+    svx_alloc_stats_on = (on ? 1 : 0);
+
+    return 0;
+}
+
+int svx_alloc_get_stats(svx_alloc_tag_t tag, svx_alloc_stats_t *stats)
+{
+    svx_alloc_stats_t *counter;
+
+    if(tag < 0 || tag >= SVX_ALLOC_TAG_COUNT || NULL == stats)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "tag:%d, stats:%p\n", tag, stats);
+
+    counter = &(svx_alloc_counters[tag].stats);
+    stats->allocs      = __sync_add_and_fetch(&(counter->allocs), 0);
+    stats->frees       = __sync_add_and_fetch(&(counter->frees), 0);
+    stats->alloc_bytes = __sync_add_and_fetch(&(counter->alloc_bytes), 0);
+    stats->live_bytes  = __sync_add_and_fetch(&(counter->live_bytes), 0);
+
+    return 0;
+}
+
+const char *svx_alloc_get_tag_name(svx_alloc_tag_t tag)
+{
+    if(tag < 0 || tag >= SVX_ALLOC_TAG_COUNT) return "unknown";
+
+    return svx_alloc_tag_names[tag];
+}
+
+void *svx_alloc_malloc(svx_alloc_tag_t tag, size_t size)
+{
+    svx_alloc_stats_t *counter;
+    uint8_t           *p;
+
+    if(!svx_alloc_stats_on) return svx_alloc_raw_malloc(tag, size);
+
+    if(size > SIZE_MAX - SVX_ALLOC_HEADER_SIZE) return NULL;
+    if(NULL == (p = svx_alloc_raw_malloc(tag, size + SVX_ALLOC_HEADER_SIZE))) return NULL;
+    *((size_t *)p) = size;
+
+    counter = &(svx_alloc_counters[tag].stats);
+    __sync_add_and_fetch(&(counter->allocs), 1);
+    __sync_add_and_fetch(&(counter->alloc_bytes), size);
+    __sync_add_and_fetch(&(counter->live_bytes), (int64_t)size);
+
+    return p + SVX_ALLOC_HEADER_SIZE;
+}
+
+void *svx_alloc_calloc(svx_alloc_tag_t tag, size_t nmemb, size_t size)
+{
+    void *p;
+
+    if(0 != size && nmemb > SIZE_MAX / size) return NULL;
+    if(NULL == (p = svx_alloc_malloc(tag, nmemb * size))) return NULL;
+    memset(p, 0, nmemb * size);
+
+    return p;
+}
+
+void *svx_alloc_realloc(svx_alloc_tag_t tag, void *ptr, size_t size)
+{
+    svx_alloc_stats_t *counter;
+    uint8_t           *p;
+    size_t             old_size;
+
+    if(!svx_alloc_stats_on) return svx_alloc_raw_realloc(tag, ptr, size);
+
+    if(NULL == ptr) return svx_alloc_malloc(tag, size);
+
+    if(size > SIZE_MAX - SVX_ALLOC_HEADER_SIZE) return NULL;
+    p        = (uint8_t *)ptr - SVX_ALLOC_HEADER_SIZE;
+    old_size = *((size_t *)p);
+    if(NULL == (p = svx_alloc_raw_realloc(tag, p, size + SVX_ALLOC_HEADER_SIZE))) return NULL;
+    *((size_t *)p) = size;
+
+    counter = &(svx_alloc_counters[tag].stats);
+    __sync_add_and_fetch(&(counter->allocs), 1);
+    __sync_add_and_fetch(&(counter->alloc_bytes), size);
+    __sync_add_and_fetch(&(counter->live_bytes), (int64_t)size - (int64_t)old_size);
+
+    return p + SVX_ALLOC_HEADER_SIZE;
+}
+
+void svx_alloc_free(svx_alloc_tag_t tag, void *ptr)
+{
+    svx_alloc_stats_t *counter;
+    uint8_t           *p;
+
+    if(NULL == ptr) return;
+
+    if(!svx_alloc_stats_on)
+    {
+        svx_alloc_raw_free(tag, ptr);
+        return;
+    }
+
+    p = (uint8_t *)ptr - SVX_ALLOC_HEADER_SIZE;
+    counter = &(svx_alloc_counters[tag].stats);
+    __sync_add_and_fetch(&(counter->frees), 1);
+    __sync_sub_and_fetch(&(counter->live_bytes), (int64_t)(*((size_t *)p)));
+
+    svx_alloc_raw_free(tag, p);
+}
+
+char *svx_alloc_strdup(svx_alloc_tag_t tag, const char *str)
+{
+    size_t  len = strlen(str) + 1;
+    char   *p;
+
+    if(NULL == (p = svx_alloc_malloc(tag, len))) return NULL;
+    memcpy(p, str, len);
+
+    return p;
+}
+
+void *svx_alloc_aligned(svx_alloc_tag_t tag, size_t alignment, size_t size)
+{
+    uint8_t   *raw;
+    uintptr_t  p;
+    void      *ptr = NULL;
+
+    if(0 == alignment || 0 != (alignment & (alignment - 1))) return NULL;
+
+    /* without hooks and counters, let the libc do it */
+    if(NULL == svx_alloc_hooks.malloc_cb && !svx_alloc_stats_on)
+    {
+        if(0 == svx_alloc_started) svx_alloc_started = 1;
+        if(alignment < sizeof(void *)) alignment = sizeof(void *);
+        return (0 == posix_memalign(&ptr, alignment, size) ? ptr : NULL);
+    }
+
+    /* over-allocate, and save the original pointer right before the aligned memory */
+    if(size > SIZE_MAX - alignment - sizeof(void *)) return NULL;
+    if(NULL == (raw = svx_alloc_malloc(tag, size + alignment + sizeof(void *)))) return NULL;
+    p = ((uintptr_t)raw + sizeof(void *) + alignment - 1) & ~((uintptr_t)alignment - 1);
+    ((void **)p)[-1] = raw;
+
+    return (void *)p;
+}
+
+void svx_alloc_aligned_free(svx_alloc_tag_t tag, void *ptr)
+{
+    if(NULL == ptr) return;
+
+    if(NULL == svx_alloc_hooks.malloc_cb && !svx_alloc_stats_on)
+        free(ptr);
+    else
+        svx_alloc_free(tag, ((void **)ptr)[-1]);
+}
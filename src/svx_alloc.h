@@ -0,0 +1,200 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_alloc.h
+ * \brief
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_ALLOC_H
+#define SVX_ALLOC_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*!
+ * \defgroup Alloc Alloc
+ * \ingroup  Base
+ *
+ * \brief    All the heap memory of libsvx is allocated through this module, and each allocation
+ *           is tagged by the subsystem it belongs to. The allocator can be replaced by hooks
+ *           (e.g. an arena, or jemalloc with per-thread arenas), and the built-in counters can
+ *           report the live bytes and the allocations of each subsystem.
+ *
+ * \warning  \link svx_alloc_set_hooks \endlink and \link svx_alloc_enable_stats \endlink MUST be
+ *           called before any other function of libsvx, because the memory allocated before them
+ *           can not be freed after them.
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The subsystem which the memory belongs to.
+ */
+typedef enum
+{
+    SVX_ALLOC_TAG_MISC = 0,       /*!< Others: process, codec, token bucket, etc. */
+    SVX_ALLOC_TAG_LOOPER,         /*!< Looper, its active channels and deferred tasks. */
+    SVX_ALLOC_TAG_TIMER,          /*!< Looper's timers. */
+    SVX_ALLOC_TAG_PENDING,        /*!< Looper's pending task buffers. */
+    SVX_ALLOC_TAG_CHANNEL,        /*!< Channel, poller and notifier. */
+    SVX_ALLOC_TAG_TCP,            /*!< TCP server, client, acceptor, connector and proxy. */
+    SVX_ALLOC_TAG_TCP_CONNECTION, /*!< TCP connection and its write queue. */
+    SVX_ALLOC_TAG_UDP,            /*!< UDP and ICMP. */
+    SVX_ALLOC_TAG_CIRCLEBUF,      /*!< Circlebuf. */
+    SVX_ALLOC_TAG_BUF,            /*!< Buf and bufpool. */
+    SVX_ALLOC_TAG_THREADPOOL,     /*!< Threadpool and its tasks. */
+    SVX_ALLOC_TAG_LOG,            /*!< Log caches. */
+    SVX_ALLOC_TAG_COUNT
+} svx_alloc_tag_t;
+
+/*!
+ * The hooks to replace the allocator. All of them are required.
+ */
+typedef struct
+{
+    void *(*malloc_cb)(size_t size, svx_alloc_tag_t tag, void *arg);             /*!< Like malloc(). */
+    void *(*realloc_cb)(void *ptr, size_t size, svx_alloc_tag_t tag, void *arg); /*!< Like realloc(). */
+    void  (*free_cb)(void *ptr, svx_alloc_tag_t tag, void *arg);                 /*!< Like free(). */
+    void  *arg;                                                                  /*!< The hooks' argument. */
+} svx_alloc_hooks_t;
+
+/*!
+ * The counters of a subsystem. The \c allocs and \c alloc_bytes are cumulative, so the allocation
+ * rate is the difference between two snapshots divided by the interval.
+ */
+typedef struct
+{
+    uint64_t allocs;      /*!< How many times the memory has been allocated (including reallocated). */
+    uint64_t frees;       /*!< How many times the memory has been freed. */
+    uint64_t alloc_bytes; /*!< The bytes which have been allocated (including reallocated). */
+    int64_t  live_bytes;  /*!< The bytes which are allocated and not freed yet. */
+} svx_alloc_stats_t;
+
+/*!
+ * Replace the allocator.
+ *
+ * \param[in] hooks  The hooks. \c NULL means using malloc(), realloc() and free(), which is the default.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_PERM if any memory has been allocated through this module.
+ */
+extern int svx_alloc_set_hooks(const svx_alloc_hooks_t *hooks);
+
+/*!
+ * Enable or disable the built-in counters. A small header is added before each allocation for
+ * recording its size when the counters are enabled.
+ *
+ * \param[in] on  \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_PERM if any memory has been allocated through this module.
+ */
+extern int svx_alloc_enable_stats(int on);
+
+/*!
+ * Get the counters of a subsystem. They are all zero if the counters are not enabled.
+ *
+ * \param[in]  tag    The subsystem.
+ * \param[out] stats  Return the counters.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_alloc_get_stats(svx_alloc_tag_t tag, svx_alloc_stats_t *stats);
+
+/*!
+ * Get the name of a subsystem.
+ *
+ * \param[in] tag  The subsystem.
+ *
+ * \return  The name. "unknown" for an invalid tag.
+ */
+extern const char *svx_alloc_get_tag_name(svx_alloc_tag_t tag);
+
+/*!
+ * Allocate memory, like malloc().
+ *
+ * \param[in] tag   The subsystem.
+ * \param[in] size  The size.
+ *
+ * \return  On success, return the memory; on error, return \c NULL.
+ */
+extern void *svx_alloc_malloc(svx_alloc_tag_t tag, size_t size);
+
+/*!
+ * Allocate zero-initialized memory, like calloc().
+ *
+ * \param[in] tag    The subsystem.
+ * \param[in] nmemb  The number of elements.
+ * \param[in] size   The size of each element.
+ *
+ * \return  On success, return the memory; on error, return \c NULL.
+ */
+extern void *svx_alloc_calloc(svx_alloc_tag_t tag, size_t nmemb, size_t size);
+
+/*!
+ * Change the size of memory, like realloc().
+ *
+ * \param[in] tag   The subsystem. MUST be the same as the one used for allocating \c ptr.
+ * \param[in] ptr   The memory. \c NULL means allocating new memory.
+ * \param[in] size  The new size. MUST NOT be \c 0.
+ *
+ * \return  On success, return the memory; on error, return \c NULL and \c ptr is untouched.
+ */
+extern void *svx_alloc_realloc(svx_alloc_tag_t tag, void *ptr, size_t size);
+
+/*!
+ * Free memory, like free().
+ *
+ * \param[in] tag  The subsystem. MUST be the same as the one used for allocating \c ptr.
+ * \param[in] ptr  The memory. Can be \c NULL.
+ */
+extern void svx_alloc_free(svx_alloc_tag_t tag, void *ptr);
+
+/*!
+ * Duplicate a string, like strdup().
+ *
+ * \param[in] tag  The subsystem.
+ * \param[in] str  The string.
+ *
+ * \return  On success, return the new string; on error, return \c NULL.
+ */
+extern char *svx_alloc_strdup(svx_alloc_tag_t tag, const char *str);
+
+/*!
+ * Allocate aligned memory. It MUST be freed by \link svx_alloc_aligned_free \endlink.
+ *
+ * \param[in] tag        The subsystem.
+ * \param[in] alignment  The alignment. MUST be a power of two.
+ * \param[in] size       The size.
+ *
+ * \return  On success, return the memory; on error, return \c NULL.
+ */
+extern void *svx_alloc_aligned(svx_alloc_tag_t tag, size_t alignment, size_t size);
+
+/*!
+ * Free the memory allocated by \link svx_alloc_aligned \endlink.
+ *
+ * \param[in] tag  The subsystem. MUST be the same as the one used for allocating \c ptr.
+ * \param[in] ptr  The memory. Can be \c NULL.
+ */
+extern void svx_alloc_aligned_free(svx_alloc_tag_t tag, void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary, 
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "svx_buf.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+
+struct svx_buf
+{
+    unsigned int       ref_count; /* atomic */
+    uint8_t           *data;
+    size_t             len;
+    svx_buf_free_cb_t  free_cb;
+    void              *free_cb_arg;
+};
+
+int svx_buf_create(svx_buf_t **self, const uint8_t *data, size_t len)
+{
+    if(NULL == self || 0 == len) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, len:%zu\n", self, len);
+
+    /* the data space is allocated right after the struct */
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_BUF, sizeof(svx_buf_t) + len))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    (*self)->ref_count   = 1;
+    (*self)->data        = (uint8_t *)((*self) + 1);
+    (*self)->len         = len;
+    (*self)->free_cb     = NULL;
+    (*self)->free_cb_arg = NULL;
+
+    if(data) memcpy((*self)->data, data, len);
+
+    return 0;
+}
+
+int svx_buf_create_by_ref(svx_buf_t **self, uint8_t *data, size_t len,
+                          svx_buf_free_cb_t free_cb, void *free_cb_arg)
+{
+    if(NULL == self || NULL == data || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, data:%p, len:%zu\n", self, data, len);
+
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_BUF, sizeof(svx_buf_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    (*self)->ref_count   = 1;
+    (*self)->data        = data;
+    (*self)->len         = len;
+    (*self)->free_cb     = free_cb;
+    (*self)->free_cb_arg = free_cb_arg;
+
+    return 0;
+}
+
+int svx_buf_add_ref(svx_buf_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    __sync_add_and_fetch(&(self->ref_count), 1);
+    return 0;
+}
+
+int svx_buf_del_ref(svx_buf_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(0 == __sync_sub_and_fetch(&(self->ref_count), 1))
+    {
+        if(self->free_cb) self->free_cb(self->data, self->free_cb_arg);
+        svx_alloc_free(SVX_ALLOC_TAG_BUF, self);
+    }
+    return 0;
+}
+
+int svx_buf_get_ptr(svx_buf_t *self, uint8_t **data, size_t *len)
+{
+    if(NULL == self || NULL == data) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, data:%p\n", self, data);
+
+    *data = self->data;
+    if(len) *len = self->len;
+    return 0;
+}
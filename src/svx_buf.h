@@ -0,0 +1,118 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary, 
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_buf.h
+ * \brief  
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_BUF_H
+#define SVX_BUF_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*!
+ * \defgroup Buf Buf
+ * \ingroup  Base
+ *
+ * \brief    Reference counted, immutable data buffer. A buffer (or any slice of it) can be
+ *           queued by reference on many TCP connections at the same time, it will be released
+ *           when the last reference is dropped.
+ *
+ * \note     The buffer's content MUST NOT be modified after it has been shared.
+ *           The reference count is updated atomically, so \link svx_buf_add_ref \endlink and
+ *           \link svx_buf_del_ref \endlink can be called in any thread.
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The type for buf.
+ */
+typedef struct svx_buf svx_buf_t;
+
+/*!
+ * Signature for releasing the data which passed by \link svx_buf_create_by_ref \endlink.
+ *
+ * \param[in] data  The data passed by \link svx_buf_create_by_ref \endlink.
+ * \param[in] arg   The argument passed by \link svx_buf_create_by_ref \endlink.
+ */
+typedef void (*svx_buf_free_cb_t)(uint8_t *data, void *arg);
+
+/*!
+ * To create a new buf with it's own data space. The initial reference count is \c 1.
+ *
+ * \param[out] self  The pointer for return the buf object.
+ * \param[in]  data  The data to be copied into the buf. If it's \c NULL, the data space is
+ *                   left uninitialized, and you can fill it via \link svx_buf_get_ptr \endlink
+ *                   before sharing the buf.
+ * \param[in]  len   The length of the data space.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_buf_create(svx_buf_t **self, const uint8_t *data, size_t len);
+
+/*!
+ * To create a new buf which refers to an existing data buffer, and take the ownership of it.
+ * The initial reference count is \c 1.
+ *
+ * \param[out] self         The pointer for return the buf object.
+ * \param[in]  data         The data buffer.
+ * \param[in]  len          The length of the data buffer.
+ * \param[in]  free_cb      The callback for releasing \c data when the buf is destroyed. Can be \c NULL.
+ * \param[in]  free_cb_arg  The \c free_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_buf_create_by_ref(svx_buf_t **self, uint8_t *data, size_t len,
+                                 svx_buf_free_cb_t free_cb, void *free_cb_arg);
+
+/*!
+ * Make the buf's reference count plus one.
+ *
+ * \param[in] self  The address of the buf.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_buf_add_ref(svx_buf_t *self);
+
+/*!
+ * Make the buf's reference count minus one. The buf will be destroyed when the reference
+ * count is reduced to \c 0.
+ *
+ * \param[in] self  The address of the buf.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_buf_del_ref(svx_buf_t *self);
+
+/*!
+ * Get the data pointer and the data length of the buf.
+ *
+ * \param[in]  self  The address of the buf.
+ * \param[out] data  Return the data pointer.
+ * \param[out] len   Return the data length. Can be \c NULL.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_buf_get_ptr(svx_buf_t *self, uint8_t **data, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "svx_bufpool.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+
+#define SVX_BUFPOOL_CACHE_LINE      64
+#define SVX_BUFPOOL_MIN_SHIFT       6  /* 64 bytes, the smallest chunk */
+#define SVX_BUFPOOL_MAX_SHIFT       24 /* 16MB, the largest chunk which can be retained */
+#define SVX_BUFPOOL_CLASSES         (SVX_BUFPOOL_MAX_SHIFT - SVX_BUFPOOL_MIN_SHIFT + 1)
+#define SVX_BUFPOOL_HUGEPAGE_SIZE   (2 * 1024 * 1024)
+
+/* a retained chunk, the link is stored in the chunk itself */
+typedef struct svx_bufpool_chunk
+{
+    struct svx_bufpool_chunk *next;
+} svx_bufpool_chunk_t;
+
+struct svx_bufpool
+{
+    unsigned int          ref_count; /* atomic */
+    int                   flags;
+    size_t                max_retained;
+    size_t                retained;  /* atomic */
+    uint64_t              hits;      /* atomic */
+    uint64_t              misses;    /* atomic */
+    uint64_t              released;  /* atomic */
+
+    /* Each class is a lock-free stack: chunks are pushed by CAS in any thread. The popping is
+       serialized by alloc_mutex, so a chunk can not be popped and pushed back between the
+       reading of the top and the CAS (no ABA problem). */
+    svx_bufpool_chunk_t  *free_lists[SVX_BUFPOOL_CLASSES];
+    pthread_mutex_t       alloc_mutex;
+};
+
+/* round up to the power of two */
+static unsigned int svx_bufpool_get_shift(size_t len)
+{
+    unsigned int shift;
+
+    if(len <= ((size_t)1 << SVX_BUFPOOL_MIN_SHIFT)) return SVX_BUFPOOL_MIN_SHIFT;
+
+    shift = (unsigned int)(sizeof(unsigned long) * 8) - (unsigned int)__builtin_clzl((unsigned long)(len - 1));
+    return shift;
+}
+
+static int svx_bufpool_use_hugepages(svx_bufpool_t *self, size_t len)
+{
+    return ((self->flags & SVX_BUFPOOL_FLAG_HUGEPAGES) && len >= SVX_BUFPOOL_HUGEPAGE_SIZE);
+}
+
+static int svx_bufpool_sys_alloc(svx_bufpool_t *self, size_t len, uint8_t **buf)
+{
+    void *p = NULL;
+
+    if(svx_bufpool_use_hugepages(self, len))
+    {
+#ifdef MAP_HUGETLB
+        /* the reserved hugepages */
+        if(MAP_FAILED != (p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)))
+        {
+            *buf = p;
+            return 0;
+        }
+#endif
+        /* fall back to the transparent hugepages */
+        if(MAP_FAILED == (p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)))
+            SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, "len:%zu\n", len);
+#ifdef MADV_HUGEPAGE
+        madvise(p, len, MADV_HUGEPAGE);
+#endif
+        *buf = p;
+        return 0;
+    }
+
+    if(NULL == (p = svx_alloc_aligned(SVX_ALLOC_TAG_BUF, SVX_BUFPOOL_CACHE_LINE, len)))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, "len:%zu\n", len);
+    *buf = p;
+    return 0;
+}
+
+static void svx_bufpool_sys_free(svx_bufpool_t *self, uint8_t *buf, size_t len)
+{
+    if(svx_bufpool_use_hugepages(self, len))
+        munmap(buf, len);
+    else
+        svx_alloc_aligned_free(SVX_ALLOC_TAG_BUF, buf);
+}
+
+int svx_bufpool_create(svx_bufpool_t **self, size_t max_retained, int flags)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_BUF, sizeof(svx_bufpool_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    memset(*self, 0, sizeof(svx_bufpool_t));
+    (*self)->ref_count    = 1;
+    (*self)->flags        = flags;
+    (*self)->max_retained = max_retained;
+    pthread_mutex_init(&((*self)->alloc_mutex), NULL);
+
+    return 0;
+}
+
+int svx_bufpool_add_ref(svx_bufpool_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    __sync_add_and_fetch(&(self->ref_count), 1);
+    return 0;
+}
+
+int svx_bufpool_del_ref(svx_bufpool_t *self)
+{
+    svx_bufpool_chunk_t *chunk = NULL;
+    unsigned int         i;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(0 == __sync_sub_and_fetch(&(self->ref_count), 1))
+    {
+        for(i = 0; i < SVX_BUFPOOL_CLASSES; i++)
+        {
+            while(NULL != (chunk = self->free_lists[i]))
+            {
+                self->free_lists[i] = chunk->next;
+                svx_bufpool_sys_free(self, (uint8_t *)chunk, (size_t)1 << (i + SVX_BUFPOOL_MIN_SHIFT));
+            }
+        }
+        pthread_mutex_destroy(&(self->alloc_mutex));
+        svx_alloc_free(SVX_ALLOC_TAG_BUF, self);
+    }
+    return 0;
+}
+
+int svx_bufpool_alloc(svx_bufpool_t *self, size_t len, uint8_t **buf, size_t *buf_len)
+{
+    svx_bufpool_chunk_t *chunk = NULL, *next = NULL;
+    unsigned int         shift;
+    size_t               chunk_len;
+    int                  r;
+
+    if(NULL == self || 0 == len || len > ((size_t)1 << (sizeof(size_t) * 8 - 1)) || NULL == buf || NULL == buf_len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, len:%zu, buf:%p, buf_len:%p\n", self, len, buf, buf_len);
+
+    shift     = svx_bufpool_get_shift(len);
+    chunk_len = (size_t)1 << shift;
+
+    /* pop a retained chunk */
+    if(shift <= SVX_BUFPOOL_MAX_SHIFT)
+    {
+        pthread_mutex_lock(&(self->alloc_mutex));
+        do
+        {
+            if(NULL == (chunk = self->free_lists[shift - SVX_BUFPOOL_MIN_SHIFT])) break;
+            next = chunk->next;
+        } while(!__sync_bool_compare_and_swap(&(self->free_lists[shift - SVX_BUFPOOL_MIN_SHIFT]), chunk, next));
+        pthread_mutex_unlock(&(self->alloc_mutex));
+
+        if(NULL != chunk)
+        {
+            __sync_sub_and_fetch(&(self->retained), chunk_len);
+            __sync_add_and_fetch(&(self->hits), 1);
+            *buf     = (uint8_t *)chunk;
+            *buf_len = chunk_len;
+            return 0;
+        }
+    }
+
+    /* allocate from the system */
+    if(0 != (r = svx_bufpool_sys_alloc(self, chunk_len, buf))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    __sync_add_and_fetch(&(self->misses), 1);
+    *buf_len = chunk_len;
+
+    return 0;
+}
+
+int svx_bufpool_free(svx_bufpool_t *self, uint8_t *buf, size_t buf_len)
+{
+    svx_bufpool_chunk_t *chunk = (svx_bufpool_chunk_t *)buf;
+    unsigned int         shift;
+
+    if(NULL == self || NULL == buf || 0 == buf_len || 0 != (buf_len & (buf_len - 1)) ||
+       buf_len < ((size_t)1 << SVX_BUFPOOL_MIN_SHIFT))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, buf_len:%zu\n", self, buf, buf_len);
+
+    shift = svx_bufpool_get_shift(buf_len);
+
+    /* too large to be retained, or the pool is full */
+    if(shift > SVX_BUFPOOL_MAX_SHIFT || __sync_add_and_fetch(&(self->retained), buf_len) > self->max_retained)
+    {
+        if(shift <= SVX_BUFPOOL_MAX_SHIFT) __sync_sub_and_fetch(&(self->retained), buf_len);
+        __sync_add_and_fetch(&(self->released), 1);
+        svx_bufpool_sys_free(self, buf, buf_len);
+        return 0;
+    }
+
+    /* push it to the lock-free stack */
+    do chunk->next = self->free_lists[shift - SVX_BUFPOOL_MIN_SHIFT];
+    while(!__sync_bool_compare_and_swap(&(self->free_lists[shift - SVX_BUFPOOL_MIN_SHIFT]), chunk->next, chunk));
+
+    return 0;
+}
+
+int svx_bufpool_get_stats(svx_bufpool_t *self, svx_bufpool_stats_t *stats)
+{
+    if(NULL == self || NULL == stats) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, stats:%p\n", self, stats);
+
+    stats->hits           = __sync_add_and_fetch(&(self->hits), 0);
+    stats->misses         = __sync_add_and_fetch(&(self->misses), 0);
+    stats->released       = __sync_add_and_fetch(&(self->released), 0);
+    stats->retained_bytes = __sync_add_and_fetch(&(self->retained), 0);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_bufpool.h
+ * \brief
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_BUFPOOL_H
+#define SVX_BUFPOOL_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*!
+ * \defgroup Bufpool Bufpool
+ * \ingroup  Base
+ *
+ * \brief    Pool of power-of-two, cache-line aligned memory chunks. It is usually attached to
+ *           a looper (see \link svx_looper_set_bufpool \endlink), and all the circlebufs of the
+ *           TCP connections in the looper draw their storage from it. So the chunks are reused
+ *           instead of being returned to malloc and fragmenting the heap.
+ *
+ * \note     \link svx_bufpool_free \endlink can be called in any thread, the chunk is returned to
+ *           the pool by a lock-free push. The reference count is updated atomically.
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The type for bufpool.
+ */
+typedef struct svx_bufpool svx_bufpool_t;
+
+#define SVX_BUFPOOL_FLAG_HUGEPAGES 0x1 /*!< Back the chunks of 2MB and larger by hugepages if possible. */
+
+/*!
+ * The counters of the bufpool. The hit rate is \c hits / (\c hits + \c misses).
+ */
+typedef struct
+{
+    uint64_t hits;           /*!< How many allocations have been served by the retained chunks. */
+    uint64_t misses;         /*!< How many allocations have been served by the system. */
+    uint64_t released;       /*!< How many freed chunks have been returned to the system because of the cap. */
+    size_t   retained_bytes; /*!< The bytes of the chunks which are retained in the pool. */
+} svx_bufpool_stats_t;
+
+/*!
+ * To create a new bufpool. The initial reference count is \c 1.
+ *
+ * \param[out] self          The pointer for return the bufpool object.
+ * \param[in]  max_retained  The maximum bytes of the chunks which are retained in the pool.
+ *                           The chunks freed beyond it are returned to the system.
+ * \param[in]  flags         \c 0 or \c SVX_BUFPOOL_FLAG_HUGEPAGES.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_create(svx_bufpool_t **self, size_t max_retained, int flags);
+
+/*!
+ * Make the bufpool's reference count plus one.
+ *
+ * \param[in] self  The address of the bufpool.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_add_ref(svx_bufpool_t *self);
+
+/*!
+ * Make the bufpool's reference count minus one. The bufpool and all the retained chunks will be
+ * released when the reference count is reduced to \c 0.
+ *
+ * \param[in] self  The address of the bufpool.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_del_ref(svx_bufpool_t *self);
+
+/*!
+ * Allocate a chunk. The chunk's length is \p len rounded up to a power of two (at least 64 bytes),
+ * and it is aligned to the cache line.
+ *
+ * \param[in]  self     The address of the bufpool.
+ * \param[in]  len      The length needed.
+ * \param[out] buf      Return the chunk.
+ * \param[out] buf_len  Return the chunk's length. The whole chunk can be used.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_alloc(svx_bufpool_t *self, size_t len, uint8_t **buf, size_t *buf_len);
+
+/*!
+ * Return a chunk to the bufpool. This function can be called in any thread.
+ *
+ * \param[in] self     The address of the bufpool.
+ * \param[in] buf      The chunk returned by \link svx_bufpool_alloc \endlink.
+ * \param[in] buf_len  The chunk's length returned by \link svx_bufpool_alloc \endlink.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_free(svx_bufpool_t *self, uint8_t *buf, size_t buf_len);
+
+/*!
+ * Get the counters of the bufpool.
+ *
+ * \param[in]  self   The address of the bufpool.
+ * \param[out] stats  Return the counters.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_bufpool_get_stats(svx_bufpool_t *self, svx_bufpool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
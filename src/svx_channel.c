@@ -15,6 +15,7 @@
 #include "svx_channel.h"
 #include "svx_looper.h"
 #include "svx_log.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 
 struct svx_channel
@@ -28,6 +29,8 @@ struct svx_channel
     void                   *read_cb_arg;
     svx_channel_callback_t  write_cb;
     void                   *write_cb_arg;
+    svx_channel_callback_t  error_cb;
+    void                   *error_cb_arg;
 };
 
 int svx_channel_create(svx_channel_t **self, svx_looper_t *looper, int fd, uint8_t events)
@@ -37,7 +40,7 @@ int svx_channel_create(svx_channel_t **self, svx_looper_t *looper, int fd, uint8
     if(NULL == self || fd < 0 || NULL == looper || SVX_CHANNEL_EVENT_NULL != (events & ~SVX_CHANNEL_EVENT_ALL))
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, fd:%d, events:%"PRIu8"\n", self, looper, fd, events);
 
-    if(NULL == (*self = malloc(sizeof(svx_channel_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_channel_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->looper       = looper;
     (*self)->fd           = fd;
     (*self)->poller_data  = 0;
@@ -47,6 +50,8 @@ int svx_channel_create(svx_channel_t **self, svx_looper_t *looper, int fd, uint8
     (*self)->read_cb_arg  = NULL;
     (*self)->write_cb     = NULL;
     (*self)->write_cb_arg = NULL;
+    (*self)->error_cb     = NULL;
+    (*self)->error_cb_arg = NULL;
 
     if(0 != (r = svx_looper_init_channel(looper, *self))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
 
@@ -58,7 +63,7 @@ int svx_channel_create(svx_channel_t **self, svx_looper_t *looper, int fd, uint8
  err:
     if(*self)
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
         *self = NULL;
     }
     return r;
@@ -72,7 +77,7 @@ int svx_channel_destroy(svx_channel_t **self)
     if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
 
     if(0 != (r = svx_channel_del_events(*self, SVX_CHANNEL_EVENT_ALL))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
     *self = NULL;
     
     return 0;
@@ -124,6 +129,16 @@ int svx_channel_set_write_callback(svx_channel_t *self, svx_channel_callback_t c
     return 0;
 }
 
+int svx_channel_set_error_callback(svx_channel_t *self, svx_channel_callback_t cb, void *cb_arg)
+{
+    if(NULL == self || NULL == cb) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, cb:%p\n", self, cb);
+
+    self->error_cb     = cb;
+    self->error_cb_arg = cb_arg;
+
+    return 0;
+}
+
 int svx_channel_set_revents(svx_channel_t *self, uint8_t revents)
 {
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
@@ -186,6 +201,7 @@ int svx_channel_handle_events(svx_channel_t *self)
 {
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
     
+    if((self->revents & SVX_CHANNEL_EVENT_ERROR) && self->error_cb) self->error_cb(self->error_cb_arg);
     if((self->revents & SVX_CHANNEL_EVENT_READ) && self->read_cb)   self->read_cb(self->read_cb_arg);
     if((self->revents & SVX_CHANNEL_EVENT_WRITE) && self->write_cb) self->write_cb(self->write_cb_arg);
 
@@ -52,11 +52,20 @@ extern "C" {
  */
 #define SVX_CHANNEL_EVENT_ALL   (SVX_CHANNEL_EVENT_READ | SVX_CHANNEL_EVENT_WRITE)
 
+/*!
+ * The error event. (e.g. there are messages in the socket error queue)
+ *
+ * \note  This event is only returned by poller, it can NOT be added to or deleted from the channel.
+ *        The error condition will also trigger the read event and the write event as before.
+ */
+#define SVX_CHANNEL_EVENT_ERROR (1 << 2)
+
 /*!
  * Signature for event callback.
  *
- * \param[in] arg  The argument which passed by \link svx_channel_set_read_callback \endlink or
- *                 \link svx_channel_set_write_callback \endlink.
+ * \param[in] arg  The argument which passed by \link svx_channel_set_read_callback \endlink,
+ *                 \link svx_channel_set_write_callback \endlink or
+ *                 \link svx_channel_set_error_callback \endlink.
  */
 typedef void (*svx_channel_callback_t)(void *arg);
 
@@ -133,6 +142,17 @@ extern int svx_channel_set_read_callback(svx_channel_t *self, svx_channel_callba
  */
 extern int svx_channel_set_write_callback(svx_channel_t *self, svx_channel_callback_t cb, void *cb_arg);
 
+/*!
+ * Set a callback for channel error event.
+ *
+ * \param[in] self    The address of the channel.
+ * \param[in] cb      The callback function for channel error event.
+ * \param[in] cb_arg  The argument pass the callback function.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_channel_set_error_callback(svx_channel_t *self, svx_channel_callback_t cb, void *cb_arg);
+
 /*!
  * Set the return-event from poller.
  *
@@ -199,7 +219,7 @@ extern int svx_channel_get_poller_data(svx_channel_t *self, intmax_t *poller_dat
 
 /*!
  * Handle all events which returned by poller. This operation may trigger the
- * read-event-callback and/or write-event-callback.
+ * error-event-callback, read-event-callback and/or write-event-callback.
  *
  * \param[in] self  The address of the channel.
  *
@@ -8,14 +8,32 @@
 #define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "svx_circlebuf.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
+#include "svx_util.h"
+#include "svx_auto_config.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if SVX_HAVE_MEMFD_CREATE
+#include <linux/memfd.h>
+#endif
+#if SVX_HAVE_AVX2
+#include <immintrin.h>
+#endif
 
 #define SVX_CIRCLEBUF_DEBUG_FLAG 0
 
+#define SVX_CIRCLEBUF_SCAN_ENDING_MAX 32
+
 #if SVX_CIRCLEBUF_DEBUG_FLAG
 #define SVX_CIRCLEBUF_DEBUG(msg) do {                   \
         size_t i_ = 0;                                  \
@@ -58,6 +76,14 @@ struct svx_circlebuf
     size_t   step;     /* min step for expand and shrink */
     size_t   offset_r; /* read index */
     size_t   offset_w; /* write index */
+    int      mirrored; /* the buffer is mapped twice back-to-back, so that the data never wraps */
+    svx_bufpool_t *pool;           /* != NULL: the buffer is a chunk of the pool */
+    size_t         pool_chunk_len; /* the chunk may be larger than the buffer because of the max limit */
+
+    /* the last searching by ending, so that the next searching can continue from where it stopped */
+    size_t   scan_len; /* the data which has been searched without finding the ending */
+    size_t   scan_ending_len;
+    uint8_t  scan_ending[SVX_CIRCLEBUF_SCAN_ENDING_MAX];
 };
 
 int svx_circlebuf_create(svx_circlebuf_t **self, size_t max_len, size_t min_len, size_t min_step)
@@ -71,10 +97,10 @@ int svx_circlebuf_create(svx_circlebuf_t **self, size_t max_len, size_t min_len,
     if(0 != min_len  % 8) min_len  += (8 - min_len  % 8);
     if(0 != min_step % 8) min_step += (8 - min_step % 8);
 
-    if(NULL == (*self = malloc(sizeof(svx_circlebuf_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
-    if(NULL == ((*self)->buf = malloc(min_len))) /* create buffer use min length */
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CIRCLEBUF, sizeof(svx_circlebuf_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == ((*self)->buf = svx_alloc_malloc(SVX_ALLOC_TAG_CIRCLEBUF, min_len))) /* create buffer use min length */
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CIRCLEBUF, *self);
         *self = NULL;
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     }
@@ -86,8 +112,185 @@ int svx_circlebuf_create(svx_circlebuf_t **self, size_t max_len, size_t min_len,
     (*self)->step     = min_step;
     (*self)->offset_r = 0;
     (*self)->offset_w = 0;
+    (*self)->mirrored = 0;
+    (*self)->pool     = NULL;
+    (*self)->pool_chunk_len = 0;
+    (*self)->scan_len = 0;
+    (*self)->scan_ending_len = 0;
+
+    return 0;
+}
+
+int svx_circlebuf_create_pooled(svx_circlebuf_t **self, svx_bufpool_t *pool, size_t max_len, size_t min_len,
+                                size_t min_step)
+{
+    uint8_t *buf = NULL;
+    size_t   chunk_len = 0;
+    int      r = 0;
+
+    if(NULL == self || NULL == pool || 0 == min_len || 0 == min_step ||
+       (0 != max_len && (min_len > max_len || min_step > max_len)))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, pool:%p, max_len:%zu, min_len:%zu, min_step:%zu\n",
+                                 self, pool, max_len, min_len, min_step);
+
+    /* align to 64 bits */
+    if(0 != max_len  % 8) max_len  += (8 - max_len  % 8);
+    if(0 != min_len  % 8) min_len  += (8 - min_len  % 8);
+    if(0 != min_step % 8) min_step += (8 - min_step % 8);
+
+    if(0 != (r = svx_bufpool_alloc(pool, min_len, &buf, &chunk_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CIRCLEBUF, sizeof(svx_circlebuf_t))))
+    {
+        svx_bufpool_free(pool, buf, chunk_len);
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    }
+    svx_bufpool_add_ref(pool);
+
+    /* use the whole chunk */
+    (*self)->buf      = buf;
+    (*self)->size     = (0 != max_len && chunk_len > max_len ? max_len : chunk_len);
+    (*self)->used     = 0;
+    (*self)->max      = max_len;
+    (*self)->min      = min_len;
+    (*self)->step     = min_step;
+    (*self)->offset_r = 0;
+    (*self)->offset_w = 0;
+    (*self)->mirrored = 0;
+    (*self)->pool     = pool;
+    (*self)->pool_chunk_len = chunk_len;
+    (*self)->scan_len = 0;
+    (*self)->scan_ending_len = 0;
+
+    return 0;
+}
+
+/* move the data into a new chunk of the pool */
+static int svx_circlebuf_pool_resize(svx_circlebuf_t *self, size_t new_size)
+{
+    uint8_t *new_buf   = NULL;
+    size_t   chunk_len = 0;
+    size_t   len1      = 0;
+    int      r         = 0;
+
+    if(0 != (r = svx_bufpool_alloc(self->pool, new_size, &new_buf, &chunk_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    /* the data starts at the beginning of the new chunk */
+    len1 = (self->used < self->size - self->offset_r ? self->used : self->size - self->offset_r);
+    memcpy(new_buf, self->buf + self->offset_r, len1);
+    memcpy(new_buf + len1, self->buf, self->used - len1);
+    svx_bufpool_free(self->pool, self->buf, self->pool_chunk_len);
+
+    self->buf            = new_buf;
+    self->pool_chunk_len = chunk_len;
+    self->size           = (0 != self->max && chunk_len > self->max ? self->max : chunk_len);
+    self->offset_r       = 0;
+    self->offset_w       = self->used % self->size;
+
+    return 0;
+}
+
+#if SVX_HAVE_MEMFD_CREATE
+/* map a memory file twice: [buf, buf + size) and [buf + size, buf + size * 2) are the same memory */
+static int svx_circlebuf_mirror_map(size_t size, uint8_t **buf)
+{
+    uint8_t *addr = NULL;
+    int      fd   = -1;
+    int      r    = 0;
+
+    if((fd = (int)syscall(SYS_memfd_create, "svx_circlebuf", MFD_CLOEXEC)) < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(ENOSYS == errno ? SVX_ERRNO_NOTSPT : errno, NULL);
+    if(0 != ftruncate(fd, (off_t)size)) SVX_LOG_ERRNO_GOTO_ERR(end, r = errno, "size:%zu\n", size);
+
+    /* reserve the address space, then map the file twice into it */
+    if(MAP_FAILED == (addr = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)))
+        SVX_LOG_ERRNO_GOTO_ERR(end, r = errno, "size:%zu\n", size);
+    if(MAP_FAILED == mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ||
+       MAP_FAILED == mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0))
+    {
+        r = errno;
+        munmap(addr, size * 2);
+        SVX_LOG_ERRNO_GOTO_ERR(end, r, "size:%zu\n", size);
+    }
+    *buf = addr;
+
+ end:
+    close(fd);
+    return r;
+}
+
+/* move the data into a new mirrored buffer */
+static int svx_circlebuf_mirror_resize(svx_circlebuf_t *self, size_t new_size)
+{
+    uint8_t *new_buf = NULL;
+    int      r       = 0;
+
+    if(0 != (r = svx_circlebuf_mirror_map(new_size, &new_buf))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    memcpy(new_buf, self->buf + self->offset_r, self->used);
+    munmap(self->buf, self->size * 2);
+
+    self->buf      = new_buf;
+    self->size     = new_size;
+    self->offset_r = 0;
+    self->offset_w = self->used % new_size;
+
+    return 0;
+}
+#endif
+
+static size_t svx_circlebuf_page_align(size_t len)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    return (0 == len % page_size ? len : len + (page_size - len % page_size));
+}
+
+int svx_circlebuf_create_mirrored(svx_circlebuf_t **self, size_t max_len, size_t min_len, size_t min_step)
+{
+#if SVX_HAVE_MEMFD_CREATE
+    uint8_t *buf = NULL;
+    int      r   = 0;
+
+    if(NULL == self || 0 == min_len || 0 == min_step || (0 != max_len && (min_len > max_len || min_step > max_len)))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, max_len:%zu, min_len:%zu, min_step:%zu\n",
+                                 self, max_len, min_len, min_step);
+
+    /* align to pages */
+    if(0 != max_len) max_len = svx_circlebuf_page_align(max_len);
+    min_len  = svx_circlebuf_page_align(min_len);
+    min_step = svx_circlebuf_page_align(min_step);
+
+    if(0 != (r = svx_circlebuf_mirror_map(min_len, &buf))) return r;
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CIRCLEBUF, sizeof(svx_circlebuf_t))))
+    {
+        munmap(buf, min_len * 2);
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    }
+
+    (*self)->buf      = buf;
+    (*self)->size     = min_len;
+    (*self)->used     = 0;
+    (*self)->max      = max_len;
+    (*self)->min      = min_len;
+    (*self)->step     = min_step;
+    (*self)->offset_r = 0;
+    (*self)->offset_w = 0;
+    (*self)->mirrored = 1;
+    (*self)->pool     = NULL;
+    (*self)->pool_chunk_len = 0;
+    (*self)->scan_len = 0;
+    (*self)->scan_ending_len = 0;
 
     return 0;
+#else
+    SVX_UTIL_UNUSED(max_len);
+    SVX_UTIL_UNUSED(min_len);
+    SVX_UTIL_UNUSED(min_step);
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    return SVX_ERRNO_NOTSPT;
+#endif
 }
 
 int svx_circlebuf_destroy(svx_circlebuf_t **self)
@@ -95,8 +298,18 @@ int svx_circlebuf_destroy(svx_circlebuf_t **self)
     if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
     if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
 
-    if((*self)->buf) free((*self)->buf);
-    free(*self);
+    if((*self)->mirrored)
+    {
+        munmap((*self)->buf, (*self)->size * 2);
+    }
+    else if((*self)->pool)
+    {
+        svx_bufpool_free((*self)->pool, (*self)->buf, (*self)->pool_chunk_len);
+        svx_bufpool_del_ref((*self)->pool);
+    }
+    else if((*self)->buf)
+        svx_alloc_free(SVX_ALLOC_TAG_CIRCLEBUF, (*self)->buf);
+    svx_alloc_free(SVX_ALLOC_TAG_CIRCLEBUF, *self);
     *self = NULL;
 
     return 0;
@@ -133,6 +346,7 @@ int svx_circlebuf_expand(svx_circlebuf_t *self, size_t freespace_need)
 {
     uint8_t *new_buf  = NULL;
     size_t   new_size = 0;
+    int      r        = 0;
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
     
@@ -148,9 +362,26 @@ int svx_circlebuf_expand(svx_circlebuf_t *self, size_t freespace_need)
     new_size = self->used + freespace_need;
     if(new_size - self->size < self->step) new_size = self->size + self->step;
     if(0 != new_size % 8) new_size += (8 - new_size % 8);
+    if(self->mirrored) new_size = svx_circlebuf_page_align(new_size);
     if(self->max > 0 && new_size > self->max) new_size = self->max;
 
-    if(NULL == (new_buf = realloc(self->buf, new_size))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+#if SVX_HAVE_MEMFD_CREATE
+    if(self->mirrored)
+    {
+        if(0 != (r = svx_circlebuf_mirror_resize(self, new_size))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        SVX_CIRCLEBUF_DEBUG("after");
+        return 0;
+    }
+#endif
+
+    if(self->pool)
+    {
+        if(0 != (r = svx_circlebuf_pool_resize(self, new_size))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        SVX_CIRCLEBUF_DEBUG("after");
+        return 0;
+    }
+
+    if(NULL == (new_buf = svx_alloc_realloc(SVX_ALLOC_TAG_CIRCLEBUF, self->buf, new_size))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
 
     /* move data if necessary */
     if(self->offset_w < self->offset_r || (self->offset_w == self->offset_r && self->used > 0))
@@ -174,6 +405,7 @@ int svx_circlebuf_shrink(svx_circlebuf_t *self, size_t freespace_keep)
 {
     uint8_t *new_buf  = NULL;
     size_t   new_size = 0;
+    int      r        = 0;
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
@@ -187,11 +419,29 @@ int svx_circlebuf_shrink(svx_circlebuf_t *self, size_t freespace_keep)
     new_size = self->used + freespace_keep;
     if(self->size - new_size < self->step) return 0; /* to avoid too small shrinking step */
     if(0 != new_size % 8) new_size += (8 - new_size % 8);
+    if(self->mirrored) new_size = svx_circlebuf_page_align(new_size);
     if(self->max > 0 && new_size > self->max) new_size = self->max;
     if(new_size >= self->size) return 0; /* new_size must smaller than the current size */
+    if(self->pool && new_size > self->pool_chunk_len / 2) return 0; /* a smaller chunk is not enough */
 
     SVX_CIRCLEBUF_DEBUG("before");
 
+    if(self->pool)
+    {
+        if(0 != (r = svx_circlebuf_pool_resize(self, new_size))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        SVX_CIRCLEBUF_DEBUG("after");
+        return 0;
+    }
+
+#if SVX_HAVE_MEMFD_CREATE
+    if(self->mirrored)
+    {
+        if(0 != (r = svx_circlebuf_mirror_resize(self, new_size))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        SVX_CIRCLEBUF_DEBUG("after");
+        return 0;
+    }
+#endif
+
     /* move data if necessary */
     if(self->offset_r < self->offset_w)
     {
@@ -245,7 +495,7 @@ int svx_circlebuf_shrink(svx_circlebuf_t *self, size_t freespace_keep)
         }
     }
 
-    if(NULL == (new_buf = realloc(self->buf, new_size))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_UNKNOWN, NULL);
+    if(NULL == (new_buf = svx_alloc_realloc(SVX_ALLOC_TAG_CIRCLEBUF, self->buf, new_size))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_UNKNOWN, NULL);
     self->buf  = new_buf;
     self->size = new_size;
 
@@ -260,6 +510,7 @@ int svx_circlebuf_erase_all_data(svx_circlebuf_t *self)
     self->used     = 0;
     self->offset_r = 0;
     self->offset_w = 0;
+    self->scan_len = 0;
 
     return 0;
 }
@@ -274,6 +525,7 @@ int svx_circlebuf_erase_data(svx_circlebuf_t *self, size_t len)
     self->used     -= len;
     self->offset_r += len;
     self->offset_r %= self->size;
+    self->scan_len  = (self->scan_len > len ? self->scan_len - len : 0);
     
     SVX_CIRCLEBUF_DEBUG("after");
     return 0;
@@ -309,7 +561,17 @@ int svx_circlebuf_append_data(svx_circlebuf_t *self, const uint8_t *buf, size_t
         if(0 != (r = svx_circlebuf_expand(self, buf_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
     }
 
-    if(self->offset_r < self->offset_w)
+    if(self->mirrored)
+    {
+        /* the freespace is always continuous */
+        if(0 == self->used)
+        {
+            self->offset_r = 0;
+            self->offset_w = 0;
+        }
+        memcpy(self->buf + self->offset_w, buf, buf_len);
+    }
+    else if(self->offset_r < self->offset_w)
     {
         /*    r  w
            ---xxx---
@@ -370,7 +632,20 @@ int svx_circlebuf_get_data_ptr(svx_circlebuf_t *self, uint8_t **buf1, size_t *bu
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf1:%p, buf1_len:%p, buf2:%p, buf2_len:%p\n",
                                  self, buf1, buf1_len, buf2, buf2_len);
 
-    if(self->offset_r < self->offset_w)
+    if(self->mirrored)
+    {
+        /* the data is always continuous */
+        if(0 == self->used)
+        {
+            self->offset_r = 0;
+            self->offset_w = 0;
+        }
+        *buf1     = (self->used > 0 ? self->buf + self->offset_r : NULL);
+        *buf1_len = self->used;
+        *buf2     = NULL;
+        *buf2_len = 0;
+    }
+    else if(self->offset_r < self->offset_w)
     {
         /*    r  w
            ---xxx---
@@ -444,7 +719,20 @@ int svx_circlebuf_get_freespace_ptr(svx_circlebuf_t *self, uint8_t **buf1, size_
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf1:%p, buf1_len:%p, buf2:%p, buf2_len:%p\n",
                                  self, buf1, buf1_len, buf2, buf2_len);
 
-    if(self->offset_r < self->offset_w)
+    if(self->mirrored)
+    {
+        /* the freespace is always continuous */
+        if(0 == self->used)
+        {
+            self->offset_r = 0;
+            self->offset_w = 0;
+        }
+        *buf1     = (self->used < self->size ? self->buf + self->offset_w : NULL);
+        *buf1_len = self->size - self->used;
+        *buf2     = NULL;
+        *buf2_len = 0;
+    }
+    else if(self->offset_r < self->offset_w)
     {
         /*    r  w
            ---xxx---
@@ -512,7 +800,15 @@ int svx_circlebuf_get_data(svx_circlebuf_t *self, uint8_t *buf, size_t buf_len)
 
     SVX_CIRCLEBUF_DEBUG("before");
 
-    if(self->offset_r < self->offset_w)
+    if(self->mirrored)
+    {
+        /* the data is always continuous */
+        memcpy(buf, self->buf + self->offset_r, buf_len);
+        self->used     -= buf_len;
+        self->offset_r += buf_len;
+        self->offset_r %= self->size;
+    }
+    else if(self->offset_r < self->offset_w)
     {
         /*    r  w
            ---xxx---
@@ -550,130 +846,280 @@ int svx_circlebuf_get_data(svx_circlebuf_t *self, uint8_t *buf, size_t buf_len)
         /* impossible */
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NODATA, NULL);
     }
+    self->scan_len = (self->scan_len > buf_len ? self->scan_len - buf_len : 0);
 
     SVX_CIRCLEBUF_DEBUG("after");
     return 0;
 }
 
+/* search the ending which is fully contained in [buf, buf + len) */
+static const uint8_t *svx_circlebuf_find_scalar(const uint8_t *buf, size_t len,
+                                                const uint8_t *ending, size_t ending_len)
+{
+    return memmem(buf, len, ending, ending_len);
+}
+
+#if defined(__SSE2__)
+/* compare the first and the last byte of the ending at 16 positions at a time,
+   only the candidates which matched both bytes need a memcmp() */
+static const uint8_t *svx_circlebuf_find_sse2(const uint8_t *buf, size_t len,
+                                              const uint8_t *ending, size_t ending_len)
+{
+    __m128i      first = _mm_set1_epi8((char)ending[0]);
+    __m128i      last  = _mm_set1_epi8((char)ending[ending_len - 1]);
+    __m128i      block_first, block_last;
+    unsigned int mask;
+    size_t       i = 0, bit;
+
+    for(; i + ending_len - 1 + 16 <= len; i += 16)
+    {
+        block_first = _mm_loadu_si128((const __m128i *)(buf + i));
+        block_last  = _mm_loadu_si128((const __m128i *)(buf + i + ending_len - 1));
+        mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                             _mm_cmpeq_epi8(block_last, last)));
+        while(0 != mask)
+        {
+            bit = (size_t)__builtin_ctz(mask);
+            if(ending_len <= 2 || 0 == memcmp(buf + i + bit + 1, ending + 1, ending_len - 2))
+                return buf + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return svx_circlebuf_find_scalar(buf + i, len - i, ending, ending_len);
+}
+#endif
+
+#if SVX_HAVE_AVX2
+__attribute__((target("avx2")))
+static const uint8_t *svx_circlebuf_find_avx2(const uint8_t *buf, size_t len,
+                                              const uint8_t *ending, size_t ending_len)
+{
+    __m256i      first = _mm256_set1_epi8((char)ending[0]);
+    __m256i      last  = _mm256_set1_epi8((char)ending[ending_len - 1]);
+    __m256i      block_first, block_last;
+    unsigned int mask;
+    size_t       i = 0, bit;
+
+    for(; i + ending_len - 1 + 32 <= len; i += 32)
+    {
+        block_first = _mm256_loadu_si256((const __m256i *)(buf + i));
+        block_last  = _mm256_loadu_si256((const __m256i *)(buf + i + ending_len - 1));
+        mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                                   _mm256_cmpeq_epi8(block_last, last)));
+        while(0 != mask)
+        {
+            bit = (size_t)__builtin_ctz(mask);
+            if(ending_len <= 2 || 0 == memcmp(buf + i + bit + 1, ending + 1, ending_len - 2))
+                return buf + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return svx_circlebuf_find_scalar(buf + i, len - i, ending, ending_len);
+}
+#endif
+
+typedef const uint8_t *(*svx_circlebuf_find_fn_t)(const uint8_t *, size_t, const uint8_t *, size_t);
+
+static pthread_once_t          svx_circlebuf_find_once = PTHREAD_ONCE_INIT;
+static svx_circlebuf_find_fn_t svx_circlebuf_find_fn   = svx_circlebuf_find_scalar;
+
+static void svx_circlebuf_find_init()
+{
+#if defined(__SSE2__)
+    svx_circlebuf_find_fn = svx_circlebuf_find_sse2;
+#endif
+#if SVX_HAVE_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) svx_circlebuf_find_fn = svx_circlebuf_find_avx2;
+#endif
+}
+
+/* search the ending in the data, starting from the "from"th byte of the data */
+static int svx_circlebuf_find(svx_circlebuf_t *self, const uint8_t *ending, size_t ending_len,
+                              size_t from, size_t *pos)
+{
+    const uint8_t *buf1 = self->buf + self->offset_r;
+    size_t         buf1_len = (self->mirrored || self->used < self->size - self->offset_r ?
+                               self->used : self->size - self->offset_r);
+    size_t         buf2_len = self->used - buf1_len;
+    const uint8_t *p = NULL;
+    size_t         i = 0, n = 0;
+
+    pthread_once(&svx_circlebuf_find_once, &svx_circlebuf_find_init);
+
+    /* the ending is fully contained in the first part of the data */
+    if(from + ending_len <= buf1_len)
+    {
+        if(NULL != (p = svx_circlebuf_find_fn(buf1 + from, buf1_len - from, ending, ending_len)))
+        {
+            *pos = (size_t)(p - buf1);
+            return 0;
+        }
+        from = buf1_len - ending_len + 1;
+    }
+
+    if(0 == buf2_len) return SVX_ERRNO_NOTFND;
+
+    /* the ending is around the "turning point" */
+    for(i = from; i < buf1_len; i++)
+    {
+        n = buf1_len - i;
+        if(ending_len - n > buf2_len) return SVX_ERRNO_NOTFND;
+        if(0 == memcmp(buf1 + i, ending, n) && 0 == memcmp(self->buf, ending + n, ending_len - n))
+        {
+            *pos = i;
+            return 0;
+        }
+    }
+
+    /* the ending is fully contained in the second part of the data */
+    from = (from > buf1_len ? from - buf1_len : 0);
+    if(from + ending_len <= buf2_len)
+    {
+        if(NULL != (p = svx_circlebuf_find_fn(self->buf + from, buf2_len - from, ending, ending_len)))
+        {
+            *pos = buf1_len + (size_t)(p - self->buf);
+            return 0;
+        }
+    }
+
+    return SVX_ERRNO_NOTFND;
+}
+
 int svx_circlebuf_get_data_by_ending(svx_circlebuf_t *self, const uint8_t *ending, size_t ending_len,
                                      uint8_t *buf, size_t buf_len, size_t *ret_len)
 {
-    uint8_t *p = NULL;
-    size_t   offset_start = 0, offset_end = 0;
-    size_t   search_len = 0, search_count = 0;
-    size_t   i = 0, j = 0;
+    size_t pos = 0;
+    int    r = 0;
 
     if(NULL == self || NULL == ending || 0 == ending_len || NULL == buf || 0 == buf_len ||
        NULL == ret_len || ending_len > buf_len)
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, ending:%p, ending_len:%zu, buf:%p, buf_len:%zu, "
                                  "ret_len:%p\n", self, ending, ending_len, buf, buf_len, ret_len);
 
-    if(ending_len > self->used) return SVX_ERRNO_NODATA;
-
     SVX_CIRCLEBUF_DEBUG("before");
-    
-    if(self->offset_r < self->offset_w)
+
+    if(0 != (r = svx_circlebuf_search(self, 0, ending, ending_len, &pos))) return r;
+
+    *ret_len = pos + ending_len;
+    if(*ret_len > buf_len) return SVX_ERRNO_NOBUF;
+
+    if(0 != (r = svx_circlebuf_get_data(self, buf, *ret_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    SVX_CIRCLEBUF_DEBUG("after");
+    return 0;
+}
+
+int svx_circlebuf_get_spans(svx_circlebuf_t *self, size_t offset, size_t len,
+                            const uint8_t **buf1, size_t *buf1_len, const uint8_t **buf2, size_t *buf2_len)
+{
+    size_t start = 0;
+
+    if(NULL == self || NULL == buf1 || NULL == buf1_len || NULL == buf2 || NULL == buf2_len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf1:%p, buf1_len:%p, buf2:%p, buf2_len:%p\n",
+                                 self, buf1, buf1_len, buf2, buf2_len);
+
+    if(offset > self->used || len > self->used - offset) return SVX_ERRNO_NODATA;
+
+    *buf2     = NULL;
+    *buf2_len = 0;
+    if(0 == len)
     {
-        /*    r  w
-           ---xxx---
-           012345678 */
-        if(NULL == (p = memmem(self->buf + self->offset_r, self->used, ending, ending_len))) return SVX_ERRNO_NOTFND;
-        *ret_len = p + ending_len - (self->buf + self->offset_r);
-        if(*ret_len > buf_len) return SVX_ERRNO_NOBUF;
-        memcpy(buf, self->buf + self->offset_r, *ret_len);
-        self->used     -= *ret_len;
-        self->offset_r += *ret_len;
-
-        SVX_CIRCLEBUF_DEBUG("after 1");
+        *buf1     = NULL;
+        *buf1_len = 0;
         return 0;
     }
-    else if(self->offset_w < self->offset_r || (self->offset_w == self->offset_r && self->used > 0))
+
+    start = (self->offset_r + offset) % self->size;
+    *buf1 = self->buf + start;
+    if(self->mirrored || len <= self->size - start)
     {
-        /*                    r
-              w  r            w
-           xxx---xxx  OR  xxxxxxxxx
-           012345678      012345678 */
+        *buf1_len = len;
+    }
+    else
+    {
+        /* wrap around */
+        *buf1_len = self->size - start;
+        *buf2     = self->buf;
+        *buf2_len = len - *buf1_len;
+    }
 
-        /* try to find the ending from self->offset_r to self->size */
-        if(self->size - self->offset_r >= ending_len)
-        {
-            if(NULL != (p = memmem(self->buf + self->offset_r, self->size - self->offset_r, ending, ending_len)))
-            {
-                *ret_len = p + ending_len - (self->buf + self->offset_r);
-                if(*ret_len > buf_len) return SVX_ERRNO_NOBUF;
-                memcpy(buf, self->buf + self->offset_r, *ret_len);
-                self->used     -= *ret_len;
-                self->offset_r += *ret_len;
-                self->offset_r %= self->size;
-
-                SVX_CIRCLEBUF_DEBUG("after 2");
-                return 0;
-            }
-        }
+    return 0;
+}
 
-        /* try to find the ending around the "turning point" */
-        if(self->offset_w > 0 && ending_len > 1)
-        {
-            offset_start = self->size - ending_len + 1;
-            if(offset_start < self->offset_r) offset_start = self->offset_r;
-            offset_end = ending_len - 1;
-            if(offset_end > self->offset_w) offset_end = self->offset_w;
-            search_len = self->size - offset_start + offset_end;
-            search_count = search_len - ending_len + 1;
-
-            for(i = 0; i < search_count; i++)
-            {
-                for(j = offset_start + i; j < self->size; j++)
-                    if(*(self->buf + j) != *(ending + (j - (offset_start + i))))
-                        goto next_round;
-                for(j = 0; j < ending_len - (self->size - (offset_start + i)); j++)
-                    if(*(self->buf + j) != *(ending + (self->size - (offset_start + i)) + j))
-                        goto next_round;
-
-                *ret_len = (self->size - self->offset_r) + j;
-                if(*ret_len > buf_len) return SVX_ERRNO_NOBUF;
-                memcpy(buf, self->buf + self->offset_r, self->size - self->offset_r);
-                memcpy(buf + (self->size - self->offset_r), self->buf, j);
-                self->used     -= *ret_len;
-                self->offset_r += *ret_len;
-                self->offset_r %= self->size;
-
-                SVX_CIRCLEBUF_DEBUG("after 3");
-                return 0;
-            next_round:
-                continue;
-            }
-        }
+int svx_circlebuf_peek(svx_circlebuf_t *self, size_t offset, uint8_t *buf, size_t len)
+{
+    const uint8_t *buf1 = NULL, *buf2 = NULL;
+    size_t         buf1_len = 0, buf2_len = 0;
+    int            r = 0;
 
-        /* try to find the ending from self->buf to self->offset_w */
-        if(self->offset_w >= ending_len)
-        {
-            if(NULL != (p = memmem(self->buf, self->offset_w, ending, ending_len)))
-            {
-                *ret_len = (self->size - self->offset_r) + (p + ending_len - self->buf);
-                if(*ret_len > buf_len) return SVX_ERRNO_NOBUF;
-                memcpy(buf, self->buf + self->offset_r, self->size - self->offset_r);
-                memcpy(buf + (self->size - self->offset_r), self->buf, p + ending_len - self->buf);
-                self->used     -= *ret_len;
-                self->offset_r += *ret_len;
-                self->offset_r %= self->size;
-
-                SVX_CIRCLEBUF_DEBUG("after 4");
-                return 0;
-            }
-        }
-        
-        /* not found */
-        return SVX_ERRNO_NOTFND;
+    if(NULL == self || NULL == buf || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+
+    if(0 != (r = svx_circlebuf_get_spans(self, offset, len, &buf1, &buf1_len, &buf2, &buf2_len))) return r;
+
+    memcpy(buf, buf1, buf1_len);
+    if(buf2_len > 0) memcpy(buf + buf1_len, buf2, buf2_len);
+
+    return 0;
+}
+
+int svx_circlebuf_compare(svx_circlebuf_t *self, size_t offset, const uint8_t *buf, size_t len, int *result)
+{
+    const uint8_t *buf1 = NULL, *buf2 = NULL;
+    size_t         buf1_len = 0, buf2_len = 0;
+    int            r = 0;
+
+    if(NULL == self || NULL == buf || 0 == len || NULL == result)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu, result:%p\n", self, buf, len, result);
+
+    if(0 != (r = svx_circlebuf_get_spans(self, offset, len, &buf1, &buf1_len, &buf2, &buf2_len))) return r;
+
+    if(0 == (*result = memcmp(buf1, buf, buf1_len)) && buf2_len > 0)
+        *result = memcmp(buf2, buf + buf1_len, buf2_len);
+
+    return 0;
+}
+
+int svx_circlebuf_search(svx_circlebuf_t *self, size_t offset, const uint8_t *pattern, size_t pattern_len,
+                         size_t *pos)
+{
+    size_t known = 0, from = 0;
+    int    remember = 0;
+    int    r = 0;
+
+    if(NULL == self || NULL == pattern || 0 == pattern_len || NULL == pos)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, pattern:%p, pattern_len:%zu, pos:%p\n",
+                                 self, pattern, pattern_len, pos);
+
+    if(offset > self->used || pattern_len > self->used - offset) return SVX_ERRNO_NODATA;
+
+    /* continue from where the last searching for the same pattern stopped */
+    if(pattern_len == self->scan_ending_len && 0 == memcmp(pattern, self->scan_ending, pattern_len))
+        known = self->scan_len;
+    if(offset <= known)
+    {
+        /* the data before "from" has been searched, so the result can be remembered */
+        from     = known;
+        remember = (pattern_len <= SVX_CIRCLEBUF_SCAN_ENDING_MAX);
     }
-    else /* self->offset_w == self->offset_r && 0 == self->used */
+    else
     {
-        /*     r
-               w
-           ---------
-           012345678 */
+        from     = offset;
+        remember = 0;
+    }
 
-        /* impossible */
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NODATA, NULL);
+    r = svx_circlebuf_find(self, pattern, pattern_len, from, pos);
+
+    /* remember where we stopped: none of the positions before it is the beginning of the pattern */
+    if(remember)
+    {
+        memcpy(self->scan_ending, pattern, pattern_len);
+        self->scan_ending_len = pattern_len;
+        self->scan_len        = (0 == r ? *pos : self->used - pattern_len + 1);
     }
+
+    return r;
 }
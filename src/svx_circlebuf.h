@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include "svx_bufpool.h"
 
 /*!
  * \defgroup Circlebuf Circlebuf
@@ -25,6 +26,12 @@
  *
  * \brief    This is a circular buffer used as TCP connection's read/write buffer.
  *
+ *           The data can be parsed in place: \link svx_circlebuf_get_spans \endlink,
+ *           \link svx_circlebuf_peek \endlink, \link svx_circlebuf_compare \endlink and
+ *           \link svx_circlebuf_search \endlink access the data at an offset from the head
+ *           without consuming it. After the parsing succeeds, consume the parsed data by
+ *           \link svx_circlebuf_erase_data \endlink.
+ *
  * \{
  */
 
@@ -49,6 +56,46 @@ typedef struct svx_circlebuf svx_circlebuf_t;
  */
 extern int svx_circlebuf_create(svx_circlebuf_t **self, size_t max_len, size_t min_len, size_t min_step);
 
+/*!
+ * To create a new mirrored circlebuf.
+ *
+ * The memory of a mirrored circlebuf is mapped twice back-to-back in the virtual address space.
+ * So that the data and the freespace are always continuous: \c svx_circlebuf_get_data_ptr(),
+ * \c svx_circlebuf_get_freespace_ptr() and \c svx_circlebuf_get_spans() always return a single
+ * buffer, and the data never needs to be copied piece by piece when it wraps around.
+ *
+ * All the lengths are rounded up to the page size, and each expand or shrink remaps the memory.
+ * So it is only suitable for large buffers.
+ *
+ * \param[out] self      The pointer for return the circlebuf object.
+ * \param[in]  max_len   The maximum length for the circlebuf.
+ * \param[in]  min_len   The minimum(default) length for the circlebuf.
+ * \param[in]  min_step  The minimum length for each step when expand the circlebuf.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_NOTSPT if the system does not support memfd_create().
+ */
+extern int svx_circlebuf_create_mirrored(svx_circlebuf_t **self, size_t max_len, size_t min_len, size_t min_step);
+
+/*!
+ * To create a new circlebuf whose buffer is a chunk of the bufpool.
+ *
+ * The buffer is replaced by another chunk of the bufpool on each expand or shrink, and it is
+ * returned to the bufpool when the circlebuf is destroyed. The chunks are power-of-two sized,
+ * so the buffer may be larger than requested (but never larger than \c max_len).
+ * The circlebuf holds a reference of the bufpool.
+ *
+ * \param[out] self      The pointer for return the circlebuf object.
+ * \param[in]  pool      The bufpool.
+ * \param[in]  max_len   The maximum length for the circlebuf.
+ * \param[in]  min_len   The minimum(default) length for the circlebuf.
+ * \param[in]  min_step  The minimum length for each step when expand the circlebuf.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_circlebuf_create_pooled(svx_circlebuf_t **self, svx_bufpool_t *pool, size_t max_len, size_t min_len,
+                                       size_t min_step);
+
 /*!
  * To destroy a circlebuf.
  *
@@ -188,7 +235,9 @@ extern int svx_circlebuf_get_data_ptr(svx_circlebuf_t *self, uint8_t **buf1, siz
 extern int svx_circlebuf_get_data(svx_circlebuf_t *self, uint8_t *buf, size_t buf_len);
 
 /*!
- * Get data according to an ending mark.
+ * Get data according to an ending mark. If the ending mark is not found, the circlebuf remembers
+ * how much data has been searched, so the next call with the same ending mark only searches
+ * the newly arrived data.
  *
  * \param[in]  self        The address of the circlebuf.
  * \param[in]  ending      The ending mark.
@@ -202,6 +251,69 @@ extern int svx_circlebuf_get_data(svx_circlebuf_t *self, uint8_t *buf, size_t bu
 extern int svx_circlebuf_get_data_by_ending(svx_circlebuf_t *self, const uint8_t *ending, size_t ending_len,
                                             uint8_t *buf, size_t buf_len, size_t *ret_len);
 
+/*!
+ * Get the in place pointers of some data without consuming it. The data is split into two
+ * buffers when it wraps around the end of the circlebuf. The pointers are valid until
+ * the circlebuf is modified.
+ *
+ * \param[in]  self      The address of the circlebuf.
+ * \param[in]  offset    The offset of the data from the head of the circlebuf.
+ * \param[in]  len       The length of the data.
+ * \param[out] buf1      Return the pointer of the first part. \c NULL if \c len is zero.
+ * \param[out] buf1_len  Return the length of the first part.
+ * \param[out] buf2      Return the pointer of the second part. \c NULL if the data is not split.
+ * \param[out] buf2_len  Return the length of the second part.
+ *
+ * \return  On success, return zero; if there is not enough data, return \c SVX_ERRNO_NODATA;
+ *          on other error, return an error number greater than zero.
+ */
+extern int svx_circlebuf_get_spans(svx_circlebuf_t *self, size_t offset, size_t len,
+                                   const uint8_t **buf1, size_t *buf1_len, const uint8_t **buf2, size_t *buf2_len);
+
+/*!
+ * Copy some data without consuming it.
+ *
+ * \param[in]  self    The address of the circlebuf.
+ * \param[in]  offset  The offset of the data from the head of the circlebuf.
+ * \param[out] buf     Return the data.
+ * \param[in]  len     The length of the data.
+ *
+ * \return  On success, return zero; if there is not enough data, return \c SVX_ERRNO_NODATA;
+ *          on other error, return an error number greater than zero.
+ */
+extern int svx_circlebuf_peek(svx_circlebuf_t *self, size_t offset, uint8_t *buf, size_t len);
+
+/*!
+ * Compare some data with a buffer in place, like memcmp(3).
+ *
+ * \param[in]  self    The address of the circlebuf.
+ * \param[in]  offset  The offset of the data from the head of the circlebuf.
+ * \param[in]  buf     The buffer to compare with.
+ * \param[in]  len     The length to compare.
+ * \param[out] result  Return zero if they are equal; otherwise, less or greater than zero.
+ *
+ * \return  On success, return zero; if there is not enough data, return \c SVX_ERRNO_NODATA;
+ *          on other error, return an error number greater than zero.
+ */
+extern int svx_circlebuf_compare(svx_circlebuf_t *self, size_t offset, const uint8_t *buf, size_t len, int *result);
+
+/*!
+ * Search a pattern in place. Like \link svx_circlebuf_get_data_by_ending \endlink, the searching
+ * continues from where the last searching for the same pattern stopped.
+ *
+ * \param[in]  self         The address of the circlebuf.
+ * \param[in]  offset       Where to start the searching, from the head of the circlebuf.
+ * \param[in]  pattern      The pattern.
+ * \param[in]  pattern_len  The pattern's length.
+ * \param[out] pos          Return the offset of the pattern from the head of the circlebuf.
+ *
+ * \return  On success, return zero; if the pattern is not found, return \c SVX_ERRNO_NOTFND;
+ *          if the data after \c offset is shorter than the pattern, return \c SVX_ERRNO_NODATA;
+ *          on other error, return an error number greater than zero.
+ */
+extern int svx_circlebuf_search(svx_circlebuf_t *self, size_t offset, const uint8_t *pattern, size_t pattern_len,
+                                size_t *pos);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,395 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "svx_codec.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+#include "svx_auto_config.h"
+#if SVX_HAVE_SSE42_CRC32
+#include <nmmintrin.h>
+#endif
+
+#define SVX_CODEC_DELIM_LEN_MAX  16
+#define SVX_CODEC_VARINT_LEN_MAX 5
+#define SVX_CODEC_CRC32C_LEN     4
+#define SVX_CODEC_CRC32C_POLY    0x82F63B78 /* reversed Castagnoli polynomial */
+
+typedef enum
+{
+    SVX_CODEC_TYPE_LENGTH_PREFIXED = 0,
+    SVX_CODEC_TYPE_DELIMITER
+} svx_codec_type_t;
+
+struct svx_codec
+{
+    svx_codec_type_t      type;
+    svx_codec_len_type_t  len_type;
+    int                   crc32c;
+    uint8_t               delim[SVX_CODEC_DELIM_LEN_MAX];
+    size_t                delim_len;
+    size_t                max_frame_len;
+    svx_codec_frame_cb_t  frame_cb;
+    void                 *frame_cb_arg;
+};
+
+/* the in place payload of a frame */
+typedef struct
+{
+    const uint8_t *buf1;
+    size_t         buf1_len;
+    const uint8_t *buf2;
+    size_t         buf2_len;
+} svx_codec_payload_t;
+
+static pthread_once_t svx_codec_crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t       svx_codec_crc32c_table[256];
+#if SVX_HAVE_SSE42_CRC32
+static int            svx_codec_crc32c_hw_supported = 0;
+#endif
+
+static void svx_codec_crc32c_init()
+{
+    uint32_t i, j, c;
+
+    for(i = 0; i < 256; i++)
+    {
+        c = i;
+        for(j = 0; j < 8; j++)
+            c = (c & 1 ? (c >> 1) ^ SVX_CODEC_CRC32C_POLY : c >> 1);
+        svx_codec_crc32c_table[i] = c;
+    }
+
+#if SVX_HAVE_SSE42_CRC32
+    __builtin_cpu_init();
+    svx_codec_crc32c_hw_supported = (__builtin_cpu_supports("sse4.2") ? 1 : 0);
+#endif
+}
+
+static uint32_t svx_codec_crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    while(len--)
+        crc = svx_codec_crc32c_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+#if SVX_HAVE_SSE42_CRC32
+__attribute__((target("sse4.2")))
+static uint32_t svx_codec_crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    uint64_t crc64 = crc;
+    uint64_t v;
+
+    for(; len >= sizeof(v); buf += sizeof(v), len -= sizeof(v))
+    {
+        memcpy(&v, buf, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+
+    crc = (uint32_t)crc64;
+    while(len--)
+        crc = _mm_crc32_u8(crc, *buf++);
+
+    return crc;
+}
+#endif
+
+uint32_t svx_codec_crc32c(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    pthread_once(&svx_codec_crc32c_once, &svx_codec_crc32c_init);
+
+    if(NULL == buf || 0 == len) return crc;
+
+#if SVX_HAVE_SSE42_CRC32
+    if(svx_codec_crc32c_hw_supported)
+        return ~svx_codec_crc32c_hw(~crc, buf, len);
+#endif
+
+    return ~svx_codec_crc32c_sw(~crc, buf, len);
+}
+
+/* decode the length prefix, return SVX_ERRNO_NODATA if the prefix is incomplete */
+static int svx_codec_decode_len(svx_codec_t *self, svx_circlebuf_t *buf, size_t data_len,
+                                size_t *prefix_len, size_t *payload_len)
+{
+    uint8_t prefix[SVX_CODEC_VARINT_LEN_MAX];
+    size_t  len = 0, i;
+    int     r;
+
+    switch(self->len_type)
+    {
+    case SVX_CODEC_LEN_U8:
+        if(0 != (r = svx_circlebuf_peek(buf, 0, prefix, 1))) return r;
+        *prefix_len = 1;
+        len = prefix[0];
+        break;
+    case SVX_CODEC_LEN_U16:
+        if(0 != (r = svx_circlebuf_peek(buf, 0, prefix, 2))) return r;
+        *prefix_len = 2;
+        len = ((size_t)prefix[0] << 8) | (size_t)prefix[1];
+        break;
+    case SVX_CODEC_LEN_U32:
+        if(0 != (r = svx_circlebuf_peek(buf, 0, prefix, 4))) return r;
+        *prefix_len = 4;
+        len = ((size_t)prefix[0] << 24) | ((size_t)prefix[1] << 16) | ((size_t)prefix[2] << 8) | (size_t)prefix[3];
+        break;
+    case SVX_CODEC_LEN_VARINT:
+        *prefix_len = (data_len < SVX_CODEC_VARINT_LEN_MAX ? data_len : SVX_CODEC_VARINT_LEN_MAX);
+        if(0 != (r = svx_circlebuf_peek(buf, 0, prefix, *prefix_len))) return r;
+        for(i = 0; i < *prefix_len; i++)
+        {
+            len |= (size_t)(prefix[i] & 0x7F) << (7 * i);
+            if(0 == (prefix[i] & 0x80)) break;
+        }
+        if(i == *prefix_len)
+            return (SVX_CODEC_VARINT_LEN_MAX == *prefix_len ? SVX_ERRNO_FORMAT : SVX_ERRNO_NODATA);
+        /* the fifth byte can only hold the highest 4 bits of a 32-bit length */
+        if(SVX_CODEC_VARINT_LEN_MAX - 1 == i && prefix[i] > 0x0F) return SVX_ERRNO_FORMAT;
+        *prefix_len = i + 1;
+        break;
+    default:
+        return SVX_ERRNO_INVAL;
+    }
+
+    if(len > self->max_frame_len) return SVX_ERRNO_REACH;
+
+    *payload_len = len;
+    return 0;
+}
+
+/* get the next frame, return SVX_ERRNO_NODATA if the frame is incomplete */
+static int svx_codec_decode(svx_codec_t *self, svx_circlebuf_t *buf, size_t data_len,
+                            svx_codec_payload_t *payload, size_t *frame_len)
+{
+    size_t   prefix_len = 0, payload_len = 0, pos;
+    uint8_t  trailer[SVX_CODEC_CRC32C_LEN];
+    uint32_t crc;
+    int      r;
+
+    if(SVX_CODEC_TYPE_LENGTH_PREFIXED == self->type)
+    {
+        if(0 != (r = svx_codec_decode_len(self, buf, data_len, &prefix_len, &payload_len))) return r;
+
+        *frame_len = prefix_len + payload_len + (self->crc32c ? SVX_CODEC_CRC32C_LEN : 0);
+        if(data_len < *frame_len) return SVX_ERRNO_NODATA;
+    }
+    else
+    {
+        /* the circlebuf remembers where the last searching stopped, so an incomplete frame is not searched again */
+        if(0 != (r = svx_circlebuf_search(buf, 0, self->delim, self->delim_len, &pos)))
+        {
+            if(SVX_ERRNO_NOTFND != r && SVX_ERRNO_NODATA != r) return r;
+            return (data_len >= self->max_frame_len + self->delim_len ? SVX_ERRNO_REACH : SVX_ERRNO_NODATA);
+        }
+        if(pos > self->max_frame_len) return SVX_ERRNO_REACH;
+
+        payload_len = pos;
+        *frame_len  = pos + self->delim_len;
+    }
+
+    if(0 != (r = svx_circlebuf_get_spans(buf, prefix_len, payload_len, &(payload->buf1), &(payload->buf1_len),
+                                         &(payload->buf2), &(payload->buf2_len)))) return r;
+
+    if(SVX_CODEC_TYPE_LENGTH_PREFIXED == self->type && self->crc32c)
+    {
+        crc = svx_codec_crc32c(0, payload->buf1, payload->buf1_len);
+        crc = svx_codec_crc32c(crc, payload->buf2, payload->buf2_len);
+        if(0 != (r = svx_circlebuf_peek(buf, prefix_len + payload_len, trailer, SVX_CODEC_CRC32C_LEN))) return r;
+        if(crc != (((uint32_t)trailer[0] << 24) | ((uint32_t)trailer[1] << 16) |
+                   ((uint32_t)trailer[2] << 8) | (uint32_t)trailer[3]))
+            return SVX_ERRNO_FORMAT;
+    }
+
+    return 0;
+}
+
+static int svx_codec_create(svx_codec_t **self, svx_codec_type_t type, size_t max_frame_len,
+                            svx_codec_frame_cb_t frame_cb, void *frame_cb_arg)
+{
+    if(NULL == (*self = svx_alloc_calloc(SVX_ALLOC_TAG_MISC, 1, sizeof(svx_codec_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+
+    (*self)->type          = type;
+    (*self)->max_frame_len = max_frame_len;
+    (*self)->frame_cb      = frame_cb;
+    (*self)->frame_cb_arg  = frame_cb_arg;
+
+    return 0;
+}
+
+int svx_codec_create_length_prefixed(svx_codec_t **self, svx_codec_len_type_t len_type,
+                                     size_t max_frame_len, int crc32c,
+                                     svx_codec_frame_cb_t frame_cb, void *frame_cb_arg)
+{
+    size_t len_max;
+    int    r;
+
+    if(NULL == self || NULL == frame_cb)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, frame_cb:%p\n", self, frame_cb);
+
+    switch(len_type)
+    {
+    case SVX_CODEC_LEN_U8:     len_max = UINT8_MAX;  break;
+    case SVX_CODEC_LEN_U16:    len_max = UINT16_MAX; break;
+    case SVX_CODEC_LEN_U32:    len_max = UINT32_MAX; break;
+    case SVX_CODEC_LEN_VARINT: len_max = UINT32_MAX; break;
+    default: SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "len_type:%d\n", len_type);
+    }
+    if(0 == max_frame_len || max_frame_len > len_max)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "max_frame_len:%zu, len_max:%zu\n", max_frame_len, len_max);
+
+    if(0 != (r = svx_codec_create(self, SVX_CODEC_TYPE_LENGTH_PREFIXED, max_frame_len, frame_cb, frame_cb_arg)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    (*self)->len_type = len_type;
+    (*self)->crc32c   = (crc32c ? 1 : 0);
+
+    return 0;
+}
+
+int svx_codec_create_delimiter(svx_codec_t **self, const uint8_t *delim, size_t delim_len,
+                               size_t max_frame_len, svx_codec_frame_cb_t frame_cb, void *frame_cb_arg)
+{
+    int r;
+
+    if(NULL == self || NULL == delim || 0 == delim_len || delim_len > SVX_CODEC_DELIM_LEN_MAX ||
+       0 == max_frame_len || max_frame_len > SIZE_MAX - delim_len || NULL == frame_cb)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, delim:%p, delim_len:%zu, max_frame_len:%zu, frame_cb:%p\n",
+                                 self, delim, delim_len, max_frame_len, frame_cb);
+
+    if(0 != (r = svx_codec_create(self, SVX_CODEC_TYPE_DELIMITER, max_frame_len, frame_cb, frame_cb_arg)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    memcpy((*self)->delim, delim, delim_len);
+    (*self)->delim_len = delim_len;
+
+    return 0;
+}
+
+int svx_codec_destroy(svx_codec_t **self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(NULL == *self) return 0;
+
+    svx_alloc_free(SVX_ALLOC_TAG_MISC, *self);
+    *self = NULL;
+    return 0;
+}
+
+void svx_codec_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    svx_codec_t         *self = (svx_codec_t *)arg;
+    svx_codec_payload_t  payload;
+    size_t               data_len, frame_len;
+    int                  r;
+
+    if(NULL == conn || NULL == buf || NULL == self)
+    {
+        SVX_LOG_ERRNO_ERR(SVX_ERRNO_INVAL, "conn:%p, buf:%p, arg:%p\n", conn, buf, arg);
+        return;
+    }
+
+    while(1)
+    {
+        if(0 != (r = svx_circlebuf_get_data_len(buf, &data_len))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+        if(0 == data_len) return;
+
+        if(0 != (r = svx_codec_decode(self, buf, data_len, &payload, &frame_len)))
+        {
+            if(SVX_ERRNO_NODATA == r) return; /* wait for more data */
+            SVX_LOG_ERRNO_GOTO_NOTICE(err, r, "invalid frame\n");
+        }
+
+        r = self->frame_cb(conn, payload.buf1, payload.buf1_len, payload.buf2, payload.buf2_len, self->frame_cb_arg);
+
+        /* the frame is consumed after the callback returns */
+        svx_circlebuf_erase_data(buf, frame_len);
+        if(0 != r) goto err;
+    }
+
+ err:
+    svx_tcp_connection_close(conn);
+}
+
+int svx_codec_write(svx_codec_t *self, svx_tcp_connection_t *conn, const uint8_t *buf, size_t len)
+{
+    struct iovec iov[3];
+    int          iovcnt = 0;
+    uint8_t      prefix[SVX_CODEC_VARINT_LEN_MAX];
+    size_t       prefix_len = 0;
+    uint8_t      trailer[SVX_CODEC_CRC32C_LEN];
+    uint32_t     crc;
+    size_t       v;
+    int          r;
+
+    if(NULL == self || NULL == conn || (NULL == buf && len > 0) || len > self->max_frame_len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, conn:%p, buf:%p, len:%zu\n", self, conn, buf, len);
+
+    if(SVX_CODEC_TYPE_LENGTH_PREFIXED == self->type)
+    {
+        switch(self->len_type)
+        {
+        case SVX_CODEC_LEN_U8:
+            prefix[prefix_len++] = (uint8_t)len;
+            break;
+        case SVX_CODEC_LEN_U16:
+            prefix[prefix_len++] = (uint8_t)(len >> 8);
+            prefix[prefix_len++] = (uint8_t)len;
+            break;
+        case SVX_CODEC_LEN_U32:
+            prefix[prefix_len++] = (uint8_t)(len >> 24);
+            prefix[prefix_len++] = (uint8_t)(len >> 16);
+            prefix[prefix_len++] = (uint8_t)(len >> 8);
+            prefix[prefix_len++] = (uint8_t)len;
+            break;
+        default:
+            for(v = len; v >= 0x80; v >>= 7)
+                prefix[prefix_len++] = (uint8_t)(v | 0x80);
+            prefix[prefix_len++] = (uint8_t)v;
+            break;
+        }
+        iov[iovcnt].iov_base = prefix;
+        iov[iovcnt].iov_len  = prefix_len;
+        iovcnt++;
+    }
+
+    if(len > 0)
+    {
+        iov[iovcnt].iov_base = (void *)buf;
+        iov[iovcnt].iov_len  = len;
+        iovcnt++;
+    }
+
+    if(SVX_CODEC_TYPE_LENGTH_PREFIXED == self->type)
+    {
+        if(self->crc32c)
+        {
+            crc = svx_codec_crc32c(0, buf, len);
+            trailer[0] = (uint8_t)(crc >> 24);
+            trailer[1] = (uint8_t)(crc >> 16);
+            trailer[2] = (uint8_t)(crc >> 8);
+            trailer[3] = (uint8_t)crc;
+            iov[iovcnt].iov_base = trailer;
+            iov[iovcnt].iov_len  = SVX_CODEC_CRC32C_LEN;
+            iovcnt++;
+        }
+    }
+    else
+    {
+        iov[iovcnt].iov_base = self->delim;
+        iov[iovcnt].iov_len  = self->delim_len;
+        iovcnt++;
+    }
+
+    if(0 != (r = svx_tcp_connection_writev(conn, iov, iovcnt))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
+}
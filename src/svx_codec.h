@@ -0,0 +1,166 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_codec.h
+ * \brief
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_CODEC_H
+#define SVX_CODEC_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "svx_tcp_connection.h"
+#include "svx_circlebuf.h"
+
+/*!
+ * \defgroup Codec Codec
+ * \ingroup  Network
+ *
+ * \brief    This module splits the byte stream of TCP connections into frames.
+ *           Each frame is delivered in place: as one or two pointers into the read circlebuf,
+ *           without any copying. The frame will be consumed after the frame callback returns.
+ *
+ *           Attach a codec to TCP connections by using \link svx_codec_read_cb \endlink as
+ *           their read callback, and the codec as the read callback's argument. A codec holds
+ *           no per-connection state, so it can be shared by all TCP connections in all loopers.
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The type for codec.
+ */
+typedef struct svx_codec svx_codec_t;
+
+/*!
+ * The length prefix type for length-prefixed frames. The fixed-size prefixes are in big-endian.
+ */
+typedef enum
+{
+    SVX_CODEC_LEN_U8 = 0, /*!< 1 byte. */
+    SVX_CODEC_LEN_U16,    /*!< 2 bytes. */
+    SVX_CODEC_LEN_U32,    /*!< 4 bytes. */
+    SVX_CODEC_LEN_VARINT  /*!< 1 to 5 bytes, unsigned LEB128. */
+} svx_codec_len_type_t;
+
+/*!
+ * Signature for frame callback. The frame is split into two buffers when it wraps around
+ * the end of the circlebuf. Both buffers are only valid until this callback returns.
+ *
+ * \param[in] conn      The address of the TCP connection.
+ * \param[in] buf1      The first part of the frame payload.
+ * \param[in] buf1_len  The length of \c buf1. Zero for an empty frame.
+ * \param[in] buf2      The second part of the frame payload. \c NULL if the frame is not split.
+ * \param[in] buf2_len  The length of \c buf2. Zero if the frame is not split.
+ * \param[in] arg       The argument which passed when creating the codec.
+ *
+ * \return  Return zero to continue decoding; return non-zero to stop decoding and close the TCP connection.
+ */
+typedef int (*svx_codec_frame_cb_t)(svx_tcp_connection_t *conn, const uint8_t *buf1, size_t buf1_len,
+                                    const uint8_t *buf2, size_t buf2_len, void *arg);
+
+/*!
+ * To create a codec for length-prefixed frames: [length][payload][CRC32C].
+ * The length is the payload's length. The CRC32C is 4 bytes in big-endian, and only presents
+ * if \c crc32c is non-zero.
+ *
+ * \warning  The whole frame MUST fit into the TCP connection's read buffer.
+ *
+ * \param[out] self           The pointer for return the codec object.
+ * \param[in]  len_type       The length prefix type.
+ * \param[in]  max_frame_len  The maximum payload length. A longer frame closes the TCP connection.
+ * \param[in]  crc32c         Non-zero to append and check the CRC32C of the payload.
+ * \param[in]  frame_cb       The callback for each frame.
+ * \param[in]  frame_cb_arg   The \c frame_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_codec_create_length_prefixed(svx_codec_t **self, svx_codec_len_type_t len_type,
+                                            size_t max_frame_len, int crc32c,
+                                            svx_codec_frame_cb_t frame_cb, void *frame_cb_arg);
+
+/*!
+ * To create a codec for delimiter-terminated frames: [payload][delimiter].
+ * The delimiter is not delivered, but it is consumed with the frame.
+ *
+ * \warning  The whole frame MUST fit into the TCP connection's read buffer.
+ *
+ * \param[out] self           The pointer for return the codec object.
+ * \param[in]  delim          The delimiter.
+ * \param[in]  delim_len      The delimiter's length. From 1 to 16.
+ * \param[in]  max_frame_len  The maximum payload length. A longer frame closes the TCP connection.
+ * \param[in]  frame_cb       The callback for each frame.
+ * \param[in]  frame_cb_arg   The \c frame_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_codec_create_delimiter(svx_codec_t **self, const uint8_t *delim, size_t delim_len,
+                                      size_t max_frame_len, svx_codec_frame_cb_t frame_cb, void *frame_cb_arg);
+
+/*!
+ * To destroy a codec.
+ *
+ * \warning  The codec MUST NOT be used by any TCP connection.
+ *
+ * \param[in, out] self  The second rank pointer of the codec.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_codec_destroy(svx_codec_t **self);
+
+/*!
+ * The TCP connection read callback which decodes frames. Pass the codec as its argument.
+ * All the complete frames in \c buf are delivered to the frame callback one by one.
+ * The incomplete frame is kept in \c buf until more data arrives.
+ * The TCP connection is closed when an invalid frame is received.
+ *
+ * \param[in] conn  The address of the TCP connection.
+ * \param[in] buf   The read buffer of the TCP connection.
+ * \param[in] arg   The address of the codec.
+ */
+extern void svx_codec_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg);
+
+/*!
+ * Encode a frame and write it to the TCP connection.
+ * For delimiter-terminated frames, the payload MUST NOT contain the delimiter.
+ *
+ * \param[in] self  The address of the codec.
+ * \param[in] conn  The address of the TCP connection.
+ * \param[in] buf   The frame payload.
+ * \param[in] len   The frame payload's length.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_codec_write(svx_codec_t *self, svx_tcp_connection_t *conn, const uint8_t *buf, size_t len);
+
+/*!
+ * Calculate CRC32C (Castagnoli). The SSE4.2 CRC32 instruction is used if the CPU supports it.
+ *
+ * \param[in] crc  The CRC32C of the previous data. Zero for the beginning.
+ * \param[in] buf  The data.
+ * \param[in] len  The data's length.
+ *
+ * \return  The CRC32C of the previous data and \c buf.
+ */
+extern uint32_t svx_codec_crc32c(uint32_t crc, const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
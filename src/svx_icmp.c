@@ -26,6 +26,7 @@
 #include "svx_channel.h"
 #include "svx_inetaddr.h"
 #include "svx_util.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -190,7 +191,7 @@ int svx_icmp_create(svx_icmp_t **self, svx_looper_t *looper)
     if(NULL == self || NULL == looper)
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p\n", self, looper);
 
-    if(NULL == (*self = malloc(sizeof(svx_icmp_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_UDP, sizeof(svx_icmp_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->running             = 0;
     (*self)->looper              = looper;
     (*self)->icmphdr_id          = (uint16_t)(getpid() & 0xffff);
@@ -215,7 +216,7 @@ int svx_icmp_destroy(svx_icmp_t **self)
     if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
 
     if(0 != (r = svx_icmp_stop(*self))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_UDP, *self);
     *self = NULL;
     return 0;
 }
@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include "svx_log.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_queue.h"
 #include "svx_util.h"
@@ -139,9 +140,9 @@ static void svx_log_file_write_to_cache(const char *msg, size_t len, struct time
             SVX_LOG_SELF_DEBUG_PRINT("malloc() -> cur cache\n");
             if(svx_log_file_cache_count_cur < svx_log_file_cache_count_max)
             {
-                if(NULL != (svx_log_file_cache_cur = malloc(sizeof(svx_log_file_cache_t))))
+                if(NULL != (svx_log_file_cache_cur = svx_alloc_malloc(SVX_ALLOC_TAG_LOG, sizeof(svx_log_file_cache_t))))
                 {
-                    if(NULL != (svx_log_file_cache_cur->buf = malloc(svx_log_file_cache_size_each)))
+                    if(NULL != (svx_log_file_cache_cur->buf = svx_alloc_malloc(SVX_ALLOC_TAG_LOG, svx_log_file_cache_size_each)))
                     {
                         /* create successfully */
                         svx_log_file_cache_cur->buf_used = 0;
@@ -150,7 +151,7 @@ static void svx_log_file_write_to_cache(const char *msg, size_t len, struct time
                     }
                     else
                     {
-                        free(svx_log_file_cache_cur);
+                        svx_alloc_free(SVX_ALLOC_TAG_LOG, svx_log_file_cache_cur);
                         svx_log_file_cache_cur = NULL;
                     }
                 }
@@ -437,21 +438,21 @@ int svx_log_file_uninit()
     /* free all file caches */
     if(NULL != svx_log_file_cache_cur)
     {
-        free(svx_log_file_cache_cur->buf);
-        free(svx_log_file_cache_cur);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, svx_log_file_cache_cur->buf);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, svx_log_file_cache_cur);
         svx_log_file_cache_cur = NULL;
     }
     TAILQ_FOREACH_SAFE(cache, &svx_log_file_cache_queue_empty, link, tmp)
     {
         TAILQ_REMOVE(&svx_log_file_cache_queue_empty, cache, link);
-        free(cache->buf);
-        free(cache);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, cache->buf);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, cache);
     }
     TAILQ_FOREACH_SAFE(cache, &svx_log_file_cache_queue_full, link, tmp)
     {
         TAILQ_REMOVE(&svx_log_file_cache_queue_full, cache, link);
-        free(cache->buf);
-        free(cache);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, cache->buf);
+        svx_alloc_free(SVX_ALLOC_TAG_LOG, cache);
     }
 
     /* close the file FD */
@@ -20,11 +20,14 @@
 #include "svx_poller.h"
 #include "svx_channel.h"
 #include "svx_notifier.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
 #define SVX_LOOPER_EVENT_ACTIVE_CHANNELS_SIZE_INIT 16
 #define SVX_LOOPER_PENDING_BUF_SIZE_INIT           1024
+#define SVX_LOOPER_DEFERREDS_SIZE_INIT             16
+#define SVX_LOOPER_WHEEL_SLOTS                     512
 
 typedef struct
 {
@@ -33,6 +36,14 @@ typedef struct
     size_t            arg_block_size;
 } svx_looper_pending_t;
 
+/* task which will be run at the end of the current loop iteration */
+typedef struct
+{
+    svx_looper_func_t  run;
+    svx_looper_func_t  clean;
+    void              *arg;
+} svx_looper_deferred_t;
+
 /* rb-tree for timer task */
 typedef struct svx_looper_timer
 {
@@ -64,10 +75,14 @@ static __inline__ int svx_looper_timer_cmp_id(svx_looper_timer_t *a, svx_looper_
 typedef RB_HEAD(svx_looper_timer_tree_id, svx_looper_timer) svx_looper_timer_tree_id_t;
 RB_GENERATE_STATIC(svx_looper_timer_tree_id, svx_looper_timer, link_id, svx_looper_timer_cmp_id);
 
+/* list of timer wheel entries */
+typedef TAILQ_HEAD(svx_looper_wheel_list, svx_looper_wheel_entry,) svx_looper_wheel_list_t;
+
 struct svx_looper
 {
     volatile int                   looping;
     pthread_t                      looping_tid;
+    uint64_t                       iteration;
 
     svx_poller_t                  *poller;
     int                            poller_timeout_ms;
@@ -84,11 +99,26 @@ struct svx_looper
     size_t                         pending_buf_size_swap;
     size_t                         pending_buf_used;
     pthread_mutex_t                pending_mutex;
+
+    svx_looper_deferred_t         *deferreds;
+    size_t                         deferreds_size;
+    size_t                         deferreds_used;
     
     svx_looper_timer_tree_when_t   timer_tree_when;
     svx_looper_timer_tree_id_t     timer_tree_id;
     uint64_t                       timer_id_sequence_next;
     pthread_mutex_t                timer_id_sequence_next_mutex;
+
+    svx_looper_wheel_list_t        wheel_slots[SVX_LOOPER_WHEEL_SLOTS];
+    svx_looper_wheel_list_t        wheel_expired; /* entries which will be run in the current tick */
+    size_t                         wheel_cnt;     /* count of entries in slots and wheel_expired */
+    int64_t                        wheel_tick;    /* the last tick which has been handled */
+    int                            wheel_running; /* the wheel's timer is running */
+    svx_looper_timer_id_t          wheel_timer_id;
+
+    svx_bufpool_t                 *bufpool; /* shared by the circlebufs of the TCP connections */
+
+    svx_looper_post_entry_t *volatile posts; /* lock-free stack of the posted entries, the newest first */
 };
 
 static void svx_looper_reset_timeout(svx_looper_t *self, svx_looper_timer_t *timer_min, int64_t now_ms)
@@ -140,7 +170,7 @@ static void svx_looper_handle_timers(svx_looper_t *self)
         else
         {
             RB_REMOVE(svx_looper_timer_tree_id, &(self->timer_tree_id), timer);
-            free(timer);
+            svx_alloc_free(SVX_ALLOC_TAG_TIMER, timer);
         }
 
         timer_run(timer_arg);
@@ -149,6 +179,33 @@ static void svx_looper_handle_timers(svx_looper_t *self)
     svx_looper_reset_timeout(self, timer, now_ms);
 }
 
+static void svx_looper_handle_posts(svx_looper_t *self, int run_flag)
+{
+    svx_looper_post_entry_t *entry, *next, *fifo = NULL;
+
+    if(NULL == self->posts) return;
+
+    /* take all the entries, and reverse them to the posted order */
+    entry = __sync_lock_test_and_set(&(self->posts), NULL);
+    while(entry)
+    {
+        next        = entry->next;
+        entry->next = fifo;
+        fifo        = entry;
+        entry       = next;
+    }
+
+    /* the entry may be freed or posted again in its callback */
+    while(fifo)
+    {
+        entry = fifo;
+        fifo  = fifo->next;
+        entry->next = NULL;
+        if(run_flag)          entry->run(entry->arg);
+        else if(entry->clean) entry->clean(entry->arg);
+    }
+}
+
 static void svx_looper_handle_pendings(svx_looper_t *self, int run_flag)
 {
     uint8_t              *pending_buf;
@@ -195,6 +252,21 @@ static void svx_looper_handle_pendings(svx_looper_t *self, int run_flag)
     }
 }
 
+static void svx_looper_handle_deferreds(svx_looper_t *self, int run_flag)
+{
+    svx_looper_deferred_t deferred;
+    size_t                i;
+
+    /* the tasks deferred by the running tasks will also be run in this round */
+    for(i = 0; i < self->deferreds_used; i++)
+    {
+        deferred = self->deferreds[i];
+        if(run_flag)             deferred.run(deferred.arg);
+        else if(deferred.clean)  deferred.clean(deferred.arg);
+    }
+    self->deferreds_used = 0;
+}
+
 static void svx_looper_handle_events(svx_looper_t *self)
 {
     size_t          i;
@@ -207,7 +279,7 @@ static void svx_looper_handle_events(svx_looper_t *self)
        We should be ready for more active_channel space next time. */
     if(self->event_active_channels_used == self->event_active_channels_size)
     {
-        if(NULL != (tmp = realloc(self->event_active_channels, sizeof(svx_channel_t *) * self->event_active_channels_size * 2)))
+        if(NULL != (tmp = svx_alloc_realloc(SVX_ALLOC_TAG_LOOPER, self->event_active_channels, sizeof(svx_channel_t *) * self->event_active_channels_size * 2)))
         {
             self->event_active_channels       = tmp;
             self->event_active_channels_size *= 2;
@@ -224,14 +296,16 @@ static void svx_looper_poller_notifier_read_callback(void *arg)
 
 int svx_looper_create(svx_looper_t **self)
 {
-    int r  = 0;
-    int fd = -1;
+    int    r  = 0;
+    int    fd = -1;
+    size_t i;
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
     
-    if(NULL == (*self = malloc(sizeof(svx_looper_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_LOOPER, sizeof(svx_looper_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->looping                    = 0;
     (*self)->looping_tid                = pthread_self();
+    (*self)->iteration                  = 0;
     (*self)->poller                     = NULL;
     (*self)->poller_timeout_ms          = -1;
     (*self)->poller_notifier            = NULL;
@@ -244,17 +318,29 @@ int svx_looper_create(svx_looper_t **self)
     (*self)->pending_buf_size           = SVX_LOOPER_PENDING_BUF_SIZE_INIT;
     (*self)->pending_buf_size_swap      = SVX_LOOPER_PENDING_BUF_SIZE_INIT;
     (*self)->pending_buf_used           = 0;
+    (*self)->deferreds                  = NULL;
+    (*self)->deferreds_size             = 0;
+    (*self)->deferreds_used             = 0;
     RB_INIT(&((*self)->timer_tree_when));
     RB_INIT(&((*self)->timer_tree_id));
     (*self)->timer_id_sequence_next     = 0;
+    for(i = 0; i < SVX_LOOPER_WHEEL_SLOTS; i++)
+        TAILQ_INIT(&((*self)->wheel_slots[i]));
+    TAILQ_INIT(&((*self)->wheel_expired));
+    (*self)->wheel_cnt                  = 0;
+    (*self)->wheel_tick                 = 0;
+    (*self)->wheel_running              = 0;
+    SVX_LOOPER_TIMER_ID_INIT(&((*self)->wheel_timer_id));
+    (*self)->bufpool                    = NULL;
+    (*self)->posts                      = NULL;
 
     if(0 != (r = svx_poller_create(&((*self)->poller)))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
     if(0 != (r = svx_notifier_create(&((*self)->poller_notifier), &fd))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
     if(0 != (r = svx_channel_create(&((*self)->poller_notifier_channel), *self, fd, SVX_CHANNEL_EVENT_READ))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
     if(0 != (r = svx_channel_set_read_callback((*self)->poller_notifier_channel, svx_looper_poller_notifier_read_callback, *self))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
-    if(NULL == ((*self)->event_active_channels = malloc(sizeof(svx_channel_t *) * (*self)->event_active_channels_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
-    if(NULL == ((*self)->pending_buf = malloc((*self)->pending_buf_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
-    if(NULL == ((*self)->pending_buf_swap = malloc((*self)->pending_buf_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
+    if(NULL == ((*self)->event_active_channels = svx_alloc_malloc(SVX_ALLOC_TAG_LOOPER, sizeof(svx_channel_t *) * (*self)->event_active_channels_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
+    if(NULL == ((*self)->pending_buf = svx_alloc_malloc(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
+    if(NULL == ((*self)->pending_buf_swap = svx_alloc_malloc(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf_size))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
     pthread_mutex_init(&((*self)->pending_mutex), NULL);
     pthread_mutex_init(&((*self)->timer_id_sequence_next_mutex), NULL);
     return 0;
@@ -265,10 +351,10 @@ int svx_looper_create(svx_looper_t **self)
         if((*self)->poller_notifier_channel) if(0 != (r = svx_channel_destroy(&((*self)->poller_notifier_channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
         if((*self)->poller_notifier)         if(0 != (r = svx_notifier_destroy(&((*self)->poller_notifier)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
         if((*self)->poller)                  if(0 != (r = svx_poller_destroy(&((*self)->poller)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-        if((*self)->event_active_channels)   free((*self)->event_active_channels);
-        if((*self)->pending_buf)             free((*self)->pending_buf);
-        if((*self)->pending_buf_swap)        free((*self)->pending_buf_swap);
-        free(*self);
+        if((*self)->event_active_channels)   svx_alloc_free(SVX_ALLOC_TAG_LOOPER, (*self)->event_active_channels);
+        if((*self)->pending_buf)             svx_alloc_free(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf);
+        if((*self)->pending_buf_swap)        svx_alloc_free(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf_swap);
+        svx_alloc_free(SVX_ALLOC_TAG_LOOPER, *self);
         *self = NULL;
     }
     return r;
@@ -287,22 +373,30 @@ int svx_looper_destroy(svx_looper_t **self)
     {
         RB_REMOVE(svx_looper_timer_tree_when, &((*self)->timer_tree_when), timer);
         if(timer->clean) timer->clean(timer->arg);
-        free(timer);
+        svx_alloc_free(SVX_ALLOC_TAG_TIMER, timer);
     }
 
     /* clean() all pending task */
     while((*self)->pending_buf_used > 0)
         svx_looper_handle_pendings(*self, 0);
 
+    /* clean() all posted entries */
+    svx_looper_handle_posts(*self, 0);
+
+    /* clean() all deferred task */
+    svx_looper_handle_deferreds(*self, 0);
+
     pthread_mutex_destroy(&((*self)->pending_mutex));
     pthread_mutex_destroy(&((*self)->timer_id_sequence_next_mutex));
     if(0 != (r = svx_channel_destroy(&((*self)->poller_notifier_channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
     if(0 != (r = svx_notifier_destroy(&((*self)->poller_notifier)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
     if(0 != (r = svx_poller_destroy(&((*self)->poller)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    free((*self)->event_active_channels);
-    free((*self)->pending_buf);
-    free((*self)->pending_buf_swap);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_LOOPER, (*self)->event_active_channels);
+    svx_alloc_free(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf);
+    svx_alloc_free(SVX_ALLOC_TAG_PENDING, (*self)->pending_buf_swap);
+    if((*self)->deferreds) svx_alloc_free(SVX_ALLOC_TAG_LOOPER, (*self)->deferreds);
+    if((*self)->bufpool) svx_bufpool_del_ref((*self)->bufpool);
+    svx_alloc_free(SVX_ALLOC_TAG_LOOPER, *self);
     *self = NULL;
 
     return r;
@@ -349,6 +443,8 @@ int svx_looper_loop(svx_looper_t *self)
                                      self->poller_timeout_ms)))
             SVX_LOG_ERRNO_RETURN_ERR(r, "svx_poller_poll() failed\n");
 
+        self->iteration++;
+
         /* handle event task */
         if(self->event_active_channels_used > 0)
             svx_looper_handle_events(self);
@@ -360,11 +456,23 @@ int svx_looper_loop(svx_looper_t *self)
         /* handle pending task */
         if(self->pending_buf_used > 0)
             svx_looper_handle_pendings(self, 1);
+
+        /* handle posted entries */
+        if(NULL != self->posts)
+            svx_looper_handle_posts(self, 1);
+
+        /* handle deferred task (at the end of this round) */
+        if(self->deferreds_used > 0)
+            svx_looper_handle_deferreds(self, 1);
     }
 
-    /* give the last chance to run all pending task recursively */
-    while(self->pending_buf_used > 0)
+    /* give the last chance to run all pending and deferred task recursively */
+    while(self->pending_buf_used > 0 || NULL != self->posts || self->deferreds_used > 0)
+    {
         svx_looper_handle_pendings(self, 1);
+        svx_looper_handle_posts(self, 1);
+        svx_looper_handle_deferreds(self, 1);
+    }
 
     return 0;
 }
@@ -413,7 +521,7 @@ static int svx_looper_run(svx_looper_t *self, svx_looper_func_t run, svx_looper_
 
     SVX_LOOPER_CHECK_DISPATCH_HELPER_8(self, svx_looper_run, self, run, clean, arg, when_ms, interval_ms, timer_id, now_ms);
 
-    if(NULL == (timer = malloc(sizeof(svx_looper_timer_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (timer = svx_alloc_malloc(SVX_ALLOC_TAG_TIMER, sizeof(svx_looper_timer_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     timer->run         = run;
     timer->clean       = clean;
     timer->arg         = arg;
@@ -513,7 +621,15 @@ int svx_looper_cancel(svx_looper_t *self, svx_looper_timer_id_t timer_id)
     
     if(timer == timer_min) svx_looper_reset_timeout(self, timer_min, -1);
 
-    free(timer);
+    svx_alloc_free(SVX_ALLOC_TAG_TIMER, timer);
+    return 0;
+}
+
+int svx_looper_get_iteration(svx_looper_t *self, uint64_t *iteration)
+{
+    if(NULL == self || NULL == iteration) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, iteration:%p\n", self, iteration);
+
+    *iteration = self->iteration;
     return 0;
 }
 
@@ -524,6 +640,25 @@ int svx_looper_is_loop_thread(svx_looper_t *self)
     return pthread_equal(self->looping_tid, pthread_self()) ? 1 : 0;
 }
 
+int svx_looper_set_bufpool(svx_looper_t *self, svx_bufpool_t *pool)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(pool) svx_bufpool_add_ref(pool);
+    if(self->bufpool) svx_bufpool_del_ref(self->bufpool);
+    self->bufpool = pool;
+
+    return 0;
+}
+
+int svx_looper_get_bufpool(svx_looper_t *self, svx_bufpool_t **pool)
+{
+    if(NULL == self || NULL == pool) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, pool:%p\n", self, pool);
+
+    *pool = self->bufpool;
+    return 0;
+}
+
 int svx_looper_dispatch(svx_looper_t *self, svx_looper_func_t run, svx_looper_func_t clean,
                         void *arg_block, size_t arg_block_size)
 {
@@ -548,7 +683,7 @@ int svx_looper_dispatch(svx_looper_t *self, svx_looper_func_t run, svx_looper_fu
         while(new_pending_buf_size - self->pending_buf_used < new_pending_size);
 
         /* realloc */
-        if(NULL == (new_pending_buf = realloc(self->pending_buf, new_pending_buf_size)))
+        if(NULL == (new_pending_buf = svx_alloc_realloc(SVX_ALLOC_TAG_PENDING, self->pending_buf, new_pending_buf_size)))
             SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
         self->pending_buf      = new_pending_buf;
         self->pending_buf_size = new_pending_buf_size;
@@ -570,3 +705,194 @@ int svx_looper_dispatch(svx_looper_t *self, svx_looper_func_t run, svx_looper_fu
     svx_notifier_send(self->poller_notifier);
     return r;
 }
+
+int svx_looper_defer(svx_looper_t *self, svx_looper_func_t run, svx_looper_func_t clean, void *arg)
+{
+    svx_looper_deferred_t *new_deferreds      = NULL;
+    size_t                 new_deferreds_size = 0;
+
+    if(NULL == self || NULL == run) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, run:%p\n", self, run);
+
+    if(!svx_looper_is_loop_thread(self))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "svx_looper_defer() MUST be called in the loop thread\n");
+
+    /* expand deferreds */
+    if(self->deferreds_used == self->deferreds_size)
+    {
+        new_deferreds_size = (0 == self->deferreds_size ? SVX_LOOPER_DEFERREDS_SIZE_INIT : self->deferreds_size * 2);
+        if(NULL == (new_deferreds = svx_alloc_realloc(SVX_ALLOC_TAG_LOOPER, self->deferreds, sizeof(svx_looper_deferred_t) * new_deferreds_size)))
+            SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+        self->deferreds      = new_deferreds;
+        self->deferreds_size = new_deferreds_size;
+    }
+
+    self->deferreds[self->deferreds_used].run   = run;
+    self->deferreds[self->deferreds_used].clean = clean;
+    self->deferreds[self->deferreds_used].arg   = arg;
+    self->deferreds_used++;
+
+    return 0;
+}
+
+static int64_t svx_looper_wheel_get_tick()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return ((int64_t)now.tv_sec * 1000 + now.tv_usec / 1000) / SVX_LOOPER_WHEEL_TICK_MS;
+}
+
+static svx_looper_wheel_list_t *svx_looper_wheel_get_list(svx_looper_t *self, int slot)
+{
+    return (SVX_LOOPER_WHEEL_SLOTS == slot ? &(self->wheel_expired) : &(self->wheel_slots[slot]));
+}
+
+/* the wheel's timer callback, run all the expired entries */
+static void svx_looper_wheel_handle(void *arg)
+{
+    svx_looper_t             *self     = (svx_looper_t *)arg;
+    int64_t                   now_tick = svx_looper_wheel_get_tick();
+    int64_t                   tick, end_tick;
+    svx_looper_wheel_entry_t *entry, *entry_tmp;
+
+    /* check each slot once at most, even if the timer has been delayed for a long time */
+    end_tick = (now_tick - self->wheel_tick > SVX_LOOPER_WHEEL_SLOTS ? self->wheel_tick + SVX_LOOPER_WHEEL_SLOTS : now_tick);
+    for(tick = self->wheel_tick + 1; tick <= end_tick; tick++)
+    {
+        TAILQ_FOREACH_SAFE(entry, &(self->wheel_slots[tick % SVX_LOOPER_WHEEL_SLOTS]), link, entry_tmp)
+        {
+            /* the entry which delay more than one round will be checked again in the next round */
+            if(entry->expire_tick > now_tick) continue;
+
+            TAILQ_REMOVE(&(self->wheel_slots[tick % SVX_LOOPER_WHEEL_SLOTS]), entry, link);
+            TAILQ_INSERT_TAIL(&(self->wheel_expired), entry, link);
+            entry->slot = SVX_LOOPER_WHEEL_SLOTS;
+        }
+    }
+    self->wheel_tick = now_tick;
+
+    /* the running entry may add or delete any entries (including itself) */
+    while(NULL != (entry = TAILQ_FIRST(&(self->wheel_expired))))
+    {
+        TAILQ_REMOVE(&(self->wheel_expired), entry, link);
+        entry->slot = -1;
+        self->wheel_cnt--;
+        entry->run(entry->arg);
+    }
+
+    /* stop the timer if the wheel is empty */
+    if(0 == self->wheel_cnt)
+    {
+        svx_looper_cancel(self, self->wheel_timer_id);
+        self->wheel_running = 0;
+    }
+}
+
+int svx_looper_post_entry_init(svx_looper_post_entry_t *entry, svx_looper_func_t run,
+                               svx_looper_func_t clean, void *arg)
+{
+    if(NULL == entry || NULL == run) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "entry:%p, run:%p\n", entry, run);
+
+    entry->run   = run;
+    entry->clean = clean;
+    entry->arg   = arg;
+    entry->next  = NULL;
+
+    return 0;
+}
+
+int svx_looper_post(svx_looper_t *self, svx_looper_post_entry_t *entry)
+{
+    svx_looper_post_entry_t *top;
+
+    if(NULL == self || NULL == entry) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, entry:%p\n", self, entry);
+
+    do
+    {
+        top = self->posts;
+        entry->next = top;
+    } while(!__sync_bool_compare_and_swap(&(self->posts), top, entry));
+
+    /* only the first entry of a batch wakes up the loop thread */
+    if(NULL == top) svx_notifier_send(self->poller_notifier);
+
+    return 0;
+}
+
+int svx_looper_wheel_entry_init(svx_looper_wheel_entry_t *entry, svx_looper_func_t run, void *arg)
+{
+    if(NULL == entry || NULL == run) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "entry:%p, run:%p\n", entry, run);
+
+    entry->run         = run;
+    entry->arg         = arg;
+    entry->expire_tick = 0;
+    entry->slot        = -1;
+
+    return 0;
+}
+
+int svx_looper_wheel_add(svx_looper_t *self, svx_looper_wheel_entry_t *entry, int64_t delay_ms)
+{
+    int64_t now_tick;
+    int64_t ticks;
+    int     r;
+
+    if(NULL == self || NULL == entry || NULL == entry->run || delay_ms < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, entry:%p, delay_ms:%"PRId64"\n", self, entry, delay_ms);
+
+    if(!svx_looper_is_loop_thread(self))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "svx_looper_wheel_add() MUST be called in the loop thread\n");
+
+    now_tick = svx_looper_wheel_get_tick();
+
+    /* start the wheel's timer */
+    if(!self->wheel_running)
+    {
+        if(0 != (r = svx_looper_run_every(self, svx_looper_wheel_handle, NULL, self, SVX_LOOPER_WHEEL_TICK_MS,
+                                          SVX_LOOPER_WHEEL_TICK_MS, &(self->wheel_timer_id))))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        self->wheel_running = 1;
+        self->wheel_tick    = now_tick;
+    }
+
+    /* reschedule */
+    if(entry->slot >= 0)
+    {
+        TAILQ_REMOVE(svx_looper_wheel_get_list(self, entry->slot), entry, link);
+        self->wheel_cnt--;
+    }
+
+    ticks = (delay_ms + SVX_LOOPER_WHEEL_TICK_MS - 1) / SVX_LOOPER_WHEEL_TICK_MS;
+    if(ticks < 1) ticks = 1;
+
+    entry->expire_tick = now_tick + ticks;
+    entry->slot        = (int)(entry->expire_tick % SVX_LOOPER_WHEEL_SLOTS);
+    TAILQ_INSERT_TAIL(&(self->wheel_slots[entry->slot]), entry, link);
+    self->wheel_cnt++;
+
+    return 0;
+}
+
+int svx_looper_wheel_del(svx_looper_t *self, svx_looper_wheel_entry_t *entry)
+{
+    if(NULL == self || NULL == entry) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, entry:%p\n", self, entry);
+
+    if(!svx_looper_is_loop_thread(self))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "svx_looper_wheel_del() MUST be called in the loop thread\n");
+
+    if(entry->slot < 0) return 0;
+
+    /* the wheel's timer will be stopped in the next tick if the wheel is empty */
+    TAILQ_REMOVE(svx_looper_wheel_get_list(self, entry->slot), entry, link);
+    entry->slot = -1;
+    self->wheel_cnt--;
+
+    return 0;
+}
+
+int svx_looper_wheel_is_pending(svx_looper_wheel_entry_t *entry)
+{
+    if(NULL == entry) return 0;
+
+    return (entry->slot >= 0 ? 1 : 0);
+}
@@ -19,6 +19,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include "svx_channel.h"
+#include "svx_queue.h"
+#include "svx_bufpool.h"
 
 /*!
  * \defgroup Looper Looper
@@ -206,6 +208,19 @@ extern int svx_looper_run_every(svx_looper_t *self, svx_looper_func_t run, svx_l
  */
 extern int svx_looper_cancel(svx_looper_t *self, svx_looper_timer_id_t timer_id);
 
+/*!
+ * Get the count of the event loop iterations. Each iteration polls once, then runs the event,
+ * timer, pending and deferred tasks. So all the tasks run in one iteration get the same value.
+ *
+ * \note  The value is only meaningful in the loop thread.
+ *
+ * \param[in]  self       The address of the looper.
+ * \param[out] iteration  Return the count of iterations.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_get_iteration(svx_looper_t *self, uint64_t *iteration);
+
 /*!
  * To check if the calling thread is the one running the event loop.
  *
@@ -215,6 +230,30 @@ extern int svx_looper_cancel(svx_looper_t *self, svx_looper_timer_id_t timer_id)
  */
 extern int svx_looper_is_loop_thread(svx_looper_t *self);
 
+/*!
+ * Attach a bufpool to the looper. The circlebufs of the TCP connections which are created in
+ * the looper afterwards will draw their buffers from the bufpool. The looper holds a reference
+ * of the bufpool until it is destroyed or another bufpool is attached.
+ *
+ * \warning  This function MUST be called before any TCP connection is created in the looper.
+ *
+ * \param[in] self  The address of the looper.
+ * \param[in] pool  The bufpool. \c NULL means detach.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_set_bufpool(svx_looper_t *self, svx_bufpool_t *pool);
+
+/*!
+ * Get the bufpool attached to the looper.
+ *
+ * \param[in]  self  The address of the looper.
+ * \param[out] pool  Return the bufpool. \c NULL if there is no bufpool attached.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_get_bufpool(svx_looper_t *self, svx_bufpool_t **pool);
+
 /*!
  * Add a task to the pending task queue. The task will be run on the next round in the event loop.
  *
@@ -230,6 +269,140 @@ extern int svx_looper_is_loop_thread(svx_looper_t *self);
 extern int svx_looper_dispatch(svx_looper_t *self, svx_looper_func_t run, svx_looper_func_t clean,
                                void *arg_block, size_t arg_block_size);
 
+/*!
+ * Add a task which will be run at the end of the current round in the event loop, after all
+ * the event, timer and pending tasks of this round have been run.
+ *
+ * \note  This function MUST be called in the loop thread. It does not lock, copy or wake up
+ *        anything, so it is much cheaper than \link svx_looper_dispatch \endlink.
+ *
+ * \param[in] self   The address of the looper.
+ * \param[in] run    The callback fucntion for running the task.
+ * \param[in] clean  The callback fucntion for cleaning data when the task can't be run.
+ * \param[in] arg    The argument pass the \c run or \c clean callback function.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_defer(svx_looper_t *self, svx_looper_func_t run, svx_looper_func_t clean, void *arg);
+
+/*!
+ * The resolution on millisecond of the looper's timer wheel.
+ */
+#define SVX_LOOPER_WHEEL_TICK_MS 10
+
+/*!
+ * An entry in the looper's timer wheel. It is embedded in the caller's own object,
+ * so adding, refreshing and deleting it never allocate memory.
+ *
+ * \note  The fields are for internal use. Use \link svx_looper_wheel_entry_init \endlink
+ *        to initialize it before using.
+ */
+typedef struct svx_looper_wheel_entry
+{
+    svx_looper_func_t                     run;         /*!< The callback function. */
+    void                                 *arg;         /*!< The argument pass the \c run callback function. */
+    int64_t                               expire_tick; /*!< The tick when the entry expires. */
+    int                                   slot;        /*!< The slot index, -1 if the entry is not in the wheel. */
+    TAILQ_ENTRY(svx_looper_wheel_entry,)  link;        /*!< The link in the slot. */
+} svx_looper_wheel_entry_t;
+
+/*!
+ * To initialize a timer wheel entry.
+ *
+ * \param[in] entry  The address of the entry.
+ * \param[in] run    The callback fucntion which will be run once when the entry expires.
+ * \param[in] arg    The argument pass the \c run callback function.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_wheel_entry_init(svx_looper_wheel_entry_t *entry, svx_looper_func_t run, void *arg);
+
+/*!
+ * Add an entry to the looper's timer wheel, the entry's callback will be run once after a delay
+ * from now. If the entry is already in the wheel, it will be rescheduled. This is an O(1) operation.
+ *
+ * All entries share one timer of the looper, so this is much cheaper than
+ * \link svx_looper_run_after \endlink when there are lots of short-lived timers.
+ * The precision is \link SVX_LOOPER_WHEEL_TICK_MS \endlink.
+ *
+ * \warning  This function MUST be called in the loop thread. The entry MUST be deleted
+ *           from the wheel before it is freed.
+ *
+ * \param[in] self      The address of the looper.
+ * \param[in] entry     The address of the entry.
+ * \param[in] delay_ms  The delay on millisecond from now.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_wheel_add(svx_looper_t *self, svx_looper_wheel_entry_t *entry, int64_t delay_ms);
+
+/*!
+ * Delete an entry from the looper's timer wheel. Nothing happens if the entry is not in the wheel.
+ *
+ * \warning  This function MUST be called in the loop thread.
+ *
+ * \param[in] self   The address of the looper.
+ * \param[in] entry  The address of the entry.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_wheel_del(svx_looper_t *self, svx_looper_wheel_entry_t *entry);
+
+/*!
+ * To check if an entry is in the looper's timer wheel.
+ *
+ * \param[in] entry  The address of the entry.
+ *
+ * \return  Return \c 1 for TURE, \c 0 for FLASE.
+ */
+extern int svx_looper_wheel_is_pending(svx_looper_wheel_entry_t *entry);
+
+/*!
+ * An entry which can be posted to the looper from any thread. It is embedded in the caller's
+ * own object, so posting it never allocates memory and never takes a lock.
+ *
+ * \note  The fields are for internal use. Use \link svx_looper_post_entry_init \endlink
+ *        to initialize it before using.
+ */
+typedef struct svx_looper_post_entry
+{
+    svx_looper_func_t              run;   /*!< The callback function. */
+    svx_looper_func_t              clean; /*!< The callback function when the entry can't be run. */
+    void                          *arg;   /*!< The argument pass the \c run or \c clean callback function. */
+    struct svx_looper_post_entry  *next;  /*!< The link in the looper's post stack. */
+} svx_looper_post_entry_t;
+
+/*!
+ * To initialize a post entry.
+ *
+ * \param[in] entry  The address of the entry.
+ * \param[in] run    The callback fucntion which will be run once in the loop thread.
+ * \param[in] clean  The callback fucntion for cleaning data when the entry can't be run.
+ * \param[in] arg    The argument pass the \c run or \c clean callback function.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_post_entry_init(svx_looper_post_entry_t *entry, svx_looper_func_t run,
+                                      svx_looper_func_t clean, void *arg);
+
+/*!
+ * Post an entry to the looper. It can be called in any thread. The entry's callback will be run
+ * in the loop thread on the next round, the entries are run in the order they were posted.
+ *
+ * The entries are pushed to a lock-free stack, and the looper is woken up only when the stack
+ * was empty. So a burst of entries posted before the loop thread drains them costs only one
+ * wakeup, and they are all run in one round. This is cheaper than \link svx_looper_dispatch \endlink
+ * for the results sent back from other threads.
+ *
+ * \warning  The entry MUST NOT be posted again or freed before its callback is run.
+ *
+ * \param[in] self   The address of the looper.
+ * \param[in] entry  The address of the entry.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_looper_post(svx_looper_t *self, svx_looper_post_entry_t *entry);
+
 /*!
  * To generate \c run function wrapper for the given function without argument.
  */
@@ -11,6 +11,7 @@
 #include <string.h>
 #include "svx_auto_config.h"
 #include "svx_notifier.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_util.h"
@@ -32,13 +33,13 @@ int svx_notifier_create(svx_notifier_t **self, int *fd)
 {
     if(NULL == self || NULL == fd) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, fd:%p\n", self, fd);
 
-    if(NULL == (*self = malloc(sizeof(svx_notifier_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_notifier_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
 
 #if SVX_HAVE_EVENTFD
     /* do not use the EFD_SEMAPHORE flag */
     if(0 > ((*self)->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
         *self = NULL;
         SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
@@ -47,7 +48,7 @@ int svx_notifier_create(svx_notifier_t **self, int *fd)
     int r;
     if(0 != pipe((*self)->pipefds))
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
         *self = NULL;
         SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
@@ -57,7 +58,7 @@ int svx_notifier_create(svx_notifier_t **self, int *fd)
         SVX_LOG_ERRNO_ERR(r, "set fd to nonblocking failed\n");
         if(0 != close((*self)->pipefds[0])) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
         if(0 != close((*self)->pipefds[1])) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
         *self = NULL;
         return r;
     }
@@ -79,7 +80,7 @@ int svx_notifier_destroy(svx_notifier_t **self)
     if(0 != close((*self)->pipefds[1])) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
 #endif
 
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
     *self = NULL;
     return 0;
 }
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include "svx_auto_config.h"
 #include "svx_poller.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -69,7 +70,7 @@ int svx_poller_create(svx_poller_t **self)
         break;
     }
 
-    if(NULL == (*self = malloc(sizeof(svx_poller_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_poller_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->obj      = NULL;
     (*self)->handlers = handlers;
 
@@ -79,7 +80,7 @@ int svx_poller_create(svx_poller_t **self)
  err:
     if(*self)
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
         *self = NULL;
     }
     return r;
@@ -117,7 +118,7 @@ int svx_poller_destroy(svx_poller_t **self)
     if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
 
     (*self)->handlers->destroy(&((*self)->obj));
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, *self);
     *self = NULL;
 
     return 0;
@@ -17,6 +17,7 @@
 #include <sys/epoll.h>
 #include "svx_poller.h"
 #include "svx_poller_epoll.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_inetaddr.h"
@@ -36,13 +37,13 @@ int svx_poller_epoll_create(void **self)
     svx_poller_epoll_t *obj = NULL;
     int                 r   = 0;
 
-    if(NULL == (obj = malloc(sizeof(svx_poller_epoll_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (obj = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_poller_epoll_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     obj->epfd        = -1;
     obj->events      = NULL;
     obj->events_size = SVX_POLLER_EPOLL_EVENTS_SIZE_INIT;
 
     if((obj->epfd = epoll_create(obj->events_size)) < 0) SVX_LOG_ERRNO_GOTO_ERR(err, r = errno, NULL);
-    if(NULL == (obj->events = calloc(obj->events_size, sizeof(struct epoll_event))))
+    if(NULL == (obj->events = svx_alloc_calloc(SVX_ALLOC_TAG_CHANNEL, obj->events_size, sizeof(struct epoll_event))))
         SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
 
     *self = (void *)obj;
@@ -52,8 +53,8 @@ int svx_poller_epoll_create(void **self)
     if(NULL != obj)
     {
         if(obj->epfd >= 0)      close(obj->epfd);
-        if(NULL != obj->events) free(obj->events);
-        free(obj);
+        if(NULL != obj->events) svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj->events);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj);
     }
     *self = NULL;
     return r;
@@ -126,6 +127,7 @@ int svx_poller_epoll_poll(void *self, svx_channel_t **active_channels, size_t ac
 
         if(obj->events[i].events & (EPOLLIN  | EPOLLERR | EPOLLHUP)) revents |= SVX_CHANNEL_EVENT_READ;
         if(obj->events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) revents |= SVX_CHANNEL_EVENT_WRITE;
+        if(obj->events[i].events & EPOLLERR)                         revents |= SVX_CHANNEL_EVENT_ERROR;
         svx_channel_set_revents(active_channels[i], revents);
     }
     *active_channels_used = i;
@@ -133,7 +135,7 @@ int svx_poller_epoll_poll(void *self, svx_channel_t **active_channels, size_t ac
     if(nfds == obj->events_size)
     {
         /* We used all of the event space this time.  We should be ready for more events next time. */
-        if(NULL != (new_events = realloc(obj->events, sizeof(struct epoll_event) * obj->events_size * 2)))
+        if(NULL != (new_events = svx_alloc_realloc(SVX_ALLOC_TAG_CHANNEL, obj->events, sizeof(struct epoll_event) * obj->events_size * 2)))
         {
             obj->events       = new_events;
             obj->events_size *= 2;
@@ -148,8 +150,8 @@ int svx_poller_epoll_destroy(void **self)
     svx_poller_epoll_t *obj = (svx_poller_epoll_t *)(*self);
 
     close(obj->epfd);
-    free(obj->events);
-    free(obj);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj->events);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj);
     *self = NULL;
     return 0;
 }
@@ -14,6 +14,7 @@
 #include <poll.h>
 #include "svx_poller.h"
 #include "svx_poller_poll.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_tree.h"
@@ -48,16 +49,16 @@ int svx_poller_poll_create(void **self)
     svx_poller_poll_t *obj = NULL;
     size_t             i   = 0;
 
-    if(NULL == (obj = malloc(sizeof(svx_poller_poll_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (obj = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_poller_poll_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     obj->events      = NULL;
     obj->events_size = SVX_POLLER_POLL_EVENTS_SIZE_INIT;
     obj->events_used = 0;
     RB_INIT(&(obj->data_tree));
 
-    if(NULL == (obj->events = calloc(obj->events_size, sizeof(struct pollfd))))
+    if(NULL == (obj->events = svx_alloc_calloc(SVX_ALLOC_TAG_CHANNEL, obj->events_size, sizeof(struct pollfd))))
     {
         SVX_LOG_ERRNO_ERR(SVX_ERRNO_NOMEM, NULL);
-        free(obj);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj);
         return SVX_ERRNO_NOMEM;
     }
     for(i = 0; i < obj->events_size; i++)
@@ -107,7 +108,7 @@ int svx_poller_poll_update_channel(void *self, svx_channel_t *channel)
         if(i >= obj->events_size)
         {
             /* no empty hole, expand the buffer */
-            if(NULL == (new_events = realloc(obj->events, sizeof(struct pollfd) * obj->events_size * 2)))
+            if(NULL == (new_events = svx_alloc_realloc(SVX_ALLOC_TAG_CHANNEL, obj->events, sizeof(struct pollfd) * obj->events_size * 2)))
                 SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
             obj->events       = new_events;
             obj->events_size *= 2;
@@ -126,13 +127,13 @@ int svx_poller_poll_update_channel(void *self, svx_channel_t *channel)
         }
 
         /* save new data to data_tree*/
-        if(NULL == (poll_data = malloc(sizeof(svx_poller_poll_data_t))))
+        if(NULL == (poll_data = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_poller_poll_data_t))))
             SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
         poll_data->fd      = fd;
         poll_data->channel = channel;
         if(NULL != RB_INSERT(svx_poller_poll_data_tree, &(obj->data_tree), poll_data))
         {
-            free(poll_data);
+            svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, poll_data);
             SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_REPEAT, "colliding fd:%d\n", fd);
         }
 
@@ -183,7 +184,7 @@ int svx_poller_poll_update_channel(void *self, svx_channel_t *channel)
         if(NULL != (poll_data = RB_FIND(svx_poller_poll_data_tree, &(obj->data_tree), &poll_data_key)))
         {
             RB_REMOVE(svx_poller_poll_data_tree, &(obj->data_tree), poll_data);
-            free(poll_data);
+            svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, poll_data);
         }
     }
 
@@ -223,6 +224,7 @@ int svx_poller_poll_poll(void *self, svx_channel_t **active_channels, size_t act
         revents = SVX_CHANNEL_EVENT_NULL;
         if(obj->events[i].revents & (POLLIN  | POLLERR | POLLHUP | POLLNVAL)) revents |= SVX_CHANNEL_EVENT_READ;
         if(obj->events[i].revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL)) revents |= SVX_CHANNEL_EVENT_WRITE;
+        if(obj->events[i].revents & POLLERR)                                  revents |= SVX_CHANNEL_EVENT_ERROR;
         svx_channel_set_revents(active_channels[cnt], revents);
 
         cnt++;
@@ -242,10 +244,10 @@ int svx_poller_poll_destroy(void **self)
     RB_FOREACH_SAFE(poll_data, svx_poller_poll_data_tree, &(obj->data_tree), poll_data_tmp)
     {
         RB_REMOVE(svx_poller_poll_data_tree, &(obj->data_tree), poll_data);
-        free(poll_data);
+        svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, poll_data);
     }
-    free(obj->events);
-    free(obj);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj->events);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj);
     *self = NULL;
     return 0;
 }
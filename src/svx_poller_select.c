@@ -16,6 +16,7 @@
 #include <sys/select.h>
 #include "svx_poller.h"
 #include "svx_poller_select.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_util.h"
@@ -34,7 +35,7 @@ int svx_poller_select_create(void **self)
 {
     svx_poller_select_t *obj = NULL;
 
-    if(NULL == (obj = malloc(sizeof(svx_poller_select_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (obj = svx_alloc_malloc(SVX_ALLOC_TAG_CHANNEL, sizeof(svx_poller_select_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     obj->maxfd = 0;
     FD_ZERO(&(obj->fdset_read));
     FD_ZERO(&(obj->fdset_write));
@@ -158,7 +159,7 @@ int svx_poller_select_destroy(void **self)
 {
     svx_poller_select_t *obj = (svx_poller_select_t *)(*self);
 
-    free(obj);
+    svx_alloc_free(SVX_ALLOC_TAG_CHANNEL, obj);
     *self = NULL;
     return 0;
 }
@@ -29,6 +29,7 @@
 #include "svx_looper.h"
 #include "svx_notifier.h"
 #include "svx_channel.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_crash.h"
@@ -489,8 +490,8 @@ int svx_process_set_log(svx_log_level_t level_file, svx_log_level_t level_syslog
     
     if(NULL != dirname)
     {
-        if(svx_process_obj.log_dirname) free(svx_process_obj.log_dirname);
-        if(NULL == (svx_process_obj.log_dirname = strdup(dirname))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+        if(svx_process_obj.log_dirname) svx_alloc_free(SVX_ALLOC_TAG_MISC, svx_process_obj.log_dirname);
+        if(NULL == (svx_process_obj.log_dirname = svx_alloc_strdup(SVX_ALLOC_TAG_MISC, dirname))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
     
     return 0;
@@ -505,13 +506,13 @@ int svx_process_set_crash(const char *dirname, const char *head_msg, size_t max_
     
     if(NULL != dirname)
     {
-        if(svx_process_obj.crash_dirname) free(svx_process_obj.crash_dirname);
-        if(NULL == (svx_process_obj.crash_dirname = strdup(dirname))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+        if(svx_process_obj.crash_dirname) svx_alloc_free(SVX_ALLOC_TAG_MISC, svx_process_obj.crash_dirname);
+        if(NULL == (svx_process_obj.crash_dirname = svx_alloc_strdup(SVX_ALLOC_TAG_MISC, dirname))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
     if(NULL != head_msg)
     {
-        if(svx_process_obj.crash_head_msg) free(svx_process_obj.crash_head_msg);
-        if(NULL == (svx_process_obj.crash_head_msg = strdup(head_msg))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+        if(svx_process_obj.crash_head_msg) svx_alloc_free(SVX_ALLOC_TAG_MISC, svx_process_obj.crash_head_msg);
+        if(NULL == (svx_process_obj.crash_head_msg = svx_alloc_strdup(SVX_ALLOC_TAG_MISC, head_msg))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
     
     return 0;
@@ -529,13 +530,13 @@ int svx_process_set_user_group(const char *user, const char *group)
 {
     if(NULL != user)
     {
-        if(svx_process_obj.user) free(svx_process_obj.user);
-        if(NULL == (svx_process_obj.user = strdup(user))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+        if(svx_process_obj.user) svx_alloc_free(SVX_ALLOC_TAG_MISC, svx_process_obj.user);
+        if(NULL == (svx_process_obj.user = svx_alloc_strdup(SVX_ALLOC_TAG_MISC, user))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
     if(NULL != group)
     {
-        if(svx_process_obj.group) free(svx_process_obj.group);
-        if(NULL == (svx_process_obj.group = strdup(group))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+        if(svx_process_obj.group) svx_alloc_free(SVX_ALLOC_TAG_MISC, svx_process_obj.group);
+        if(NULL == (svx_process_obj.group = svx_alloc_strdup(SVX_ALLOC_TAG_MISC, group))) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
     }
 
     return 0;
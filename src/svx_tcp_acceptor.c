@@ -15,6 +15,7 @@
 #include "svx_inetaddr.h"
 #include "svx_channel.h"
 #include "svx_util.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -82,7 +83,7 @@ int svx_tcp_acceptor_create(svx_tcp_acceptor_t **self, svx_looper_t *looper, svx
     if(NULL == self || NULL == looper || NULL == accepted_cb)
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, accepted_cb:%p\n", self, looper, accepted_cb);
 
-    if(NULL == (*self = malloc(sizeof(svx_tcp_acceptor_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_acceptor_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->looper          = looper;
     (*self)->listen_addr     = listen_addr;
     (*self)->listen_fd       = -1;
@@ -94,7 +95,7 @@ int svx_tcp_acceptor_create(svx_tcp_acceptor_t **self, svx_looper_t *looper, svx
     if(0 > ((*self)->idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)))
     {
         r = errno;
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
         *self = NULL;
         SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
     }
@@ -109,7 +110,7 @@ int svx_tcp_acceptor_destroy(svx_tcp_acceptor_t **self)
 
     svx_tcp_acceptor_stop(*self);
     if((*self)->idle_fd >= 0) close((*self)->idle_fd);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
     *self = NULL;
 
     return 0;
@@ -16,6 +16,7 @@
 #include "svx_inetaddr.h"
 #include "svx_looper.h"
 #include "svx_util.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -88,7 +89,7 @@ int svx_tcp_client_create(svx_tcp_client_t **self, svx_looper_t *looper, svx_ine
     
     if(NULL == self || NULL == looper) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p\n", self, looper);
 
-    if(NULL == (*self = malloc(sizeof(svx_tcp_client_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_client_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->conn_ptr                  = NULL;
     (*self)->server_addr               = server_addr;
     (*self)->connector                 = NULL;
@@ -114,7 +115,7 @@ int svx_tcp_client_create(svx_tcp_client_t **self, svx_looper_t *looper, svx_ine
     if(NULL != *self)
     {
         if(NULL != (*self)->connector) svx_tcp_connector_destroy(&((*self)->connector));
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
         *self = NULL;
     }
 
@@ -127,7 +128,7 @@ int svx_tcp_client_destroy(svx_tcp_client_t **self)
     if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
 
     svx_tcp_connector_destroy(&((*self)->connector));
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
     *self = NULL;
     return 0;
 }
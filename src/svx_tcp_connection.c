@@ -5,21 +5,50 @@
  * for any purpose, commercial or non-commercial, and by any means.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
+#include "svx_auto_config.h"
+#if SVX_HAVE_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
 #include "svx_tcp_connection.h"
 #include "svx_inetaddr.h"
 #include "svx_circlebuf.h"
+#include "svx_buf.h"
+#include "svx_token_bucket.h"
 #include "svx_looper.h"
 #include "svx_channel.h"
+#include "svx_threadpool.h"
+#include "svx_queue.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
+#include "svx_util.h"
 
 #define SVX_TCP_CONNECTION_READ_BUF_MIN_STEP  64
 #define SVX_TCP_CONNECTION_WRITE_BUF_MIN_STEP 64
+#define SVX_TCP_CONNECTION_WRITE_IOV_CNT      IOV_MAX
+#define SVX_TCP_CONNECTION_RECV_CHUNK_LEN     (64 * 1024)
+#define SVX_TCP_CONNECTION_STREAM_BUF_LEN     (64 * 1024)
+#define SVX_TCP_CONNECTION_STREAM_LOW_WATER   (16 * 1024)
+#define SVX_TCP_CONNECTION_RCVLOWAT_MAX       (64 * 1024)
+#define SVX_TCP_CONNECTION_ZEROCOPY_REAP_MS   50    /* poll the error queue while the fd is not in the poller */
+#define SVX_TCP_CONNECTION_ZEROCOPY_LINGER_MS (60 * 1000)
+#define SVX_TCP_CONNECTION_ZEROCOPY_SKIP_MAX  1024  /* send at most this many large buffers by copying after a COPIED */
 
 typedef enum
 {
@@ -28,6 +57,48 @@ typedef enum
     SVX_TCP_CONNECTION_STATE_DISCONNECTED
 } svx_tcp_connection_state_t;
 
+/* a segment of data which queued by reference (not copied to write_buf), a range of a file, or a stream */
+typedef struct svx_tcp_connection_wseg
+{
+    size_t                        copy_before; /* length of data in write_buf which MUST be sent before this segment */
+    const uint8_t                *buf;
+    size_t                        len;
+    size_t                        sent;
+    svx_tcp_connection_free_cb_t  free_cb;
+    void                         *free_cb_arg;
+    int                           file_fd;     /* >= 0: send [file_offset, file_offset + len) of the file by sendfile() */
+    off_t                         file_offset;
+    svx_tcp_connection_sendfile_done_cb_t file_done_cb;
+    void                         *file_done_cb_arg;
+    int                           file_errnum;
+    int                           zerocopy;         /* send by MSG_ZEROCOPY */
+    uint32_t                      zerocopy_id;      /* the id of the first MSG_ZEROCOPY send() */
+    uint32_t                      zerocopy_cnt;     /* count of MSG_ZEROCOPY send() */
+    uint32_t                      zerocopy_pending; /* count of MSG_ZEROCOPY send() which has not been completed */
+    svx_tcp_connection_produce_cb_t stream_cb;      /* != NULL: the data is pulled from the producer into buf */
+    void                         *stream_cb_arg;
+    svx_tcp_connection_t         *stream_conn;
+    int                           stream_eof;
+    TAILQ_ENTRY(svx_tcp_connection_wseg,) link;
+} svx_tcp_connection_wseg_t;
+typedef TAILQ_HEAD(svx_tcp_connection_wseg_queue, svx_tcp_connection_wseg,) svx_tcp_connection_wseg_queue_t;
+
+/* an offloaded task, it is owned by the loop thread except while the work callback is running */
+typedef struct svx_tcp_connection_offload
+{
+    svx_tcp_connection_t                   *conn;     /* NULL: the connection has been destroyed */
+    svx_looper_t                           *looper;
+    svx_tcp_connection_handle_t             handle;
+    svx_tcp_connection_offload_work_cb_t    work_cb;
+    svx_tcp_connection_offload_done_cb_t    done_cb;
+    void                                   *arg;
+    int                                     errnum;   /* SVX_ERRNO_NOTRUN: the work callback was not run */
+    int                                     finished;
+    svx_looper_post_entry_t                 entry;    /* posted back to the looper after the work callback */
+    TAILQ_ENTRY(svx_tcp_connection_offload,) link;
+} svx_tcp_connection_offload_t;
+typedef TAILQ_HEAD(svx_tcp_connection_offload_queue, svx_tcp_connection_offload,) svx_tcp_connection_offload_queue_t;
+
 struct svx_tcp_connection
 {
     svx_tcp_connection_state_t      state;
@@ -36,18 +107,220 @@ struct svx_tcp_connection
     svx_channel_t                  *channel;
     int                             fd;
     svx_circlebuf_t                *read_buf;
+    size_t                          read_buf_min_len;
     size_t                          read_buf_max_len;
+    size_t                          read_avg;      /* moving average of the bytes per reading */
+    int                             read_full;     /* the last reading filled up the buffers */
+    int                             read_fionread; /* get the readable bytes by FIONREAD in a burst */
+    size_t                          read_lowat;    /* call the read callback only if there are enough data */
+    int                             read_rcvlowat; /* SO_RCVLOWAT of the socket, -1: not supported */
+    svx_tcp_connection_read_stats_t read_stats;
     svx_circlebuf_t                *write_buf;
     size_t                          write_buf_high_water_mark;
+    svx_tcp_connection_wseg_queue_t wsegs;
+    size_t                          wsegs_len;      /* unsent data length in all wsegs */
+    size_t                          wsegs_copy_len; /* sum of copy_before in all wsegs */
+    svx_tcp_connection_wseg_queue_t zerocopy_wsegs; /* sent wsegs which are waiting for the kernel completion */
+    size_t                          zerocopy_threshold; /* 0: do NOT use MSG_ZEROCOPY */
+    uint32_t                        zerocopy_next_id;
+    uint32_t                        zerocopy_pending;   /* count of MSG_ZEROCOPY send() which has not been completed */
+    unsigned int                    zerocopy_skip;      /* the next large buffers which will be sent by copying */
+    unsigned int                    zerocopy_backoff;   /* 0: the kernel did not copy the data last time */
+    svx_looper_wheel_entry_t        zerocopy_entry;     /* reap the completions while the fd is not in the poller */
     svx_tcp_connection_callbacks_t *callbacks;
     int                             write_completed_enable;
     int                             high_water_mark_enable;
+    int                             auto_cork;
+    int                             auto_cork_pending; /* the flush task has been deferred */
+    int                             read_enable;       /* the reading is enabled by user */
+    size_t                          flow_low_mark;
+    size_t                          flow_high_mark;    /* 0: the write flow control is off */
+    size_t                          flow_hard_cap;
+    int                             flow_paused;       /* the reading is paused by the write flow control */
+    int                             flow_aborted;
+    svx_tcp_connection_flow_stats_t *flow_stats;
+    svx_tcp_connection_offload_queue_t offloads; /* in-flight offloads in the submitted order */
+    unsigned int                    offloads_cnt;
+    unsigned int                    offloads_max;      /* 0: no limit */
+    int                             offload_paused;    /* the reading is paused by the offload limit */
+    svx_token_bucket_t             *read_bucket;         /* owned by this connection */
+    svx_token_bucket_t             *write_bucket;        /* owned by this connection */
+    svx_token_bucket_t             *read_shared_bucket;  /* shared with other connections */
+    svx_token_bucket_t             *write_shared_bucket; /* shared with other connections */
+    int                             read_parked;         /* the reading is paused until the tokens are refilled */
+    int                             write_parked;        /* the writing is paused until the tokens are refilled */
+    int64_t                         unpark_ms;
+    svx_looper_wheel_entry_t        unpark_entry;
+    size_t                          read_quota_bytes;     /* 0: no limit */
+    unsigned int                    read_quota_cbs;       /* 0: no limit */
+    unsigned int                    read_weight;
+    uint64_t                        read_quota_iteration; /* the loop iteration which the quota belongs to */
+    unsigned int                    read_quota_cbs_used;
+    int                             read_quota_deferred;  /* the rest of read_buf will be delivered in the next iteration */
+    size_t                          read_deficit;         /* the bytes can be read in this loop iteration */
+    int64_t                         idle_timeout_ms;      /* 0: off (the same for all the timeouts and deadlines) */
+    int64_t                         read_timeout_ms;
+    int64_t                         write_timeout_ms;
+    int64_t                         read_deadline_ms;     /* absolute time */
+    int64_t                         write_deadline_ms;    /* absolute time */
+    int64_t                         last_read_ms;
+    int64_t                         last_write_ms;
+    int64_t                         timeout_check_ms;     /* when the timeout entry will be run */
+    svx_looper_wheel_entry_t        timeout_entry;
+    svx_tcp_connection_close_reason_t close_reason;
+    svx_tcp_connection_hooks_t      hooks;
+    int                             write_hook_enable;
+    int                             recv_fd;          /* >= 0: the received data is redirected to this fd */
+    uint64_t                        recv_remaining;
+    int                             recv_pipe_fds[2]; /* [-1, -1]: copy mode */
+    svx_tcp_connection_recv_to_fd_done_cb_t recv_done_cb;
+    void                           *recv_done_cb_arg;
     svx_tcp_connection_remove_cb_t  remove_cb;
     void                           *remove_cb_arg;
     void                           *context;
     void                           *info;
+    svx_tcp_connection_handle_t     handle;
 };
 
+/* The handle table. A handle is (generation << 32 | slot index). The generation of a slot is odd while
+   it is used by a connection, and it is increased when the slot is acquired or released, so a stale
+   handle can be rejected by comparing the generation. The slots are allocated in segments which are
+   never moved or freed, so they can be read in any thread without locking. */
+#define SVX_TCP_CONNECTION_SLOT_SEG_SHIFT 12
+#define SVX_TCP_CONNECTION_SLOT_SEG_SIZE  (1U << SVX_TCP_CONNECTION_SLOT_SEG_SHIFT)
+#define SVX_TCP_CONNECTION_SLOT_SEG_MAX   1024 /* 4M connections */
+#define SVX_TCP_CONNECTION_SLOT_NONE      UINT32_MAX
+
+typedef struct
+{
+    uint32_t              generation; /* written in the owner looper's thread, read in any thread */
+    uint32_t              next_free;
+    svx_looper_t         *looper;
+    svx_tcp_connection_t *conn;
+} svx_tcp_connection_slot_t;
+
+static svx_tcp_connection_slot_t *svx_tcp_connection_slot_segs[SVX_TCP_CONNECTION_SLOT_SEG_MAX];
+static uint32_t                   svx_tcp_connection_slots_cnt  = 0;
+static uint32_t                   svx_tcp_connection_slots_free = SVX_TCP_CONNECTION_SLOT_NONE;
+static pthread_mutex_t            svx_tcp_connection_slots_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static svx_tcp_connection_slot_t *svx_tcp_connection_get_slot(uint32_t idx)
+{
+    svx_tcp_connection_slot_t *seg;
+
+    if((idx >> SVX_TCP_CONNECTION_SLOT_SEG_SHIFT) >= SVX_TCP_CONNECTION_SLOT_SEG_MAX) return NULL;
+    seg = *((svx_tcp_connection_slot_t * volatile *)&(svx_tcp_connection_slot_segs[idx >> SVX_TCP_CONNECTION_SLOT_SEG_SHIFT]));
+    if(NULL == seg) return NULL;
+
+    return &(seg[idx & (SVX_TCP_CONNECTION_SLOT_SEG_SIZE - 1)]);
+}
+
+static int svx_tcp_connection_acquire_slot(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_slot_t *seg, *slot;
+    uint32_t                   idx, i;
+    int                        r = 0;
+
+    pthread_mutex_lock(&svx_tcp_connection_slots_mutex);
+
+    if(SVX_TCP_CONNECTION_SLOT_NONE == svx_tcp_connection_slots_free)
+    {
+        /* add a new segment to the free list */
+        if((svx_tcp_connection_slots_cnt >> SVX_TCP_CONNECTION_SLOT_SEG_SHIFT) >= SVX_TCP_CONNECTION_SLOT_SEG_MAX)
+            SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_REACH, "slots:%"PRIu32"\n", svx_tcp_connection_slots_cnt);
+        if(NULL == (seg = svx_alloc_calloc(SVX_ALLOC_TAG_TCP_CONNECTION, SVX_TCP_CONNECTION_SLOT_SEG_SIZE, sizeof(svx_tcp_connection_slot_t))))
+            SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
+        for(i = 0; i < SVX_TCP_CONNECTION_SLOT_SEG_SIZE; i++)
+            seg[i].next_free = (SVX_TCP_CONNECTION_SLOT_SEG_SIZE - 1 == i ? SVX_TCP_CONNECTION_SLOT_NONE : svx_tcp_connection_slots_cnt + i + 1);
+        __sync_synchronize();
+        svx_tcp_connection_slot_segs[svx_tcp_connection_slots_cnt >> SVX_TCP_CONNECTION_SLOT_SEG_SHIFT] = seg;
+        svx_tcp_connection_slots_free = svx_tcp_connection_slots_cnt;
+        svx_tcp_connection_slots_cnt += SVX_TCP_CONNECTION_SLOT_SEG_SIZE;
+    }
+
+    idx  = svx_tcp_connection_slots_free;
+    slot = svx_tcp_connection_get_slot(idx);
+    svx_tcp_connection_slots_free = slot->next_free;
+
+    /* publish the slot's content before the new generation */
+    slot->looper = self->looper;
+    slot->conn   = self;
+    __sync_synchronize();
+    slot->generation++;
+    __sync_synchronize();
+
+    self->handle = ((uint64_t)(slot->generation) << 32) | idx;
+
+ end:
+    pthread_mutex_unlock(&svx_tcp_connection_slots_mutex);
+    return r;
+}
+
+static void svx_tcp_connection_release_slot(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_slot_t *slot;
+
+    if(SVX_TCP_CONNECTION_HANDLE_INVALID == self->handle) return;
+
+    pthread_mutex_lock(&svx_tcp_connection_slots_mutex);
+
+    /* all the handles of this connection are stale from now on */
+    slot = svx_tcp_connection_get_slot((uint32_t)(self->handle));
+    slot->generation++;
+    __sync_synchronize();
+    slot->looper    = NULL;
+    slot->conn      = NULL;
+    slot->next_free = svx_tcp_connection_slots_free;
+    svx_tcp_connection_slots_free = (uint32_t)(self->handle);
+
+    pthread_mutex_unlock(&svx_tcp_connection_slots_mutex);
+
+    self->handle = SVX_TCP_CONNECTION_HANDLE_INVALID;
+}
+
+/* the in-flight offloads will be completed without the connection */
+static void svx_tcp_connection_release_offloads(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_offload_t *offload = NULL, *tmp = NULL;
+
+    TAILQ_FOREACH_SAFE(offload, &(self->offloads), link, tmp)
+    {
+        TAILQ_REMOVE(&(self->offloads), offload, link);
+        offload->conn = NULL;
+
+        /* finished but waiting for an earlier one, its entry has been consumed */
+        if(offload->finished)
+        {
+            offload->done_cb(NULL, offload->errnum, offload->arg);
+            svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, offload);
+        }
+    }
+    self->offloads_cnt = 0;
+}
+
+/* Resolve a handle in any thread, without locking and without writing to any shared memory.
+   The returned connection can only be used in its looper's thread, because it may be destroyed
+   at any time in the other threads. */
+static int svx_tcp_connection_resolve_handle(svx_tcp_connection_handle_t handle, svx_looper_t **looper,
+                                             svx_tcp_connection_t **conn)
+{
+    svx_tcp_connection_slot_t *slot;
+    uint32_t                   generation = (uint32_t)(handle >> 32);
+
+    if(0 == (generation & 1)) return SVX_ERRNO_NOTCONN;
+    if(NULL == (slot = svx_tcp_connection_get_slot((uint32_t)handle))) return SVX_ERRNO_NOTCONN;
+
+    /* read the generation, then the content, then the generation again (like a seqlock) */
+    if(generation != *((volatile uint32_t *)&(slot->generation))) return SVX_ERRNO_NOTCONN;
+    __sync_synchronize();
+    *looper = slot->looper;
+    if(conn) *conn = slot->conn;
+    __sync_synchronize();
+    if(generation != *((volatile uint32_t *)&(slot->generation))) return SVX_ERRNO_NOTCONN;
+
+    return 0;
+}
+
 /* callback for write_completed */
 typedef struct
 {
@@ -83,627 +356,3302 @@ static void svx_tcp_connection_high_water_mark_callback_clean(void *arg)
     svx_tcp_connection_del_ref(p->self);
 }
 
-static void svx_tcp_connection_handle_close(svx_tcp_connection_t *self)
+static void svx_tcp_connection_notify_write_completed(svx_tcp_connection_t *self)
 {
-    int r;
-    
-    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return;
-    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
+    if(self->callbacks->write_completed_cb && self->write_completed_enable)
+    {
+        svx_tcp_connection_add_ref(self);
+        svx_tcp_connection_write_completed_callback_param_t p = {self};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_write_completed_callback_run,
+                            svx_tcp_connection_write_completed_callback_clean, &p, sizeof(p));
+    }
+}
 
-    if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_ALL)))
-        SVX_LOG_ERRNO_ERR(r, "del_events() error. fd:%d\n", self->fd);
-    
-    self->remove_cb(self, self->remove_cb_arg);
+static int64_t svx_tcp_connection_get_now_ms()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
 }
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_handle_close, svx_tcp_connection_t *, self)
 
-static void svx_tcp_connection_handle_read(void *arg)
+/* run the timeout entry no later than when_ms (the timestamps are checked lazily, so it is only moved forward) */
+static int svx_tcp_connection_schedule_timeout(svx_tcp_connection_t *self, int64_t when_ms, int64_t now_ms)
 {
-    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
-    struct iovec          iov[3];
-    int                   iov_cnt;
-    char                  extra_buf[64 * 1024];
-    size_t                extra_buf_len;
-    size_t                buf_len;
-    size_t                freespace_len;
-    ssize_t               n;
-    int                   r;
+    if(svx_looper_wheel_is_pending(&(self->timeout_entry)) && self->timeout_check_ms <= when_ms) return 0;
 
-    /* prepare buffers for readv() */
-    svx_circlebuf_get_buf_len(self->read_buf, &buf_len);
-    svx_circlebuf_get_freespace_ptr(self->read_buf, (uint8_t **)(&(iov[0].iov_base)), &(iov[0].iov_len),
-                                    (uint8_t **)(&(iov[1].iov_base)), &(iov[1].iov_len));
-    freespace_len = iov[0].iov_len + iov[1].iov_len;
+    self->timeout_check_ms = when_ms;
+    return svx_looper_wheel_add(self->looper, &(self->timeout_entry), (when_ms > now_ms ? when_ms - now_ms : 0));
+}
 
-    if((buf_len != freespace_len) || (NULL == iov[0].iov_base && NULL == iov[1].iov_base))
-        SVX_LOG_ERRNO_GOTO_ERR(err, SVX_ERRNO_UNKNOWN, "You MUST always take out all data from the buffer on each read-callback. fd:%d\n", self->fd);
+/* refresh the timestamps of the activities, they are only read when the timeout entry is run */
+static void svx_tcp_connection_touch_read(svx_tcp_connection_t *self)
+{
+    if(self->idle_timeout_ms > 0 || self->read_timeout_ms > 0)
+        self->last_read_ms = svx_tcp_connection_get_now_ms();
+}
 
-    if(freespace_len > self->read_buf_max_len)
-    {
-        SVX_LOG_ERRNO_GOTO_ERR(err, SVX_ERRNO_UNKNOWN, "fd:%d\n", self->fd);
-    }
-    else if(freespace_len == self->read_buf_max_len)
-    {
-        /* read_buf reached the max_len limit, so do not use the extra_buf */
-        iov_cnt = (NULL == iov[1].iov_base ? 1 : 2);
-    }
-    else
-    {
-        extra_buf_len = ((self->read_buf_max_len - freespace_len) < sizeof(extra_buf) ?
-                         (self->read_buf_max_len - freespace_len) : sizeof(extra_buf));
-        if(NULL == iov[1].iov_base)
-        {
-            iov[1].iov_base = extra_buf;
-            iov[1].iov_len  = extra_buf_len;
-            iov_cnt = 2;
-        }
-        else
-        {
-            iov[2].iov_base = extra_buf;
-            iov[2].iov_len  = extra_buf_len;
-            iov_cnt = 3;
-        }
-    }
+static void svx_tcp_connection_touch_write(svx_tcp_connection_t *self)
+{
+    if(self->idle_timeout_ms > 0 || self->write_timeout_ms > 0)
+        self->last_write_ms = svx_tcp_connection_get_now_ms();
+}
 
-    /* read data */
-    do n = readv(self->fd, iov, iov_cnt);
-    while(-1 == n && EINTR == errno);
+/* watch the read event only if the reading is enabled by user, and it is not paused by the write flow control or the rate limit */
+static int svx_tcp_connection_update_read_event(svx_tcp_connection_t *self)
+{
+    uint8_t channel_events = 0;
 
-    if(n < 0)
-    {
-        if(EAGAIN == errno || EWOULDBLOCK == errno) return;
+    svx_channel_get_events(self->channel, &channel_events);
 
-        if(ECONNRESET == errno)
-            SVX_LOG_ERRNO_GOTO_NOTICE(err, errno, "readv() error. fd:%d\n", self->fd);
-        else
-            SVX_LOG_ERRNO_GOTO_ERR(err, errno, "readv() error. fd:%d\n", self->fd);
-    }
-    else if(0 == n)
+    if(self->read_enable && !self->flow_paused && !self->offload_paused && !self->read_parked)
     {
-        /* FIN has arrived */
-        svx_tcp_connection_handle_close(self);
+        if(0 == (channel_events & SVX_CHANNEL_EVENT_READ))
+        {
+            /* the read timeout is counted from now on */
+            svx_tcp_connection_touch_read(self);
+            return svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_READ);
+        }
     }
     else
     {
-        /* read OK */
-        if((size_t)n <= freespace_len)
-        {
-            /* extra_buf not used*/
-            svx_circlebuf_commit_data(self->read_buf, (size_t)n);
-        }
-        else
-        {
-            /* extra_buf used*/
-            svx_circlebuf_commit_data(self->read_buf, freespace_len);
-            if(0 != (r = svx_circlebuf_append_data(self->read_buf, (uint8_t *)extra_buf, (size_t)n - freespace_len)))
-                SVX_LOG_ERRNO_GOTO_ERR(err, r, "append_data() error. fd:%d\n", self->fd);
-        }
-
-        /* callback */
-        if(self->callbacks->read_cb)
-            self->callbacks->read_cb(self, self->read_buf, self->callbacks->read_cb_arg);
-        else
-            svx_circlebuf_erase_all_data(self->read_buf);
+        if(channel_events & SVX_CHANNEL_EVENT_READ)
+            return svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_READ);
     }
 
-    return;
+    return 0;
+}
 
- err:
-    svx_tcp_connection_handle_close(self);    
+/* the available tokens of the rate limit, INT64_MAX if there is no limit */
+static int64_t svx_tcp_connection_get_tokens(svx_token_bucket_t *bucket, svx_token_bucket_t *shared_bucket)
+{
+    int64_t tokens        = INT64_MAX;
+    int64_t shared_tokens = INT64_MAX;
+
+    if(bucket)        svx_token_bucket_get_tokens(bucket, &tokens);
+    if(shared_bucket) svx_token_bucket_get_tokens(shared_bucket, &shared_tokens);
+
+    return (tokens < shared_tokens ? tokens : shared_tokens);
 }
 
-static void svx_tcp_connection_handle_write(void *arg)
+static void svx_tcp_connection_consume_tokens(svx_token_bucket_t *bucket, svx_token_bucket_t *shared_bucket, size_t n)
 {
-    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
-    struct iovec          iov[2];
-    size_t                data_len;
-    ssize_t               n;
-    int                   r;
+    if(bucket)        svx_token_bucket_consume(bucket, n);
+    if(shared_bucket) svx_token_bucket_consume(shared_bucket, n);
+}
 
-    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state) return;
+/* wait until both token buckets are refilled */
+static int svx_tcp_connection_park(svx_tcp_connection_t *self, svx_token_bucket_t *bucket, svx_token_bucket_t *shared_bucket)
+{
+    int64_t now_ms;
+    int64_t wait_ms        = 0;
+    int64_t shared_wait_ms = 0;
 
-    svx_circlebuf_get_data_ptr(self->write_buf, (uint8_t **)(&(iov[0].iov_base)), &(iov[0].iov_len),
-                               (uint8_t **)(&(iov[1].iov_base)), &(iov[1].iov_len));
-    data_len = iov[0].iov_len + iov[1].iov_len;
+    if(bucket)        svx_token_bucket_get_wait_ms(bucket, &wait_ms);
+    if(shared_bucket) svx_token_bucket_get_wait_ms(shared_bucket, &shared_wait_ms);
+    if(wait_ms < shared_wait_ms) wait_ms = shared_wait_ms;
 
-    /* no data need to write */
-    if(0 == data_len)
-    {
-        if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
-            SVX_LOG_ERRNO_GOTO_ERR(err, r, "del_events() error. fd:%d\n", self->fd);
-        return;
-    }
+    now_ms = svx_tcp_connection_get_now_ms();
 
-    /* write data */
-    do n = writev(self->fd, iov, (NULL == iov[1].iov_base) ? 1 : 2);
-    while(-1 == n && EINTR == errno);
+    /* the reading and the writing share one entry in the looper's timer wheel, keep the earlier one */
+    if(svx_looper_wheel_is_pending(&(self->unpark_entry)) && self->unpark_ms <= now_ms + wait_ms) return 0;
 
-    if(n < 0)
-    {
-        if(EAGAIN == errno || EWOULDBLOCK == errno) return;
+    self->unpark_ms = now_ms + wait_ms;
+    return svx_looper_wheel_add(self->looper, &(self->unpark_entry), wait_ms);
+}
 
-        /* error */
-        SVX_LOG_ERRNO_GOTO_ERR(err, errno, "writev() error. fd:%d\n", self->fd);
-    }
-    else if(n > 0)
-    {
-        /* write OK */
-        svx_circlebuf_erase_data(self->write_buf, n);
+/* the writing is limited, so the data can NOT be written directly in the calling function */
+static int svx_tcp_connection_is_write_limited(svx_tcp_connection_t *self)
+{
+    return (NULL != self->write_bucket || NULL != self->write_shared_bucket);
+}
 
-        if((size_t)n == data_len)
-        {
-            if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
-                SVX_LOG_ERRNO_GOTO_ERR(err, r, "del_events() error. fd:%d\n", self->fd);
-            
-            if(SVX_TCP_CONNECTION_STATE_DISCONNECTING == self->state)
-                shutdown(self->fd, SHUT_WR);
+/* cut the iovec array to no more than limit bytes, return the new count */
+static int svx_tcp_connection_limit_iov(struct iovec *iov, int iov_cnt, size_t limit)
+{
+    int i;
 
-            if(self->callbacks->write_completed_cb && self->write_completed_enable)
-            {
-                svx_tcp_connection_add_ref(self);
-                svx_tcp_connection_write_completed_callback_param_t p = {self};
-                svx_looper_dispatch(self->looper, svx_tcp_connection_write_completed_callback_run,
-                                    svx_tcp_connection_write_completed_callback_clean, &p, sizeof(p));
-            }
+    for(i = 0; i < iov_cnt; i++)
+    {
+        if(iov[i].iov_len >= limit)
+        {
+            iov[i].iov_len = limit;
+            return i + 1;
         }
+        limit -= iov[i].iov_len;
     }
 
-    return;
-
- err:
-    svx_tcp_connection_handle_close(self);    
+    return iov_cnt;
 }
 
-int svx_tcp_connection_create(svx_tcp_connection_t **self, svx_looper_t *looper, int fd,
-                              size_t read_buf_min_len, size_t read_buf_max_len,
-                              size_t write_buf_min_len, size_t write_buf_high_water_mark,
-                              svx_tcp_connection_callbacks_t *callbacks,
-                              svx_tcp_connection_remove_cb_t remove_cb, void *remove_cb_arg,
-                              void *info)
-{
-    int r = 0;
-    
-    if(NULL == self || NULL == looper || fd < 0 ||
-       0 == read_buf_min_len || 0 == read_buf_max_len || read_buf_min_len > read_buf_max_len ||
-       0 == write_buf_min_len || 0 == write_buf_high_water_mark || write_buf_min_len > write_buf_high_water_mark || NULL == callbacks || NULL == remove_cb)
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, fd:%d, read_buf_min_len:%zu, "
-                                 "read_buf_max_len:%zu, write_buf_min_len:%zu, write_buf_high_water_mark:%zu, callbacks:%p, remove_cb:%p\n",
-                                 self, looper, fd, read_buf_min_len, read_buf_max_len, write_buf_min_len, write_buf_high_water_mark, callbacks, remove_cb);
+static void svx_tcp_connection_handle_close_by(svx_tcp_connection_t *self, svx_tcp_connection_close_reason_t reason);
 
-    if(NULL == (*self = malloc(sizeof(svx_tcp_connection_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
-    (*self)->state                     = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
-    (*self)->ref_count                 = 1;
-    (*self)->looper                    = looper;
-    (*self)->channel                   = NULL;
-    (*self)->fd                        = fd;
-    (*self)->read_buf                  = NULL;
-    (*self)->read_buf_max_len          = read_buf_max_len;
-    (*self)->write_buf                 = NULL;
-    (*self)->write_buf_high_water_mark = write_buf_high_water_mark;
-    (*self)->callbacks                 = callbacks;
-    (*self)->write_completed_enable    = 1;
-    (*self)->high_water_mark_enable    = 1;
-    (*self)->remove_cb                 = remove_cb;
-    (*self)->remove_cb_arg             = remove_cb_arg;
-    (*self)->context                   = NULL;
-    (*self)->info                      = info;
+/* pause or resume the reading according to the unsent data length, close the connection at the hard cap */
+static int svx_tcp_connection_check_flow_control(svx_tcp_connection_t *self)
+{
+    size_t unsent_len;
+    int    r;
 
-    if(0 != (r = svx_channel_create(&((*self)->channel), (*self)->looper, (*self)->fd, SVX_CHANNEL_EVENT_NULL)))
-        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    if(self->flow_aborted) return SVX_ERRNO_REACH;
+    if(0 == self->flow_high_mark || SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return 0;
 
-    if(0 != (r = svx_channel_set_read_callback((*self)->channel, svx_tcp_connection_handle_read, *self)))
-        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    svx_circlebuf_get_data_len(self->write_buf, &unsent_len);
+    unsent_len += self->wsegs_len;
 
-    if(0 != (r = svx_channel_set_write_callback((*self)->channel, svx_tcp_connection_handle_write, *self)))
-        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    if(self->flow_hard_cap > 0 && unsent_len > self->flow_hard_cap)
+    {
+        self->flow_aborted = 1;
+        if(self->flow_stats) __sync_add_and_fetch(&(self->flow_stats->aborted), 1);
+        SVX_LOG_ERRNO_NOTICE(SVX_ERRNO_REACH, "write hard cap reached, close it. fd:%d, unsent:%zu, hard_cap:%zu\n",
+                             self->fd, unsent_len, self->flow_hard_cap);
+
+        /* do not let the peer hold the unsent data any longer */
+        svx_tcp_connection_handle_close_by(self, SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_HARD_CAP);
+        return SVX_ERRNO_REACH;
+    }
+    else if(!self->flow_paused && unsent_len >= self->flow_high_mark)
+    {
+        self->flow_paused = 1;
+        if(self->flow_stats) __sync_add_and_fetch(&(self->flow_stats->paused), 1);
+        if(0 != (r = svx_tcp_connection_update_read_event(self)))
+            SVX_LOG_ERRNO_ERR(r, "update_read_event() error. fd:%d\n", self->fd);
+    }
+    else if(self->flow_paused && unsent_len <= self->flow_low_mark)
+    {
+        self->flow_paused = 0;
+        if(self->flow_stats) __sync_add_and_fetch(&(self->flow_stats->resumed), 1);
+        if(0 != (r = svx_tcp_connection_update_read_event(self)))
+            SVX_LOG_ERRNO_ERR(r, "update_read_event() error. fd:%d\n", self->fd);
+    }
 
-    if(0 != (r = svx_circlebuf_create(&((*self)->read_buf), read_buf_max_len, read_buf_min_len, SVX_TCP_CONNECTION_READ_BUF_MIN_STEP)))
-        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    return 0;
+}
 
-    if(0 != (r = svx_circlebuf_create(&((*self)->write_buf), 0, write_buf_min_len, SVX_TCP_CONNECTION_WRITE_BUF_MIN_STEP)))
-        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+static int svx_tcp_connection_check_high_water_mark(svx_tcp_connection_t *self, size_t data_len_old)
+{
+    size_t data_len_new = 0;
+    int64_t now_ms;
+    int     r;
 
-    return 0;
+    /* the write timeout is counted from the moment the data is queued */
+    if(0 == data_len_old && self->write_timeout_ms > 0)
+    {
+        now_ms = svx_tcp_connection_get_now_ms();
+        self->last_write_ms = now_ms;
+        if(0 != (r = svx_tcp_connection_schedule_timeout(self, now_ms + self->write_timeout_ms, now_ms)))
+            SVX_LOG_ERRNO_ERR(r, "schedule_timeout() error. fd:%d\n", self->fd);
+    }
 
- err:
-    if(*self)
+    if(self->callbacks->high_water_mark_cb && self->high_water_mark_enable)
     {
-        if((*self)->channel)   svx_channel_destroy(&((*self)->channel));
-        if((*self)->read_buf)  svx_circlebuf_destroy(&((*self)->read_buf));
-        if((*self)->write_buf) svx_circlebuf_destroy(&((*self)->write_buf));
-        free(*self);
-        *self = NULL;
+        svx_circlebuf_get_data_len(self->write_buf, &data_len_new);
+        data_len_new += self->wsegs_len;
+
+        if(data_len_new >= self->write_buf_high_water_mark && data_len_old < self->write_buf_high_water_mark)
+        {
+            svx_tcp_connection_add_ref(self);
+            svx_tcp_connection_high_water_mark_callback_param_t p = {self, data_len_new};
+            svx_looper_dispatch(self->looper, svx_tcp_connection_high_water_mark_callback_run,
+                                svx_tcp_connection_high_water_mark_callback_clean, &p, sizeof(p));
+        }
     }
 
-    return r;
+    return svx_tcp_connection_check_flow_control(self);
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_destroy, svx_tcp_connection_t *, self)
-int svx_tcp_connection_destroy(svx_tcp_connection_t *self)
+/* the length of all unsent data (in write_buf and wsegs) */
+static size_t svx_tcp_connection_get_unsent_len(svx_tcp_connection_t *self)
 {
-    int r;
-    
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    size_t data_len = 0;
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_destroy, self);
+    svx_circlebuf_get_data_len(self->write_buf, &data_len);
+    return data_len + self->wsegs_len;
+}
 
-    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
-    if(0 != (r = svx_circlebuf_destroy(&(self->read_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(0 != (r = svx_circlebuf_destroy(&(self->write_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(0 != (r = svx_channel_destroy(&(self->channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(self->fd >= 0) if(0 != close(self->fd)) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
-    
-    if(self->callbacks->closed_cb)
-        self->callbacks->closed_cb(self, self->callbacks->closed_cb_arg);
-    
-    free(self);
+static int svx_tcp_connection_add_wseg(svx_tcp_connection_t *self, const uint8_t *buf, size_t len, size_t sent,
+                                       svx_tcp_connection_free_cb_t free_cb, void *free_cb_arg)
+{
+    svx_tcp_connection_wseg_t *wseg     = NULL;
+    size_t                     data_len = 0;
+
+    if(NULL == (wseg = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, sizeof(svx_tcp_connection_wseg_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+
+    svx_circlebuf_get_data_len(self->write_buf, &data_len);
+    wseg->copy_before      = data_len - self->wsegs_copy_len;
+    wseg->buf              = buf;
+    wseg->len              = len;
+    wseg->sent             = sent;
+    wseg->free_cb          = free_cb;
+    wseg->free_cb_arg      = free_cb_arg;
+    wseg->zerocopy         = 0;
+    wseg->zerocopy_id      = 0;
+    wseg->zerocopy_cnt     = 0;
+    wseg->zerocopy_pending = 0;
+    wseg->file_fd          = -1;
+    wseg->file_offset      = 0;
+    wseg->file_done_cb     = NULL;
+    wseg->file_done_cb_arg = NULL;
+    wseg->file_errnum      = 0;
+    wseg->stream_cb        = NULL;
+    wseg->stream_cb_arg    = NULL;
+    wseg->stream_conn      = NULL;
+    wseg->stream_eof       = 0;
+    TAILQ_INSERT_TAIL(&(self->wsegs), wseg, link);
+    self->wsegs_len      += (len - sent);
+    self->wsegs_copy_len += wseg->copy_before;
 
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_start, svx_tcp_connection_t *, self)
-int svx_tcp_connection_start(svx_tcp_connection_t *self)
+static int svx_tcp_connection_add_file_wseg(svx_tcp_connection_t *self, int fd, off_t offset, size_t len,
+                                            svx_tcp_connection_sendfile_done_cb_t done_cb, void *done_cb_arg)
 {
-    int r = 0;
-
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    svx_tcp_connection_wseg_t *wseg = NULL;
+    int                        r;
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_start, self);
-
-    if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_READ)))
-        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_tcp_connection_add_wseg(self, NULL, len, 0, NULL, NULL))) return r;
 
-    self->state = SVX_TCP_CONNECTION_STATE_CONNECTED;
-
-    if(self->callbacks->established_cb)
-        self->callbacks->established_cb(self, self->callbacks->established_cb_arg);
+    wseg = TAILQ_LAST(&(self->wsegs), svx_tcp_connection_wseg_queue);
+    wseg->zerocopy         = 0;
+    wseg->file_fd          = fd;
+    wseg->file_offset      = offset;
+    wseg->file_done_cb     = done_cb;
+    wseg->file_done_cb_arg = done_cb_arg;
 
     return 0;
 }
 
-int svx_tcp_connection_get_local_addr(svx_tcp_connection_t *self, svx_inetaddr_t *addr)
+static int svx_tcp_connection_add_stream_wseg(svx_tcp_connection_t *self, uint8_t *buf,
+                                              svx_tcp_connection_produce_cb_t produce_cb, void *produce_cb_arg)
 {
-    int r;
-    
-    if(NULL == self || NULL == addr)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, addr:%p\n", self, addr);
+    svx_tcp_connection_wseg_t *wseg = NULL;
+    int                        r;
 
-    if(0 != (r = svx_inetaddr_from_fd_local(addr, self->fd))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    /* the stream buffer is empty now, it will be filled when the stream reaches the head of wsegs */
+    if(0 != (r = svx_tcp_connection_add_wseg(self, buf, 0, 0, NULL, NULL))) return r;
+
+    wseg = TAILQ_LAST(&(self->wsegs), svx_tcp_connection_wseg_queue);
+    wseg->zerocopy      = 0;
+    wseg->stream_cb     = produce_cb;
+    wseg->stream_cb_arg = produce_cb_arg;
+    wseg->stream_conn   = self;
 
     return 0;
 }
 
-int svx_tcp_connection_get_peer_addr(svx_tcp_connection_t *self, svx_inetaddr_t *addr)
+/* release the buffer (or notify the end of the file sending or the stream) and free the wseg */
+static void svx_tcp_connection_free_wseg(svx_tcp_connection_wseg_t *wseg, int errnum)
 {
-    int r;
+    if(wseg->stream_cb)
+    {
+        /* the stream is aborted, let the producer release its resources */
+        if(!wseg->stream_eof)
+            wseg->stream_cb(wseg->stream_conn, NULL, 0, NULL, NULL, wseg->stream_cb_arg);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, (uint8_t *)wseg->buf);
+    }
+    else if(wseg->file_fd >= 0)
+    {
+        if(wseg->file_done_cb)
+            wseg->file_done_cb(wseg->file_fd, (wseg->sent == wseg->len ? 0 : (wseg->file_errnum ? wseg->file_errnum : errnum)),
+                               wseg->file_done_cb_arg);
+    }
+    else
+    {
+        if(wseg->free_cb) wseg->free_cb((uint8_t *)wseg->buf, wseg->free_cb_arg);
+    }
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, wseg);
+}
+
+static void svx_tcp_connection_release_wsegs(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_wseg_t *wseg = NULL, *tmp = NULL;
+
+    TAILQ_FOREACH_SAFE(wseg, &(self->wsegs), link, tmp)
+    {
+        TAILQ_REMOVE(&(self->wsegs), wseg, link);
+        if(wseg->zerocopy_pending > 0)
+        {
+            /* the kernel may still be transmitting the pages of the buffer, release it after the completion */
+            TAILQ_INSERT_TAIL(&(self->zerocopy_wsegs), wseg, link);
+        }
+        else
+        {
+            svx_tcp_connection_free_wseg(wseg, SVX_ERRNO_NOTCONN);
+        }
+    }
+    self->wsegs_len      = 0;
+    self->wsegs_copy_len = 0;
+}
+
+/* add the data in range [offset, offset + len) of write_buf to iov */
+static int svx_tcp_connection_add_write_buf_iov(svx_tcp_connection_t *self, struct iovec *iov, int iov_cnt,
+                                                size_t offset, size_t len)
+{
+    uint8_t *buf1 = NULL, *buf2 = NULL;
+    size_t   buf1_len = 0, buf2_len = 0;
+    size_t   n;
+
+    if(0 == len) return iov_cnt;
+
+    svx_circlebuf_get_data_ptr(self->write_buf, &buf1, &buf1_len, &buf2, &buf2_len);
+
+    if(offset < buf1_len)
+    {
+        n = (len < buf1_len - offset ? len : buf1_len - offset);
+        iov[iov_cnt].iov_base = buf1 + offset;
+        iov[iov_cnt].iov_len  = n;
+        iov_cnt++;
+        len   -= n;
+        offset = 0;
+    }
+    else
+    {
+        offset -= buf1_len;
+    }
+
+    if(len > 0 && iov_cnt < SVX_TCP_CONNECTION_WRITE_IOV_CNT)
+    {
+        iov[iov_cnt].iov_base = buf2 + offset;
+        iov[iov_cnt].iov_len  = len;
+        iov_cnt++;
+    }
+
+    return iov_cnt;
+}
+
+/* remove the sent data from write_buf and wsegs */
+static void svx_tcp_connection_erase_sent(svx_tcp_connection_t *self, size_t n)
+{
+    svx_tcp_connection_wseg_t *wseg = NULL;
+    size_t                     k;
+
+    while(n > 0 && NULL != (wseg = TAILQ_FIRST(&(self->wsegs))))
+    {
+        k = (n < wseg->copy_before ? n : wseg->copy_before);
+        if(k > 0) svx_circlebuf_erase_data(self->write_buf, k);
+        wseg->copy_before    -= k;
+        self->wsegs_copy_len -= k;
+        n                    -= k;
+        if(wseg->copy_before > 0) break;
+
+        k = (n < wseg->len - wseg->sent ? n : wseg->len - wseg->sent);
+        wseg->sent      += k;
+        self->wsegs_len -= k;
+        n               -= k;
+        if(wseg->sent < wseg->len) break;
+        if(wseg->stream_cb && !wseg->stream_eof) break; /* it will be refilled */
+
+        TAILQ_REMOVE(&(self->wsegs), wseg, link);
+        if(wseg->zerocopy_pending > 0)
+        {
+            /* the buffer can NOT be released until the kernel completion */
+            TAILQ_INSERT_TAIL(&(self->zerocopy_wsegs), wseg, link);
+        }
+        else
+        {
+            svx_tcp_connection_free_wseg(wseg, 0);
+        }
+    }
+
+    if(n > 0) svx_circlebuf_erase_data(self->write_buf, n);
+}
+
+/* decide whether to send a buffer by MSG_ZEROCOPY */
+static int svx_tcp_connection_use_zerocopy(svx_tcp_connection_t *self, size_t len)
+{
+    if(0 == self->zerocopy_threshold || len < self->zerocopy_threshold) return 0;
+
+    /* the kernel copied the data recently, send some buffers by copying before trying again */
+    if(self->zerocopy_skip > 0)
+    {
+        self->zerocopy_skip--;
+        return 0;
+    }
+
+    return 1;
+}
+
+/* the wseg will be sent by MSG_ZEROCOPY */
+static int svx_tcp_connection_is_zerocopy(svx_tcp_connection_t *self, svx_tcp_connection_wseg_t *wseg)
+{
+    return (wseg->zerocopy && self->zerocopy_threshold > 0);
+}
+
+/* the wseg can NOT be sent by writev() with other data */
+static int svx_tcp_connection_is_sent_alone(svx_tcp_connection_t *self, svx_tcp_connection_wseg_t *wseg)
+{
+    return (wseg->file_fd >= 0 || svx_tcp_connection_is_zerocopy(self, wseg));
+}
+
+/* send the rest of the file range (no more than limit bytes) by sendfile() */
+static ssize_t svx_tcp_connection_send_file(svx_tcp_connection_t *self, svx_tcp_connection_wseg_t *wseg, size_t limit)
+{
+    off_t   offset = wseg->file_offset + (off_t)wseg->sent;
+    ssize_t n;
+
+    do n = sendfile(self->fd, wseg->file_fd, &offset, limit);
+    while(-1 == n && EINTR == errno);
+
+    if(n < 0 && EAGAIN != errno && EWOULDBLOCK != errno)
+    {
+        wseg->file_errnum = errno;
+    }
+    else if(0 == n)
+    {
+        /* the file is shorter than expected */
+        wseg->file_errnum = SVX_ERRNO_NODATA;
+        errno = SVX_ERRNO_NODATA;
+        n = -1;
+    }
+
+    return n;
+}
+
+/* send the rest of the wseg (no more than limit bytes) by MSG_ZEROCOPY */
+static ssize_t svx_tcp_connection_send_zerocopy(svx_tcp_connection_t *self, svx_tcp_connection_wseg_t *wseg, size_t limit)
+{
+    ssize_t n;
+
+#if SVX_HAVE_MSG_ZEROCOPY
+    do n = send(self->fd, wseg->buf + wseg->sent, limit, MSG_ZEROCOPY);
+    while(-1 == n && EINTR == errno);
+
+    if(n > 0)
+    {
+        /* the kernel assigns a sequential id (starts from 0) for each successful MSG_ZEROCOPY send() */
+        if(0 == wseg->zerocopy_cnt) wseg->zerocopy_id = self->zerocopy_next_id;
+        wseg->zerocopy_cnt++;
+        wseg->zerocopy_pending++;
+        self->zerocopy_next_id++;
+        self->zerocopy_pending++;
+
+        /* the completion may not wake up the poller (e.g. both reading and writing are off) */
+        if(!svx_looper_wheel_is_pending(&(self->zerocopy_entry)))
+            svx_looper_wheel_add(self->looper, &(self->zerocopy_entry), SVX_TCP_CONNECTION_ZEROCOPY_REAP_MS);
+        return n;
+    }
+    else if(-1 == n && ENOBUFS == errno)
+    {
+        /* exceeded the optmem limit, send this part by copying */
+    }
+    else
+    {
+        return n;
+    }
+#endif
+
+    do n = write(self->fd, wseg->buf + wseg->sent, limit);
+    while(-1 == n && EINTR == errno);
+
+    return n;
+}
+
+/* release all the wsegs in the queue */
+static void svx_tcp_connection_free_wsegs(svx_tcp_connection_wseg_queue_t *wsegs, int errnum)
+{
+    svx_tcp_connection_wseg_t *wseg = NULL, *tmp = NULL;
+
+    TAILQ_FOREACH_SAFE(wseg, wsegs, link, tmp)
+    {
+        TAILQ_REMOVE(wsegs, wseg, link);
+        svx_tcp_connection_free_wseg(wseg, errnum);
+    }
+}
+
+#if SVX_HAVE_MSG_ZEROCOPY
+/* the MSG_ZEROCOPY send() in range [lo, hi] have been completed, return the count of completed send() of the wseg */
+static uint32_t svx_tcp_connection_complete_zerocopy_wseg(svx_tcp_connection_wseg_t *wseg, uint32_t lo, uint32_t hi)
+{
+    int64_t first, last;
+
+    if(0 == wseg->zerocopy_pending) return 0;
+
+    /* the ids are wrapped around at 2^32, so compare them relatively */
+    first = (int32_t)(lo - wseg->zerocopy_id);
+    last  = (int32_t)(hi - wseg->zerocopy_id);
+    if(first < 0) first = 0;
+    if(last > (int64_t)wseg->zerocopy_cnt - 1) last = (int64_t)wseg->zerocopy_cnt - 1;
+    if(first > last) return 0;
+
+    wseg->zerocopy_pending -= (uint32_t)(last - first + 1);
+    return (uint32_t)(last - first + 1);
+}
+
+/* the MSG_ZEROCOPY send() in range [lo, hi] have been completed, release the buffers which the kernel no longer uses */
+static void svx_tcp_connection_complete_zerocopy(svx_tcp_connection_wseg_t *head, svx_tcp_connection_wseg_queue_t *wsegs,
+                                                 uint32_t *pending, uint32_t lo, uint32_t hi)
+{
+    svx_tcp_connection_wseg_t *wseg = NULL, *tmp = NULL;
+
+    /* the partially sent wseg */
+    if(NULL != head)
+        *pending -= svx_tcp_connection_complete_zerocopy_wseg(head, lo, hi);
+
+    TAILQ_FOREACH_SAFE(wseg, wsegs, link, tmp)
+    {
+        *pending -= svx_tcp_connection_complete_zerocopy_wseg(wseg, lo, hi);
+        if(0 == wseg->zerocopy_pending)
+        {
+            TAILQ_REMOVE(wsegs, wseg, link);
+            svx_tcp_connection_free_wseg(wseg, 0);
+        }
+    }
+}
+
+/* read the MSG_ZEROCOPY completion notifications from the socket error queue,
+   set *copied to 1 if the kernel copied the data anyway, or 0 if it did not */
+static void svx_tcp_connection_read_zerocopy(int fd, svx_tcp_connection_wseg_t *head, svx_tcp_connection_wseg_queue_t *wsegs,
+                                             uint32_t *pending, int *copied)
+{
+    struct msghdr             msg;
+    struct cmsghdr           *cmsg;
+    struct sock_extended_err *serr;
+    union
+    {
+        char                  buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct cmsghdr        align;
+    } control;
+    ssize_t                   n;
+
+    while(*pending > 0)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        do n = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        while(-1 == n && EINTR == errno);
+
+        if(n < 0)
+        {
+            /* other socket errors will be handled in handle_read() and handle_write() */
+            if(EAGAIN != errno && EWOULDBLOCK != errno)
+                SVX_LOG_ERRNO_ERR(errno, "recvmsg() error. fd:%d\n", fd);
+            return;
+        }
+
+        for(cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if(!(SOL_IP == cmsg->cmsg_level && IP_RECVERR == cmsg->cmsg_type) &&
+               !(SOL_IPV6 == cmsg->cmsg_level && IPV6_RECVERR == cmsg->cmsg_type)) continue;
+
+            serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if(SO_EE_ORIGIN_ZEROCOPY != serr->ee_origin || 0 != serr->ee_errno) continue;
+
+            if(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                *copied = 1;
+            else if(*copied < 0)
+                *copied = 0;
+
+            svx_tcp_connection_complete_zerocopy(head, wsegs, pending, serr->ee_info, serr->ee_data);
+        }
+    }
+}
+#endif
+
+/* reap the MSG_ZEROCOPY completion notifications of the connection */
+static void svx_tcp_connection_reap_zerocopy(void *arg)
+{
+#if SVX_HAVE_MSG_ZEROCOPY
+    svx_tcp_connection_t *self   = (svx_tcp_connection_t *)arg;
+    int                   copied = -1;
+
+    if(0 == self->zerocopy_pending) return;
+
+    svx_tcp_connection_read_zerocopy(self->fd, TAILQ_FIRST(&(self->wsegs)), &(self->zerocopy_wsegs),
+                                     &(self->zerocopy_pending), &copied);
+
+    if(1 == copied)
+    {
+        /* the kernel copied the data anyway (e.g. loopback), so MSG_ZEROCOPY is only an overhead for a while */
+        self->zerocopy_backoff = (0 == self->zerocopy_backoff ? 1 : self->zerocopy_backoff * 2);
+        if(self->zerocopy_backoff > SVX_TCP_CONNECTION_ZEROCOPY_SKIP_MAX)
+            self->zerocopy_backoff = SVX_TCP_CONNECTION_ZEROCOPY_SKIP_MAX;
+        self->zerocopy_skip = self->zerocopy_backoff;
+    }
+    else if(0 == copied)
+    {
+        self->zerocopy_backoff = 0;
+    }
+
+    if(0 == self->zerocopy_pending)
+        svx_looper_wheel_del(self->looper, &(self->zerocopy_entry));
+    else if(!svx_looper_wheel_is_pending(&(self->zerocopy_entry)))
+        svx_looper_wheel_add(self->looper, &(self->zerocopy_entry), SVX_TCP_CONNECTION_ZEROCOPY_REAP_MS);
+#else
+    (void)arg;
+#endif
+}
+
+static void svx_tcp_connection_handle_error(void *arg)
+{
+    svx_tcp_connection_reap_zerocopy(arg);
+}
+
+/* the fd and the buffers of a destroyed connection, which are still used by the kernel for MSG_ZEROCOPY */
+typedef struct
+{
+    svx_looper_t                    *looper;
+    int                              fd;
+    svx_tcp_connection_wseg_queue_t  wsegs;
+    uint32_t                         pending;
+    int64_t                          deadline_ms;
+} svx_tcp_connection_linger_t;
+
+static void svx_tcp_connection_linger_finish(void *arg)
+{
+    svx_tcp_connection_linger_t *linger = (svx_tcp_connection_linger_t *)arg;
+
+    if(linger->pending > 0)
+        SVX_LOG_WARNING("MSG_ZEROCOPY completions are lost, release the buffers anyway. fd:%d, pending:%"PRIu32"\n",
+                        linger->fd, linger->pending);
+
+    svx_tcp_connection_free_wsegs(&(linger->wsegs), 0);
+    if(0 != close(linger->fd)) SVX_LOG_ERRNO_ERR(errno, "close() error. fd:%d\n", linger->fd);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, linger);
+}
+
+static void svx_tcp_connection_linger_run(void *arg)
+{
+    svx_tcp_connection_linger_t *linger = (svx_tcp_connection_linger_t *)arg;
+#if SVX_HAVE_MSG_ZEROCOPY
+    int                          copied = -1;
+
+    svx_tcp_connection_read_zerocopy(linger->fd, NULL, &(linger->wsegs), &(linger->pending), &copied);
+#endif
+
+    if(linger->pending > 0 && svx_tcp_connection_get_now_ms() < linger->deadline_ms)
+        if(0 == svx_looper_run_after(linger->looper, svx_tcp_connection_linger_run, svx_tcp_connection_linger_finish,
+                                     linger, SVX_TCP_CONNECTION_ZEROCOPY_REAP_MS, NULL)) return;
+
+    svx_tcp_connection_linger_finish(linger);
+}
+
+/* keep the fd open and the buffers alive until the kernel completes all the MSG_ZEROCOPY send() */
+static void svx_tcp_connection_linger(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_linger_t *linger = NULL;
+
+    svx_looper_wheel_del(self->looper, &(self->zerocopy_entry));
+    if(0 == self->zerocopy_pending || self->fd < 0) return;
+
+    if(NULL == (linger = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, sizeof(svx_tcp_connection_linger_t))))
+    {
+        SVX_LOG_ERRNO_ERR(SVX_ERRNO_NOMEM, "release the MSG_ZEROCOPY buffers anyway. fd:%d\n", self->fd);
+        svx_tcp_connection_free_wsegs(&(self->zerocopy_wsegs), 0);
+        self->zerocopy_pending = 0;
+        return;
+    }
+
+    linger->looper      = self->looper;
+    linger->fd          = self->fd;
+    TAILQ_INIT(&(linger->wsegs));
+    TAILQ_CONCAT(&(linger->wsegs), &(self->zerocopy_wsegs), link);
+    linger->pending     = self->zerocopy_pending;
+    linger->deadline_ms = svx_tcp_connection_get_now_ms() + SVX_TCP_CONNECTION_ZEROCOPY_LINGER_MS;
+    self->fd               = -1;
+    self->zerocopy_pending = 0;
+
+    /* send the FIN after the queued data, the same as close() */
+    if(0 != shutdown(linger->fd, SHUT_WR) && ENOTCONN != errno)
+        SVX_LOG_ERRNO_ERR(errno, "shutdown() error. fd:%d\n", linger->fd);
+
+    svx_tcp_connection_linger_run(linger);
+}
+
+/* write all the data to a blocking fd */
+static int svx_tcp_connection_write_fd(int fd, const uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0)
+    {
+        do n = write(fd, buf, len);
+        while(-1 == n && EINTR == errno);
+        if(n <= 0) SVX_LOG_ERRNO_RETURN_ERR(n < 0 ? errno : SVX_ERRNO_UNKNOWN, "write() error. fd:%d\n", fd);
+
+        buf += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/* stop redirecting the received data to recv_fd */
+static void svx_tcp_connection_recv_to_fd_finish(svx_tcp_connection_t *self, int errnum)
+{
+    svx_tcp_connection_recv_to_fd_done_cb_t  done_cb     = self->recv_done_cb;
+    void                                    *done_cb_arg = self->recv_done_cb_arg;
+    int                                      fd          = self->recv_fd;
+
+    if(fd < 0) return;
+
+    if(self->recv_pipe_fds[0] >= 0) close(self->recv_pipe_fds[0]);
+    if(self->recv_pipe_fds[1] >= 0) close(self->recv_pipe_fds[1]);
+    self->recv_pipe_fds[0] = -1;
+    self->recv_pipe_fds[1] = -1;
+    self->recv_fd          = -1;
+    self->recv_remaining   = 0;
+    self->recv_done_cb     = NULL;
+    self->recv_done_cb_arg = NULL;
+
+    if(done_cb) done_cb(self, fd, errnum, done_cb_arg);
+}
+
+static void svx_tcp_connection_handle_close(svx_tcp_connection_t *self)
+{
+    int r;
+    
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return;
+    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
+
+    /* closed without a specific reason */
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_NONE == self->close_reason)
+        self->close_reason = SVX_TCP_CONNECTION_CLOSE_REASON_ERROR;
+
+    if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_ALL)))
+        SVX_LOG_ERRNO_ERR(r, "del_events() error. fd:%d\n", self->fd);
+
+    svx_looper_wheel_del(self->looper, &(self->unpark_entry));
+    svx_looper_wheel_del(self->looper, &(self->timeout_entry));
+
+    if(self->hooks.close_hook)
+        self->hooks.close_hook(self, self->hooks.arg);
+
+    svx_tcp_connection_recv_to_fd_finish(self, SVX_ERRNO_NOTCONN);
+
+    /* the unsent data will never be sent, release the buffers now */
+    svx_tcp_connection_release_wsegs(self);
+    
+    self->remove_cb(self, self->remove_cb_arg);
+}
+
+static void svx_tcp_connection_handle_close_by(svx_tcp_connection_t *self, svx_tcp_connection_close_reason_t reason)
+{
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_NONE == self->close_reason)
+        self->close_reason = reason;
+
+    svx_tcp_connection_handle_close(self);
+}
+
+/* closed by svx_tcp_connection_close() */
+static void svx_tcp_connection_handle_local_close(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_handle_close_by(self, SVX_TCP_CONNECTION_CLOSE_REASON_LOCAL);
+}
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_handle_local_close, svx_tcp_connection_t *, self)
+
+/* move the received data to recv_fd, one read per call (the same as handle_read) */
+static int svx_tcp_connection_recv_to_fd_read(svx_tcp_connection_t *self)
+{
+    uint8_t buf[SVX_TCP_CONNECTION_RECV_CHUNK_LEN];
+    size_t  want = (self->recv_remaining < sizeof(buf) ? (size_t)self->recv_remaining : sizeof(buf));
+    size_t  left;
+    ssize_t n = 0;
+    ssize_t m;
+    int     r;
+
+    /* all bytes have been received, it will be finished after the read callback */
+    if(0 == want) return 0;
+
+    if(self->recv_pipe_fds[0] >= 0)
+    {
+        /* socket ==> pipe */
+        do n = splice(self->fd, NULL, self->recv_pipe_fds[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        while(-1 == n && EINTR == errno);
+
+        if(-1 == n && EINVAL == errno)
+        {
+            /* splice() is not supported, fall back to copy mode */
+            SVX_LOG_ERRNO_NOTICE(errno, "splice() is not supported, use copy mode. fd:%d\n", self->fd);
+            close(self->recv_pipe_fds[0]);
+            close(self->recv_pipe_fds[1]);
+            self->recv_pipe_fds[0] = -1;
+            self->recv_pipe_fds[1] = -1;
+        }
+        else if(n > 0)
+        {
+            /* pipe ==> fd (the pipe is always drained before the next reading) */
+            for(left = (size_t)n; left > 0; left -= (size_t)m)
+            {
+                do m = splice(self->recv_pipe_fds[0], NULL, self->recv_fd, NULL, left, SPLICE_F_MOVE);
+                while(-1 == m && EINTR == errno);
+
+                if(-1 == m && EINVAL == errno)
+                {
+                    /* fd does not support splice(), copy the data in the pipe */
+                    do m = read(self->recv_pipe_fds[0], buf, left);
+                    while(-1 == m && EINTR == errno);
+                    if(m <= 0) SVX_LOG_ERRNO_RETURN_ERR(m < 0 ? errno : SVX_ERRNO_UNKNOWN, "read() pipe error. fd:%d\n", self->fd);
+                    if(0 != (r = svx_tcp_connection_write_fd(self->recv_fd, buf, (size_t)m))) return r;
+                }
+                else if(m <= 0)
+                {
+                    SVX_LOG_ERRNO_RETURN_ERR(m < 0 ? errno : SVX_ERRNO_UNKNOWN, "splice() error. fd:%d, recv_fd:%d\n", self->fd, self->recv_fd);
+                }
+            }
+            self->recv_remaining -= (uint64_t)n;
+            return 0;
+        }
+    }
+
+    if(self->recv_pipe_fds[0] < 0)
+    {
+        /* copy mode */
+        do n = read(self->fd, buf, want);
+        while(-1 == n && EINTR == errno);
+
+        if(n > 0)
+        {
+            if(0 != (r = svx_tcp_connection_write_fd(self->recv_fd, buf, (size_t)n))) return r;
+            self->recv_remaining -= (uint64_t)n;
+            return 0;
+        }
+    }
+
+    if(n < 0)
+    {
+        if(EAGAIN == errno || EWOULDBLOCK == errno) return 0;
+
+        if(ECONNRESET == errno)
+            SVX_LOG_ERRNO_RETURN_NOTICE(errno, "read() error. fd:%d\n", self->fd);
+        else
+            SVX_LOG_ERRNO_RETURN_ERR(errno, "read() error. fd:%d\n", self->fd);
+    }
+
+    /* FIN has arrived before all bytes are received */
+    SVX_LOG_ERRNO_RETURN_NOTICE(SVX_ERRNO_NODATA, "FIN arrived. fd:%d, remaining:%"PRIu64"\n", self->fd, self->recv_remaining);
+}
+
+/* reset the read quota at the first reading of each loop iteration */
+static void svx_tcp_connection_refill_read_quota(svx_tcp_connection_t *self)
+{
+    uint64_t iteration = 0;
+    size_t   quantum;
+
+    svx_looper_get_iteration(self->looper, &iteration);
+    if(iteration == self->read_quota_iteration) return;
+
+    self->read_quota_iteration = iteration;
+    self->read_quota_cbs_used  = 0;
+
+    /* deficit round robin: the quantum is in proportion to the weight, the unused quantum is kept for one more iteration */
+    if(self->read_quota_bytes > 0)
+    {
+        quantum = self->read_quota_bytes * self->read_weight;
+        self->read_deficit = (self->read_deficit > quantum ? quantum * 2 : self->read_deficit + quantum);
+    }
+}
+
+static void svx_tcp_connection_deliver(svx_tcp_connection_t *self);
+
+/* the read callback quota has been refilled in the new loop iteration, deliver the rest of read_buf */
+static void svx_tcp_connection_deliver_rest_run(void *arg)
+{
+    svx_tcp_connection_t *self = *((svx_tcp_connection_t **)arg);
+
+    svx_tcp_connection_deliver(self);
+    svx_tcp_connection_del_ref(self);
+}
+static void svx_tcp_connection_deliver_rest_clean(void *arg)
+{
+    svx_tcp_connection_t *self = *((svx_tcp_connection_t **)arg);
+
+    svx_tcp_connection_del_ref(self);
+}
+
+/* the other connections have been handled in this loop iteration, move the delivering to the next iteration */
+static void svx_tcp_connection_deliver_deferred_run(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+    int                   r;
+
+    self->read_quota_deferred = 0;
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED != self->state)
+    {
+        svx_tcp_connection_add_ref(self);
+        if(0 != (r = svx_looper_dispatch(self->looper, svx_tcp_connection_deliver_rest_run,
+                                         svx_tcp_connection_deliver_rest_clean, &self, sizeof(self))))
+        {
+            svx_tcp_connection_del_ref(self);
+            SVX_LOG_ERRNO_ERR(r, "dispatch() error. fd:%d\n", self->fd);
+        }
+    }
+
+    svx_tcp_connection_del_ref(self);
+}
+static void svx_tcp_connection_deliver_deferred_clean(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+
+    self->read_quota_deferred = 0;
+    svx_tcp_connection_del_ref(self);
+}
+
+/* the read callback quota of this loop iteration is used up, the rest of read_buf will be delivered later */
+static void svx_tcp_connection_defer_deliver(svx_tcp_connection_t *self)
+{
+    int r;
+
+    if(self->read_quota_deferred) return;
+
+    svx_tcp_connection_add_ref(self);
+    if(0 != (r = svx_looper_defer(self->looper, svx_tcp_connection_deliver_deferred_run,
+                                  svx_tcp_connection_deliver_deferred_clean, self)))
+    {
+        svx_tcp_connection_del_ref(self);
+        SVX_LOG_ERRNO_ERR(r, "defer() error. fd:%d\n", self->fd);
+        return;
+    }
+    self->read_quota_deferred = 1;
+}
+
+/* call the read callback while there are enough data (the read low-water mark) and it takes some of them */
+static void svx_tcp_connection_deliver(svx_tcp_connection_t *self)
+{
+    size_t data_len     = 0;
+    size_t data_len_old = 0;
+
+    svx_circlebuf_get_data_len(self->read_buf, &data_len);
+
+    while(data_len > 0 && data_len >= self->read_lowat && SVX_TCP_CONNECTION_STATE_DISCONNECTED != self->state &&
+          self->read_enable && self->recv_fd < 0)
+    {
+        if(NULL == self->callbacks->read_cb)
+        {
+            svx_circlebuf_erase_all_data(self->read_buf);
+            return;
+        }
+
+        /* each call of the read callback takes one of the read quota */
+        if(self->read_quota_cbs > 0)
+        {
+            svx_tcp_connection_refill_read_quota(self);
+            if(self->read_quota_cbs_used >= self->read_quota_cbs)
+            {
+                svx_tcp_connection_defer_deliver(self);
+                return;
+            }
+            self->read_quota_cbs_used++;
+        }
+
+        self->callbacks->read_cb(self, self->read_buf, self->callbacks->read_cb_arg);
+
+        /* the rest is a partial message, wait for more data */
+        data_len_old = data_len;
+        svx_circlebuf_get_data_len(self->read_buf, &data_len);
+        if(data_len == data_len_old) return;
+    }
+}
+
+/* let the kernel wake up the reading only after the rest of the read low-water mark has arrived */
+static void svx_tcp_connection_update_rcvlowat(svx_tcp_connection_t *self)
+{
+    size_t data_len = 0;
+    int    lowat    = 1;
+
+    if(self->read_rcvlowat < 0) return;
+
+    /* every byte is needed by the receiving to fd and the read hook */
+    svx_circlebuf_get_data_len(self->read_buf, &data_len);
+    if(self->read_lowat > data_len && self->recv_fd < 0 && NULL == self->hooks.read_hook)
+        lowat = (int)(self->read_lowat - data_len < SVX_TCP_CONNECTION_RCVLOWAT_MAX ?
+                      self->read_lowat - data_len : SVX_TCP_CONNECTION_RCVLOWAT_MAX);
+
+    if(lowat == self->read_rcvlowat) return;
+
+    if(0 != setsockopt(self->fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)))
+    {
+        /* the data will be buffered in read_buf until the low-water mark is reached */
+        SVX_LOG_ERRNO_NOTICE(errno, "setsockopt(SO_RCVLOWAT) failed, buffer it in user space. fd:%d\n", self->fd);
+        self->read_rcvlowat = -1;
+        return;
+    }
+    self->read_rcvlowat = lowat;
+}
+
+/* finish the completed receiving, and deliver the following data in read_buf to the read callback */
+static void svx_tcp_connection_recv_to_fd_resume(svx_tcp_connection_t *self)
+{
+    while(self->recv_fd >= 0 && 0 == self->recv_remaining)
+    {
+        svx_tcp_connection_recv_to_fd_finish(self, 0);
+        svx_tcp_connection_deliver(self);
+    }
+}
+
+/* the reading can be continued in handle_read() */
+static int svx_tcp_connection_is_reading(svx_tcp_connection_t *self)
+{
+    return (SVX_TCP_CONNECTION_STATE_CONNECTED == self->state && self->read_enable && !self->flow_paused &&
+            !self->offload_paused && !self->read_parked && self->recv_fd < 0 && NULL == self->hooks.read_hook);
+}
+
+/* expand read_buf geometrically for the expected reading, so the data will be read into it directly (not by extra_buf),
+   and shrink the empty read_buf after a burst, so it does not keep the storage of the burst for its whole lifetime */
+static int svx_tcp_connection_reserve_read_buf(svx_tcp_connection_t *self)
+{
+    size_t buf_len  = 0;
+    size_t data_len = 0;
+    size_t expect   = self->read_avg * 2;
+    size_t new_len;
+    int    avail    = 0;
+
+    /* the data is arriving faster than reading, ask the kernel how many bytes are waiting */
+    if(self->read_fionread && self->read_full && 0 == ioctl(self->fd, FIONREAD, &avail) && (size_t)avail > expect)
+        expect = (size_t)avail;
+
+    svx_circlebuf_get_buf_len(self->read_buf, &buf_len);
+    svx_circlebuf_get_data_len(self->read_buf, &data_len);
+
+    /* at least the rest of the read low-water mark */
+    if(self->read_lowat > data_len + expect) expect = self->read_lowat - data_len;
+
+    /* the moving average has decayed, shrink back toward the expected reading */
+    if(0 == data_len && buf_len > expect * 4 && buf_len > self->read_buf_min_len)
+        return svx_circlebuf_shrink(self->read_buf, (expect > self->read_buf_min_len ? expect : self->read_buf_min_len));
+
+    if(buf_len - data_len >= expect || buf_len >= self->read_buf_max_len) return 0;
+
+    new_len = (data_len + expect > buf_len * 2 ? data_len + expect : buf_len * 2);
+    if(new_len > self->read_buf_max_len) new_len = self->read_buf_max_len;
+
+    return svx_circlebuf_expand(self->read_buf, new_len - data_len);
+}
+
+static void svx_tcp_connection_handle_read(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+    struct iovec          iov[3];
+    int                   iov_cnt;
+    char                  extra_buf[64 * 1024];
+    size_t                extra_buf_len;
+    size_t                buf_len;
+    size_t                freespace_len;
+    size_t                want;
+    int64_t               tokens;
+    unsigned int          rounds = 0;
+    int                   more   = 0;
+    int                   i;
+    ssize_t               n;
+    int                   r;
+
+    svx_tcp_connection_touch_read(self);
+
+    /* the reading has been taken over by the hook */
+    if(self->hooks.read_hook)
+    {
+        if(0 != (r = self->hooks.read_hook(self, self->fd, self->hooks.arg))) goto err;
+        return;
+    }
+
+    /* the received data is redirected to a file */
+    if(self->recv_fd >= 0)
+    {
+        if(0 != (r = svx_tcp_connection_recv_to_fd_read(self)))
+        {
+            svx_tcp_connection_recv_to_fd_finish(self, r);
+            svx_tcp_connection_handle_close_by(self, (SVX_ERRNO_NODATA == r ? SVX_TCP_CONNECTION_CLOSE_REASON_PEER :
+                                                      SVX_TCP_CONNECTION_CLOSE_REASON_ERROR));
+            return;
+        }
+        svx_tcp_connection_recv_to_fd_resume(self);
+        svx_tcp_connection_update_rcvlowat(self);
+        return;
+    }
+
+    /* a new loop iteration, give the connection its read quota */
+    svx_tcp_connection_refill_read_quota(self);
+
+    /* read until the socket is drained or the read quota of this loop iteration is used up */
+    do
+    {
+        if(0 != (r = svx_tcp_connection_reserve_read_buf(self)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, "reserve_read_buf() error. fd:%d\n", self->fd);
+
+        /* prepare buffers for readv() (the read callback may have left a partial message in read_buf) */
+        svx_circlebuf_get_buf_len(self->read_buf, &buf_len);
+        svx_circlebuf_get_freespace_ptr(self->read_buf, (uint8_t **)(&(iov[0].iov_base)), &(iov[0].iov_len),
+                                        (uint8_t **)(&(iov[1].iov_base)), &(iov[1].iov_len));
+        freespace_len = iov[0].iov_len + iov[1].iov_len;
+
+        if(buf_len > self->read_buf_max_len)
+        {
+            SVX_LOG_ERRNO_GOTO_ERR(err, SVX_ERRNO_UNKNOWN, "fd:%d\n", self->fd);
+        }
+        else if(buf_len == self->read_buf_max_len)
+        {
+            /* read_buf reached the max_len limit, so do not use the extra_buf */
+            if(0 == freespace_len)
+                SVX_LOG_ERRNO_GOTO_ERR(err, SVX_ERRNO_REACH, "read_buf is full of unconsumed data. fd:%d, max_len:%zu\n",
+                                       self->fd, self->read_buf_max_len);
+            iov_cnt = (NULL == iov[1].iov_base ? 1 : 2);
+        }
+        else
+        {
+            extra_buf_len = ((self->read_buf_max_len - buf_len) < sizeof(extra_buf) ?
+                             (self->read_buf_max_len - buf_len) : sizeof(extra_buf));
+            if(NULL == iov[1].iov_base)
+            {
+                iov[1].iov_base = extra_buf;
+                iov[1].iov_len  = extra_buf_len;
+                iov_cnt = 2;
+            }
+            else
+            {
+                iov[2].iov_base = extra_buf;
+                iov[2].iov_len  = extra_buf_len;
+                iov_cnt = 3;
+            }
+        }
+
+        /* read no more than the available tokens */
+        if(self->read_bucket || self->read_shared_bucket)
+        {
+            if((tokens = svx_tcp_connection_get_tokens(self->read_bucket, self->read_shared_bucket)) <= 0)
+            {
+                /* stop reading until the tokens are refilled */
+                self->read_parked = 1;
+                if(0 != (r = svx_tcp_connection_update_read_event(self)))
+                    SVX_LOG_ERRNO_GOTO_ERR(err, r, "update_read_event() error. fd:%d\n", self->fd);
+                if(0 != (r = svx_tcp_connection_park(self, self->read_bucket, self->read_shared_bucket)))
+                    SVX_LOG_ERRNO_GOTO_ERR(err, r, "park() error. fd:%d\n", self->fd);
+                return;
+            }
+            iov_cnt = svx_tcp_connection_limit_iov(iov, iov_cnt, (size_t)tokens);
+        }
+
+        /* read no more than the read quota, the rest will be read in the next loop iteration */
+        if(self->read_quota_bytes > 0)
+        {
+            if(0 == self->read_deficit) return;
+            iov_cnt = svx_tcp_connection_limit_iov(iov, iov_cnt, self->read_deficit);
+        }
+        for(want = 0, i = 0; i < iov_cnt; i++)
+            want += iov[i].iov_len;
+
+        /* read data */
+        do n = readv(self->fd, iov, iov_cnt);
+        while(-1 == n && EINTR == errno);
+
+        if(n < 0)
+        {
+            if(EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                /* the socket is drained, the unused quota can not be saved for later (deficit round robin) */
+                self->read_deficit = 0;
+                self->read_full    = 0;
+                return;
+            }
+
+            if(ECONNRESET == errno)
+                SVX_LOG_ERRNO_GOTO_NOTICE(err, errno, "readv() error. fd:%d\n", self->fd);
+            else
+                SVX_LOG_ERRNO_GOTO_ERR(err, errno, "readv() error. fd:%d\n", self->fd);
+        }
+        else if(0 == n)
+        {
+            /* FIN has arrived */
+            svx_tcp_connection_handle_close_by(self, SVX_TCP_CONNECTION_CLOSE_REASON_PEER);
+        }
+        else
+        {
+            /* read OK, the moving average follows 1/8 of the change */
+            if((size_t)n > self->read_avg)
+                self->read_avg += ((size_t)n - self->read_avg + 7) / 8;
+            else
+                self->read_avg -= (self->read_avg - (size_t)n) / 8;
+            self->read_full = ((size_t)n == want);
+            self->read_stats.reads++;
+
+            svx_tcp_connection_consume_tokens(self->read_bucket, self->read_shared_bucket, (size_t)n);
+            if(self->read_quota_bytes > 0)
+                self->read_deficit = ((size_t)n < want ? 0 : self->read_deficit - (size_t)n);
+            if((size_t)n <= freespace_len)
+            {
+                /* extra_buf not used*/
+                svx_circlebuf_commit_data(self->read_buf, (size_t)n);
+            }
+            else
+            {
+                /* extra_buf used*/
+                self->read_stats.copied_reads++;
+                if(freespace_len > 0) svx_circlebuf_commit_data(self->read_buf, freespace_len);
+                if(0 != (r = svx_circlebuf_append_data(self->read_buf, (uint8_t *)extra_buf, (size_t)n - freespace_len)))
+                    SVX_LOG_ERRNO_GOTO_ERR(err, r, "append_data() error. fd:%d\n", self->fd);
+            }
+
+            /* callback */
+            svx_tcp_connection_deliver(self);
+
+            /* svx_tcp_connection_recv_to_fd() may be completed by the data in read_buf */
+            svx_tcp_connection_recv_to_fd_resume(self);
+            svx_tcp_connection_update_rcvlowat(self);
+
+            /* there may be more data if the buffers were filled up, read again only with the read quota */
+            rounds++;
+            more = ((size_t)n == want && svx_tcp_connection_is_reading(self) &&
+                    rounds < self->read_quota_cbs && self->read_quota_cbs_used < self->read_quota_cbs &&
+                    (0 == self->read_quota_bytes || self->read_deficit > 0));
+        }
+    } while(more);
+
+    return;
+
+ err:
+    svx_tcp_connection_handle_close(self);    
+}
+
+/* refill the stream at the head of wsegs when it is below the low water mark, remove it at the end of stream */
+static int svx_tcp_connection_produce(svx_tcp_connection_t *self, svx_tcp_connection_wseg_t *wseg, int *stalled)
+{
+    uint8_t *buf     = (uint8_t *)wseg->buf;
+    size_t   ret_len = 0;
+    int      eof     = 0;
+    int      r;
+
+    *stalled = 0;
+
+    if(!wseg->stream_eof && wseg->len - wseg->sent < SVX_TCP_CONNECTION_STREAM_LOW_WATER)
+    {
+        /* move the unsent data to the beginning of the buffer */
+        if(wseg->sent > 0)
+        {
+            memmove(buf, buf + wseg->sent, wseg->len - wseg->sent);
+            wseg->len  -= wseg->sent;
+            wseg->sent  = 0;
+        }
+
+        if(0 != (r = wseg->stream_cb(self, buf + wseg->len, SVX_TCP_CONNECTION_STREAM_BUF_LEN - wseg->len,
+                                     &ret_len, &eof, wseg->stream_cb_arg)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, "produce_cb() error. fd:%d\n", self->fd);
+        if(ret_len > SVX_TCP_CONNECTION_STREAM_BUF_LEN - wseg->len)
+            SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_RANGE, "produce_cb() returned too much data. fd:%d, ret_len:%zu\n", self->fd, ret_len);
+
+        wseg->len       += ret_len;
+        wseg->stream_eof = eof;
+        self->wsegs_len += ret_len;
+    }
+
+    if(wseg->sent == wseg->len)
+    {
+        if(wseg->stream_eof)
+        {
+            TAILQ_REMOVE(&(self->wsegs), wseg, link);
+            svx_tcp_connection_free_wseg(wseg, 0);
+        }
+        else
+        {
+            /* the producer has no data for now, wait for svx_tcp_connection_resume_stream() */
+            *stalled = 1;
+        }
+    }
+
+    return 0;
+}
+
+/* write the queued data, watch the write event if there is still unsent data */
+static int svx_tcp_connection_flush(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_wseg_t *wseg = NULL;
+    struct iovec               iov[SVX_TCP_CONNECTION_WRITE_IOV_CNT];
+    int                        iov_cnt;
+    size_t                     offset;
+    size_t                     len;
+    size_t                     want;
+    uint8_t                    channel_events = 0;
+    int                        stalled        = 0;
+    size_t                     limit;
+    int64_t                    tokens;
+    ssize_t                    n;
+    int                        r;
+
+    svx_channel_get_events(self->channel, &channel_events);
+    self->write_parked = 0;
+    svx_tcp_connection_touch_write(self);
+
+    /* no data need to write */
+    if(0 == svx_tcp_connection_get_unsent_len(self) && TAILQ_EMPTY(&(self->wsegs)))
+    {
+        if((channel_events & SVX_CHANNEL_EVENT_WRITE) && !self->write_hook_enable)
+            if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, "del_events() error. fd:%d\n", self->fd);
+        return 0;
+    }
+
+    while(svx_tcp_connection_get_unsent_len(self) > 0 || !TAILQ_EMPTY(&(self->wsegs)))
+    {
+        wseg = TAILQ_FIRST(&(self->wsegs));
+        if(NULL != wseg && 0 == wseg->copy_before && wseg->stream_cb)
+        {
+            /* pull the data from the producer */
+            if(0 != (r = svx_tcp_connection_produce(self, wseg, &stalled))) return r;
+            if(stalled) break;
+            if(NULL == (wseg = TAILQ_FIRST(&(self->wsegs))) && 0 == svx_tcp_connection_get_unsent_len(self)) break;
+        }
+
+        /* write no more than the available tokens */
+        limit = SIZE_MAX;
+        if(svx_tcp_connection_is_write_limited(self))
+        {
+            if((tokens = svx_tcp_connection_get_tokens(self->write_bucket, self->write_shared_bucket)) <= 0)
+            {
+                self->write_parked = 1;
+                break;
+            }
+            limit = (size_t)tokens;
+        }
+
+        if(NULL != wseg && 0 == wseg->copy_before && wseg->file_fd >= 0)
+        {
+            /* send the file range by sendfile() */
+            want = (wseg->len - wseg->sent < limit ? wseg->len - wseg->sent : limit);
+            n = svx_tcp_connection_send_file(self, wseg, want);
+        }
+        else if(NULL != wseg && 0 == wseg->copy_before && svx_tcp_connection_is_zerocopy(self, wseg))
+        {
+            /* send the large wseg alone by MSG_ZEROCOPY */
+            want = (wseg->len - wseg->sent < limit ? wseg->len - wseg->sent : limit);
+            n = svx_tcp_connection_send_zerocopy(self, wseg, want);
+        }
+        else
+        {
+            /* prepare buffers for writev(), keep the order of write_buf and wsegs */
+            iov_cnt = 0;
+            offset  = 0;
+            TAILQ_FOREACH(wseg, &(self->wsegs), link)
+            {
+                if(iov_cnt >= SVX_TCP_CONNECTION_WRITE_IOV_CNT) break;
+                iov_cnt = svx_tcp_connection_add_write_buf_iov(self, iov, iov_cnt, offset, wseg->copy_before);
+                offset += wseg->copy_before;
+                if(iov_cnt >= SVX_TCP_CONNECTION_WRITE_IOV_CNT) break;
+                if(svx_tcp_connection_is_sent_alone(self, wseg)) break; /* stop before the file or MSG_ZEROCOPY wseg */
+                iov[iov_cnt].iov_base = (void *)(wseg->buf + wseg->sent);
+                iov[iov_cnt].iov_len  = wseg->len - wseg->sent;
+                iov_cnt++;
+                if(wseg->stream_cb && !wseg->stream_eof) break; /* the rest of the stream has not been produced */
+            }
+            if(NULL == wseg && iov_cnt < SVX_TCP_CONNECTION_WRITE_IOV_CNT)
+            {
+                svx_circlebuf_get_data_len(self->write_buf, &len);
+                iov_cnt = svx_tcp_connection_add_write_buf_iov(self, iov, iov_cnt, offset, len - offset);
+            }
+            for(want = 0, len = 0; len < (size_t)iov_cnt; len++)
+                want += iov[len].iov_len;
+            if(want > limit)
+            {
+                iov_cnt = svx_tcp_connection_limit_iov(iov, iov_cnt, limit);
+                want    = limit;
+            }
+
+            /* write data */
+            do n = writev(self->fd, iov, iov_cnt);
+            while(-1 == n && EINTR == errno);
+        }
+
+        if(n < 0)
+        {
+            if(EAGAIN != errno && EWOULDBLOCK != errno)
+                SVX_LOG_ERRNO_RETURN_ERR(errno, "write error. fd:%d\n", self->fd);
+            n = 0; /* wrote nothing, try later */
+        }
+
+        /* write OK */
+        if(n > 0)
+        {
+            svx_tcp_connection_consume_tokens(self->write_bucket, self->write_shared_bucket, (size_t)n);
+            svx_tcp_connection_erase_sent(self, (size_t)n);
+        }
+
+        /* the socket send buffer is full */
+        if(0 == n || (size_t)n < want) break;
+    }
+
+    /* resume the reading if the unsent data has fallen to the low mark */
+    if(0 != (r = svx_tcp_connection_check_flow_control(self))) return r;
+
+    if(self->write_parked)
+    {
+        /* do not watch the write event until the tokens are refilled */
+        if(channel_events & SVX_CHANNEL_EVENT_WRITE)
+            if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, "del_events() error. fd:%d\n", self->fd);
+        if(0 != (r = svx_tcp_connection_park(self, self->write_bucket, self->write_shared_bucket)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, "park() error. fd:%d\n", self->fd);
+    }
+    else if(stalled)
+    {
+        /* do not watch the write event until the producer resumes */
+        if((channel_events & SVX_CHANNEL_EVENT_WRITE) && !self->write_hook_enable)
+            if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, "del_events() error. fd:%d\n", self->fd);
+    }
+    else if(0 == svx_tcp_connection_get_unsent_len(self) && TAILQ_EMPTY(&(self->wsegs)))
+    {
+        if((channel_events & SVX_CHANNEL_EVENT_WRITE) && !self->write_hook_enable)
+            if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, "del_events() error. fd:%d\n", self->fd);
+
+        if(SVX_TCP_CONNECTION_STATE_DISCONNECTING == self->state)
+            shutdown(self->fd, SHUT_WR);
+
+        svx_tcp_connection_notify_write_completed(self);
+    }
+    else
+    {
+        /* enable writing for channel */
+        if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
+            if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, "add_events() error. fd:%d\n", self->fd);
+    }
+
+    return 0;
+}
+
+static void svx_tcp_connection_handle_write(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state) return;
+
+    if(0 != svx_tcp_connection_flush(self))
+    {
+        svx_tcp_connection_handle_close(self);
+        return;
+    }
+
+    /* the write buffer has been flushed, let the hook write its own data */
+    if(self->hooks.write_hook && self->write_hook_enable &&
+       0 == svx_tcp_connection_get_unsent_len(self) && TAILQ_EMPTY(&(self->wsegs)))
+        if(0 != self->hooks.write_hook(self, self->fd, self->hooks.arg))
+            svx_tcp_connection_handle_close(self);
+}
+
+/* the tokens may have been refilled, resume the parked reading and writing (called by the looper's timer wheel) */
+static void svx_tcp_connection_unpark(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+    int                   r;
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return;
+
+    /* handle_read() will park it again if the tokens are still not enough */
+    if(self->read_parked)
+    {
+        self->read_parked = 0;
+        if(0 != (r = svx_tcp_connection_update_read_event(self)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, "update_read_event() error. fd:%d\n", self->fd);
+    }
+
+    if(self->write_parked)
+    {
+        if(0 != (r = svx_tcp_connection_flush(self))) goto err;
+
+        /* the write event is still needed by the hook */
+        if(self->write_hook_enable && !self->write_parked)
+            if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+                SVX_LOG_ERRNO_GOTO_ERR(err, r, "add_events() error. fd:%d\n", self->fd);
+    }
+
+    return;
+
+ err:
+    svx_tcp_connection_handle_close(self);
+}
+
+/* the deadline has expired, or keep the earliest one in next_ms */
+static int svx_tcp_connection_is_expired(int64_t deadline_ms, int64_t now_ms, int64_t *next_ms)
+{
+    if(deadline_ms <= now_ms) return 1;
+    if(deadline_ms < *next_ms) *next_ms = deadline_ms;
+    return 0;
+}
+
+/* check all the timeouts and deadlines (called by the looper's timer wheel) */
+static void svx_tcp_connection_handle_timeout(void *arg)
+{
+    svx_tcp_connection_t              *self       = (svx_tcp_connection_t *)arg;
+    svx_tcp_connection_close_reason_t  reason     = SVX_TCP_CONNECTION_CLOSE_REASON_NONE;
+    int64_t                            now_ms     = svx_tcp_connection_get_now_ms();
+    int64_t                            next_ms    = INT64_MAX;
+    size_t                             unsent_len = svx_tcp_connection_get_unsent_len(self);
+    int                                r;
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return;
+
+    /* the write deadline is met if all the data has been sent */
+    if(self->write_deadline_ms > 0 && self->write_deadline_ms <= now_ms && 0 == unsent_len && TAILQ_EMPTY(&(self->wsegs)))
+        self->write_deadline_ms = 0;
+
+    if(self->idle_timeout_ms > 0 &&
+       svx_tcp_connection_is_expired((self->last_read_ms > self->last_write_ms ? self->last_read_ms : self->last_write_ms) +
+                                     self->idle_timeout_ms, now_ms, &next_ms))
+        reason = SVX_TCP_CONNECTION_CLOSE_REASON_IDLE_TIMEOUT;
+    else if(self->read_timeout_ms > 0 && self->read_enable && !self->flow_paused && !self->offload_paused &&
+            !self->read_parked &&
+            svx_tcp_connection_is_expired(self->last_read_ms + self->read_timeout_ms, now_ms, &next_ms))
+        reason = SVX_TCP_CONNECTION_CLOSE_REASON_READ_TIMEOUT;
+    else if(self->read_deadline_ms > 0 &&
+            svx_tcp_connection_is_expired(self->read_deadline_ms, now_ms, &next_ms))
+        reason = SVX_TCP_CONNECTION_CLOSE_REASON_READ_TIMEOUT;
+    else if(self->write_timeout_ms > 0 && unsent_len > 0 && !self->write_parked &&
+            svx_tcp_connection_is_expired(self->last_write_ms + self->write_timeout_ms, now_ms, &next_ms))
+        reason = SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_TIMEOUT;
+    else if(self->write_deadline_ms > 0 &&
+            svx_tcp_connection_is_expired(self->write_deadline_ms, now_ms, &next_ms))
+        reason = SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_TIMEOUT;
+
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_NONE != reason)
+    {
+        SVX_LOG_ERRNO_NOTICE(SVX_ERRNO_TIMEDOUT, "timed out, close it. fd:%d, reason:%d\n", self->fd, (int)reason);
+        svx_tcp_connection_handle_close_by(self, reason);
+        return;
+    }
+
+    /* the activities have refreshed the timestamps, check it again at the earliest deadline */
+    if(INT64_MAX != next_ms)
+    {
+        if(0 != (r = svx_tcp_connection_schedule_timeout(self, next_ms, now_ms)))
+        {
+            SVX_LOG_ERRNO_ERR(r, "schedule_timeout() error. fd:%d\n", self->fd);
+            svx_tcp_connection_handle_close(self);
+        }
+    }
+}
+
+/* flush the data which written in the current loop round (auto-cork mode) */
+static void svx_tcp_connection_auto_cork_flush_run(void *arg)
+{
+    svx_tcp_connection_t *self           = (svx_tcp_connection_t *)arg;
+    uint8_t               channel_events = 0;
+
+    self->auto_cork_pending = 0;
+
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED == self->state)
+    {
+        /* if the write event is watched, the data will be sent in handle_write() */
+        svx_channel_get_events(self->channel, &channel_events);
+        if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
+            if(0 != svx_tcp_connection_flush(self))
+                svx_tcp_connection_handle_close(self);
+    }
+
+    svx_tcp_connection_del_ref(self);
+}
+static void svx_tcp_connection_auto_cork_flush_clean(void *arg)
+{
+    svx_tcp_connection_t *self = (svx_tcp_connection_t *)arg;
+
+    self->auto_cork_pending = 0;
+    svx_tcp_connection_del_ref(self);
+}
+
+/* the data has been queued, send it now or later */
+static int svx_tcp_connection_schedule_write(svx_tcp_connection_t *self, uint8_t channel_events)
+{
+    int r;
+
+    /* the data will be sent in handle_write(), or when the tokens are refilled */
+    if((channel_events & SVX_CHANNEL_EVENT_WRITE) || self->write_parked) return 0;
+
+    if(self->auto_cork)
+    {
+        /* coalesce all the data written in the current loop round, flush them at the end of this round */
+        if(self->auto_cork_pending) return 0;
+        svx_tcp_connection_add_ref(self);
+        if(0 != (r = svx_looper_defer(self->looper, svx_tcp_connection_auto_cork_flush_run,
+                                      svx_tcp_connection_auto_cork_flush_clean, self)))
+        {
+            svx_tcp_connection_del_ref(self);
+            SVX_LOG_ERRNO_RETURN_ERR(r, "defer() error. fd:%d\n", self->fd);
+        }
+        self->auto_cork_pending = 1;
+    }
+    else
+    {
+        /* enable writing for channel */
+        if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, "add_events() error. fd:%d\n", self->fd);
+    }
+
+    return 0;
+}
+
+int svx_tcp_connection_create(svx_tcp_connection_t **self, svx_looper_t *looper, int fd,
+                              size_t read_buf_min_len, size_t read_buf_max_len,
+                              size_t write_buf_min_len, size_t write_buf_high_water_mark,
+                              svx_tcp_connection_callbacks_t *callbacks,
+                              svx_tcp_connection_remove_cb_t remove_cb, void *remove_cb_arg,
+                              void *info)
+{
+    svx_bufpool_t *pool = NULL;
+    int            r    = 0;
+    
+    if(NULL == self || NULL == looper || fd < 0 ||
+       0 == read_buf_min_len || 0 == read_buf_max_len || read_buf_min_len > read_buf_max_len ||
+       0 == write_buf_min_len || 0 == write_buf_high_water_mark || write_buf_min_len > write_buf_high_water_mark || NULL == callbacks || NULL == remove_cb)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, fd:%d, read_buf_min_len:%zu, "
+                                 "read_buf_max_len:%zu, write_buf_min_len:%zu, write_buf_high_water_mark:%zu, callbacks:%p, remove_cb:%p\n",
+                                 self, looper, fd, read_buf_min_len, read_buf_max_len, write_buf_min_len, write_buf_high_water_mark, callbacks, remove_cb);
+
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, sizeof(svx_tcp_connection_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    (*self)->state                     = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
+    (*self)->ref_count                 = 1;
+    (*self)->looper                    = looper;
+    (*self)->channel                   = NULL;
+    (*self)->fd                        = fd;
+    (*self)->read_buf                  = NULL;
+    (*self)->read_buf_min_len          = read_buf_min_len;
+    (*self)->read_buf_max_len          = read_buf_max_len;
+    (*self)->read_avg                  = 0;
+    (*self)->read_full                 = 1;
+    (*self)->read_fionread             = 0;
+    (*self)->read_lowat                = 1;
+    (*self)->read_rcvlowat             = 1;
+    memset(&((*self)->read_stats), 0, sizeof((*self)->read_stats));
+    (*self)->write_buf                 = NULL;
+    (*self)->write_buf_high_water_mark = write_buf_high_water_mark;
+    TAILQ_INIT(&((*self)->wsegs));
+    (*self)->wsegs_len                 = 0;
+    (*self)->wsegs_copy_len            = 0;
+    TAILQ_INIT(&((*self)->zerocopy_wsegs));
+    (*self)->zerocopy_threshold        = 0;
+    (*self)->zerocopy_next_id          = 0;
+    (*self)->zerocopy_pending          = 0;
+    (*self)->zerocopy_skip             = 0;
+    (*self)->zerocopy_backoff          = 0;
+    svx_looper_wheel_entry_init(&((*self)->zerocopy_entry), svx_tcp_connection_reap_zerocopy, *self);
+    (*self)->callbacks                 = callbacks;
+    (*self)->write_completed_enable    = 1;
+    (*self)->high_water_mark_enable    = 1;
+    (*self)->auto_cork                 = 0;
+    (*self)->auto_cork_pending         = 0;
+    (*self)->read_enable               = 1;
+    (*self)->flow_low_mark             = 0;
+    (*self)->flow_high_mark            = 0;
+    (*self)->flow_hard_cap             = 0;
+    (*self)->flow_paused               = 0;
+    (*self)->flow_aborted              = 0;
+    (*self)->flow_stats                = NULL;
+    TAILQ_INIT(&((*self)->offloads));
+    (*self)->offloads_cnt              = 0;
+    (*self)->offloads_max              = 0;
+    (*self)->offload_paused            = 0;
+    (*self)->read_bucket               = NULL;
+    (*self)->write_bucket              = NULL;
+    (*self)->read_shared_bucket        = NULL;
+    (*self)->write_shared_bucket       = NULL;
+    (*self)->read_parked               = 0;
+    (*self)->write_parked              = 0;
+    (*self)->unpark_ms                 = 0;
+    svx_looper_wheel_entry_init(&((*self)->unpark_entry), svx_tcp_connection_unpark, *self);
+    (*self)->read_quota_bytes          = 0;
+    (*self)->read_quota_cbs            = 0;
+    (*self)->read_weight               = 1;
+    (*self)->read_quota_iteration      = UINT64_MAX;
+    (*self)->read_quota_cbs_used       = 0;
+    (*self)->read_quota_deferred       = 0;
+    (*self)->read_deficit              = 0;
+    (*self)->idle_timeout_ms           = 0;
+    (*self)->read_timeout_ms           = 0;
+    (*self)->write_timeout_ms          = 0;
+    (*self)->read_deadline_ms          = 0;
+    (*self)->write_deadline_ms         = 0;
+    (*self)->last_read_ms              = 0;
+    (*self)->last_write_ms             = 0;
+    (*self)->timeout_check_ms          = 0;
+    svx_looper_wheel_entry_init(&((*self)->timeout_entry), svx_tcp_connection_handle_timeout, *self);
+    (*self)->close_reason              = SVX_TCP_CONNECTION_CLOSE_REASON_NONE;
+    memset(&((*self)->hooks), 0, sizeof((*self)->hooks));
+    (*self)->write_hook_enable         = 0;
+    (*self)->recv_fd                   = -1;
+    (*self)->recv_remaining            = 0;
+    (*self)->recv_pipe_fds[0]          = -1;
+    (*self)->recv_pipe_fds[1]          = -1;
+    (*self)->recv_done_cb              = NULL;
+    (*self)->recv_done_cb_arg          = NULL;
+    (*self)->remove_cb                 = remove_cb;
+    (*self)->remove_cb_arg             = remove_cb_arg;
+    (*self)->context                   = NULL;
+    (*self)->info                      = info;
+    (*self)->handle                    = SVX_TCP_CONNECTION_HANDLE_INVALID;
+
+    if(0 != (r = svx_channel_create(&((*self)->channel), (*self)->looper, (*self)->fd, SVX_CHANNEL_EVENT_NULL)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(0 != (r = svx_channel_set_read_callback((*self)->channel, svx_tcp_connection_handle_read, *self)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(0 != (r = svx_channel_set_write_callback((*self)->channel, svx_tcp_connection_handle_write, *self)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(0 != (r = svx_channel_set_error_callback((*self)->channel, svx_tcp_connection_handle_error, *self)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    /* draw the buffers from the looper's bufpool if there is one */
+    svx_looper_get_bufpool(looper, &pool);
+    if(pool)
+    {
+        if(0 != (r = svx_circlebuf_create_pooled(&((*self)->read_buf), pool, read_buf_max_len, read_buf_min_len,
+                                                 SVX_TCP_CONNECTION_READ_BUF_MIN_STEP)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+        if(0 != (r = svx_circlebuf_create_pooled(&((*self)->write_buf), pool, 0, write_buf_min_len,
+                                                 SVX_TCP_CONNECTION_WRITE_BUF_MIN_STEP)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    }
+    else
+    {
+        if(0 != (r = svx_circlebuf_create(&((*self)->read_buf), read_buf_max_len, read_buf_min_len, SVX_TCP_CONNECTION_READ_BUF_MIN_STEP)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+        if(0 != (r = svx_circlebuf_create(&((*self)->write_buf), 0, write_buf_min_len, SVX_TCP_CONNECTION_WRITE_BUF_MIN_STEP)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    }
+
+    if(0 != (r = svx_tcp_connection_acquire_slot(*self))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    return 0;
+
+ err:
+    if(*self)
+    {
+        if((*self)->channel)   svx_channel_destroy(&((*self)->channel));
+        if((*self)->read_buf)  svx_circlebuf_destroy(&((*self)->read_buf));
+        if((*self)->write_buf) svx_circlebuf_destroy(&((*self)->write_buf));
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, *self);
+        *self = NULL;
+    }
+
+    return r;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_destroy, svx_tcp_connection_t *, self)
+int svx_tcp_connection_destroy(svx_tcp_connection_t *self)
+{
+    int r;
+    
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_destroy, self);
+
+    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTED;
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_NONE == self->close_reason)
+        self->close_reason = SVX_TCP_CONNECTION_CLOSE_REASON_LOCAL;
+    svx_tcp_connection_release_slot(self);
+    svx_tcp_connection_release_offloads(self);
+    svx_tcp_connection_recv_to_fd_finish(self, SVX_ERRNO_NOTCONN);
+    svx_tcp_connection_release_wsegs(self);
+    svx_looper_wheel_del(self->looper, &(self->unpark_entry));
+    svx_looper_wheel_del(self->looper, &(self->timeout_entry));
+    if(self->read_bucket)  svx_token_bucket_destroy(&(self->read_bucket));
+    if(self->write_bucket) svx_token_bucket_destroy(&(self->write_bucket));
+    if(0 != (r = svx_circlebuf_destroy(&(self->read_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_circlebuf_destroy(&(self->write_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_channel_destroy(&(self->channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    svx_tcp_connection_linger(self);
+    if(self->fd >= 0) if(0 != close(self->fd)) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+    
+    if(self->callbacks->closed_cb)
+        self->callbacks->closed_cb(self, self->callbacks->closed_cb_arg);
+    
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, self);
+
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_start, svx_tcp_connection_t *, self)
+int svx_tcp_connection_start(svx_tcp_connection_t *self)
+{
+    int r = 0;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_start, self);
+
+    if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_READ)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    self->state = SVX_TCP_CONNECTION_STATE_CONNECTED;
+
+    if(self->callbacks->established_cb)
+        self->callbacks->established_cb(self, self->callbacks->established_cb_arg);
+
+    return 0;
+}
+
+int svx_tcp_connection_get_local_addr(svx_tcp_connection_t *self, svx_inetaddr_t *addr)
+{
+    int r;
+    
+    if(NULL == self || NULL == addr)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, addr:%p\n", self, addr);
+
+    if(0 != (r = svx_inetaddr_from_fd_local(addr, self->fd))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
+}
+
+int svx_tcp_connection_get_peer_addr(svx_tcp_connection_t *self, svx_inetaddr_t *addr)
+{
+    int r;
+    
+    if(NULL == self || NULL == addr)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, addr:%p\n", self, addr);
+
+    if(0 != (r = svx_inetaddr_from_fd_peer(addr, self->fd))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
+}
+
+int svx_tcp_connection_get_info(svx_tcp_connection_t *self, void **info)
+{
+    if(NULL == self || NULL == info)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, info:%p\n", self, info);
+
+    *info = self->info;
+    return 0;
+}
+
+int svx_tcp_connection_set_context(svx_tcp_connection_t *self, void *context)
+{
+    if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->context = context;
+    return 0;
+}
+
+int svx_tcp_connection_get_context(svx_tcp_connection_t *self, void **context)
+{
+    if(NULL == self || NULL == context)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, context:%p\n", self, context);
+
+    *context = self->context;
+    return 0;
+}
+
+static int svx_tcp_connection_destroy_safely(svx_tcp_connection_t *self)
+{
+    int r;
+    
+    if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    svx_tcp_connection_release_slot(self);
+    svx_tcp_connection_release_offloads(self);
+    svx_tcp_connection_release_wsegs(self);
+    svx_looper_wheel_del(self->looper, &(self->unpark_entry));
+    svx_looper_wheel_del(self->looper, &(self->timeout_entry));
+    if(self->read_bucket)  svx_token_bucket_destroy(&(self->read_bucket));
+    if(self->write_bucket) svx_token_bucket_destroy(&(self->write_bucket));
+    if(0 != (r = svx_circlebuf_destroy(&(self->read_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_circlebuf_destroy(&(self->write_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_channel_destroy(&(self->channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    svx_tcp_connection_linger(self);
+    if(self->fd >= 0) if(0 != close(self->fd)) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
+    
+    if(self->callbacks->closed_cb)
+        self->callbacks->closed_cb(self, self->callbacks->closed_cb_arg);
+
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, self);
+    return 0;
+}
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_destroy_safely, svx_tcp_connection_t *, self);
+
+int svx_tcp_connection_add_ref(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        SVX_LOG_ERRNO_ERR(SVX_ERRNO_UNKNOWN, NULL);
+        exit(1);
+    }
+
+    self->ref_count++;
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_del_ref, svx_tcp_connection_t *, self)
+int svx_tcp_connection_del_ref(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_del_ref, self);
+
+    self->ref_count--;
+    if(0 == self->ref_count)
+    {
+        /* always destroy the conn in the next round */
+        SVX_LOOPER_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_destroy_safely, self);
+    }
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_read, svx_tcp_connection_t *, self)
+int svx_tcp_connection_enable_read(svx_tcp_connection_t *self)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_read, self);
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. enable read failed. fd:%d\n", self->fd);
+
+    /* the reading may still be paused by the write flow control or the rate limit */
+    self->read_enable = 1;
+    if(0 != (r = svx_tcp_connection_update_read_event(self)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_read, svx_tcp_connection_t *, self)
+int svx_tcp_connection_disable_read(svx_tcp_connection_t *self)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_read, self);
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. disable read failed. fd:%d\n", self->fd);
+
+    self->read_enable = 0;
+
+    if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_READ)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_write_completed, svx_tcp_connection_t *, self)
+int svx_tcp_connection_enable_write_completed(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_write_completed, self);
+
+    self->write_completed_enable = 1;
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_write_completed, svx_tcp_connection_t *, self)
+int svx_tcp_connection_disable_write_completed(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_write_completed, self);
+
+    self->write_completed_enable = 0;
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_high_water_mark, svx_tcp_connection_t *, self)
+int svx_tcp_connection_enable_high_water_mark(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_high_water_mark, self);
+
+    self->high_water_mark_enable = 1;
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_high_water_mark, svx_tcp_connection_t *, self)
+int svx_tcp_connection_disable_high_water_mark(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_high_water_mark, self);
+
+    self->high_water_mark_enable = 0;
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_shrink_read_buf, svx_tcp_connection_t *, self, size_t, freespace_keep)
+int svx_tcp_connection_shrink_read_buf(svx_tcp_connection_t *self, size_t freespace_keep)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_shrink_read_buf, self, freespace_keep);
+
+    if(0 != (r = svx_circlebuf_shrink(self->read_buf, freespace_keep)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_shrink_write_buf, svx_tcp_connection_t *, self, size_t, freespace_keep)
+int svx_tcp_connection_shrink_write_buf(svx_tcp_connection_t *self, size_t freespace_keep)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_shrink_write_buf, self, freespace_keep);
+
+    if(0 != (r = svx_circlebuf_shrink(self->write_buf, freespace_keep)))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    
+    return 0;
+}
+
+typedef struct
+{
+    svx_tcp_connection_t *self;
+    uint8_t              *buf;
+    size_t                len;
+} svx_tcp_connection_write_param_t;
+static void svx_tcp_connection_write_run(void *arg)
+{
+    svx_tcp_connection_write_param_t *p = (svx_tcp_connection_write_param_t *)arg;
+    svx_tcp_connection_write(p->self, p->buf, p->len);
+    if(p->buf) svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, p->buf);
+}
+static void svx_tcp_connection_write_clean(void *arg)
+{
+    svx_tcp_connection_write_param_t *p = (svx_tcp_connection_write_param_t *)arg;
+    if(p->buf) svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, p->buf);
+}
+int svx_tcp_connection_write(svx_tcp_connection_t *self, const uint8_t *buf, size_t len)
+{
+    struct iovec iov;
+
+    if(NULL == self || NULL == buf || 0 == len) 
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+
+    iov.iov_base = (void *)buf;
+    iov.iov_len  = len;
+    return svx_tcp_connection_writev(self, &iov, 1);
+}
+
+int svx_tcp_connection_writev(svx_tcp_connection_t *self, const struct iovec *iov, int iovcnt)
+{
+    uint8_t  channel_events     = 0;
+    size_t   data_len_old       = 0;
+    size_t   len                = 0;
+    size_t   skip               = 0;
+    ssize_t  n                  = 0;
+    int      r                  = 0;
+    int      i                  = 0;
+    uint8_t *buf2               = NULL;
+
+    if(NULL == self || NULL == iov || iovcnt <= 0 || iovcnt > IOV_MAX)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, iov:%p, iovcnt:%d\n", self, iov, iovcnt);
+
+    for(i = 0; i < iovcnt; i++)
+    {
+        if(NULL == iov[i].iov_base && iov[i].iov_len > 0)
+            SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "iov[%d].iov_base:NULL, iov[%d].iov_len:%zu\n", i, i, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    if(0 == len) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "len:%zu\n", len);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        /* flatten all the segments into one buffer, then send it in the loop thread */
+        if(NULL == (buf2 = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, len))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+        for(i = 0; i < iovcnt; i++)
+        {
+            if(0 == iov[i].iov_len) continue;
+            memcpy(buf2 + skip, iov[i].iov_base, iov[i].iov_len);
+            skip += iov[i].iov_len;
+        }
+        svx_tcp_connection_write_param_t p = {self, buf2, len};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_write_run, svx_tcp_connection_write_clean, &p, sizeof(p));
+        return 0;
+    }
+
+    if(self->flow_aborted)
+        SVX_LOG_ERRNO_RETURN_NOTICE(SVX_ERRNO_REACH, "write hard cap reached. write failed. fd:%d\n", self->fd);
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. write failed. fd:%d\n", self->fd);
+
+    svx_channel_get_events(self->channel, &channel_events);
+    data_len_old = svx_tcp_connection_get_unsent_len(self);
+
+    /* if write buffer is empty, try to write immediately (directly from the caller's buffers) */
+    if(!self->auto_cork && !svx_tcp_connection_is_write_limited(self) &&
+       (0 == (channel_events & SVX_CHANNEL_EVENT_WRITE)) && 0 == data_len_old && TAILQ_EMPTY(&(self->wsegs)))
+    {
+        if(1 == iovcnt)
+        {
+            do n = write(self->fd, iov[0].iov_base, iov[0].iov_len);
+            while(-1 == n && EINTR == errno);
+        }
+        else
+        {
+            do n = writev(self->fd, iov, iovcnt);
+            while(-1 == n && EINTR == errno);
+        }
+
+        if(n < 0)
+        {
+            /* error */
+            if(EAGAIN == errno || EWOULDBLOCK == errno)
+                n = 0; /* wrote nothing, try later */
+            else
+                SVX_LOG_ERRNO_GOTO_ERR(err, r = errno, "write() error. fd:%d\n", self->fd);
+        }
+        else
+        {
+            /* OK */
+            svx_tcp_connection_touch_write(self);
+            if(len == (size_t)n) svx_tcp_connection_notify_write_completed(self);
+        }
+    }
+
+    /* save the rest of unsent data to the write buffer */
+    if((size_t)n < len)
+    {
+        skip = (size_t)n;
+        for(i = 0; i < iovcnt; i++)
+        {
+            if(skip >= iov[i].iov_len)
+            {
+                skip -= iov[i].iov_len;
+                continue;
+            }
+            if(0 != (r = svx_circlebuf_append_data(self->write_buf, (uint8_t *)iov[i].iov_base + skip, iov[i].iov_len - skip)))
+                SVX_LOG_ERRNO_GOTO_ERR(err, r, "append_data() error. fd:%d\n", self->fd);
+            skip = 0;
+        }
+
+        /* closed at the write hard cap */
+        if(0 != (r = svx_tcp_connection_check_high_water_mark(self, data_len_old))) return r;
+
+        if(0 != (r = svx_tcp_connection_schedule_write(self, channel_events)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    }
+
+    return 0;
+
+ err:
+    svx_tcp_connection_handle_close(self);
+    return r;
+}
+
+/* send the data by reference, free_cb will always be called (in the loop thread) */
+static int svx_tcp_connection_write_ref(svx_tcp_connection_t *self, const uint8_t *buf, size_t len,
+                                        svx_tcp_connection_free_cb_t free_cb, void *free_cb_arg)
+{
+    uint8_t channel_events = 0;
+    size_t  data_len_old   = 0;
+    int     zerocopy       = 0;
+    ssize_t n              = 0;
+    int     r              = 0;
+
+    if(self->flow_aborted)
+        SVX_LOG_ERRNO_GOTO_NOTICE(end, r = SVX_ERRNO_REACH, "write hard cap reached. write failed. fd:%d\n", self->fd);
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+        SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOTCONN, "not connected. write failed. fd:%d\n", self->fd);
+
+    svx_channel_get_events(self->channel, &channel_events);
+    data_len_old = svx_tcp_connection_get_unsent_len(self);
+    zerocopy     = svx_tcp_connection_use_zerocopy(self, len);
+
+    /* if write buffer is empty, try to write immediately (the MSG_ZEROCOPY data need to be queued first) */
+    if(!self->auto_cork && !zerocopy && !svx_tcp_connection_is_write_limited(self) &&
+       (0 == (channel_events & SVX_CHANNEL_EVENT_WRITE)) && 0 == data_len_old && TAILQ_EMPTY(&(self->wsegs)))
+    {
+        do n = write(self->fd, buf, len);
+        while(-1 == n && EINTR == errno);
+
+        if(n < 0)
+        {
+            /* error */
+            if(EAGAIN == errno || EWOULDBLOCK == errno)
+                n = 0; /* wrote nothing, try later */
+            else
+                SVX_LOG_ERRNO_GOTO_ERR(err, r = errno, "write() error. fd:%d\n", self->fd);
+        }
+        else
+        {
+            /* OK */
+            svx_tcp_connection_touch_write(self);
+            if(len == (size_t)n)
+            {
+                svx_tcp_connection_notify_write_completed(self);
+                goto end;
+            }
+        }
+    }
+
+    /* queue the rest of unsent data by reference */
+    if(0 != (r = svx_tcp_connection_add_wseg(self, buf, len, (size_t)n, free_cb, free_cb_arg)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, "add_wseg() error. fd:%d\n", self->fd);
+    TAILQ_LAST(&(self->wsegs), svx_tcp_connection_wseg_queue)->zerocopy = zerocopy;
+
+    /* closed at the write hard cap, the buffer has been released in handle_close() */
+    if(0 != (r = svx_tcp_connection_check_high_water_mark(self, data_len_old))) return r;
+
+    if(!self->auto_cork && zerocopy && (0 == (channel_events & SVX_CHANNEL_EVENT_WRITE)) && 0 == data_len_old)
+        r = svx_tcp_connection_flush(self);
+    else
+        r = svx_tcp_connection_schedule_write(self, channel_events);
+    if(0 != r)
+    {
+        /* the buffer is owned by wsegs now, it will be released in handle_close() */
+        SVX_LOG_ERRNO_ERR(r, NULL);
+        svx_tcp_connection_handle_close(self);
+        return r;
+    }
+
+    return 0;
+
+ err:
+    svx_tcp_connection_handle_close(self);
+ end:
+    if(free_cb) free_cb((uint8_t *)buf, free_cb_arg);
+    return r;
+}
+
+typedef struct
+{
+    svx_tcp_connection_t         *self;
+    uint8_t                      *buf;
+    size_t                        len;
+    svx_tcp_connection_free_cb_t  free_cb;
+    void                         *free_cb_arg;
+} svx_tcp_connection_write_owned_param_t;
+static void svx_tcp_connection_write_owned_run(void *arg)
+{
+    svx_tcp_connection_write_owned_param_t *p = (svx_tcp_connection_write_owned_param_t *)arg;
+    svx_tcp_connection_write_ref(p->self, p->buf, p->len, p->free_cb, p->free_cb_arg);
+}
+static void svx_tcp_connection_write_owned_clean(void *arg)
+{
+    svx_tcp_connection_write_owned_param_t *p = (svx_tcp_connection_write_owned_param_t *)arg;
+    if(p->free_cb) p->free_cb(p->buf, p->free_cb_arg);
+}
+int svx_tcp_connection_write_owned(svx_tcp_connection_t *self, uint8_t *buf, size_t len,
+                                   svx_tcp_connection_free_cb_t free_cb, void *free_cb_arg)
+{
+    if(NULL == self || NULL == buf || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        /* the buffer is passed by reference, no copy */
+        svx_tcp_connection_write_owned_param_t p = {self, buf, len, free_cb, free_cb_arg};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_write_owned_run, svx_tcp_connection_write_owned_clean, &p, sizeof(p));
+        return 0;
+    }
+
+    return svx_tcp_connection_write_ref(self, buf, len, free_cb, free_cb_arg);
+}
+
+static void svx_tcp_connection_buf_free_cb(uint8_t *data, void *arg)
+{
+    SVX_UTIL_UNUSED(data);
+
+    svx_buf_del_ref((svx_buf_t *)arg);
+}
+
+typedef struct
+{
+    svx_tcp_connection_t *self;
+    svx_buf_t            *buf;
+    size_t                offset;
+    size_t                len;
+} svx_tcp_connection_write_buf_param_t;
+static void svx_tcp_connection_write_buf_run(void *arg)
+{
+    svx_tcp_connection_write_buf_param_t *p    = (svx_tcp_connection_write_buf_param_t *)arg;
+    uint8_t                              *data = NULL;
+
+    svx_buf_get_ptr(p->buf, &data, NULL);
+    svx_tcp_connection_write_ref(p->self, data + p->offset, p->len, svx_tcp_connection_buf_free_cb, p->buf);
+}
+static void svx_tcp_connection_write_buf_clean(void *arg)
+{
+    svx_tcp_connection_write_buf_param_t *p = (svx_tcp_connection_write_buf_param_t *)arg;
+    svx_buf_del_ref(p->buf);
+}
+int svx_tcp_connection_write_buf(svx_tcp_connection_t *self, svx_buf_t *buf, size_t offset, size_t len)
+{
+    uint8_t *data     = NULL;
+    size_t   data_len = 0;
+    int      r        = 0;
+
+    if(NULL == self || NULL == buf || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+
+    if(0 != (r = svx_buf_get_ptr(buf, &data, &data_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(offset > data_len || len > data_len - offset)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_RANGE, "offset:%zu, len:%zu, buf_len:%zu\n", offset, len, data_len);
+
+    /* the slice holds a reference of the buf until it has been sent */
+    svx_buf_add_ref(buf);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        svx_tcp_connection_write_buf_param_t p = {self, buf, offset, len};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_write_buf_run, svx_tcp_connection_write_buf_clean, &p, sizeof(p));
+        return 0;
+    }
+
+    return svx_tcp_connection_write_ref(self, data + offset, len, svx_tcp_connection_buf_free_cb, buf);
+}
+
+typedef struct
+{
+    svx_tcp_connection_t                  *self;
+    int                                    fd;
+    off_t                                  offset;
+    size_t                                 len;
+    svx_tcp_connection_sendfile_done_cb_t  done_cb;
+    void                                  *done_cb_arg;
+} svx_tcp_connection_sendfile_param_t;
+static int svx_tcp_connection_sendfile_in_loop(svx_tcp_connection_t *self, int fd, off_t offset, size_t len,
+                                               svx_tcp_connection_sendfile_done_cb_t done_cb, void *done_cb_arg)
+{
+    uint8_t channel_events = 0;
+    size_t  data_len_old   = 0;
+    int     r              = 0;
+
+    if(self->flow_aborted)
+    {
+        if(done_cb) done_cb(fd, SVX_ERRNO_REACH, done_cb_arg);
+        SVX_LOG_ERRNO_RETURN_NOTICE(SVX_ERRNO_REACH, "write hard cap reached. sendfile failed. fd:%d\n", self->fd);
+    }
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+    {
+        if(done_cb) done_cb(fd, SVX_ERRNO_NOTCONN, done_cb_arg);
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. sendfile failed. fd:%d\n", self->fd);
+    }
+
+    svx_channel_get_events(self->channel, &channel_events);
+    data_len_old = svx_tcp_connection_get_unsent_len(self);
+
+    /* queue the file range, keep the order with the data written before and after it */
+    if(0 != (r = svx_tcp_connection_add_file_wseg(self, fd, offset, len, done_cb, done_cb_arg)))
+    {
+        if(done_cb) done_cb(fd, r, done_cb_arg);
+        SVX_LOG_ERRNO_ERR(r, "add_file_wseg() error. fd:%d\n", self->fd);
+        svx_tcp_connection_handle_close(self);
+        return r;
+    }
+
+    /* closed at the write hard cap, done_cb has been called in handle_close() */
+    if(0 != (r = svx_tcp_connection_check_high_water_mark(self, data_len_old))) return r;
+
+    if(!self->auto_cork && (0 == (channel_events & SVX_CHANNEL_EVENT_WRITE)) && 0 == data_len_old)
+        r = svx_tcp_connection_flush(self);
+    else
+        r = svx_tcp_connection_schedule_write(self, channel_events);
+    if(0 != r)
+    {
+        /* the file range is owned by wsegs now, done_cb will be called in handle_close() */
+        SVX_LOG_ERRNO_ERR(r, NULL);
+        svx_tcp_connection_handle_close(self);
+        return r;
+    }
+
+    return 0;
+}
+static void svx_tcp_connection_sendfile_run(void *arg)
+{
+    svx_tcp_connection_sendfile_param_t *p = (svx_tcp_connection_sendfile_param_t *)arg;
+    svx_tcp_connection_sendfile_in_loop(p->self, p->fd, p->offset, p->len, p->done_cb, p->done_cb_arg);
+}
+static void svx_tcp_connection_sendfile_clean(void *arg)
+{
+    svx_tcp_connection_sendfile_param_t *p = (svx_tcp_connection_sendfile_param_t *)arg;
+    if(p->done_cb) p->done_cb(p->fd, SVX_ERRNO_NOTCONN, p->done_cb_arg);
+}
+int svx_tcp_connection_sendfile(svx_tcp_connection_t *self, int fd, off_t offset, size_t len,
+                                svx_tcp_connection_sendfile_done_cb_t done_cb, void *done_cb_arg)
+{
+    if(NULL == self || fd < 0 || offset < 0 || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, fd:%d, offset:%jd, len:%zu\n", self, fd, (intmax_t)offset, len);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        svx_tcp_connection_sendfile_param_t p = {self, fd, offset, len, done_cb, done_cb_arg};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_sendfile_run, svx_tcp_connection_sendfile_clean, &p, sizeof(p));
+        return 0;
+    }
+
+    return svx_tcp_connection_sendfile_in_loop(self, fd, offset, len, done_cb, done_cb_arg);
+}
+
+int svx_tcp_connection_recv_to_fd(svx_tcp_connection_t *self, int fd, uint64_t len,
+                                  svx_tcp_connection_recv_to_fd_done_cb_t done_cb, void *done_cb_arg)
+{
+    uint8_t *buf1 = NULL, *buf2 = NULL;
+    size_t   buf1_len = 0, buf2_len = 0;
+    size_t   k;
+    int      r;
+
+    if(NULL == self || fd < 0 || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, fd:%d, len:%"PRIu64"\n", self, fd, len);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. recv to fd failed. fd:%d\n", self->fd);
+    if(self->recv_fd >= 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_REPEAT, "already receiving to fd:%d. fd:%d\n", self->recv_fd, self->fd);
+    if(self->hooks.read_hook)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "the reading has been taken over by the hook. fd:%d\n", self->fd);
+
+    /* take out the data in read_buf first */
+    svx_circlebuf_get_data_ptr(self->read_buf, &buf1, &buf1_len, &buf2, &buf2_len);
+    k = (buf1_len < len ? buf1_len : (size_t)len);
+    if(k > 0)
+    {
+        if(0 != (r = svx_tcp_connection_write_fd(fd, buf1, k))) return r;
+        svx_circlebuf_erase_data(self->read_buf, k);
+        len -= k;
+    }
+    k = (buf2_len < len ? buf2_len : (size_t)len);
+    if(k > 0)
+    {
+        if(0 != (r = svx_tcp_connection_write_fd(fd, buf2, k))) return r;
+        svx_circlebuf_erase_data(self->read_buf, k);
+        len -= k;
+    }
+
+    /* the rest data will be moved by splice(), fall back to copy mode if pipe is unavailable */
+    if(len > 0 && 0 != pipe2(self->recv_pipe_fds, O_NONBLOCK | O_CLOEXEC))
+    {
+        SVX_LOG_ERRNO_NOTICE(errno, "pipe2() failed, use copy mode. fd:%d\n", self->fd);
+        self->recv_pipe_fds[0] = -1;
+        self->recv_pipe_fds[1] = -1;
+    }
+
+    /* if len is 0 now, it will be finished after the read callback */
+    self->recv_fd          = fd;
+    self->recv_remaining   = len;
+    self->recv_done_cb     = done_cb;
+    self->recv_done_cb_arg = done_cb_arg;
+    svx_tcp_connection_update_rcvlowat(self);
+    return 0;
+}
+
+static int svx_tcp_connection_write_stream_in_loop(svx_tcp_connection_t *self,
+                                                   svx_tcp_connection_produce_cb_t produce_cb, void *produce_cb_arg)
+{
+    uint8_t  channel_events = 0;
+    uint8_t *buf            = NULL;
+    int      r              = 0;
+
+    if(self->flow_aborted)
+    {
+        produce_cb(self, NULL, 0, NULL, NULL, produce_cb_arg);
+        SVX_LOG_ERRNO_RETURN_NOTICE(SVX_ERRNO_REACH, "write hard cap reached. write stream failed. fd:%d\n", self->fd);
+    }
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+    {
+        produce_cb(self, NULL, 0, NULL, NULL, produce_cb_arg);
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. write stream failed. fd:%d\n", self->fd);
+    }
+
+    /* queue the stream, keep the order with the data written before and after it */
+    if(NULL == (buf = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, SVX_TCP_CONNECTION_STREAM_BUF_LEN)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
+    if(0 != (r = svx_tcp_connection_add_stream_wseg(self, buf, produce_cb, produce_cb_arg)))
+        SVX_LOG_ERRNO_GOTO_ERR(err, r, "add_stream_wseg() error. fd:%d\n", self->fd);
+
+    svx_channel_get_events(self->channel, &channel_events);
+    if(0 != (r = svx_tcp_connection_schedule_write(self, channel_events)))
+    {
+        /* the stream is owned by wsegs now, produce_cb will be called in handle_close() */
+        SVX_LOG_ERRNO_ERR(r, NULL);
+        svx_tcp_connection_handle_close(self);
+        return r;
+    }
+
+    return 0;
+
+ err:
+    if(buf) svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, buf);
+    produce_cb(self, NULL, 0, NULL, NULL, produce_cb_arg);
+    svx_tcp_connection_handle_close(self);
+    return r;
+}
+
+typedef struct
+{
+    svx_tcp_connection_t            *self;
+    svx_tcp_connection_produce_cb_t  produce_cb;
+    void                            *produce_cb_arg;
+} svx_tcp_connection_write_stream_param_t;
+static void svx_tcp_connection_write_stream_run(void *arg)
+{
+    svx_tcp_connection_write_stream_param_t *p = (svx_tcp_connection_write_stream_param_t *)arg;
+    svx_tcp_connection_write_stream_in_loop(p->self, p->produce_cb, p->produce_cb_arg);
+}
+static void svx_tcp_connection_write_stream_clean(void *arg)
+{
+    svx_tcp_connection_write_stream_param_t *p = (svx_tcp_connection_write_stream_param_t *)arg;
+    p->produce_cb(p->self, NULL, 0, NULL, NULL, p->produce_cb_arg);
+}
+int svx_tcp_connection_write_stream(svx_tcp_connection_t *self, svx_tcp_connection_produce_cb_t produce_cb, void *produce_cb_arg)
+{
+    if(NULL == self || NULL == produce_cb)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, produce_cb:%p\n", self, produce_cb);
+
+    if(!svx_looper_is_loop_thread(self->looper))
+    {
+        svx_tcp_connection_write_stream_param_t p = {self, produce_cb, produce_cb_arg};
+        svx_looper_dispatch(self->looper, svx_tcp_connection_write_stream_run, svx_tcp_connection_write_stream_clean, &p, sizeof(p));
+        return 0;
+    }
+
+    return svx_tcp_connection_write_stream_in_loop(self, produce_cb, produce_cb_arg);
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_resume_stream, svx_tcp_connection_t *, self)
+int svx_tcp_connection_resume_stream(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_wseg_t *wseg           = NULL;
+    uint8_t                    channel_events = 0;
+    int                        r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_resume_stream, self);
+
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. resume stream failed. fd:%d\n", self->fd);
+
+    /* only the stalled stream at the head of wsegs need to be resumed */
+    wseg = TAILQ_FIRST(&(self->wsegs));
+    if(NULL == wseg || NULL == wseg->stream_cb || wseg->copy_before > 0 || wseg->sent < wseg->len) return 0;
+
+    svx_channel_get_events(self->channel, &channel_events);
+    if(0 != (r = svx_tcp_connection_schedule_write(self, channel_events)))
+    {
+        SVX_LOG_ERRNO_ERR(r, NULL);
+        svx_tcp_connection_handle_close(self);
+        return r;
+    }
+
+    return 0;
+}
+
+SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_shutdown_wr, svx_tcp_connection_t *, self)
+int svx_tcp_connection_shutdown_wr(svx_tcp_connection_t *self)
+{
+    uint8_t channel_events = 0;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_shutdown_wr, self);
+
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state) return 0;
+
+    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTING;
+    svx_channel_get_events(self->channel, &channel_events);
+    if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
+        shutdown(self->fd, SHUT_WR);
     
-    if(NULL == self || NULL == addr)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, addr:%p\n", self, addr);
+    return 0;
+}
+
+int svx_tcp_connection_close(svx_tcp_connection_t *self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    /* always close the connection in the next round */
+    SVX_LOOPER_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_handle_local_close, self);
+
+    return 0;
+}
+
+int svx_tcp_connection_get_handle(svx_tcp_connection_t *self, svx_tcp_connection_handle_t *handle)
+{
+    if(NULL == self || NULL == handle) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, handle:%p\n", self, handle);
+
+    *handle = self->handle;
+    return 0;
+}
+
+typedef struct
+{
+    svx_tcp_connection_handle_t  handle;
+    uint8_t                     *buf;
+    size_t                       len;
+} svx_tcp_connection_write_by_handle_param_t;
+static void svx_tcp_connection_write_by_handle_run(void *arg)
+{
+    svx_tcp_connection_write_by_handle_param_t *p = (svx_tcp_connection_write_by_handle_param_t *)arg;
+    svx_looper_t                               *looper;
+    svx_tcp_connection_t                       *conn;
+
+    /* the connection may have been destroyed after the dispatching */
+    if(0 == svx_tcp_connection_resolve_handle(p->handle, &looper, &conn))
+        svx_tcp_connection_write(conn, p->buf, p->len);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, p->buf);
+}
+static void svx_tcp_connection_write_by_handle_clean(void *arg)
+{
+    svx_tcp_connection_write_by_handle_param_t *p = (svx_tcp_connection_write_by_handle_param_t *)arg;
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, p->buf);
+}
+int svx_tcp_connection_write_by_handle(svx_tcp_connection_handle_t handle, const uint8_t *buf, size_t len)
+{
+    svx_looper_t         *looper;
+    svx_tcp_connection_t *conn;
+    uint8_t              *buf2;
+    int                   r;
+
+    if(NULL == buf || 0 == len) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "buf:%p, len:%zu\n", buf, len);
+
+    /* a stale handle is rejected here cheaply, it is an expected case so no error is logged */
+    if(0 != (r = svx_tcp_connection_resolve_handle(handle, &looper, &conn))) return r;
+
+    if(svx_looper_is_loop_thread(looper))
+        return svx_tcp_connection_write(conn, buf, len);
+
+    if(NULL == (buf2 = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, len))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    memcpy(buf2, buf, len);
+    svx_tcp_connection_write_by_handle_param_t p = {handle, buf2, len};
+    if(0 != (r = svx_looper_dispatch(looper, svx_tcp_connection_write_by_handle_run,
+                                     svx_tcp_connection_write_by_handle_clean, &p, sizeof(p))))
+    {
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, buf2);
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    }
+
+    return 0;
+}
+
+static void svx_tcp_connection_close_by_handle_run(void *arg)
+{
+    svx_tcp_connection_handle_t *handle = (svx_tcp_connection_handle_t *)arg;
+    svx_looper_t                *looper;
+    svx_tcp_connection_t        *conn;
+
+    if(0 == svx_tcp_connection_resolve_handle(*handle, &looper, &conn))
+        svx_tcp_connection_handle_local_close(conn);
+}
+int svx_tcp_connection_close_by_handle(svx_tcp_connection_handle_t handle)
+{
+    svx_looper_t *looper;
+    int           r;
+
+    if(0 != (r = svx_tcp_connection_resolve_handle(handle, &looper, NULL))) return r;
+
+    /* always close the connection in the next round */
+    if(0 != (r = svx_looper_dispatch(looper, svx_tcp_connection_close_by_handle_run, NULL, &handle, sizeof(handle))))
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
+}
+
+/* call the done callbacks of the finished offloads in the submitted order */
+static void svx_tcp_connection_complete_offloads(svx_tcp_connection_t *self)
+{
+    svx_tcp_connection_offload_t *offload;
+
+    svx_tcp_connection_add_ref(self);
+
+    while(NULL != (offload = TAILQ_FIRST(&(self->offloads))) && offload->finished)
+    {
+        TAILQ_REMOVE(&(self->offloads), offload, link);
+        self->offloads_cnt--;
+        offload->done_cb(self, offload->errnum, offload->arg);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, offload);
+    }
+
+    /* resume the reading, and deliver the pipelined requests which are left in the read buffer */
+    if(self->offload_paused && (0 == self->offloads_max || self->offloads_cnt < self->offloads_max) &&
+       SVX_TCP_CONNECTION_STATE_CONNECTED == self->state)
+    {
+        self->offload_paused = 0;
+        svx_tcp_connection_update_read_event(self);
+        svx_tcp_connection_deliver(self);
+    }
+
+    svx_tcp_connection_del_ref(self);
+}
+
+/* in the loop thread */
+static void svx_tcp_connection_offload_done(void *arg)
+{
+    svx_tcp_connection_offload_t *offload = (svx_tcp_connection_offload_t *)arg;
+
+    offload->finished = 1;
+
+    if(NULL == offload->conn)
+    {
+        offload->done_cb(NULL, offload->errnum, offload->arg);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, offload);
+        return;
+    }
+
+    svx_tcp_connection_complete_offloads(offload->conn);
+}
+
+/* the looper is destroyed before the done, maybe not in the loop thread */
+static void svx_tcp_connection_offload_drop(void *arg)
+{
+    svx_tcp_connection_offload_t *offload = (svx_tcp_connection_offload_t *)arg;
+
+    if(NULL != offload->conn)
+    {
+        TAILQ_REMOVE(&(offload->conn->offloads), offload, link);
+        offload->conn->offloads_cnt--;
+    }
+    offload->done_cb(NULL, offload->errnum, offload->arg);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, offload);
+}
+
+/* in the threadpool's thread */
+static void svx_tcp_connection_offload_work(void *arg)
+{
+    svx_tcp_connection_offload_t *offload = (svx_tcp_connection_offload_t *)arg;
+
+    offload->work_cb(offload->handle, offload->arg);
+    svx_looper_post(offload->looper, &(offload->entry));
+}
+
+/* the threadpool is destroyed before the work is run, it is still done in the submitted order */
+static void svx_tcp_connection_offload_clean(void *arg)
+{
+    svx_tcp_connection_offload_t *offload = (svx_tcp_connection_offload_t *)arg;
+
+    offload->errnum = SVX_ERRNO_NOTRUN;
+    svx_looper_post(offload->looper, &(offload->entry));
+}
+
+int svx_tcp_connection_offload(svx_tcp_connection_t *self, svx_threadpool_t *threadpool,
+                               svx_tcp_connection_offload_work_cb_t work_cb,
+                               svx_tcp_connection_offload_done_cb_t done_cb, void *arg)
+{
+    svx_tcp_connection_offload_t *offload;
+    int                           r;
+
+    if(NULL == self || NULL == threadpool || NULL == work_cb || NULL == done_cb)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, threadpool:%p, work_cb:%p, done_cb:%p\n",
+                                 self, threadpool, work_cb, done_cb);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. offload failed. fd:%d\n", self->fd);
+
+    /* the limit is reached, stop reading until some of them are finished */
+    if(self->offloads_max > 0 && self->offloads_cnt >= self->offloads_max)
+    {
+        if(!self->offload_paused)
+        {
+            self->offload_paused = 1;
+            svx_tcp_connection_update_read_event(self);
+        }
+        return SVX_ERRNO_REACH;
+    }
+
+    if(NULL == (offload = svx_alloc_malloc(SVX_ALLOC_TAG_TCP_CONNECTION, sizeof(svx_tcp_connection_offload_t))))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    offload->conn     = self;
+    offload->looper   = self->looper;
+    offload->handle   = self->handle;
+    offload->work_cb  = work_cb;
+    offload->done_cb  = done_cb;
+    offload->arg      = arg;
+    offload->errnum   = 0;
+    offload->finished = 0;
+    svx_looper_post_entry_init(&(offload->entry), svx_tcp_connection_offload_done,
+                               svx_tcp_connection_offload_drop, offload);
+
+    TAILQ_INSERT_TAIL(&(self->offloads), offload, link);
+    self->offloads_cnt++;
+
+    if(0 != (r = svx_threadpool_dispatch(threadpool, svx_tcp_connection_offload_work,
+                                         svx_tcp_connection_offload_clean, offload)))
+    {
+        TAILQ_REMOVE(&(self->offloads), offload, link);
+        self->offloads_cnt--;
+        svx_alloc_free(SVX_ALLOC_TAG_TCP_CONNECTION, offload);
+        if(SVX_ERRNO_REACH == r) return r; /* the threadpool's task queue is full */
+        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    }
+
+    return 0;
+}
+
+int svx_tcp_connection_get_looper(svx_tcp_connection_t *self, svx_looper_t **looper)
+{
+    if(NULL == self || NULL == looper) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p\n", self, looper);
+
+    *looper = self->looper;
+    return 0;
+}
+
+int svx_tcp_connection_get_fd(svx_tcp_connection_t *self, int *fd)
+{
+    if(NULL == self || NULL == fd) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, fd:%p\n", self, fd);
+
+    *fd = self->fd;
+    return 0;
+}
+
+int svx_tcp_connection_get_read_stats(svx_tcp_connection_t *self, svx_tcp_connection_read_stats_t *stats)
+{
+    if(NULL == self || NULL == stats) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, stats:%p\n", self, stats);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    *stats = self->read_stats;
+    return 0;
+}
+
+int svx_tcp_connection_get_write_queue_len(svx_tcp_connection_t *self, size_t *len)
+{
+    if(NULL == self || NULL == len) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, len:%p\n", self, len);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    *len = svx_tcp_connection_get_unsent_len(self);
+    return 0;
+}
+
+int svx_tcp_connection_is_connected(svx_tcp_connection_t *self)
+{
+    if(NULL == self) return 0;
+
+    return (SVX_TCP_CONNECTION_STATE_CONNECTED == self->state ? 1 : 0);
+}
+
+int svx_tcp_connection_set_hooks(svx_tcp_connection_t *self, const svx_tcp_connection_hooks_t *hooks)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    if(NULL == hooks)
+    {
+        memset(&(self->hooks), 0, sizeof(self->hooks));
+        if(self->write_hook_enable)
+            if(0 != (r = svx_tcp_connection_disable_write_hook(self))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    }
+    else
+    {
+        self->hooks = *hooks;
+    }
+
+    svx_tcp_connection_update_rcvlowat(self);
+    return 0;
+}
+
+int svx_tcp_connection_enable_write_hook(svx_tcp_connection_t *self)
+{
+    uint8_t channel_events = 0;
+    int     r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
 
-    if(0 != (r = svx_inetaddr_from_fd_peer(addr, self->fd))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. enable write hook failed. fd:%d\n", self->fd);
 
-    return 0;
-}
+    self->write_hook_enable = 1;
 
-int svx_tcp_connection_get_info(svx_tcp_connection_t *self, void **info)
-{
-    if(NULL == self || NULL == info)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, info:%p\n", self, info);
+    svx_channel_get_events(self->channel, &channel_events);
+    if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
+        if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
 
-    *info = self->info;
     return 0;
 }
 
-int svx_tcp_connection_set_context(svx_tcp_connection_t *self, void *context)
+int svx_tcp_connection_disable_write_hook(svx_tcp_connection_t *self)
 {
-    if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    uint8_t channel_events = 0;
+    int     r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    self->write_hook_enable = 0;
+
+    /* keep watching if there is still unsent data in the write buffer */
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state) return 0;
+    if(svx_tcp_connection_get_unsent_len(self) > 0) return 0;
+
+    svx_channel_get_events(self->channel, &channel_events);
+    if(channel_events & SVX_CHANNEL_EVENT_WRITE)
+        if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
 
-    self->context = context;
     return 0;
 }
 
-int svx_tcp_connection_get_context(svx_tcp_connection_t *self, void **context)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_auto_cork, svx_tcp_connection_t *, self, int, on)
+int svx_tcp_connection_set_auto_cork(svx_tcp_connection_t *self, int on)
 {
-    if(NULL == self || NULL == context)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, context:%p\n", self, context);
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_auto_cork, self, on);
+
+    self->auto_cork = (on ? 1 : 0);
 
-    *context = self->context;
     return 0;
 }
 
-static int svx_tcp_connection_destroy_safely(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_5(svx_tcp_connection_set_write_flow_control, svx_tcp_connection_t *, self, size_t, low_mark,
+                          size_t, high_mark, size_t, hard_cap, svx_tcp_connection_flow_stats_t *, stats)
+int svx_tcp_connection_set_write_flow_control(svx_tcp_connection_t *self, size_t low_mark, size_t high_mark,
+                                              size_t hard_cap, svx_tcp_connection_flow_stats_t *stats)
 {
     int r;
-    
-    if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    if(0 != (r = svx_circlebuf_destroy(&(self->read_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(0 != (r = svx_circlebuf_destroy(&(self->write_buf)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(0 != (r = svx_channel_destroy(&(self->channel)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    if(self->fd >= 0) if(0 != close(self->fd)) SVX_LOG_ERRNO_RETURN_ERR(errno, NULL);
-    
-    if(self->callbacks->closed_cb)
-        self->callbacks->closed_cb(self, self->callbacks->closed_cb_arg);
+    if(NULL == self || (high_mark > 0 && (low_mark >= high_mark || (hard_cap > 0 && hard_cap < high_mark))))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, low_mark:%zu, high_mark:%zu, hard_cap:%zu\n",
+                                 self, low_mark, high_mark, hard_cap);
 
-    free(self);
-    return 0;
-}
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_destroy_safely, svx_tcp_connection_t *, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_5(self->looper, svx_tcp_connection_set_write_flow_control, self,
+                                       low_mark, high_mark, hard_cap, stats);
 
-int svx_tcp_connection_add_ref(svx_tcp_connection_t *self)
-{
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    self->flow_low_mark  = low_mark;
+    self->flow_high_mark = high_mark;
+    self->flow_hard_cap  = hard_cap;
+    self->flow_stats     = stats;
 
-    if(!svx_looper_is_loop_thread(self->looper))
+    if(0 == high_mark && self->flow_paused)
     {
-        SVX_LOG_ERRNO_ERR(SVX_ERRNO_UNKNOWN, NULL);
-        exit(1);
+        /* turned off, resume the reading */
+        self->flow_paused = 0;
+        if(SVX_TCP_CONNECTION_STATE_DISCONNECTED != self->state)
+            if(0 != (r = svx_tcp_connection_update_read_event(self)))
+                SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
     }
 
-    self->ref_count++;
+    /* the new hard cap may have been reached already */
+    if(0 != (r = svx_tcp_connection_check_flow_control(self))) return r;
+
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_del_ref, svx_tcp_connection_t *, self)
-int svx_tcp_connection_del_ref(svx_tcp_connection_t *self)
+/* the rate limit has been changed, check the parked reading and writing in the next tick */
+static int svx_tcp_connection_repark(svx_tcp_connection_t *self)
 {
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    int r;
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_del_ref, self);
+    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state || (!self->read_parked && !self->write_parked)) return 0;
+
+    self->unpark_ms = 0;
+    if(0 != (r = svx_looper_wheel_add(self->looper, &(self->unpark_entry), 0))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
 
-    self->ref_count--;
-    if(0 == self->ref_count)
-    {
-        /* always destroy the conn in the next round */
-        SVX_LOOPER_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_destroy_safely, self);
-    }
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_read, svx_tcp_connection_t *, self)
-int svx_tcp_connection_enable_read(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_5(svx_tcp_connection_set_rate_limit, svx_tcp_connection_t *, self, size_t, read_rate,
+                          size_t, read_burst, size_t, write_rate, size_t, write_burst)
+int svx_tcp_connection_set_rate_limit(svx_tcp_connection_t *self, size_t read_rate, size_t read_burst,
+                                      size_t write_rate, size_t write_burst)
 {
     int r;
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_read, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_5(self->looper, svx_tcp_connection_set_rate_limit, self,
+                                       read_rate, read_burst, write_rate, write_burst);
 
-    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. enable read failed. fd:%d\n", self->fd);
+    if(self->read_bucket)  svx_token_bucket_destroy(&(self->read_bucket));
+    if(self->write_bucket) svx_token_bucket_destroy(&(self->write_bucket));
 
-    if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_READ)))
-        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    
-    return 0;
+    if(read_rate > 0)
+        if(0 != (r = svx_token_bucket_create(&(self->read_bucket), read_rate, read_burst)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    if(write_rate > 0)
+        if(0 != (r = svx_token_bucket_create(&(self->write_bucket), write_rate, write_burst)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return svx_tcp_connection_repark(self);
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_read, svx_tcp_connection_t *, self)
-int svx_tcp_connection_disable_read(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_3(svx_tcp_connection_set_shared_rate_limit, svx_tcp_connection_t *, self,
+                          svx_token_bucket_t *, read_bucket, svx_token_bucket_t *, write_bucket)
+int svx_tcp_connection_set_shared_rate_limit(svx_tcp_connection_t *self, svx_token_bucket_t *read_bucket,
+                                             svx_token_bucket_t *write_bucket)
 {
-    int r;
-
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_read, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_3(self->looper, svx_tcp_connection_set_shared_rate_limit, self,
+                                       read_bucket, write_bucket);
 
-    if(SVX_TCP_CONNECTION_STATE_DISCONNECTED == self->state)
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. disable read failed. fd:%d\n", self->fd);
+    self->read_shared_bucket  = read_bucket;
+    self->write_shared_bucket = write_bucket;
 
-    if(0 != (r = svx_channel_del_events(self->channel, SVX_CHANNEL_EVENT_READ)))
-        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    
-    return 0;
+    return svx_tcp_connection_repark(self);
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_write_completed, svx_tcp_connection_t *, self)
-int svx_tcp_connection_enable_write_completed(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_3(svx_tcp_connection_set_read_quota, svx_tcp_connection_t *, self, size_t, bytes,
+                          unsigned int, callbacks)
+int svx_tcp_connection_set_read_quota(svx_tcp_connection_t *self, size_t bytes, unsigned int callbacks)
 {
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(NULL == self || 0 == callbacks)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, callbacks:%u\n", self, callbacks);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_write_completed, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_3(self->looper, svx_tcp_connection_set_read_quota, self, bytes, callbacks);
+
+    self->read_quota_bytes = bytes;
+    self->read_quota_cbs   = callbacks;
+    self->read_deficit     = 0;
 
-    self->write_completed_enable = 1;
-    
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_write_completed, svx_tcp_connection_t *, self)
-int svx_tcp_connection_disable_write_completed(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_read_weight, svx_tcp_connection_t *, self, unsigned int, weight)
+int svx_tcp_connection_set_read_weight(svx_tcp_connection_t *self, unsigned int weight)
 {
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(NULL == self || 0 == weight || weight > SVX_TCP_CONNECTION_READ_WEIGHT_MAX)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, weight:%u\n", self, weight);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_write_completed, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_read_weight, self, weight);
+
+    self->read_weight = weight;
 
-    self->write_completed_enable = 0;
-    
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_enable_high_water_mark, svx_tcp_connection_t *, self)
-int svx_tcp_connection_enable_high_water_mark(svx_tcp_connection_t *self)
+/* deliver the data which is already in read_buf after the read low-water mark is lowered */
+static void svx_tcp_connection_deliver_run(void *arg)
 {
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    svx_tcp_connection_t *self = *((svx_tcp_connection_t **)arg);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_enable_high_water_mark, self);
+    svx_tcp_connection_deliver(self);
+    svx_tcp_connection_update_rcvlowat(self);
+    svx_tcp_connection_del_ref(self);
+}
+static void svx_tcp_connection_deliver_clean(void *arg)
+{
+    svx_tcp_connection_t *self = *((svx_tcp_connection_t **)arg);
+
+    svx_tcp_connection_del_ref(self);
+}
+
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_read_lowat, svx_tcp_connection_t *, self, size_t, lowat)
+int svx_tcp_connection_set_read_lowat(svx_tcp_connection_t *self, size_t lowat)
+{
+    size_t data_len = 0;
+
+    if(NULL == self || lowat > self->read_buf_max_len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, lowat:%zu\n", self, lowat);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_read_lowat, self, lowat);
+
+    self->read_lowat = (0 == lowat ? 1 : lowat);
+    svx_tcp_connection_update_rcvlowat(self);
+
+    /* no more data may arrive, so do not wait for the next reading */
+    svx_circlebuf_get_data_len(self->read_buf, &data_len);
+    if(data_len > 0 && data_len >= self->read_lowat && SVX_TCP_CONNECTION_STATE_DISCONNECTED != self->state)
+    {
+        svx_tcp_connection_add_ref(self);
+        svx_looper_dispatch(self->looper, svx_tcp_connection_deliver_run, svx_tcp_connection_deliver_clean,
+                            &self, sizeof(self));
+    }
 
-    self->high_water_mark_enable = 1;
-    
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_disable_high_water_mark, svx_tcp_connection_t *, self)
-int svx_tcp_connection_disable_high_water_mark(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_offload_limit, svx_tcp_connection_t *, self, unsigned int, max_inflight)
+int svx_tcp_connection_set_offload_limit(svx_tcp_connection_t *self, unsigned int max_inflight)
 {
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_disable_high_water_mark, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_offload_limit, self, max_inflight);
+
+    self->offloads_max = max_inflight;
+
+    /* resume the reading if the limit is raised, and deliver the requests which are left in read_buf */
+    if(self->offload_paused && (0 == max_inflight || self->offloads_cnt < max_inflight))
+    {
+        self->offload_paused = 0;
+        svx_tcp_connection_update_read_event(self);
+        svx_tcp_connection_add_ref(self);
+        svx_looper_dispatch(self->looper, svx_tcp_connection_deliver_run, svx_tcp_connection_deliver_clean,
+                            &self, sizeof(self));
+    }
 
-    self->high_water_mark_enable = 0;
-    
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_shrink_read_buf, svx_tcp_connection_t *, self, size_t, freespace_keep)
-int svx_tcp_connection_shrink_read_buf(svx_tcp_connection_t *self, size_t freespace_keep)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_fionread, svx_tcp_connection_t *, self, int, on)
+int svx_tcp_connection_set_fionread(svx_tcp_connection_t *self, int on)
 {
-    int r;
-
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_shrink_read_buf, self, freespace_keep);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_fionread, self, on);
+
+    self->read_fionread = (on ? 1 : 0);
 
-    if(0 != (r = svx_circlebuf_shrink(self->read_buf, freespace_keep)))
-        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    
     return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_shrink_write_buf, svx_tcp_connection_t *, self, size_t, freespace_keep)
-int svx_tcp_connection_shrink_write_buf(svx_tcp_connection_t *self, size_t freespace_keep)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_mirrored_read_buf, svx_tcp_connection_t *, self, int, on)
+int svx_tcp_connection_set_mirrored_read_buf(svx_tcp_connection_t *self, int on)
 {
-    int r;
+    svx_circlebuf_t *read_buf  = NULL;
+    svx_bufpool_t   *pool      = NULL;
+    size_t           data_len  = 0;
+    size_t           max_len   = 0;
+    size_t           page_size = 0;
+    int              r         = 0;
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_shrink_write_buf, self, freespace_keep);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_mirrored_read_buf, self, on);
+
+    /* the read buffer can only be replaced before any data is received */
+    svx_circlebuf_get_data_len(self->read_buf, &data_len);
+    if(data_len > 0) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "fd:%d, data_len:%zu\n", self->fd, data_len);
+
+    max_len = self->read_buf_max_len;
+    if(on)
+    {
+        /* the mirrored circlebuf rounds its lengths up to the page size */
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        if(0 != max_len % page_size) max_len += (page_size - max_len % page_size);
+        if(0 != (r = svx_circlebuf_create_mirrored(&read_buf, max_len, self->read_buf_min_len,
+                                                   SVX_TCP_CONNECTION_READ_BUF_MIN_STEP)))
+        {
+            if(SVX_ERRNO_NOTSPT == r)
+                SVX_LOG_ERRNO_RETURN_NOTICE(r, "mirrored circlebuf is not supported. fd:%d\n", self->fd);
+            SVX_LOG_ERRNO_RETURN_ERR(r, "fd:%d, max_len:%zu\n", self->fd, max_len);
+        }
+    }
+    else
+    {
+        svx_looper_get_bufpool(self->looper, &pool);
+        if(pool)
+            r = svx_circlebuf_create_pooled(&read_buf, pool, max_len, self->read_buf_min_len,
+                                            SVX_TCP_CONNECTION_READ_BUF_MIN_STEP);
+        else
+            r = svx_circlebuf_create(&read_buf, max_len, self->read_buf_min_len, SVX_TCP_CONNECTION_READ_BUF_MIN_STEP);
+        if(0 != r) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    }
+
+    svx_circlebuf_destroy(&(self->read_buf));
+    self->read_buf         = read_buf;
+    self->read_buf_max_len = max_len;
+    if(on) svx_circlebuf_get_buf_len(read_buf, &(self->read_buf_min_len)); /* the read_buf is never shrunk below it */
 
-    if(0 != (r = svx_circlebuf_shrink(self->write_buf, freespace_keep)))
-        SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
-    
     return 0;
 }
 
-typedef struct
-{
-    svx_tcp_connection_t *self;
-    uint8_t              *buf;
-    size_t                len;
-} svx_tcp_connection_write_param_t;
-static void svx_tcp_connection_write_run(void *arg)
-{
-    svx_tcp_connection_write_param_t *p = (svx_tcp_connection_write_param_t *)arg;
-    svx_tcp_connection_write(p->self, p->buf, p->len);
-    if(p->buf) free(p->buf);
-}
-static void svx_tcp_connection_write_clean(void *arg)
+SVX_LOOPER_GENERATE_RUN_4(svx_tcp_connection_set_timeouts, svx_tcp_connection_t *, self, int64_t, idle_ms,
+                          int64_t, read_ms, int64_t, write_ms)
+int svx_tcp_connection_set_timeouts(svx_tcp_connection_t *self, int64_t idle_ms, int64_t read_ms, int64_t write_ms)
 {
-    svx_tcp_connection_write_param_t *p = (svx_tcp_connection_write_param_t *)arg;
-    if(p->buf) free(p->buf);
+    int64_t now_ms;
+    int     r;
+
+    if(NULL == self || idle_ms < 0 || read_ms < 0 || write_ms < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, idle_ms:%"PRId64", read_ms:%"PRId64", write_ms:%"PRId64"\n",
+                                 self, idle_ms, read_ms, write_ms);
+
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_4(self->looper, svx_tcp_connection_set_timeouts, self, idle_ms, read_ms, write_ms);
+
+    now_ms = svx_tcp_connection_get_now_ms();
+    self->idle_timeout_ms  = idle_ms;
+    self->read_timeout_ms  = read_ms;
+    self->write_timeout_ms = write_ms;
+    self->last_read_ms     = now_ms;
+    self->last_write_ms    = now_ms;
+
+    /* check the new timeouts in the next tick */
+    if(0 != (r = svx_tcp_connection_schedule_timeout(self, now_ms, now_ms))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
 }
-int svx_tcp_connection_write(svx_tcp_connection_t *self, const uint8_t *buf, size_t len)
+
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_read_deadline, svx_tcp_connection_t *, self, int64_t, deadline_ms)
+int svx_tcp_connection_set_read_deadline(svx_tcp_connection_t *self, int64_t deadline_ms)
 {
-    size_t   write_buf_data_len = 0;
-    uint8_t  channel_events     = 0;
-    size_t   data_len_old       = 0;
-    size_t   data_len_new       = 0;
-    ssize_t  n                  = 0;
-    int      r                  = 0;
-    uint8_t *buf2               = NULL;
+    int64_t now_ms;
+    int     r;
 
-    if(NULL == self || NULL == buf || 0 == len) 
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+    if(NULL == self || deadline_ms < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, deadline_ms:%"PRId64"\n", self, deadline_ms);
 
-    if(!svx_looper_is_loop_thread(self->looper))
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_read_deadline, self, deadline_ms);
+
+    /* a cleared or postponed deadline is ignored when the timeout entry is run */
+    if(0 == deadline_ms)
     {
-        if(NULL == (buf2 = malloc(len))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
-        memcpy(buf2, buf, len);
-        svx_tcp_connection_write_param_t p = {self, buf2, len};
-        svx_looper_dispatch(self->looper, svx_tcp_connection_write_run, svx_tcp_connection_write_clean, &p, sizeof(p));
+        self->read_deadline_ms = 0;
         return 0;
     }
 
-    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state)
-        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTCONN, "not connected. write failed. fd:%d\n", self->fd);
-
-    svx_channel_get_events(self->channel, &channel_events);
-    svx_circlebuf_get_data_len(self->write_buf, &write_buf_data_len);
+    now_ms = svx_tcp_connection_get_now_ms();
+    self->read_deadline_ms = now_ms + deadline_ms;
+    if(0 != (r = svx_tcp_connection_schedule_timeout(self, self->read_deadline_ms, now_ms))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
 
-    /* if write buffer is empty, try to write immediately */
-    if((0 == (channel_events & SVX_CHANNEL_EVENT_WRITE)) && 0 == write_buf_data_len)
-    {
-        do n = write(self->fd, buf, len);
-        while(-1 == n && EINTR == errno);
+    return 0;
+}
 
-        if(n < 0)
-        {
-            /* error */
-            if(EAGAIN == errno || EWOULDBLOCK == errno)
-                n = 0; /* wrote nothing, try later */
-            else
-                SVX_LOG_ERRNO_GOTO_ERR(err, r = errno, "write() error. fd:%d\n", self->fd);
-        }
-        else
-        {
-            /* OK */
-            if(len == (size_t)n)
-            {
-                if(self->callbacks->write_completed_cb && self->write_completed_enable)
-                {
-                    svx_tcp_connection_add_ref(self);
-                    svx_tcp_connection_write_completed_callback_param_t p = {self};
-                    svx_looper_dispatch(self->looper, svx_tcp_connection_write_completed_callback_run,
-                                        svx_tcp_connection_write_completed_callback_clean, &p, sizeof(p));
-                }
-            }
-        }
-    }
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_write_deadline, svx_tcp_connection_t *, self, int64_t, deadline_ms)
+int svx_tcp_connection_set_write_deadline(svx_tcp_connection_t *self, int64_t deadline_ms)
+{
+    int64_t now_ms;
+    int     r;
 
-    /* save the rest of unsent data to the write buffer */
-    if((size_t)n < len)
-    {
-        svx_circlebuf_get_data_len(self->write_buf, &data_len_old);
-        if(0 != (r = svx_circlebuf_append_data(self->write_buf, buf + n, len - n)))
-            SVX_LOG_ERRNO_GOTO_ERR(err, r, "append_data() error. fd:%d\n", self->fd);
-        svx_circlebuf_get_data_len(self->write_buf, &data_len_new);
+    if(NULL == self || deadline_ms < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, deadline_ms:%"PRId64"\n", self, deadline_ms);
 
-        if(self->callbacks->high_water_mark_cb &&
-           self->high_water_mark_enable &&
-           data_len_new >= self->write_buf_high_water_mark && 
-           data_len_old < self->write_buf_high_water_mark)
-        {
-            svx_tcp_connection_add_ref(self);
-            svx_tcp_connection_high_water_mark_callback_param_t p = {self, data_len_new};
-            svx_looper_dispatch(self->looper, svx_tcp_connection_high_water_mark_callback_run,
-                                svx_tcp_connection_high_water_mark_callback_clean, &p, sizeof(p));
-        }
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_write_deadline, self, deadline_ms);
 
-        /* enable writing for channel */
-        if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
-        {
-            if(0 != (r = svx_channel_add_events(self->channel, SVX_CHANNEL_EVENT_WRITE)))
-                SVX_LOG_ERRNO_GOTO_ERR(err, r, "add_events() error. fd:%d\n", self->fd);
-        }
+    if(0 == deadline_ms)
+    {
+        self->write_deadline_ms = 0;
+        return 0;
     }
 
+    now_ms = svx_tcp_connection_get_now_ms();
+    self->write_deadline_ms = now_ms + deadline_ms;
+    if(0 != (r = svx_tcp_connection_schedule_timeout(self, self->write_deadline_ms, now_ms))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
     return 0;
+}
 
- err:
-    svx_tcp_connection_handle_close(self);
-    return r;
+int svx_tcp_connection_get_close_reason(svx_tcp_connection_t *self, svx_tcp_connection_close_reason_t *reason)
+{
+    if(NULL == self || NULL == reason) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, reason:%p\n", self, reason);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    *reason = self->close_reason;
+    return 0;
 }
 
-SVX_LOOPER_GENERATE_RUN_1(svx_tcp_connection_shutdown_wr, svx_tcp_connection_t *, self)
-int svx_tcp_connection_shutdown_wr(svx_tcp_connection_t *self)
+SVX_LOOPER_GENERATE_RUN_2(svx_tcp_connection_set_zerocopy, svx_tcp_connection_t *, self, size_t, threshold)
+int svx_tcp_connection_set_zerocopy(svx_tcp_connection_t *self, size_t threshold)
 {
-    uint8_t channel_events = 0;
+#if SVX_HAVE_MSG_ZEROCOPY
+    int on = 1;
+#endif
 
     if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
 
-    SVX_LOOPER_CHECK_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_shutdown_wr, self);
+    SVX_LOOPER_CHECK_DISPATCH_HELPER_2(self->looper, svx_tcp_connection_set_zerocopy, self, threshold);
 
-    if(SVX_TCP_CONNECTION_STATE_CONNECTED != self->state) return 0;
+    self->zerocopy_skip    = 0;
+    self->zerocopy_backoff = 0;
 
-    self->state = SVX_TCP_CONNECTION_STATE_DISCONNECTING;
-    svx_channel_get_events(self->channel, &channel_events);
-    if(0 == (channel_events & SVX_CHANNEL_EVENT_WRITE))
-        shutdown(self->fd, SHUT_WR);
-    
-    return 0;
-}
+    if(0 == threshold)
+    {
+        self->zerocopy_threshold = 0;
+        return 0;
+    }
 
-int svx_tcp_connection_close(svx_tcp_connection_t *self)
-{
-    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+#if SVX_HAVE_MSG_ZEROCOPY
+    if(0 != setsockopt(self->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)))
+        SVX_LOG_ERRNO_RETURN_NOTICE(SVX_ERRNO_NOTSPT, "setsockopt(SO_ZEROCOPY) failed. errno:%d, fd:%d\n", errno, self->fd);
 
-    /* always close the connection in the next round */
-    SVX_LOOPER_DISPATCH_HELPER_1(self->looper, svx_tcp_connection_handle_close, self);
+    self->zerocopy_threshold = threshold;
+#else
+    SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOTSPT, "System does NOT support MSG_ZEROCOPY.\n");
+#endif
 
     return 0;
 }
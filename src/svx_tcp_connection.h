@@ -18,10 +18,14 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include "svx_looper.h"
 #include "svx_channel.h"
 #include "svx_circlebuf.h"
+#include "svx_buf.h"
 #include "svx_inetaddr.h"
+#include "svx_token_bucket.h"
+#include "svx_threadpool.h"
 
 /*!
  * \defgroup TCP_connection TCP_connection
@@ -43,6 +47,18 @@ extern "C" {
  */
 typedef struct svx_tcp_connection svx_tcp_connection_t;
 
+/*!
+ * The type for TCP connection handle. A handle is a 64-bit value which can be copied to
+ * and used in any thread. It becomes stale when the TCP connection is destroyed, and a
+ * stale handle will never refer to another TCP connection.
+ */
+typedef uint64_t svx_tcp_connection_handle_t;
+
+/*!
+ * The invalid TCP connection handle.
+ */
+#define SVX_TCP_CONNECTION_HANDLE_INVALID ((svx_tcp_connection_handle_t)0)
+
 /*!
  * Signature for TCP connection established callback.
  *
@@ -52,7 +68,9 @@ typedef struct svx_tcp_connection svx_tcp_connection_t;
 typedef void (*svx_tcp_connection_established_cb_t)(svx_tcp_connection_t *conn, void *arg);
 
 /*!
- * Signature for TCP connection readable callback.
+ * Signature for TCP connection readable callback. The data which is left in \p buf will be kept
+ * for the next call. If the read buffer is full (\c read_buf_max_len) and nothing is taken out,
+ * the TCP connection will be closed.
  *
  * \param[in] conn  The address of the TCP connection.
  * \param[in] buf   The TCP connection's read buffer.
@@ -81,13 +99,122 @@ typedef void (*svx_tcp_connection_write_completed_cb_t)(svx_tcp_connection_t *co
 typedef void (*svx_tcp_connection_high_water_mark_cb_t)(svx_tcp_connection_t *conn, size_t water_mark, void *arg);
 
 /*!
- * Signature for TCP connection closed callback.
+ * Signature for TCP connection closed callback. The reason can be got by
+ * \link svx_tcp_connection_get_close_reason \endlink in this callback.
  *
  * \param[in] conn  The address of the TCP connection.
  * \param[in] arg   The argument which passed by \link svx_tcp_connection_create \endlink.
  */
 typedef void (*svx_tcp_connection_closed_cb_t)(svx_tcp_connection_t *conn, void *arg);
 
+/*!
+ * The reason why the TCP connection was closed.
+ */
+typedef enum
+{
+    SVX_TCP_CONNECTION_CLOSE_REASON_NONE = 0,       /*!< The TCP connection has not been closed. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_PEER,           /*!< The peer has closed the TCP connection (FIN received). */
+    SVX_TCP_CONNECTION_CLOSE_REASON_LOCAL,          /*!< Closed by \link svx_tcp_connection_close \endlink or destroyed. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_ERROR,          /*!< An I/O error or an error in a callback or a hook. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_HARD_CAP, /*!< The unsent data exceeded the hard cap of the write flow control. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_IDLE_TIMEOUT,   /*!< Nothing was read or written within the idle timeout. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_READ_TIMEOUT,   /*!< The read timeout or the read deadline expired. */
+    SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_TIMEOUT   /*!< The write timeout or the write deadline expired. */
+} svx_tcp_connection_close_reason_t;
+
+/*!
+ * Signature for releasing the buffer which passed by \link svx_tcp_connection_write_owned \endlink.
+ *
+ * \param[in] buf  The buffer passed by \link svx_tcp_connection_write_owned \endlink.
+ * \param[in] arg  The argument passed by \link svx_tcp_connection_write_owned \endlink.
+ */
+typedef void (*svx_tcp_connection_free_cb_t)(uint8_t *buf, void *arg);
+
+/*!
+ * Signature for the end of the file sending which started by \link svx_tcp_connection_sendfile \endlink.
+ *
+ * \param[in] fd      The file descriptor passed by \link svx_tcp_connection_sendfile \endlink.
+ * \param[in] errnum  Zero if the whole range of the file has been sent; otherwise, an error number.
+ *                    (e.g. SVX_ERRNO_NOTCONN if the connection closed before the sending completed)
+ * \param[in] arg     The argument passed by \link svx_tcp_connection_sendfile \endlink.
+ */
+typedef void (*svx_tcp_connection_sendfile_done_cb_t)(int fd, int errnum, void *arg);
+
+/*!
+ * Signature for the stream producer which passed by \link svx_tcp_connection_write_stream \endlink.
+ *
+ * \note  This callback is called in the loop thread, only when the stream has reached the head of
+ * the write queue, the socket is writable, and the buffered stream data is below the low water mark.
+ * Produce the data into \c buf, at most \c len bytes. If there is no data for now, return with
+ * \c *ret_len set to zero, and call \link svx_tcp_connection_resume_stream \endlink when the data
+ * is ready. After \c *eof is set, this callback will never be called again. If the TCP connection
+ * is closed before the end of stream, this callback will be called with \c buf set to \c NULL
+ * (and \c ret_len, \c eof set to \c NULL), for releasing the resources of the producer.
+ *
+ * \param[in]  conn     The address of the TCP connection.
+ * \param[out] buf      The buffer for the produced data.
+ * \param[in]  len      The length of \c buf.
+ * \param[out] ret_len  Return the length of the produced data.
+ * \param[out] eof      Set to non-zero if this is the end of stream.
+ * \param[in]  arg      The argument passed by \link svx_tcp_connection_write_stream \endlink.
+ *
+ * \return  Return zero to continue; otherwise, the TCP connection will be closed.
+ */
+typedef int (*svx_tcp_connection_produce_cb_t)(svx_tcp_connection_t *conn, uint8_t *buf, size_t len,
+                                               size_t *ret_len, int *eof, void *arg);
+
+/*!
+ * Signature for the end of the receiving which started by \link svx_tcp_connection_recv_to_fd \endlink.
+ *
+ * \param[in] conn    The address of the TCP connection.
+ * \param[in] fd      The file descriptor passed by \link svx_tcp_connection_recv_to_fd \endlink.
+ * \param[in] errnum  Zero if all the bytes have been written to \c fd; otherwise, an error number.
+ *                    (e.g. SVX_ERRNO_NOTCONN if the connection closed before the receiving completed)
+ * \param[in] arg     The argument passed by \link svx_tcp_connection_recv_to_fd \endlink.
+ */
+typedef void (*svx_tcp_connection_recv_to_fd_done_cb_t)(svx_tcp_connection_t *conn, int fd, int errnum, void *arg);
+
+/*!
+ * Signature for the work callback of an offloaded task. It is called in a thread of the threadpool.
+ *
+ * \param[in] handle  The handle of the TCP connection, it can be used to write to the TCP connection
+ *                    directly by \link svx_tcp_connection_write_by_handle \endlink.
+ * \param[in] arg     The argument passed by \link svx_tcp_connection_offload \endlink.
+ */
+typedef void (*svx_tcp_connection_offload_work_cb_t)(svx_tcp_connection_handle_t handle, void *arg);
+
+/*!
+ * Signature for the done callback of an offloaded task. It is called in the loop thread.
+ *
+ * \param[in] conn    The address of the TCP connection. \c NULL if the TCP connection has been destroyed,
+ *                    then only the resources in \c arg should be released.
+ * \param[in] errnum  Zero if the work callback has been called; SVX_ERRNO_NOTRUN if it has not been called
+ *                    (the threadpool was destroyed before). If the looper is destroyed before the done
+ *                    callback, it is called with a \c NULL \c conn, maybe not in the loop thread.
+ * \param[in] arg     The argument passed by \link svx_tcp_connection_offload \endlink.
+ */
+typedef void (*svx_tcp_connection_offload_done_cb_t)(svx_tcp_connection_t *conn, int errnum, void *arg);
+
+/*!
+ * The counters of the write flow control. They are updated atomically, so they can be shared
+ * by the TCP connections in different threads.
+ */
+typedef struct
+{
+    uint64_t paused;  /*!< How many times the reading has been paused at the high mark. */
+    uint64_t resumed; /*!< How many times the reading has been resumed at the low mark. */
+    uint64_t aborted; /*!< How many TCP connections have been aborted at the hard cap. */
+} svx_tcp_connection_flow_stats_t;
+
+/*!
+ * The counters of the reading of a TCP connection.
+ */
+typedef struct
+{
+    uint64_t reads;        /*!< How many times the data has been read from the socket. */
+    uint64_t copied_reads; /*!< How many readings did not fit in the read buffer, and were copied into it a second time. */
+} svx_tcp_connection_read_stats_t;
+
 /*!
  * The TCP connection's callback signature and arguments collection.
  */
@@ -105,6 +232,37 @@ typedef struct
     void                                    *closed_cb_arg;          /*!< Closed callback's argument. */
 } svx_tcp_connection_callbacks_t;
 
+/*!
+ * Signature for the I/O hook which takes over reading or writing of the TCP connection.
+ *
+ * \param[in] conn  The address of the TCP connection.
+ * \param[in] fd    The file descriptor of the TCP connection.
+ * \param[in] arg   The argument in \link svx_tcp_connection_hooks_t \endlink.
+ *
+ * \return  Return zero to keep the TCP connection; return an error number to close it.
+ */
+typedef int (*svx_tcp_connection_io_hook_t)(svx_tcp_connection_t *conn, int fd, void *arg);
+
+/*!
+ * Signature for the hook which is called when the TCP connection is closing.
+ *
+ * \param[in] conn  The address of the TCP connection.
+ * \param[in] arg   The argument in \link svx_tcp_connection_hooks_t \endlink.
+ */
+typedef void (*svx_tcp_connection_close_hook_t)(svx_tcp_connection_t *conn, void *arg);
+
+/*!
+ * The TCP connection's hooks collection. Hooks let another module (e.g. \c TCP_proxy) move
+ * data on the connection's file descriptor directly, without the read buffer and the write buffer.
+ */
+typedef struct
+{
+    svx_tcp_connection_io_hook_t     read_hook;  /*!< Called instead of reading into the read buffer. Can be NULL. */
+    svx_tcp_connection_io_hook_t     write_hook; /*!< Called on writable after the write buffer has been flushed. Can be NULL. */
+    svx_tcp_connection_close_hook_t  close_hook; /*!< Called when the connection is closing. Can be NULL. */
+    void                            *arg;        /*!< The hooks' argument. */
+} svx_tcp_connection_hooks_t;
+
 /*!
  * Signature for notifying \c TCP_server or \c TCP_client to remove the \c TCP_connection
  * handler.
@@ -333,6 +491,138 @@ extern int svx_tcp_connection_shrink_write_buf(svx_tcp_connection_t *self, size_
  */
 extern int svx_tcp_connection_write(svx_tcp_connection_t *self, const uint8_t *buf, size_t len);
 
+/*!
+ * Send the data which scattered in several buffers via the TCP connection (gather write).
+ *
+ * \note  If the internal write buffer is empty, the data will be written by a single writev(2)
+ * directly from the caller's buffers, and only the unsent tail will be copied to the internal
+ * write buffer. In the loop thread, this function does not allocate any temporary memory.
+ * In other threads, the data will be copied to a temporary buffer, and then be sent in the
+ * loop thread.
+ *
+ * \param[in] self    The address of the TCP connection.
+ * \param[in] iov     The data buffers.
+ * \param[in] iovcnt  The number of \c iov, it MUST be in range [1, IOV_MAX].
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_writev(svx_tcp_connection_t *self, const struct iovec *iov, int iovcnt);
+
+/*!
+ * Send the data via the TCP connection, and transfer the ownership of the data buffer to
+ * the TCP connection.
+ *
+ * \note  The data will be sent directly from \c buf, and the unsent data will be queued by
+ * reference, so the data will never be copied in user space, even if this function is called
+ * in a thread other than the loop thread. The caller MUST NOT modify or release \c buf after
+ * calling this function. \c free_cb will be called (usually in the loop thread) when all the
+ * data has been written by write(2), or when the TCP connection is closed, or when an error
+ * occurred (except for \c SVX_ERRNO_INVAL).
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] buf          The data buffer.
+ * \param[in] len          The length of data you want to send.
+ * \param[in] free_cb      The callback for releasing \c buf. Can be \c NULL.
+ * \param[in] free_cb_arg  The \c free_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_write_owned(svx_tcp_connection_t *self, uint8_t *buf, size_t len,
+                                          svx_tcp_connection_free_cb_t free_cb, void *free_cb_arg);
+
+/*!
+ * Send a slice of a reference counted buffer via the TCP connection.
+ *
+ * \note  The unsent part of the slice will be queued by reference (the TCP connection holds a
+ * reference of \c buf until the slice has been written by write(2)), so the same buffer can be
+ * queued on many TCP connections without copying. The queued slices are flushed by writev(2),
+ * up to \c IOV_MAX slices at a time. The caller still owns its own reference of \c buf.
+ *
+ * \param[in] self    The address of the TCP connection.
+ * \param[in] buf     The reference counted buffer.
+ * \param[in] offset  The slice's offset in \c buf.
+ * \param[in] len     The slice's length.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_write_buf(svx_tcp_connection_t *self, svx_buf_t *buf, size_t offset, size_t len);
+
+/*!
+ * Send a range of a file via the TCP connection by sendfile(2).
+ *
+ * \note  The file range will be queued in the write path, in order with the data written before
+ * and after it, and sent by non-blocking sendfile(2) without copying the file contents to user space.
+ * The unsent length of the file range is counted for the high water mark, the same as the buffered
+ * data. \c done_cb is always called in the loop thread once the range has been sent, or the sending
+ * failed. The caller MUST keep \c fd open until \c done_cb is called. If sendfile(2) fails, or the
+ * file is shorter than expected, the connection will be closed.
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] fd           The file descriptor. (a regular file, or other file which supports mmap(2))
+ * \param[in] offset       The offset of the range in the file.
+ * \param[in] len          The length of the range.
+ * \param[in] done_cb      The callback for the end of the sending. Can be \c NULL.
+ * \param[in] done_cb_arg  The \c done_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_sendfile(svx_tcp_connection_t *self, int fd, off_t offset, size_t len,
+                                       svx_tcp_connection_sendfile_done_cb_t done_cb, void *done_cb_arg);
+
+/*!
+ * Send a stream of data which is pulled from a producer.
+ *
+ * \note  The stream will be queued in the write path, in order with the data written before and
+ * after it. The data is pulled by \c produce_cb into a bounded buffer of the stream, only when the
+ * socket is writable, so the memory used by the stream keeps bounded regardless of the stream length.
+ * Only the buffered data of the stream is counted for the high water mark.
+ * \c produce_cb is always called in the loop thread.
+ *
+ * \param[in] self            The address of the TCP connection.
+ * \param[in] produce_cb      The producer of the stream.
+ * \param[in] produce_cb_arg  The \c produce_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_write_stream(svx_tcp_connection_t *self,
+                                           svx_tcp_connection_produce_cb_t produce_cb, void *produce_cb_arg);
+
+/*!
+ * Resume the stream which is waiting for the producer. (the producer returned no data last time)
+ *
+ * \param[in] self  The address of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_resume_stream(svx_tcp_connection_t *self);
+
+/*!
+ * Redirect the next \c len bytes received by the TCP connection to a file descriptor.
+ *
+ * \note  The bytes which are already in the read buffer will be taken out first, then the rest
+ * bytes will be moved from the socket to \c fd by splice(2) through a pipe, without copying them
+ * to user space. (if splice(2) is not supported by \c fd, they will be copied by read(2) and write(2))
+ * The read callback will not be called until all the \c len bytes have been written to \c fd.
+ * After that, \c done_cb will be called, and then the read callback will be called as usual
+ * with the bytes after the \c len bytes. The bytes are written at the current file offset of \c fd.
+ * \c fd is written in blocking mode, so it SHOULD be a regular file, or a blocking file descriptor.
+ * The caller MUST keep \c fd open until \c done_cb is called. If writing to \c fd fails,
+ * or the connection reaches the end of file too early, the connection will be closed.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *           (usually in the read callback)
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] fd           The file descriptor.
+ * \param[in] len          The number of bytes to receive.
+ * \param[in] done_cb      The callback for the end of the receiving. Can be \c NULL.
+ * \param[in] done_cb_arg  The \c done_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_recv_to_fd(svx_tcp_connection_t *self, int fd, uint64_t len,
+                                         svx_tcp_connection_recv_to_fd_done_cb_t done_cb, void *done_cb_arg);
+
 /*!
  * Shut down the write part of the TCP connection.
  *
@@ -351,6 +641,428 @@ extern int svx_tcp_connection_shutdown_wr(svx_tcp_connection_t *self);
  */
 extern int svx_tcp_connection_close(svx_tcp_connection_t *self);
 
+/*!
+ * Get the handle of the TCP connection.
+ *
+ * \param[in]  self    The address of the TCP connection.
+ * \param[out] handle  Return the handle.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_handle(svx_tcp_connection_t *self, svx_tcp_connection_handle_t *handle);
+
+/*!
+ * Send the data via the TCP connection referred by a handle. It can be called in any thread.
+ *
+ * \note  A stale handle is rejected by comparing a generation number, without locking and
+ * without touching the reference count. In the loop thread, the data is sent like
+ * \link svx_tcp_connection_write \endlink. In other threads, the data will be copied and sent
+ * in the loop thread, and it will be dropped silently if the TCP connection has been destroyed
+ * by then.
+ *
+ * \warning  The handle MUST NOT be used after the looper of the TCP connection has been destroyed.
+ *
+ * \param[in] handle  The handle of the TCP connection.
+ * \param[in] buf     The data buffer.
+ * \param[in] len     The length of data you want to send.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_NOTCONN if the handle is stale.
+ */
+extern int svx_tcp_connection_write_by_handle(svx_tcp_connection_handle_t handle, const uint8_t *buf, size_t len);
+
+/*!
+ * Close the TCP connection referred by a handle. It can be called in any thread.
+ *
+ * \warning  The handle MUST NOT be used after the looper of the TCP connection has been destroyed.
+ *
+ * \param[in] handle  The handle of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_NOTCONN if the handle is stale.
+ */
+extern int svx_tcp_connection_close_by_handle(svx_tcp_connection_handle_t handle);
+
+/*!
+ * Offload a task (e.g. processing a CPU-heavy request) from the loop thread to a threadpool.
+ *
+ * \note  The work callback is called in a thread of the threadpool, then the done callback is called
+ * back in the loop thread, where the response can be written without copying. The done callbacks of
+ * a TCP connection are always called in the order the tasks were offloaded, even if the tasks are
+ * finished out of order, so the responses of pipelined requests are kept in order. The finished
+ * tasks are sent back by \link svx_looper_post \endlink, so they are batched per looper, and a
+ * burst of them costs only one wakeup of the loop thread.
+ *
+ * \warning  This function MUST be called in the loop thread. The threadpool MUST be destroyed before
+ *           the looper.
+ *
+ * \param[in] self        The address of the TCP connection.
+ * \param[in] threadpool  The threadpool which runs the work callback.
+ * \param[in] work_cb     The work callback.
+ * \param[in] done_cb     The done callback.
+ * \param[in] arg         The argument pass the \c work_cb and \c done_cb callback function.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_REACH if the limit set by \link svx_tcp_connection_set_offload_limit \endlink
+ *          is reached, then the reading is paused until some of the tasks are finished, and the rest of
+ *          the data in the read buffer will be delivered to the read callback again. Also return
+ *          \c SVX_ERRNO_REACH if the threadpool's task queue is full.
+ */
+extern int svx_tcp_connection_offload(svx_tcp_connection_t *self, svx_threadpool_t *threadpool,
+                                      svx_tcp_connection_offload_work_cb_t work_cb,
+                                      svx_tcp_connection_offload_done_cb_t done_cb, void *arg);
+
+/*!
+ * Get the looper which the TCP connection associate with.
+ *
+ * \param[in]  self    The address of the TCP connection.
+ * \param[out] looper  Return the looper.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_looper(svx_tcp_connection_t *self, svx_looper_t **looper);
+
+/*!
+ * Get the file descriptor of the TCP connection.
+ *
+ * \param[in]  self  The address of the TCP connection.
+ * \param[out] fd    Return the file descriptor.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_fd(svx_tcp_connection_t *self, int *fd);
+
+/*!
+ * Get the counters of the reading.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in]  self   The address of the TCP connection.
+ * \param[out] stats  Return the counters.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_read_stats(svx_tcp_connection_t *self, svx_tcp_connection_read_stats_t *stats);
+
+/*!
+ * Get the length of the data which is queued for writing but has not been written.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in]  self  The address of the TCP connection.
+ * \param[out] len   Return the length in bytes.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_write_queue_len(svx_tcp_connection_t *self, size_t *len);
+
+/*!
+ * To check if the TCP connection is connected, so the data can be written to it.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in] self  The address of the TCP connection.
+ *
+ * \return  Return \c 1 for TURE, \c 0 for FLASE.
+ */
+extern int svx_tcp_connection_is_connected(svx_tcp_connection_t *self);
+
+/*!
+ * Set (or remove) the hooks of the TCP connection.
+ *
+ * \note  While a read hook is set, the read callback will not be called, the read hook is
+ * responsible for reading the data (and the end of file) from the file descriptor. The write hook
+ * is called only if it has been enabled by svx_tcp_connection_enable_write_hook().
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in] self   The address of the TCP connection.
+ * \param[in] hooks  The hooks collection (copied by the TCP connection), or \c NULL to remove all hooks.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_hooks(svx_tcp_connection_t *self, const svx_tcp_connection_hooks_t *hooks);
+
+/*!
+ * Watch the writable event for the write hook.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in] self  The address of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_enable_write_hook(svx_tcp_connection_t *self);
+
+/*!
+ * Stop watching the writable event for the write hook.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in] self  The address of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_disable_write_hook(svx_tcp_connection_t *self);
+
+/*!
+ * Set auto-cork mode for the TCP connection.
+ *
+ * \note  In auto-cork mode, the data written by the write functions will not be sent
+ * immediately. All the data written in the same loop round (e.g. status line, headers and body
+ * written in one read callback) will be coalesced, and be sent by a single writev(2) at the end
+ * of the round.
+ *
+ * \param[in] self  The address of the TCP connection.
+ * \param[in] on    Whether to enable auto-cork mode. \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_auto_cork(svx_tcp_connection_t *self, int on);
+
+/*!
+ * Set the MSG_ZEROCOPY threshold for the TCP connection.
+ *
+ * \note  The data which written by svx_tcp_connection_write_owned() or svx_tcp_connection_write_buf()
+ * and not shorter than \p threshold will be sent by send(2) with MSG_ZEROCOPY, the kernel will not
+ * copy the data from the buffer. The buffer will be released (by the free callback) after the kernel
+ * notifies the completion via the socket error queue, not after the data is sent. This is also
+ * true after the connection is closed or destroyed, the socket will be kept open until all the
+ * completions arrive. If the kernel reports that the data was copied anyway (e.g. on the loopback
+ * device), the following large buffers will be sent by copying for a while, and MSG_ZEROCOPY will
+ * be tried again later. MSG_ZEROCOPY requires Linux kernel 4.14 or later, and it usually pays off
+ * only for large buffers (e.g. \>= 64KB).
+ *
+ * \param[in] self       The address of the TCP connection.
+ * \param[in] threshold  The minimum data length for MSG_ZEROCOPY. \c 0 means off, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          If the system does NOT support MSG_ZEROCOPY, return SVX_ERRNO_NOTSPT, and the connection
+ *          will still send the data by copying.
+ */
+extern int svx_tcp_connection_set_zerocopy(svx_tcp_connection_t *self, size_t threshold);
+
+/*!
+ * Set the write flow control for the TCP connection.
+ *
+ * \note  When the unsent data (in the write buffer) reaches \p high_mark, the reading of the
+ * TCP connection will be paused; when the unsent data falls to \p low_mark, the reading will be
+ * resumed. So a peer which sends requests but reads responses slowly can not make the write buffer
+ * grow without limit. If the unsent data exceeds \p hard_cap, the TCP connection will be closed
+ * at once (with \c SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_HARD_CAP), the write which exceeded it
+ * and all the following writes will return \c SVX_ERRNO_REACH.
+ * svx_tcp_connection_enable_read() and svx_tcp_connection_disable_read() still work while
+ * the reading is paused, the reading will be resumed only if it is enabled.
+ *
+ * \param[in] self       The address of the TCP connection.
+ * \param[in] low_mark   The low mark. MUST be less than \p high_mark.
+ * \param[in] high_mark  The high mark. \c 0 means off, default is off.
+ * \param[in] hard_cap   The hard cap. MUST NOT be less than \p high_mark. \c 0 means no limit.
+ * \param[in] stats      The counters for recording the pausing, resuming and aborting. Can be \c NULL.
+ *                       It MUST be kept valid during the lifetime of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_write_flow_control(svx_tcp_connection_t *self, size_t low_mark, size_t high_mark,
+                                                     size_t hard_cap, svx_tcp_connection_flow_stats_t *stats);
+
+/*!
+ * Set the bandwidth limit for the TCP connection by its own token buckets.
+ *
+ * \note  Each \c handle_read reads no more bytes than the available tokens, and each write
+ * syscall writes no more bytes than the available tokens. When the tokens are used up, the
+ * TCP connection stops watching the read (or write) event, and it will be resumed by the looper's
+ * timer wheel when the tokens are refilled, so there is no timer for each TCP connection.
+ * The data received by \link svx_tcp_connection_recv_to_fd \endlink or by a read hook
+ * is not limited. The data will never be written directly in the calling function while
+ * the writing is limited.
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] read_rate    The reading rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] read_burst   The max bytes can be read in a burst. \c 0 means the same as \p read_rate.
+ * \param[in] write_rate   The writing rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] write_burst  The max bytes can be written in a burst. \c 0 means the same as \p write_rate.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_rate_limit(svx_tcp_connection_t *self, size_t read_rate, size_t read_burst,
+                                             size_t write_rate, size_t write_burst);
+
+/*!
+ * Set the bandwidth limit for the TCP connection by the token buckets which are shared with
+ * other TCP connections (e.g. all TCP connections of a TCP server). It works together with
+ * \link svx_tcp_connection_set_rate_limit \endlink, the reading (or writing) is limited by both
+ * token buckets.
+ *
+ * \param[in] self          The address of the TCP connection.
+ * \param[in] read_bucket   The shared token bucket for reading. \c NULL means no limit.
+ * \param[in] write_bucket  The shared token bucket for writing. \c NULL means no limit.
+ *                          Both token buckets MUST be kept valid during the lifetime of the TCP connection.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_shared_rate_limit(svx_tcp_connection_t *self, svx_token_bucket_t *read_bucket,
+                                                    svx_token_bucket_t *write_bucket);
+
+/*!
+ * Set the read quota of each event loop iteration for the TCP connection.
+ *
+ * \note  By default, the TCP connection reads once (at most \c read_buf_max_len bytes) in each
+ * event loop iteration, and calls the read callback until the data is consumed. With the read quota,
+ * the TCP connection reads at most \p bytes (multiplied by the weight, see
+ * \link svx_tcp_connection_set_read_weight \endlink) and calls the read callback at most \p callbacks
+ * times in each event loop iteration. The rest data will be read, and the rest data in the read buffer
+ * will be delivered, in the next iteration. So a client which sends a lot of data can not hold the
+ * looper for long, and the small requests from other clients will be handled in time.
+ *
+ * The quota is shared by the connections in a deficit round robin way: the unused quota of an
+ * iteration is kept for the next iteration only if the socket was not drained.
+ *
+ * \param[in] self       The address of the TCP connection.
+ * \param[in] bytes      The max bytes to read in each iteration. \c 0 means no limit, default is no limit.
+ * \param[in] callbacks  The max times to call the read callback in each iteration. MUST be greater
+ *                       than zero, default is no limit.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_read_quota(svx_tcp_connection_t *self, size_t bytes, unsigned int callbacks);
+
+/*!
+ * The max weight for \link svx_tcp_connection_set_read_weight \endlink.
+ */
+#define SVX_TCP_CONNECTION_READ_WEIGHT_MAX 1024
+
+/*!
+ * Set the weight for the read quota of the TCP connection (weighted fair queuing). In each event
+ * loop iteration, the TCP connection can read the bytes of the read quota multiplied by the weight.
+ *
+ * \param[in] self    The address of the TCP connection.
+ * \param[in] weight  The weight. From \c 1 to \link SVX_TCP_CONNECTION_READ_WEIGHT_MAX \endlink, default is \c 1.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_read_weight(svx_tcp_connection_t *self, unsigned int weight);
+
+/*!
+ * Set the read low-water mark for the TCP connection. The read callback will be called only if
+ * there are at least \p lowat bytes in the read buffer.
+ *
+ * \note  The read callback is allowed to leave a partial message in the read buffer, it will be
+ * called again when more data has arrived. It is called repeatedly as long as it takes some data
+ * out and the rest is still not less than the low-water mark. The low-water mark can be changed
+ * in the read callback (e.g. to the length of the next frame after reading its header).
+ * SO_RCVLOWAT is also set on the socket, so the looper will not be woken up before enough data
+ * has arrived. If SO_RCVLOWAT is not supported, the data will be buffered in the read buffer.
+ *
+ * \param[in] self   The address of the TCP connection.
+ * \param[in] lowat  The low-water mark in bytes. MUST NOT be greater than \c read_buf_max_len.
+ *                   \c 0 and \c 1 mean off, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_read_lowat(svx_tcp_connection_t *self, size_t lowat);
+
+/*!
+ * Limit the in-flight tasks offloaded by \link svx_tcp_connection_offload \endlink.
+ *
+ * \param[in] self          The address of the TCP connection.
+ * \param[in] max_inflight  The maximum count of the in-flight tasks. \c 0 means no limit, default is no limit.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_offload_limit(svx_tcp_connection_t *self, unsigned int max_inflight);
+
+/*!
+ * Get the number of readable bytes by ioctl(FIONREAD) before reading in a burst.
+ *
+ * \note  The read buffer is expanded geometrically (up to \c read_buf_max_len) according to the
+ * moving average of the bytes per reading, so the data is read into it directly without a second copy.
+ * After a burst, the empty read buffer is shrunk back as the moving average decays.
+ * When the previous reading filled up the buffer, the data is arriving in a burst, and with this
+ * option the read buffer is expanded for all the readable bytes at once, at the cost of one more syscall.
+ *
+ * \param[in] self  The address of the TCP connection.
+ * \param[in] on    \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_fionread(svx_tcp_connection_t *self, int on);
+
+/*!
+ * Use a mirrored circlebuf as the read buffer.
+ *
+ * \note  The received data in a mirrored read buffer never wraps around, so the read callback can
+ * always parse it as one continuous buffer. The read buffer's lengths are rounded up to the page size,
+ * so it is only suitable for TCP connections with large read buffers. The read buffer's maximum length
+ * (\c read_buf_max_len of \link svx_tcp_connection_create \endlink) is rounded up too, so the read
+ * callback may see up to (page size - 1) bytes more unconsumed data than the configured limit.
+ * This option MUST be set before any data is received (e.g. before starting the TCP connection).
+ *
+ * \param[in] self  The address of the TCP connection.
+ * \param[in] on    \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_NOTSPT if the system does not support it.
+ *
+ * \see svx_circlebuf_create_mirrored()
+ */
+extern int svx_tcp_connection_set_mirrored_read_buf(svx_tcp_connection_t *self, int on);
+
+/*!
+ * Set the timeouts for the TCP connection. The TCP connection will be closed when one of them expires.
+ *
+ * \note  All the timeouts and deadlines of the TCP connections are checked by one entry per
+ * connection in the looper's timer wheel, so the precision is about 10 milliseconds. Each reading
+ * and writing only refreshes a timestamp, there is no timer operation or memory allocation.
+ *
+ * \param[in] self      The address of the TCP connection.
+ * \param[in] idle_ms   Close the TCP connection if nothing is read or written for this long.
+ * \param[in] read_ms   Close the TCP connection if nothing is read for this long while the reading
+ *                      is enabled (and not paused by the write flow control or the rate limit).
+ * \param[in] write_ms  Close the TCP connection if the unsent data makes no progress for this long.
+ *                      All the timeouts are in milliseconds, \c 0 means off, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_timeouts(svx_tcp_connection_t *self, int64_t idle_ms, int64_t read_ms, int64_t write_ms);
+
+/*!
+ * Set the read deadline for the TCP connection. The TCP connection will be closed if the deadline
+ * is not cleared or postponed before it expires, no matter how much data has been read. For example,
+ * set it when waiting for a new request and clear it when the whole request has been received, so
+ * the clients which send the requests very slowly can not hold the TCP connections.
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] deadline_ms  The deadline in milliseconds from now. \c 0 means clear the deadline.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_read_deadline(svx_tcp_connection_t *self, int64_t deadline_ms);
+
+/*!
+ * Set the write deadline for the TCP connection. The TCP connection will be closed if there
+ * is still unsent data when the deadline expires.
+ *
+ * \param[in] self         The address of the TCP connection.
+ * \param[in] deadline_ms  The deadline in milliseconds from now. \c 0 means clear the deadline.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_set_write_deadline(svx_tcp_connection_t *self, int64_t deadline_ms);
+
+/*!
+ * Get the reason why the TCP connection was closed.
+ *
+ * \warning  This function MUST be called in the TCP connection's loop thread.
+ *
+ * \param[in]  self    The address of the TCP connection.
+ * \param[out] reason  Return the reason. \link SVX_TCP_CONNECTION_CLOSE_REASON_NONE \endlink
+ *                     if the TCP connection has not been closed.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_connection_get_close_reason(svx_tcp_connection_t *self, svx_tcp_connection_close_reason_t *reason);
+
 /*!
  * Set TCP_NODELAY for the connection's fd.
  *
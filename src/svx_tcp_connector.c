@@ -17,6 +17,7 @@
 #include "svx_inetaddr.h"
 #include "svx_channel.h"
 #include "svx_util.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -77,7 +78,7 @@ int svx_tcp_connector_create(svx_tcp_connector_t **self, svx_looper_t *looper,
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, connected_cb:%p, init_delay_ms:%"PRId64", max_delay_ms:%"PRId64"\n",
                                  self, looper, connected_cb, init_delay_ms, max_delay_ms);
 
-    if(NULL == (*self = malloc(sizeof(svx_tcp_connector_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_connector_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     (*self)->looper           = looper;
     (*self)->server_addr      = server_addr;
     (*self)->client_addr      = client_addr;
@@ -104,7 +105,7 @@ int svx_tcp_connector_destroy(svx_tcp_connector_t **self)
         svx_looper_cancel((*self)->looper, (*self)->retry_timer_id);
     
     svx_tcp_connector_reset(*self);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
     *self = NULL;
 
     return 0;
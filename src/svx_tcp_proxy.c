@@ -0,0 +1,446 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "svx_tcp_proxy.h"
+#include "svx_tcp_connection.h"
+#include "svx_looper.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+
+#define SVX_TCP_PROXY_PIPE_SIZE_DEFAULT (64 * 1024)
+
+/* one direction of the TCP proxy: src ==> pipe (or buf) ==> dst */
+typedef struct
+{
+    svx_tcp_connection_t *src;
+    svx_tcp_connection_t *dst;
+    int                   src_fd;
+    int                   dst_fd;
+    int                   pipe_fds[2]; /* [-1, -1]: copy mode */
+    uint8_t              *buf;         /* the buffer for copy mode */
+    size_t                buf_offset;
+    size_t                cap;         /* capacity of the pipe (or buf) */
+    size_t                pending;     /* length of data in the pipe (or buf) */
+    int                   pipe_full;   /* the pipe has no more free slot */
+    int                   src_reading;
+    int                   src_eof;
+    int                   dst_writing;
+    int                   dst_shut;
+    uint64_t              bytes;
+} svx_tcp_proxy_dir_t;
+
+struct svx_tcp_proxy
+{
+    svx_looper_t              *looper;
+    svx_tcp_proxy_dir_t        dirs[2]; /* [0]: conn1 ==> conn2, [1]: conn2 ==> conn1 */
+    int                        started;
+    int                        closed;
+    svx_tcp_proxy_closed_cb_t  closed_cb;
+    void                      *closed_cb_arg;
+};
+
+static void svx_tcp_proxy_close(svx_tcp_proxy_t *self, int errnum, svx_tcp_connection_t *closing_conn)
+{
+    int i;
+
+    if(self->closed) return;
+    self->closed = 1;
+
+    for(i = 0; i < 2; i++)
+    {
+        svx_tcp_connection_set_hooks(self->dirs[i].src, NULL);
+
+        /* the closing conn will be closed by itself */
+        if(self->dirs[i].src == closing_conn) continue;
+
+        /* do NOT deliver the data to the read callback any more */
+        if(self->dirs[i].src_reading) svx_tcp_connection_disable_read(self->dirs[i].src);
+        svx_tcp_connection_close(self->dirs[i].src);
+    }
+
+    /* self may be destroyed in the closed callback */
+    if(self->closed_cb) self->closed_cb(self, errnum, self->closed_cb_arg);
+}
+
+static int svx_tcp_proxy_use_copy_mode(svx_tcp_proxy_dir_t *dir)
+{
+    uint8_t *buf = NULL;
+    ssize_t  n;
+
+    if(NULL == (buf = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, dir->cap))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+
+    /* take the data out of the pipe */
+    if(dir->pending > 0)
+    {
+        do n = read(dir->pipe_fds[0], buf, dir->pending);
+        while(-1 == n && EINTR == errno);
+        if(n < 0 || (size_t)n != dir->pending)
+        {
+            svx_alloc_free(SVX_ALLOC_TAG_TCP, buf);
+            SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_UNKNOWN, "read pipe failed. n:%zd, pending:%zu\n", n, dir->pending);
+        }
+    }
+
+    close(dir->pipe_fds[0]);
+    close(dir->pipe_fds[1]);
+    dir->pipe_fds[0] = -1;
+    dir->pipe_fds[1] = -1;
+    dir->buf         = buf;
+    dir->buf_offset  = 0;
+    dir->pipe_full   = 0;
+
+    return 0;
+}
+
+/* enable or disable the events according to the state of the direction */
+static int svx_tcp_proxy_update(svx_tcp_proxy_t *self, svx_tcp_proxy_dir_t *dir)
+{
+    size_t queue_len = 0;
+    int    reading;
+    int    writing;
+    int    r;
+
+    /* stop reading when the pipe (or buf) is full */
+    if(dir->pipe_fds[0] >= 0)
+        reading = (!dir->src_eof && !dir->pipe_full && dir->pending < dir->cap);
+    else
+        reading = (!dir->src_eof && 0 == dir->pending);
+    if(reading != dir->src_reading)
+    {
+        if(0 != (r = (reading ? svx_tcp_connection_enable_read(dir->src) : svx_tcp_connection_disable_read(dir->src))))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        dir->src_reading = reading;
+    }
+
+    /* watch the writable event when the dst socket is full,
+       or when the data written before the proxy started is still in the dst's write buffer */
+    if(0 != (r = svx_tcp_connection_get_write_queue_len(dir->dst, &queue_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    writing = (dir->pending > 0 || (dir->src_eof && !dir->dst_shut && queue_len > 0));
+    if(writing != dir->dst_writing)
+    {
+        if(0 != (r = (writing ? svx_tcp_connection_enable_write_hook(dir->dst) : svx_tcp_connection_disable_write_hook(dir->dst))))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        dir->dst_writing = writing;
+    }
+
+    /* half-close: pass the end of file to dst */
+    if(dir->src_eof && 0 == dir->pending && 0 == queue_len && !dir->dst_shut)
+    {
+        if(0 != (r = svx_tcp_connection_shutdown_wr(dir->dst))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        dir->dst_shut = 1;
+    }
+
+    /* both directions have finished */
+    if(self->dirs[0].dst_shut && self->dirs[1].dst_shut)
+        svx_tcp_proxy_close(self, 0, NULL);
+
+    return 0;
+}
+
+/* move the data from the pipe (or buf) to dst */
+static int svx_tcp_proxy_drain(svx_tcp_proxy_dir_t *dir)
+{
+    size_t  queue_len = 0;
+    ssize_t n;
+    int     r;
+
+    /* the data written before the proxy started MUST be sent first */
+    if(0 != (r = svx_tcp_connection_get_write_queue_len(dir->dst, &queue_len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(queue_len > 0) return 0;
+
+    while(dir->pending > 0)
+    {
+        if(dir->pipe_fds[0] >= 0)
+        {
+            do n = splice(dir->pipe_fds[0], NULL, dir->dst_fd, NULL, dir->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            while(-1 == n && EINTR == errno);
+
+            if(-1 == n && EINVAL == errno)
+            {
+                /* splice() is not supported for dst, fall back to copy mode */
+                if(0 != (r = svx_tcp_proxy_use_copy_mode(dir))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+                continue;
+            }
+        }
+        else
+        {
+            do n = write(dir->dst_fd, dir->buf + dir->buf_offset, dir->pending);
+            while(-1 == n && EINTR == errno);
+        }
+
+        if(n < 0)
+        {
+            if(EAGAIN == errno || EWOULDBLOCK == errno) break;
+            SVX_LOG_ERRNO_RETURN_NOTICE(errno, "write to fd:%d failed\n", dir->dst_fd);
+        }
+
+        dir->pending   -= (size_t)n;
+        dir->bytes     += (uint64_t)n;
+        dir->pipe_full  = 0;
+        if(dir->buf) dir->buf_offset = (0 == dir->pending ? 0 : dir->buf_offset + (size_t)n);
+    }
+
+    return 0;
+}
+
+/* move the data from src to the pipe (or buf) */
+static int svx_tcp_proxy_fill(svx_tcp_proxy_dir_t *dir)
+{
+    ssize_t n;
+    int     r;
+
+    if(dir->src_eof) return 0;
+
+    if(dir->pipe_fds[0] >= 0)
+    {
+        if(dir->pending >= dir->cap) return 0;
+
+        do n = splice(dir->src_fd, NULL, dir->pipe_fds[1], NULL, dir->cap - dir->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        while(-1 == n && EINTR == errno);
+
+        if(-1 == n && EINVAL == errno)
+        {
+            /* splice() is not supported for src, fall back to copy mode */
+            if(0 != (r = svx_tcp_proxy_use_copy_mode(dir))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+            return 0;
+        }
+        if(-1 == n && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            /* src has no data, or the pipe has no more free slot (a slot may hold less than a page) */
+            if(dir->pending > 0) dir->pipe_full = 1;
+            return 0;
+        }
+    }
+    else
+    {
+        if(dir->pending > 0) return 0;
+
+        do n = read(dir->src_fd, dir->buf, dir->cap);
+        while(-1 == n && EINTR == errno);
+
+        if(-1 == n && (EAGAIN == errno || EWOULDBLOCK == errno)) return 0;
+    }
+
+    if(n < 0)
+    {
+        if(ECONNRESET == errno)
+            SVX_LOG_ERRNO_RETURN_NOTICE(errno, "read from fd:%d failed\n", dir->src_fd);
+        else
+            SVX_LOG_ERRNO_RETURN_ERR(errno, "read from fd:%d failed\n", dir->src_fd);
+    }
+
+    if(0 == n)
+        dir->src_eof = 1; /* FIN has arrived */
+    else
+        dir->pending += (size_t)n;
+
+    return 0;
+}
+
+static int svx_tcp_proxy_handle_read(svx_tcp_connection_t *conn, int fd, void *arg)
+{
+    svx_tcp_proxy_t     *self = (svx_tcp_proxy_t *)arg;
+    svx_tcp_proxy_dir_t *dir  = (conn == self->dirs[0].src ? &(self->dirs[0]) : &(self->dirs[1]));
+    int                  r;
+
+    (void)fd;
+
+    if(0 != (r = svx_tcp_proxy_fill(dir))) goto err;
+    if(0 != (r = svx_tcp_proxy_drain(dir))) goto err;
+    if(0 != (r = svx_tcp_proxy_update(self, dir))) goto err;
+    return 0;
+
+ err:
+    svx_tcp_proxy_close(self, r, NULL);
+    return 0;
+}
+
+static int svx_tcp_proxy_handle_write(svx_tcp_connection_t *conn, int fd, void *arg)
+{
+    svx_tcp_proxy_t     *self = (svx_tcp_proxy_t *)arg;
+    svx_tcp_proxy_dir_t *dir  = (conn == self->dirs[0].dst ? &(self->dirs[0]) : &(self->dirs[1]));
+    int                  r;
+
+    (void)fd;
+
+    if(0 != (r = svx_tcp_proxy_drain(dir))) goto err;
+    if(0 != (r = svx_tcp_proxy_update(self, dir))) goto err;
+    return 0;
+
+ err:
+    svx_tcp_proxy_close(self, r, NULL);
+    return 0;
+}
+
+static void svx_tcp_proxy_handle_close(svx_tcp_connection_t *conn, void *arg)
+{
+    svx_tcp_proxy_t *self = (svx_tcp_proxy_t *)arg;
+
+    svx_tcp_proxy_close(self, SVX_ERRNO_NOTCONN, conn);
+}
+
+static int svx_tcp_proxy_dir_init(svx_tcp_proxy_dir_t *dir, svx_tcp_connection_t *src, svx_tcp_connection_t *dst)
+{
+    int r;
+    int size;
+
+    dir->src          = src;
+    dir->dst          = dst;
+    dir->src_fd       = -1;
+    dir->dst_fd       = -1;
+    dir->pipe_fds[0]  = -1;
+    dir->pipe_fds[1]  = -1;
+    dir->buf          = NULL;
+    dir->buf_offset   = 0;
+    dir->cap          = SVX_TCP_PROXY_PIPE_SIZE_DEFAULT;
+    dir->pending      = 0;
+    dir->pipe_full    = 0;
+    dir->src_reading  = 1; /* the TCP connection reads by default */
+    dir->src_eof      = 0;
+    dir->dst_writing  = 0;
+    dir->dst_shut     = 0;
+    dir->bytes        = 0;
+
+    if(0 != (r = svx_tcp_connection_get_fd(src, &(dir->src_fd)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_tcp_connection_get_fd(dst, &(dir->dst_fd)))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    if(0 == pipe2(dir->pipe_fds, O_NONBLOCK | O_CLOEXEC))
+    {
+        if((size = fcntl(dir->pipe_fds[0], F_GETPIPE_SZ)) > 0) dir->cap = (size_t)size;
+    }
+    else
+    {
+        /* no pipe, use copy mode */
+        SVX_LOG_ERRNO_NOTICE(errno, "pipe2() failed, use copy mode.\n");
+        dir->pipe_fds[0] = -1;
+        dir->pipe_fds[1] = -1;
+        if(NULL == (dir->buf = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, dir->cap))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    }
+
+    return 0;
+}
+
+static void svx_tcp_proxy_dir_uninit(svx_tcp_proxy_dir_t *dir)
+{
+    if(dir->pipe_fds[0] >= 0) close(dir->pipe_fds[0]);
+    if(dir->pipe_fds[1] >= 0) close(dir->pipe_fds[1]);
+    if(NULL != dir->buf) svx_alloc_free(SVX_ALLOC_TAG_TCP, dir->buf);
+    dir->pipe_fds[0] = -1;
+    dir->pipe_fds[1] = -1;
+    dir->buf         = NULL;
+}
+
+int svx_tcp_proxy_create(svx_tcp_proxy_t **self, svx_tcp_connection_t *conn1, svx_tcp_connection_t *conn2,
+                         svx_tcp_proxy_closed_cb_t closed_cb, void *closed_cb_arg)
+{
+    svx_looper_t *looper1 = NULL;
+    svx_looper_t *looper2 = NULL;
+    int           r       = 0;
+
+    if(NULL == self || NULL == conn1 || NULL == conn2 || conn1 == conn2)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, conn1:%p, conn2:%p\n", self, conn1, conn2);
+
+    if(0 != (r = svx_tcp_connection_get_looper(conn1, &looper1))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(0 != (r = svx_tcp_connection_get_looper(conn2, &looper2))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+    if(looper1 != looper2)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "the connections MUST be in the same looper. looper1:%p, looper2:%p\n", looper1, looper2);
+    if(!svx_looper_is_loop_thread(looper1)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_proxy_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    memset(*self, 0, sizeof(svx_tcp_proxy_t));
+    (*self)->looper        = looper1;
+    (*self)->dirs[0].pipe_fds[0] = (*self)->dirs[0].pipe_fds[1] = -1;
+    (*self)->dirs[1].pipe_fds[0] = (*self)->dirs[1].pipe_fds[1] = -1;
+    (*self)->started       = 0;
+    (*self)->closed        = 0;
+    (*self)->closed_cb     = closed_cb;
+    (*self)->closed_cb_arg = closed_cb_arg;
+
+    if(0 != (r = svx_tcp_proxy_dir_init(&((*self)->dirs[0]), conn1, conn2))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+    if(0 != (r = svx_tcp_proxy_dir_init(&((*self)->dirs[1]), conn2, conn1))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    /* hold the connections until the proxy is destroyed */
+    svx_tcp_connection_add_ref(conn1);
+    svx_tcp_connection_add_ref(conn2);
+
+    return 0;
+
+ err:
+    svx_tcp_proxy_dir_uninit(&((*self)->dirs[0]));
+    svx_tcp_proxy_dir_uninit(&((*self)->dirs[1]));
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
+    *self = NULL;
+    return r;
+}
+
+int svx_tcp_proxy_destroy(svx_tcp_proxy_t **self)
+{
+    int i;
+
+    if(NULL == self)  SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
+    if(!svx_looper_is_loop_thread((*self)->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+
+    /* close the proxy without the closed callback */
+    if((*self)->started && !(*self)->closed)
+    {
+        (*self)->closed_cb = NULL;
+        svx_tcp_proxy_close(*self, SVX_ERRNO_NOTCONN, NULL);
+    }
+
+    for(i = 0; i < 2; i++)
+    {
+        svx_tcp_proxy_dir_uninit(&((*self)->dirs[i]));
+        svx_tcp_connection_del_ref((*self)->dirs[i].src);
+    }
+
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
+    *self = NULL;
+    return 0;
+}
+
+int svx_tcp_proxy_start(svx_tcp_proxy_t *self)
+{
+    svx_tcp_connection_hooks_t hooks = {svx_tcp_proxy_handle_read, svx_tcp_proxy_handle_write, svx_tcp_proxy_handle_close, self};
+    int                        i;
+    int                        r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(!svx_looper_is_loop_thread(self->looper)) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, NULL);
+    if(self->started) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_REPEAT, "already started\n");
+
+    for(i = 0; i < 2; i++)
+        if(0 != (r = svx_tcp_connection_set_hooks(self->dirs[i].src, &hooks))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    /* both connections read from now on */
+    for(i = 0; i < 2; i++)
+        if(0 != (r = svx_tcp_connection_enable_read(self->dirs[i].src))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    self->started = 1;
+    return 0;
+
+ err:
+    for(i = 0; i < 2; i++)
+        svx_tcp_connection_set_hooks(self->dirs[i].src, NULL);
+    return r;
+}
+
+int svx_tcp_proxy_get_bytes(svx_tcp_proxy_t *self, uint64_t *bytes_1to2, uint64_t *bytes_2to1)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    if(bytes_1to2) *bytes_1to2 = self->dirs[0].bytes;
+    if(bytes_2to1) *bytes_2to1 = self->dirs[1].bytes;
+    return 0;
+}
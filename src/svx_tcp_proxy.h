@@ -0,0 +1,116 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_tcp_proxy.h
+ * \brief
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_TCP_PROXY_H
+#define SVX_TCP_PROXY_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "svx_tcp_connection.h"
+
+/*!
+ * \defgroup TCP_proxy TCP_proxy
+ * \ingroup  Network
+ *
+ * \brief    This module relays the data between two TCP connections in both directions.
+ *           The data is moved by splice(2) through a pipe, so it is never copied to user space.
+ *           If splice(2) is not available, the data will be copied by read(2) and write(2).
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The type for TCP proxy.
+ */
+typedef struct svx_tcp_proxy svx_tcp_proxy_t;
+
+/*!
+ * Signature for TCP proxy closed callback. Both TCP connections are being closed when this
+ * callback is called. It is safe to destroy the TCP proxy in this callback.
+ *
+ * \param[in] proxy   The address of the TCP proxy.
+ * \param[in] errnum  Zero if both directions have reached the end of file; otherwise, an error number.
+ * \param[in] arg     The argument which passed by \link svx_tcp_proxy_create \endlink.
+ */
+typedef void (*svx_tcp_proxy_closed_cb_t)(svx_tcp_proxy_t *proxy, int errnum, void *arg);
+
+/*!
+ * To create a new TCP proxy.
+ *
+ * \warning  This function MUST be called in the TCP connections' loop thread.
+ *           Both TCP connections MUST be associated with the same looper.
+ *
+ * \param[out] self           The pointer for return the TCP proxy object.
+ * \param[in]  conn1          The first TCP connection.
+ * \param[in]  conn2          The second TCP connection.
+ * \param[in]  closed_cb      The callback for TCP proxy closed. Can be \c NULL.
+ * \param[in]  closed_cb_arg  The \c closed_cb callback's argument.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_proxy_create(svx_tcp_proxy_t **self,
+                                svx_tcp_connection_t *conn1,
+                                svx_tcp_connection_t *conn2,
+                                svx_tcp_proxy_closed_cb_t closed_cb,
+                                void *closed_cb_arg);
+
+/*!
+ * To destroy a TCP proxy. If the TCP proxy has not been closed, both TCP connections will be closed.
+ *
+ * \warning  This function MUST be called in the TCP connections' loop thread.
+ *
+ * \param[in, out] self  The second rank pointer of the TCP proxy.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_proxy_destroy(svx_tcp_proxy_t **self);
+
+/*!
+ * Start relaying. The data which is already queued in the TCP connections' write buffer
+ * will be sent before the relayed data.
+ *
+ * \warning  This function MUST be called in the TCP connections' loop thread.
+ *           The read callbacks of both TCP connections will not be called after this.
+ *           The data which is already in the TCP connections' read buffer will NOT be relayed,
+ *           so disable reading on the TCP connections until the TCP proxy is started.
+ *
+ * \param[in] self  The address of the TCP proxy.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_proxy_start(svx_tcp_proxy_t *self);
+
+/*!
+ * Get the number of bytes which have been relayed.
+ *
+ * \param[in]  self         The address of the TCP proxy.
+ * \param[out] bytes_1to2   Return the number of bytes from \c conn1 to \c conn2. Can be \c NULL.
+ * \param[out] bytes_2to1   Return the number of bytes from \c conn2 to \c conn1. Can be \c NULL.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_proxy_get_bytes(svx_tcp_proxy_t *self, uint64_t *bytes_1to2, uint64_t *bytes_2to1);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
@@ -17,9 +17,12 @@
 #include "svx_tcp_server.h"
 #include "svx_tcp_acceptor.h"
 #include "svx_tcp_connection.h"
+#include "svx_token_bucket.h"
+#include "svx_buf.h"
 #include "svx_tree.h"
 #include "svx_queue.h"
 #include "svx_inetaddr.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 
@@ -32,6 +35,7 @@
 typedef struct svx_tcp_connection_node
 {
     svx_tcp_connection_t              *conn_ptr;
+    int                                looper_idx; /* index in io_loopers, 0 for base_looper */
     RB_ENTRY(svx_tcp_connection_node)  link;
 } svx_tcp_connection_node_t;
 static __inline__ int svx_tcp_connection_node_cmp(svx_tcp_connection_node_t *a, svx_tcp_connection_node_t *b)
@@ -60,6 +64,7 @@ struct svx_tcp_server
     svx_looper_t                   **io_loopers;
     int                              io_loopers_num;
     int                              io_loopers_idx;
+    int                              started;
     size_t                           read_buf_min_len;
     size_t                           read_buf_max_len;
     size_t                           write_buf_min_len;
@@ -68,6 +73,28 @@ struct svx_tcp_server
     int                              keepalive_intvl_s;
     int                              keepalive_cnt;
     int                              reuseport;
+    int                              auto_cork;
+    int                              fionread;
+    int                              mirrored_read_buf;
+    unsigned int                     offload_limit;
+    size_t                           bufpool_max_retained; /* 0: the io loopers have no bufpool */
+    int                              bufpool_flags;
+    size_t                           zerocopy_threshold;
+    size_t                           flow_low_mark;
+    size_t                           flow_high_mark; /* 0: the write flow control is off */
+    size_t                           flow_hard_cap;
+    svx_tcp_connection_flow_stats_t  flow_stats;
+    size_t                           read_rate;   /* 0: the reading of each connection is not limited */
+    size_t                           read_burst;
+    size_t                           write_rate;  /* 0: the writing of each connection is not limited */
+    size_t                           write_burst;
+    svx_token_bucket_t              *total_read_bucket;  /* shared by all connections */
+    svx_token_bucket_t              *total_write_bucket; /* shared by all connections */
+    size_t                           read_quota_bytes;   /* 0: no limit */
+    unsigned int                     read_quota_cbs;     /* 0: no quota */
+    int64_t                          idle_timeout_ms;    /* 0: off */
+    int64_t                          read_timeout_ms;    /* 0: off */
+    int64_t                          write_timeout_ms;   /* 0: off */
     svx_tcp_connection_callbacks_t   callbacks;
 };
 
@@ -87,7 +114,7 @@ static void svx_tcp_server_handle_remove(svx_tcp_connection_t *conn, void *arg)
     svx_tcp_connection_get_info(conn, (void *)&node);
 
     RB_REMOVE(svx_tcp_connection_tree, &(self->conns), node);
-    free(node);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, node);
     svx_tcp_connection_del_ref(conn);
 }
 
@@ -96,17 +123,20 @@ static void svx_tcp_server_handle_accepted(int fd, void *arg)
     svx_tcp_server_t          *self = (svx_tcp_server_t *)arg;
     svx_tcp_connection_node_t *node = NULL;
     svx_looper_t              *looper;
+    int                        looper_idx;
     int                        on;
     int                        r;
 
     /* get looper */
     if(0 == self->io_loopers_num)
     {
-        looper = self->base_looper;
+        looper     = self->base_looper;
+        looper_idx = 0;
     }
     else
     {
-        looper = self->io_loopers[self->io_loopers_idx];
+        looper     = self->io_loopers[self->io_loopers_idx];
+        looper_idx = self->io_loopers_idx;
 
         self->io_loopers_idx++;
         if(self->io_loopers_idx >= self->io_loopers_num)
@@ -128,14 +158,59 @@ static void svx_tcp_server_handle_accepted(int fd, void *arg)
     }
 
     /* create node and connection */
-    if(NULL == (node = malloc(sizeof(svx_tcp_connection_node_t)))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
-    node->conn_ptr = NULL;
+    if(NULL == (node = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_connection_node_t)))) SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
+    node->conn_ptr   = NULL;
+    node->looper_idx = looper_idx;
     if(0 != (r = svx_tcp_connection_create(&(node->conn_ptr), looper, fd,
                                            self->read_buf_min_len, self->read_buf_max_len,
                                            self->write_buf_min_len, self->write_buf_high_water_mark,
                                            &(self->callbacks), svx_tcp_server_handle_remove, self, node)))
         SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
 
+    if(self->auto_cork)
+        if(0 != (r = svx_tcp_connection_set_auto_cork(node->conn_ptr, 1)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->fionread)
+        if(0 != (r = svx_tcp_connection_set_fionread(node->conn_ptr, 1)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    /* the connection will use the normal read buffer if the mirrored one is not supported */
+    if(self->mirrored_read_buf)
+        if(0 != (r = svx_tcp_connection_set_mirrored_read_buf(node->conn_ptr, 1)) && SVX_ERRNO_NOTSPT != r)
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->offload_limit > 0)
+        if(0 != (r = svx_tcp_connection_set_offload_limit(node->conn_ptr, self->offload_limit)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    /* the connection will send data by copying if MSG_ZEROCOPY is not supported */
+    if(self->zerocopy_threshold > 0)
+        svx_tcp_connection_set_zerocopy(node->conn_ptr, self->zerocopy_threshold);
+
+    if(self->flow_high_mark > 0)
+        if(0 != (r = svx_tcp_connection_set_write_flow_control(node->conn_ptr, self->flow_low_mark, self->flow_high_mark,
+                                                               self->flow_hard_cap, &(self->flow_stats))))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->read_rate > 0 || self->write_rate > 0)
+        if(0 != (r = svx_tcp_connection_set_rate_limit(node->conn_ptr, self->read_rate, self->read_burst,
+                                                       self->write_rate, self->write_burst)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->total_read_bucket || self->total_write_bucket)
+        if(0 != (r = svx_tcp_connection_set_shared_rate_limit(node->conn_ptr, self->total_read_bucket, self->total_write_bucket)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->read_quota_cbs > 0)
+        if(0 != (r = svx_tcp_connection_set_read_quota(node->conn_ptr, self->read_quota_bytes, self->read_quota_cbs)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
+    if(self->idle_timeout_ms > 0 || self->read_timeout_ms > 0 || self->write_timeout_ms > 0)
+        if(0 != (r = svx_tcp_connection_set_timeouts(node->conn_ptr, self->idle_timeout_ms, self->read_timeout_ms,
+                                                     self->write_timeout_ms)))
+            SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+
     /* save the node(and the connection) into conns collection */
     if(NULL != RB_INSERT(svx_tcp_connection_tree, &(self->conns), node))
         SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_REPEAT, "colliding conn's key?!\n");
@@ -154,7 +229,7 @@ static void svx_tcp_server_handle_accepted(int fd, void *arg)
     if(NULL != node)
     {
         if(NULL != node->conn_ptr) svx_tcp_connection_del_ref(node->conn_ptr);
-        free(node);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, node);
     }
 }
 
@@ -164,7 +239,7 @@ int svx_tcp_server_create(svx_tcp_server_t **self, svx_looper_t *looper, svx_ine
 
     if(NULL == self || NULL == looper) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p\n", self, looper);
 
-    if(NULL == (*self = malloc(sizeof(svx_tcp_server_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_server_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     TAILQ_INIT(&((*self)->listeners));
     RB_INIT(&((*self)->conns));
     (*self)->base_looper                    = looper;
@@ -172,6 +247,7 @@ int svx_tcp_server_create(svx_tcp_server_t **self, svx_looper_t *looper, svx_ine
     (*self)->io_loopers                     = NULL;
     (*self)->io_loopers_num                 = 0;
     (*self)->io_loopers_idx                 = 0;
+    (*self)->started                        = 0;
     (*self)->read_buf_min_len               = SVX_TCP_SERVER_DEFAULT_READ_BUF_MIN_LEN;
     (*self)->read_buf_max_len               = SVX_TCP_SERVER_DEFAULT_READ_BUF_MAX_LEN;
     (*self)->write_buf_min_len              = SVX_TCP_SERVER_DEFAULT_WRITE_BUF_MIN_LEN;
@@ -180,6 +256,28 @@ int svx_tcp_server_create(svx_tcp_server_t **self, svx_looper_t *looper, svx_ine
     (*self)->keepalive_intvl_s              = 0;
     (*self)->keepalive_cnt                  = 0;
     (*self)->reuseport                      = 0;
+    (*self)->auto_cork                      = 0;
+    (*self)->fionread                       = 0;
+    (*self)->mirrored_read_buf              = 0;
+    (*self)->offload_limit                  = 0;
+    (*self)->bufpool_max_retained           = 0;
+    (*self)->bufpool_flags                  = 0;
+    (*self)->zerocopy_threshold             = 0;
+    (*self)->flow_low_mark                  = 0;
+    (*self)->flow_high_mark                 = 0;
+    (*self)->flow_hard_cap                  = 0;
+    memset(&((*self)->flow_stats), 0, sizeof((*self)->flow_stats));
+    (*self)->read_rate                      = 0;
+    (*self)->read_burst                     = 0;
+    (*self)->write_rate                     = 0;
+    (*self)->write_burst                    = 0;
+    (*self)->total_read_bucket              = NULL;
+    (*self)->total_write_bucket             = NULL;
+    (*self)->read_quota_bytes               = 0;
+    (*self)->read_quota_cbs                 = 0;
+    (*self)->idle_timeout_ms                = 0;
+    (*self)->read_timeout_ms                = 0;
+    (*self)->write_timeout_ms               = 0;
     memset(&((*self)->callbacks), 0, sizeof((*self)->callbacks));
 
     if(0 != (r = svx_tcp_server_add_listener(*self, listen_addr))) SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
@@ -189,7 +287,7 @@ int svx_tcp_server_create(svx_tcp_server_t **self, svx_looper_t *looper, svx_ine
  err:
     if(NULL != *self)
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
         *self = NULL;
     }
 
@@ -207,11 +305,14 @@ int svx_tcp_server_destroy(svx_tcp_server_t **self)
     {
         TAILQ_REMOVE(&((*self)->listeners), listener, link);
         svx_tcp_acceptor_destroy(&(listener->acceptor));
-        free(listener);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, listener);
         listener = NULL;
     }
+
+    if((*self)->total_read_bucket)  svx_token_bucket_destroy(&((*self)->total_read_bucket));
+    if((*self)->total_write_bucket) svx_token_bucket_destroy(&((*self)->total_write_bucket));
     
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, *self);
     *self = NULL;
     return 0;
 }
@@ -237,7 +338,7 @@ int svx_tcp_server_add_listener(svx_tcp_server_t *self, svx_inetaddr_t listen_ad
     }
 
     /* Add a new listener */
-    if(NULL == (listener = malloc(sizeof(svx_tcp_server_listener_t))))
+    if(NULL == (listener = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_server_listener_t))))
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     listener->listen_addr = listen_addr;
     listener->acceptor    = NULL;
@@ -248,7 +349,7 @@ int svx_tcp_server_add_listener(svx_tcp_server_t *self, svx_inetaddr_t listen_ad
     return 0;
 
  err:
-    if(NULL != listener) free(listener);
+    if(NULL != listener) svx_alloc_free(SVX_ALLOC_TAG_TCP, listener);
     return r;
 }
 
@@ -287,6 +388,172 @@ int svx_tcp_server_set_reuseport(svx_tcp_server_t *self, int on)
     return 0;
 }
 
+int svx_tcp_server_set_auto_cork(svx_tcp_server_t *self, int on)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->auto_cork = (on ? 1 : 0);
+
+    return 0;
+}
+
+int svx_tcp_server_set_fionread(svx_tcp_server_t *self, int on)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->fionread = (on ? 1 : 0);
+
+    return 0;
+}
+
+int svx_tcp_server_set_mirrored_read_buf(svx_tcp_server_t *self, int on)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->mirrored_read_buf = (on ? 1 : 0);
+
+    return 0;
+}
+
+int svx_tcp_server_set_offload_limit(svx_tcp_server_t *self, unsigned int max_inflight)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->offload_limit = max_inflight;
+
+    return 0;
+}
+
+int svx_tcp_server_set_bufpool(svx_tcp_server_t *self, size_t max_retained, int flags)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->bufpool_max_retained = max_retained;
+    self->bufpool_flags        = flags;
+
+    return 0;
+}
+
+int svx_tcp_server_get_bufpool_stats(svx_tcp_server_t *self, svx_bufpool_stats_t *stats)
+{
+    svx_bufpool_t       *pool = NULL;
+    svx_bufpool_stats_t  pool_stats;
+    int                  i;
+
+    if(NULL == self || NULL == stats) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, stats:%p\n", self, stats);
+
+    memset(stats, 0, sizeof(svx_bufpool_stats_t));
+    if(NULL == self->io_loopers) return 0;
+
+    for(i = 0; i < self->io_loopers_num; i++)
+    {
+        svx_looper_get_bufpool(self->io_loopers[i], &pool);
+        if(NULL == pool || 0 != svx_bufpool_get_stats(pool, &pool_stats)) continue;
+
+        stats->hits           += pool_stats.hits;
+        stats->misses         += pool_stats.misses;
+        stats->released       += pool_stats.released;
+        stats->retained_bytes += pool_stats.retained_bytes;
+    }
+
+    return 0;
+}
+
+int svx_tcp_server_set_zerocopy(svx_tcp_server_t *self, size_t threshold)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->zerocopy_threshold = threshold;
+
+    return 0;
+}
+
+int svx_tcp_server_set_write_flow_control(svx_tcp_server_t *self, size_t low_mark, size_t high_mark, size_t hard_cap)
+{
+    if(NULL == self || (high_mark > 0 && (low_mark >= high_mark || (hard_cap > 0 && hard_cap < high_mark))))
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, low_mark:%zu, high_mark:%zu, hard_cap:%zu\n",
+                                 self, low_mark, high_mark, hard_cap);
+
+    self->flow_low_mark  = low_mark;
+    self->flow_high_mark = high_mark;
+    self->flow_hard_cap  = hard_cap;
+
+    return 0;
+}
+
+int svx_tcp_server_get_write_flow_control_stats(svx_tcp_server_t *self, svx_tcp_connection_flow_stats_t *stats)
+{
+    if(NULL == self || NULL == stats) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, stats:%p\n", self, stats);
+
+    /* the counters are updated in the IO loopers */
+    stats->paused  = __sync_add_and_fetch(&(self->flow_stats.paused), 0);
+    stats->resumed = __sync_add_and_fetch(&(self->flow_stats.resumed), 0);
+    stats->aborted = __sync_add_and_fetch(&(self->flow_stats.aborted), 0);
+
+    return 0;
+}
+
+int svx_tcp_server_set_rate_limit(svx_tcp_server_t *self, size_t read_rate, size_t read_burst,
+                                  size_t write_rate, size_t write_burst)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    self->read_rate   = read_rate;
+    self->read_burst  = read_burst;
+    self->write_rate  = write_rate;
+    self->write_burst = write_burst;
+
+    return 0;
+}
+
+int svx_tcp_server_set_total_rate_limit(svx_tcp_server_t *self, size_t read_rate, size_t read_burst,
+                                        size_t write_rate, size_t write_burst)
+{
+    int r;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    /* the token buckets are referenced by the connections, so they can NOT be changed after starting */
+    if(self->started) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_PERM, "the server has been started\n");
+
+    if(self->total_read_bucket)  svx_token_bucket_destroy(&(self->total_read_bucket));
+    if(self->total_write_bucket) svx_token_bucket_destroy(&(self->total_write_bucket));
+
+    if(read_rate > 0)
+        if(0 != (r = svx_token_bucket_create(&(self->total_read_bucket), read_rate, read_burst)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    if(write_rate > 0)
+        if(0 != (r = svx_token_bucket_create(&(self->total_write_bucket), write_rate, write_burst)))
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    return 0;
+}
+
+int svx_tcp_server_set_read_quota(svx_tcp_server_t *self, size_t bytes, unsigned int callbacks)
+{
+    if(NULL == self || 0 == callbacks)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, callbacks:%u\n", self, callbacks);
+
+    self->read_quota_bytes = bytes;
+    self->read_quota_cbs   = callbacks;
+
+    return 0;
+}
+
+int svx_tcp_server_set_timeouts(svx_tcp_server_t *self, int64_t idle_ms, int64_t read_ms, int64_t write_ms)
+{
+    if(NULL == self || idle_ms < 0 || read_ms < 0 || write_ms < 0)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, idle_ms:%"PRId64", read_ms:%"PRId64", write_ms:%"PRId64"\n",
+                                 self, idle_ms, read_ms, write_ms);
+
+    self->idle_timeout_ms  = idle_ms;
+    self->read_timeout_ms  = read_ms;
+    self->write_timeout_ms = write_ms;
+
+    return 0;
+}
+
 int svx_tcp_server_set_read_buf_len(svx_tcp_server_t *self, size_t min_len, size_t max_len)
 {
     if(NULL == self || 0 == min_len || 0 == max_len || min_len > max_len)
@@ -372,6 +639,7 @@ SVX_LOOPER_GENERATE_RUN_1(svx_tcp_server_start, svx_tcp_server_t *, self)
 int svx_tcp_server_start(svx_tcp_server_t *self)
 {
     svx_tcp_server_listener_t *listener = NULL;
+    svx_bufpool_t             *pool     = NULL;
     uint16_t                   i;
     int                        r;
 
@@ -381,9 +649,9 @@ int svx_tcp_server_start(svx_tcp_server_t *self)
 
     if(self->io_loopers_num > 0)
     {
-        if(NULL == (self->io_threads = malloc(sizeof(pthread_t) * self->io_loopers_num)))
+        if(NULL == (self->io_threads = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(pthread_t) * self->io_loopers_num)))
             SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
-        if(NULL == (self->io_loopers = malloc(sizeof(svx_looper_t *) * self->io_loopers_num)))
+        if(NULL == (self->io_loopers = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_looper_t *) * self->io_loopers_num)))
             SVX_LOG_ERRNO_GOTO_ERR(err, r = SVX_ERRNO_NOMEM, NULL);
         self->io_loopers_idx = 0;
 
@@ -391,6 +659,18 @@ int svx_tcp_server_start(svx_tcp_server_t *self)
             if(0 != (r = svx_looper_create(&(self->io_loopers[i]))))
                 SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
 
+        /* each io looper has its own bufpool, which is released with the looper */
+        if(self->bufpool_max_retained > 0)
+        {
+            for(i = 0; i < self->io_loopers_num; i++)
+            {
+                if(0 != (r = svx_bufpool_create(&pool, self->bufpool_max_retained, self->bufpool_flags)))
+                    SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
+                svx_looper_set_bufpool(self->io_loopers[i], pool);
+                svx_bufpool_del_ref(pool);
+            }
+        }
+
         for(i = 0; i < self->io_loopers_num; i++)
         {
             if(0 != (r = pthread_create(&(self->io_threads[i]), NULL, &svx_tcp_server_io_loopers_func, self->io_loopers[i])))
@@ -410,6 +690,7 @@ int svx_tcp_server_start(svx_tcp_server_t *self)
         if(0 != (r = svx_tcp_acceptor_start(listener->acceptor, self->reuseport)))
             SVX_LOG_ERRNO_GOTO_ERR(err, r, NULL);
 
+    self->started = 1;
     return 0;
 
  err:
@@ -418,13 +699,13 @@ int svx_tcp_server_start(svx_tcp_server_t *self)
         for(i = 0; i < self->io_loopers_num; i++)
             if(NULL != self->io_loopers[i])
                 svx_looper_destroy(&(self->io_loopers[i]));
-        free(self->io_loopers);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, self->io_loopers);
         self->io_loopers = NULL;
         self->io_loopers_idx = 0;
     }
     if(NULL != self->io_threads)
     {
-        free(self->io_threads);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, self->io_threads);
         self->io_threads = NULL;
     }
     
@@ -452,7 +733,7 @@ int svx_tcp_server_stop(svx_tcp_server_t *self)
     {
         svx_tcp_connection_destroy(node->conn_ptr);
         RB_REMOVE(svx_tcp_connection_tree, &(self->conns), node);
-        free(node);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, node);
     }
 
     if(self->io_loopers_num > 0)
@@ -466,13 +747,148 @@ int svx_tcp_server_stop(svx_tcp_server_t *self)
             svx_looper_destroy(&(self->io_loopers[i]));
         }
 
-        free(self->io_loopers);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, self->io_loopers);
         self->io_loopers = NULL;
         self->io_loopers_idx = 0;
 
-        free(self->io_threads);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, self->io_threads);
         self->io_threads = NULL;
     }
-    
+
+    self->started = 0;
     return 0;
 }
+
+typedef struct
+{
+    svx_buf_t                            *buf;
+    svx_tcp_server_broadcast_filter_cb_t  filter_cb;
+    void                                 *filter_cb_arg;
+    svx_tcp_connection_t                **conns;
+    size_t                                conns_cnt;
+} svx_tcp_server_broadcast_looper_param_t;
+static void svx_tcp_server_broadcast_looper_run(void *arg)
+{
+    svx_tcp_server_broadcast_looper_param_t *p   = (svx_tcp_server_broadcast_looper_param_t *)arg;
+    size_t                                   len = 0;
+    uint8_t                                 *data;
+    size_t                                   i;
+
+    svx_buf_get_ptr(p->buf, &data, &len);
+
+    /* running in the connections' I/O looper thread, skip the ones which are closing */
+    for(i = 0; i < p->conns_cnt; i++)
+        if(svx_tcp_connection_is_connected(p->conns[i]) &&
+           (NULL == p->filter_cb || p->filter_cb(p->conns[i], p->filter_cb_arg)))
+            svx_tcp_connection_write_buf(p->conns[i], p->buf, 0, len);
+
+    svx_buf_del_ref(p->buf);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, p->conns);
+}
+static void svx_tcp_server_broadcast_looper_clean(void *arg)
+{
+    svx_tcp_server_broadcast_looper_param_t *p = (svx_tcp_server_broadcast_looper_param_t *)arg;
+
+    svx_buf_del_ref(p->buf);
+    svx_alloc_free(SVX_ALLOC_TAG_TCP, p->conns);
+}
+
+/* running in the base looper thread, because the conns collection can only be accessed there */
+static int svx_tcp_server_broadcast_buf(svx_tcp_server_t *self, svx_tcp_server_broadcast_filter_cb_t filter_cb,
+                                        void *filter_cb_arg, svx_buf_t *buf)
+{
+    svx_tcp_server_broadcast_looper_param_t *params      = NULL;
+    svx_tcp_connection_node_t               *node        = NULL;
+    int                                      loopers_num = (self->io_loopers_num > 0 ? self->io_loopers_num : 1);
+    int                                      i;
+    int                                      r           = 0;
+
+    /* group the connections by their I/O loopers */
+    if(NULL == (params = svx_alloc_calloc(SVX_ALLOC_TAG_TCP, loopers_num, sizeof(svx_tcp_server_broadcast_looper_param_t))))
+        SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
+    RB_FOREACH(node, svx_tcp_connection_tree, &(self->conns))
+        params[node->looper_idx].conns_cnt++;
+    for(i = 0; i < loopers_num; i++)
+    {
+        if(0 == params[i].conns_cnt) continue;
+        if(NULL == (params[i].conns = svx_alloc_malloc(SVX_ALLOC_TAG_TCP, sizeof(svx_tcp_connection_t *) * params[i].conns_cnt)))
+            SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
+        params[i].conns_cnt = 0;
+    }
+    RB_FOREACH(node, svx_tcp_connection_tree, &(self->conns))
+        params[node->looper_idx].conns[params[node->looper_idx].conns_cnt++] = node->conn_ptr;
+
+    /* post one task to each I/O looper. The connections will not be destroyed before the task
+       is run, because their del_ref() will be dispatched to the same looper after this task. */
+    for(i = 0; i < loopers_num; i++)
+    {
+        if(0 == params[i].conns_cnt) continue;
+        svx_buf_add_ref(buf);
+        params[i].buf           = buf;
+        params[i].filter_cb     = filter_cb;
+        params[i].filter_cb_arg = filter_cb_arg;
+        if(0 != (r = svx_looper_dispatch(self->io_loopers_num > 0 ? self->io_loopers[i] : self->base_looper,
+                                         svx_tcp_server_broadcast_looper_run, svx_tcp_server_broadcast_looper_clean,
+                                         &(params[i]), sizeof(params[i]))))
+        {
+            /* the task is not queued, the conns array will be freed below */
+            svx_buf_del_ref(buf);
+            SVX_LOG_ERRNO_GOTO_ERR(end, r, NULL);
+        }
+        params[i].conns = NULL; /* owned by the task now */
+    }
+
+ end:
+    if(NULL != params)
+    {
+        for(i = 0; i < loopers_num; i++)
+            if(NULL != params[i].conns) svx_alloc_free(SVX_ALLOC_TAG_TCP, params[i].conns);
+        svx_alloc_free(SVX_ALLOC_TAG_TCP, params);
+    }
+    svx_buf_del_ref(buf);
+    return r;
+}
+
+typedef struct
+{
+    svx_tcp_server_t                     *self;
+    svx_tcp_server_broadcast_filter_cb_t  filter_cb;
+    void                                 *filter_cb_arg;
+    svx_buf_t                            *buf;
+} svx_tcp_server_broadcast_param_t;
+static void svx_tcp_server_broadcast_run(void *arg)
+{
+    svx_tcp_server_broadcast_param_t *p = (svx_tcp_server_broadcast_param_t *)arg;
+    svx_tcp_server_broadcast_buf(p->self, p->filter_cb, p->filter_cb_arg, p->buf);
+}
+static void svx_tcp_server_broadcast_clean(void *arg)
+{
+    svx_tcp_server_broadcast_param_t *p = (svx_tcp_server_broadcast_param_t *)arg;
+    svx_buf_del_ref(p->buf);
+}
+
+int svx_tcp_server_broadcast(svx_tcp_server_t *self, svx_tcp_server_broadcast_filter_cb_t filter_cb,
+                             void *filter_cb_arg, const uint8_t *buf, size_t len)
+{
+    svx_buf_t *sbuf = NULL;
+    int        r;
+
+    if(NULL == self || NULL == buf || 0 == len)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, buf:%p, len:%zu\n", self, buf, len);
+
+    /* copy the data only once, all the connections share it */
+    if(0 != (r = svx_buf_create(&sbuf, buf, len))) SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+
+    if(!svx_looper_is_loop_thread(self->base_looper))
+    {
+        svx_tcp_server_broadcast_param_t p = {self, filter_cb, filter_cb_arg, sbuf};
+        if(0 != (r = svx_looper_dispatch(self->base_looper, svx_tcp_server_broadcast_run, svx_tcp_server_broadcast_clean, &p, sizeof(p))))
+        {
+            svx_buf_del_ref(sbuf);
+            SVX_LOG_ERRNO_RETURN_ERR(r, NULL);
+        }
+        return 0;
+    }
+
+    return svx_tcp_server_broadcast_buf(self, filter_cb, filter_cb_arg, sbuf);
+}
@@ -41,6 +41,16 @@ extern "C" {
  */
 typedef struct svx_tcp_server svx_tcp_server_t;
 
+/*!
+ * Signature for the broadcast filter callback.
+ *
+ * \param[in] conn  The address of the TCP connection.
+ * \param[in] arg   The argument which passed by \link svx_tcp_server_broadcast \endlink.
+ *
+ * \return  Return non-zero to send the data to \c conn, return zero to skip it.
+ */
+typedef int (*svx_tcp_server_broadcast_filter_cb_t)(svx_tcp_connection_t *conn, void *arg);
+
 /*!
  * To create a new TCP server.
  *
@@ -122,6 +132,186 @@ extern int svx_tcp_server_set_keepalive(svx_tcp_server_t *self,
  */
 extern int svx_tcp_server_set_reuseport(svx_tcp_server_t *self, int on);
 
+/*!
+ * Set auto-cork mode for all the accepted TCP connections.
+ *
+ * \param[in] self  The address of the TCP server.
+ * \param[in] on    Whether to enable auto-cork mode. \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_auto_cork()
+ */
+extern int svx_tcp_server_set_auto_cork(svx_tcp_server_t *self, int on);
+
+/*!
+ * Get the number of readable bytes by ioctl(FIONREAD) before reading in a burst, for all the
+ * accepted TCP connections.
+ *
+ * \param[in] self  The address of the TCP server.
+ * \param[in] on    Whether to use ioctl(FIONREAD). \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_fionread()
+ */
+extern int svx_tcp_server_set_fionread(svx_tcp_server_t *self, int on);
+
+/*!
+ * Use mirrored circlebufs as the read buffers for all the accepted TCP connections.
+ * The normal read buffers are kept if the system does not support mirrored circlebufs.
+ * The maximum length of the read buffers is rounded up to the page size.
+ *
+ * \param[in] self  The address of the TCP server.
+ * \param[in] on    Whether to use mirrored read buffers. \c 0 means off, \c 1 means on, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_mirrored_read_buf()
+ */
+extern int svx_tcp_server_set_mirrored_read_buf(svx_tcp_server_t *self, int on);
+
+/*!
+ * Limit the in-flight offloaded tasks for each accepted TCP connection.
+ *
+ * \param[in] self          The address of the TCP server.
+ * \param[in] max_inflight  The maximum count of the in-flight tasks. \c 0 means no limit, default is no limit.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_offload_limit()
+ */
+extern int svx_tcp_server_set_offload_limit(svx_tcp_server_t *self, unsigned int max_inflight);
+
+/*!
+ * Create a bufpool for each io looper, so that the circlebufs of the TCP connections in the
+ * same io looper share the memory chunks. It only works with io loopers (see
+ * \link svx_tcp_server_set_io_loopers_num \endlink). Without io loopers, the TCP connections
+ * use the bufpool attached to the base looper (see \link svx_looper_set_bufpool \endlink).
+ *
+ * \param[in] self          The address of the TCP server.
+ * \param[in] max_retained  The maximum bytes retained by each bufpool. \c 0 means off, default is off.
+ * \param[in] flags         The bufpool's flags. \c 0 or \c SVX_BUFPOOL_FLAG_HUGEPAGES.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_bufpool_create()
+ */
+extern int svx_tcp_server_set_bufpool(svx_tcp_server_t *self, size_t max_retained, int flags);
+
+/*!
+ * Get the sum of the counters of all the io loopers' bufpools.
+ *
+ * \param[in]  self   The address of the TCP server.
+ * \param[out] stats  Return the counters.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_server_get_bufpool_stats(svx_tcp_server_t *self, svx_bufpool_stats_t *stats);
+
+/*!
+ * Set the MSG_ZEROCOPY threshold for all the accepted TCP connections.
+ *
+ * \param[in] self       The address of the TCP server.
+ * \param[in] threshold  The minimum data length for MSG_ZEROCOPY. \c 0 means off, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_zerocopy()
+ */
+extern int svx_tcp_server_set_zerocopy(svx_tcp_server_t *self, size_t threshold);
+
+/*!
+ * Set the write flow control for all the accepted TCP connections.
+ *
+ * \param[in] self       The address of the TCP server.
+ * \param[in] low_mark   The low mark for resuming the reading. MUST be less than \p high_mark.
+ * \param[in] high_mark  The high mark for pausing the reading. \c 0 means off, default is off.
+ * \param[in] hard_cap   The hard cap for closing the TCP connection. \c 0 means no limit.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_write_flow_control()
+ */
+extern int svx_tcp_server_set_write_flow_control(svx_tcp_server_t *self, size_t low_mark, size_t high_mark, size_t hard_cap);
+
+/*!
+ * Get the write flow control counters of all the accepted TCP connections.
+ *
+ * \param[in]  self   The address of the TCP server.
+ * \param[out] stats  Return the counters.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_server_get_write_flow_control_stats(svx_tcp_server_t *self, svx_tcp_connection_flow_stats_t *stats);
+
+/*!
+ * Set the bandwidth limit for each of the accepted TCP connections. It can be overridden
+ * by \link svx_tcp_connection_set_rate_limit \endlink in the established callback.
+ *
+ * \param[in] self         The address of the TCP server.
+ * \param[in] read_rate    The reading rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] read_burst   The max bytes can be read in a burst. \c 0 means the same as \p read_rate.
+ * \param[in] write_rate   The writing rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] write_burst  The max bytes can be written in a burst. \c 0 means the same as \p write_rate.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_rate_limit()
+ */
+extern int svx_tcp_server_set_rate_limit(svx_tcp_server_t *self, size_t read_rate, size_t read_burst,
+                                         size_t write_rate, size_t write_burst);
+
+/*!
+ * Set the bandwidth limit for all the accepted TCP connections together (in all IO loopers).
+ *
+ * \warning  This function MUST be called before \link svx_tcp_server_start \endlink (or after
+ *           \link svx_tcp_server_stop \endlink), otherwise \c SVX_ERRNO_PERM will be returned.
+ *
+ * \param[in] self         The address of the TCP server.
+ * \param[in] read_rate    The total reading rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] read_burst   The max bytes can be read in a burst. \c 0 means the same as \p read_rate.
+ * \param[in] write_rate   The total writing rate in bytes per second. \c 0 means no limit, default is no limit.
+ * \param[in] write_burst  The max bytes can be written in a burst. \c 0 means the same as \p write_rate.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_shared_rate_limit()
+ */
+extern int svx_tcp_server_set_total_rate_limit(svx_tcp_server_t *self, size_t read_rate, size_t read_burst,
+                                               size_t write_rate, size_t write_burst);
+
+/*!
+ * Set the read quota of each event loop iteration for all the accepted TCP connections.
+ * The weight of each TCP connection can be set by \link svx_tcp_connection_set_read_weight \endlink
+ * in the established callback.
+ *
+ * \param[in] self       The address of the TCP server.
+ * \param[in] bytes      The max bytes to read in each iteration. \c 0 means no limit, default is no limit.
+ * \param[in] callbacks  The max times to call the read callback in each iteration. MUST be greater
+ *                       than zero, default is no limit.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_read_quota()
+ */
+extern int svx_tcp_server_set_read_quota(svx_tcp_server_t *self, size_t bytes, unsigned int callbacks);
+
+/*!
+ * Set the timeouts for all the accepted TCP connections. Unlike the TCP keep-alive, it also
+ * closes the TCP connections whose peers are alive but idle or too slow.
+ *
+ * \param[in] self      The address of the TCP server.
+ * \param[in] idle_ms   The idle timeout in milliseconds. \c 0 means off, default is off.
+ * \param[in] read_ms   The read timeout in milliseconds. \c 0 means off, default is off.
+ * \param[in] write_ms  The write timeout in milliseconds. \c 0 means off, default is off.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *
+ * \see svx_tcp_connection_set_timeouts()
+ */
+extern int svx_tcp_server_set_timeouts(svx_tcp_server_t *self, int64_t idle_ms, int64_t read_ms, int64_t write_ms);
+
 /*!
  * Set the read buffer length for all TCP connections.
  *
@@ -238,6 +428,30 @@ extern int svx_tcp_server_start(svx_tcp_server_t *self);
  */
 extern int svx_tcp_server_stop(svx_tcp_server_t *self);
 
+/*!
+ * Send the same data to all (or part of) the TCP connections of the TCP server.
+ *
+ * \note  The data will be copied only once into a shared, reference counted buffer. The target
+ * connections are grouped by their I/O loopers, and only one task will be posted to each I/O
+ * looper. Each connection's unsent data refers to the shared buffer, which will be released
+ * when the last connection has flushed it. This function can be called in any thread. If it
+ * is not called in the base looper thread, the errors of posting the tasks can only be logged.
+ *
+ * \param[in] self           The address of the TCP server.
+ * \param[in] filter_cb      The filter callback, it will be called in the connection's I/O
+ *                           looper thread. \c NULL means sending to all the connections.
+ * \param[in] filter_cb_arg  The filter callback's argument.
+ * \param[in] buf            The data buffer.
+ * \param[in] len            The length of data you want to send.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_tcp_server_broadcast(svx_tcp_server_t *self,
+                                    svx_tcp_server_broadcast_filter_cb_t filter_cb,
+                                    void *filter_cb_arg,
+                                    const uint8_t *buf,
+                                    size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,29 +11,47 @@
 #include <errno.h>
 #include <pthread.h>
 #include "svx_threadpool.h"
+#include "svx_alloc.h"
 #include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_queue.h"
+#include "svx_tree.h"
 
 typedef struct svx_threadpool_task
 {
-    svx_threadpool_func_t  run;
-    svx_threadpool_func_t  clean;
-    void                  *arg;
+    svx_threadpool_func_t          run;
+    svx_threadpool_func_t          clean;
+    void                          *arg;
+    svx_looper_t                  *looper; /* NULL: a task without completion */
+    svx_threadpool_func_t          done;
+    svx_threadpool_task_id_t       id;
+    svx_looper_post_entry_t        entry;  /* posted back to the looper for the done or clean callback */
     TAILQ_ENTRY(svx_threadpool_task, volatile) link;
+    RB_ENTRY(svx_threadpool_task)  link_id;
 } svx_threadpool_task_t;
 typedef TAILQ_HEAD(svx_threadpool_task_queue, svx_threadpool_task, volatile) svx_threadpool_task_queue_t;
+/* the queued tasks with completion, use id as key */
+static __inline__ int svx_threadpool_task_cmp_id(svx_threadpool_task_t *a, svx_threadpool_task_t *b)
+{
+    if     (a->id > b->id) return 1;
+    else if(a->id < b->id) return -1;
+    else                   return 0;
+}
+typedef RB_HEAD(svx_threadpool_task_tree_id, svx_threadpool_task) svx_threadpool_task_tree_id_t;
+RB_GENERATE_STATIC(svx_threadpool_task_tree_id, svx_threadpool_task, link_id, svx_threadpool_task_cmp_id);
 
 struct svx_threadpool
 {
-    volatile int                 running;
-    pthread_t                   *volatile threads;
-    volatile size_t              threads_cnt;
-    svx_threadpool_task_queue_t  task_queue;
-    size_t                       task_queue_size_max;
-    size_t                       task_queue_size_cur;
-    pthread_mutex_t              mutex;
-    pthread_cond_t               cond;
+    volatile int                   running;
+    pthread_t                     *volatile threads;
+    volatile size_t                threads_cnt;
+    svx_threadpool_task_queue_t    task_queue;
+    size_t                         task_queue_size_max;
+    size_t                         task_queue_size_cur;
+    svx_threadpool_task_tree_id_t  task_tree_id;
+    svx_threadpool_task_id_t       task_seq;
+    pthread_mutex_t                mutex;
+    pthread_cond_t                 cond;
 };
 
 static void *svx_threadpool_loop_func(void *arg)
@@ -58,16 +76,46 @@ static void *svx_threadpool_loop_func(void *arg)
         TAILQ_REMOVE(&(self->task_queue), task, link);
         if(self->task_queue_size_max > 0)
             self->task_queue_size_cur--;
+        if(task->looper)
+            RB_REMOVE(svx_threadpool_task_tree_id, &(self->task_tree_id), task); /* can not be canceled now */
 
         pthread_mutex_unlock(&(self->mutex));
 
         task->run(task->arg);
-        free(task);
+        if(task->looper)
+            svx_looper_post(task->looper, &(task->entry));
+        else
+            svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, task);
     }
 
     return NULL;
 }
 
+/* in the loop thread */
+static void svx_threadpool_task_done(void *arg)
+{
+    svx_threadpool_task_t *task = (svx_threadpool_task_t *)arg;
+
+    task->done(task->arg);
+    svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, task);
+}
+
+/* in the loop thread, or the looper is being destroyed */
+static void svx_threadpool_task_clean(void *arg)
+{
+    svx_threadpool_task_t *task = (svx_threadpool_task_t *)arg;
+
+    if(task->clean) task->clean(task->arg);
+    svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, task);
+}
+
+/* the work callback will not be run, send the task back to the looper for the clean callback */
+static void svx_threadpool_task_cancel(svx_threadpool_task_t *task)
+{
+    svx_looper_post_entry_init(&(task->entry), svx_threadpool_task_clean, svx_threadpool_task_clean, task);
+    svx_looper_post(task->looper, &(task->entry));
+}
+
 int svx_threadpool_create(svx_threadpool_t **self, size_t threads_cnt, size_t max_task_queue_size)
 {
     size_t i = 0;
@@ -76,10 +124,10 @@ int svx_threadpool_create(svx_threadpool_t **self, size_t threads_cnt, size_t ma
     if(NULL == self || 0 == threads_cnt)
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, threads_cnt:%zu\n", self, threads_cnt);
 
-    if(NULL == (*self = malloc(sizeof(svx_threadpool_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
-    if(NULL == ((*self)->threads = malloc(threads_cnt * sizeof(pthread_t))))
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_THREADPOOL, sizeof(svx_threadpool_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    if(NULL == ((*self)->threads = svx_alloc_malloc(SVX_ALLOC_TAG_THREADPOOL, threads_cnt * sizeof(pthread_t))))
     {
-        free(*self);
+        svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, *self);
         *self = NULL;
         SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
     }
@@ -89,6 +137,8 @@ int svx_threadpool_create(svx_threadpool_t **self, size_t threads_cnt, size_t ma
     TAILQ_INIT(&((*self)->task_queue));
     (*self)->task_queue_size_max = max_task_queue_size;
     (*self)->task_queue_size_cur = 0;
+    RB_INIT(&((*self)->task_tree_id));
+    (*self)->task_seq = 0;
     pthread_mutex_init(&((*self)->mutex), NULL);
     pthread_cond_init(&((*self)->cond), NULL);
 
@@ -105,8 +155,8 @@ int svx_threadpool_create(svx_threadpool_t **self, size_t threads_cnt, size_t ma
             }
             pthread_mutex_destroy(&((*self)->mutex));
             pthread_cond_destroy(&((*self)->cond));
-            free((*self)->threads);
-            free(*self);
+            svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, (*self)->threads);
+            svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, *self);
             *self = NULL;
             SVX_LOG_ERRNO_RETURN_ERR(saved_errno, "One of thread create failed\n");
         }
@@ -137,14 +187,19 @@ int svx_threadpool_destroy(svx_threadpool_t **self)
     TAILQ_FOREACH_SAFE(task, &((*self)->task_queue), link, tmp)
     {
         TAILQ_REMOVE(&((*self)->task_queue), task, link);
+        if(task->looper)
+        {
+            svx_threadpool_task_cancel(task);
+            continue;
+        }
         if(task->clean) task->clean(task->arg);
-        free(task);
+        svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, task);
     }
 
     pthread_mutex_destroy(&((*self)->mutex));
     pthread_cond_destroy(&((*self)->cond));
-    free((*self)->threads);
-    free(*self);
+    svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, (*self)->threads);
+    svx_alloc_free(SVX_ALLOC_TAG_THREADPOOL, *self);
     *self = NULL;
 
     return 0;
@@ -166,11 +221,12 @@ int svx_threadpool_dispatch(svx_threadpool_t *self, svx_threadpool_func_t run, s
         goto end;
     }
 
-    if(NULL == (task = malloc(sizeof(svx_threadpool_task_t))))
+    if(NULL == (task = svx_alloc_malloc(SVX_ALLOC_TAG_THREADPOOL, sizeof(svx_threadpool_task_t))))
         SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
-    task->run   = run;
-    task->clean = clean;
-    task->arg   = arg;
+    task->run    = run;
+    task->clean  = clean;
+    task->arg    = arg;
+    task->looper = NULL;
 
     TAILQ_INSERT_TAIL(&(self->task_queue), task, link);
 
@@ -183,3 +239,73 @@ int svx_threadpool_dispatch(svx_threadpool_t *self, svx_threadpool_func_t run, s
     pthread_mutex_unlock(&(self->mutex));
     return r;
 }
+
+int svx_threadpool_submit_to_looper(svx_threadpool_t *self, svx_looper_t *looper, svx_threadpool_func_t work,
+                                    svx_threadpool_func_t done, svx_threadpool_func_t clean, void *arg,
+                                    svx_threadpool_task_id_t *task_id)
+{
+    int                    r    = 0;
+    svx_threadpool_task_t *task = NULL;
+
+    if(NULL == self || NULL == looper || NULL == work || NULL == done)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, looper:%p, work:%p, done:%p\n", self, looper, work, done);
+
+    pthread_mutex_lock(&(self->mutex));
+
+    if(self->task_queue_size_max > 0 && self->task_queue_size_cur >= self->task_queue_size_max)
+    {
+        r = SVX_ERRNO_REACH;
+        goto end;
+    }
+
+    if(NULL == (task = svx_alloc_malloc(SVX_ALLOC_TAG_THREADPOOL, sizeof(svx_threadpool_task_t))))
+        SVX_LOG_ERRNO_GOTO_ERR(end, r = SVX_ERRNO_NOMEM, NULL);
+    task->run    = work;
+    task->clean  = clean;
+    task->arg    = arg;
+    task->looper = looper;
+    task->done   = done;
+    task->id     = ++(self->task_seq);
+    svx_looper_post_entry_init(&(task->entry), svx_threadpool_task_done, svx_threadpool_task_clean, task);
+
+    TAILQ_INSERT_TAIL(&(self->task_queue), task, link);
+    RB_INSERT(svx_threadpool_task_tree_id, &(self->task_tree_id), task);
+
+    if(self->task_queue_size_max > 0)
+        self->task_queue_size_cur++;
+
+    if(task_id) *task_id = task->id;
+
+    pthread_cond_signal(&(self->cond));
+
+ end:
+    pthread_mutex_unlock(&(self->mutex));
+    return r;
+}
+
+int svx_threadpool_cancel(svx_threadpool_t *self, svx_threadpool_task_id_t task_id)
+{
+    svx_threadpool_task_t  task_key = {.id = task_id};
+    svx_threadpool_task_t *task;
+
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    pthread_mutex_lock(&(self->mutex));
+
+    /* the task is running, finished or canceled */
+    if(NULL == (task = RB_FIND(svx_threadpool_task_tree_id, &(self->task_tree_id), &task_key)))
+    {
+        pthread_mutex_unlock(&(self->mutex));
+        return SVX_ERRNO_NOTFND;
+    }
+
+    TAILQ_REMOVE(&(self->task_queue), task, link);
+    RB_REMOVE(svx_threadpool_task_tree_id, &(self->task_tree_id), task);
+    if(self->task_queue_size_max > 0)
+        self->task_queue_size_cur--;
+
+    pthread_mutex_unlock(&(self->mutex));
+
+    svx_threadpool_task_cancel(task);
+    return 0;
+}
@@ -16,7 +16,9 @@
 #ifndef SVX_THREADPOOL_H
 #define SVX_THREADPOOL_H 1
 
+#include <stdint.h>
 #include <sys/types.h>
+#include "svx_looper.h"
 
 /*!
  * \defgroup Threadpool Threadpool
@@ -34,7 +36,8 @@ extern "C" {
 /*!
  * Signature for task callback.
  *
- * \param[in] arg  The argument which passed by \link svx_threadpool_dispatch \endlink.
+ * \param[in] arg  The argument which passed by \link svx_threadpool_dispatch \endlink or
+ *                 \link svx_threadpool_submit_to_looper \endlink.
  */
 typedef void (*svx_threadpool_func_t)(void *arg);
 
@@ -43,6 +46,11 @@ typedef void (*svx_threadpool_func_t)(void *arg);
  */
 typedef struct svx_threadpool svx_threadpool_t;
 
+/*!
+ * The ID of a task submitted by \link svx_threadpool_submit_to_looper \endlink. Zero is never used.
+ */
+typedef uint64_t svx_threadpool_task_id_t;
+
 /*!
  * To create a new thread pool.
  *
@@ -80,6 +88,52 @@ extern int svx_threadpool_destroy(svx_threadpool_t **self);
  */
 extern int svx_threadpool_dispatch(svx_threadpool_t *self, svx_threadpool_func_t run, svx_threadpool_func_t clean,  void *arg);
 
+/*!
+ * Submit a new task to the thread pool, and send its completion back to a looper. It can be
+ * called in any thread.
+ *
+ * The \c work callback is run in a thread of the pool, then the \c done callback is run in the
+ * loop thread of the looper. The finished tasks are sent back by \link svx_looper_post \endlink,
+ * so they are batched per looper: a burst of finished tasks costs only one wakeup of the loop
+ * thread, and they are all run in one round, without any lock or memory allocation.
+ *
+ * The \c clean callback is run instead of the \c work and \c done callback if the task is
+ * canceled by \link svx_threadpool_cancel \endlink, or the thread pool is destroyed before the
+ * task is run. It is run in the loop thread too, so the data of the task is always released in
+ * the thread which owns it. It is also run when the looper is destroyed before the \c done
+ * callback is run.
+ *
+ * \warning  The thread pool MUST be destroyed before the looper.
+ *
+ * \param[in]  self     The address of the thread pool.
+ * \param[in]  looper   The looper which runs the \c done and \c clean callback.
+ * \param[in]  work     The callback fucntion for running the task in the thread pool.
+ * \param[in]  done     The callback fucntion which is run in the loop thread after the task is run.
+ * \param[in]  clean    The callback fucntion for cleaning data when the task can't be run. Can be \c NULL.
+ * \param[in]  arg      The argument pass the work, done or clean callback function.
+ * \param[out] task_id  Return the ID of the task for canceling it. Can be \c NULL.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_REACH if the task queue is full.
+ */
+extern int svx_threadpool_submit_to_looper(svx_threadpool_t *self, svx_looper_t *looper, svx_threadpool_func_t work,
+                                           svx_threadpool_func_t done, svx_threadpool_func_t clean, void *arg,
+                                           svx_threadpool_task_id_t *task_id);
+
+/*!
+ * Cancel a task submitted by \link svx_threadpool_submit_to_looper \endlink. It can be called in
+ * any thread. The task is removed from the task queue, and its \c clean callback will be run in
+ * the loop thread of its looper.
+ *
+ * \param[in] self     The address of the thread pool.
+ * \param[in] task_id  The ID of the task.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ *          Return \c SVX_ERRNO_NOTFND if the task is running or finished (then the \c done
+ *          callback will be run as usual), or it has been canceled.
+ */
+extern int svx_threadpool_cancel(svx_threadpool_t *self, svx_threadpool_task_id_t task_id);
+
 #ifdef __cplusplus
 }
 #endif
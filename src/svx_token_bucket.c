@@ -0,0 +1,134 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "svx_token_bucket.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
+#include "svx_log.h"
+
+#define SVX_TOKEN_BUCKET_ELAPSED_MS_MAX (24 * 3600 * 1000)
+
+struct svx_token_bucket
+{
+    int64_t         rate;    /* tokens per second */
+    int64_t         burst;
+    int64_t         quantum; /* the number of tokens which worth waiting for */
+    int64_t         tokens;  /* negative: in debt */
+    int64_t         last_ms; /* the last refilling time */
+    int64_t         frac;    /* the fraction of a token (in 1/1000) which has not been refilled */
+    pthread_mutex_t mutex;
+};
+
+static int64_t svx_token_bucket_get_now_ms()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/* MUST be called with the mutex locked */
+static void svx_token_bucket_refill(svx_token_bucket_t *self)
+{
+    int64_t now_ms = svx_token_bucket_get_now_ms();
+    int64_t elapsed_ms;
+    int64_t total;
+
+    /* the system time has been changed backwards */
+    if(now_ms < self->last_ms) self->last_ms = now_ms;
+
+    /* avoid overflow after a long idle time, refill one day of tokens at most */
+    elapsed_ms = now_ms - self->last_ms;
+    if(elapsed_ms > SVX_TOKEN_BUCKET_ELAPSED_MS_MAX) elapsed_ms = SVX_TOKEN_BUCKET_ELAPSED_MS_MAX;
+
+    /* carry the fraction of a token over to the next refilling, so that the rate is exact */
+    total         = elapsed_ms * self->rate + self->frac;
+    self->last_ms = now_ms;
+    self->frac    = total % 1000;
+    self->tokens += total / 1000;
+
+    if(self->tokens >= self->burst)
+    {
+        self->tokens = self->burst;
+        self->frac   = 0;
+    }
+}
+
+int svx_token_bucket_create(svx_token_bucket_t **self, size_t rate, size_t burst)
+{
+    if(NULL == self || 0 == rate || rate > INT32_MAX || burst > INT32_MAX)
+        SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, rate:%zu, burst:%zu\n", self, rate, burst);
+
+    if(NULL == (*self = svx_alloc_malloc(SVX_ALLOC_TAG_MISC, sizeof(svx_token_bucket_t)))) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_NOMEM, NULL);
+    (*self)->rate    = (int64_t)rate;
+    (*self)->burst   = (int64_t)(0 == burst ? rate : burst);
+    (*self)->quantum = (*self)->rate / 100;
+    if((*self)->quantum > (*self)->burst) (*self)->quantum = (*self)->burst;
+    if((*self)->quantum < 1)              (*self)->quantum = 1;
+    (*self)->tokens  = (*self)->burst;
+    (*self)->last_ms = svx_token_bucket_get_now_ms();
+    (*self)->frac    = 0;
+    pthread_mutex_init(&((*self)->mutex), NULL);
+
+    return 0;
+}
+
+int svx_token_bucket_destroy(svx_token_bucket_t **self)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+    if(NULL == *self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "*self:%p\n", *self);
+
+    pthread_mutex_destroy(&((*self)->mutex));
+    svx_alloc_free(SVX_ALLOC_TAG_MISC, *self);
+    *self = NULL;
+
+    return 0;
+}
+
+int svx_token_bucket_get_tokens(svx_token_bucket_t *self, int64_t *tokens)
+{
+    if(NULL == self || NULL == tokens) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, tokens:%p\n", self, tokens);
+
+    pthread_mutex_lock(&(self->mutex));
+    svx_token_bucket_refill(self);
+    *tokens = self->tokens;
+    pthread_mutex_unlock(&(self->mutex));
+
+    return 0;
+}
+
+int svx_token_bucket_consume(svx_token_bucket_t *self, size_t n)
+{
+    if(NULL == self) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p\n", self);
+
+    pthread_mutex_lock(&(self->mutex));
+    self->tokens -= (int64_t)n;
+    pthread_mutex_unlock(&(self->mutex));
+
+    return 0;
+}
+
+int svx_token_bucket_get_wait_ms(svx_token_bucket_t *self, int64_t *wait_ms)
+{
+    int64_t need;
+
+    if(NULL == self || NULL == wait_ms) SVX_LOG_ERRNO_RETURN_ERR(SVX_ERRNO_INVAL, "self:%p, wait_ms:%p\n", self, wait_ms);
+
+    pthread_mutex_lock(&(self->mutex));
+    svx_token_bucket_refill(self);
+    need = self->quantum - self->tokens;
+    pthread_mutex_unlock(&(self->mutex));
+
+    *wait_ms = (need <= 0 ? 0 : (need * 1000 + self->rate - 1) / self->rate);
+
+    return 0;
+}
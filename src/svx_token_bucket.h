@@ -0,0 +1,102 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+/*!
+ * \file   svx_token_bucket.h
+ * \brief
+ *
+ * \author Alan Choi
+ * \date   2026-10-18
+ */
+
+#ifndef SVX_TOKEN_BUCKET_H
+#define SVX_TOKEN_BUCKET_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*!
+ * \defgroup Token_bucket Token_bucket
+ * \ingroup  Network
+ *
+ * \brief    A token bucket for bandwidth shaping. The tokens are refilled at a constant rate
+ *           up to the burst size. Consuming is allowed to make the bucket run into debt,
+ *           which will be paid back by the following refilling.
+ *
+ *           All functions are thread-safe, so a token bucket can be shared by the TCP connections
+ *           in different loopers.
+ *
+ * \{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The type for token bucket.
+ */
+typedef struct svx_token_bucket svx_token_bucket_t;
+
+/*!
+ * To create a new token bucket. The bucket is full after creating.
+ *
+ * \param[out] self   The pointer for return the token bucket object.
+ * \param[in]  rate   The refilling rate, in tokens (bytes) per second. MUST be greater than zero.
+ * \param[in]  burst  The capacity of the bucket. Zero means the same as \c rate.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_token_bucket_create(svx_token_bucket_t **self, size_t rate, size_t burst);
+
+/*!
+ * To destroy a token bucket.
+ *
+ * \param[in, out] self  The second rank pointer of the token bucket.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_token_bucket_destroy(svx_token_bucket_t **self);
+
+/*!
+ * Refill the bucket, then get the number of available tokens.
+ *
+ * \param[in]  self    The address of the token bucket.
+ * \param[out] tokens  Return the number of available tokens. Zero or negative if the bucket is in debt.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_token_bucket_get_tokens(svx_token_bucket_t *self, int64_t *tokens);
+
+/*!
+ * Take tokens from the bucket. The bucket will run into debt if there are not enough tokens.
+ *
+ * \param[in] self  The address of the token bucket.
+ * \param[in] n     The number of tokens.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_token_bucket_consume(svx_token_bucket_t *self, size_t n);
+
+/*!
+ * Get how long to wait until the bucket is worth using again. That is, until it is refilled with
+ * 10 milliseconds of tokens (but no more than the burst size, and at least one token).
+ *
+ * \param[in]  self     The address of the token bucket.
+ * \param[out] wait_ms  Return the waiting time on millisecond. Zero if the bucket can be used now.
+ *
+ * \return  On success, return zero; on error, return an error number greater than zero.
+ */
+extern int svx_token_bucket_get_wait_ms(svx_token_bucket_t *self, int64_t *wait_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* \} */
+
+#endif
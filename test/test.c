@@ -35,9 +35,13 @@ int test_rbtree_runner();
 int test_log_runner();
 int test_threadpool_runner();
 int test_notifier_runner();
+int test_alloc_runner();
 int test_circlebuf_runner();
+int test_bufpool_runner();
 int test_plc_runner();
 int test_tcp_runner();
+int test_tcp_proxy_runner();
+int test_codec_runner();
 int test_udp_runner();
 int test_icmp_runner();
 int test_crash_runner();
@@ -53,9 +57,13 @@ test_info_t test_infos[] = {
     {"log",        &test_log_runner,        -1},
     {"threadpool", &test_threadpool_runner, -1},
     {"notifier",   &test_notifier_runner,   -1},
+    {"alloc",      &test_alloc_runner,      -1},
     {"circlebuf",  &test_circlebuf_runner,  -1},
+    {"bufpool",    &test_bufpool_runner,    -1},
     {"PLC",        &test_plc_runner,        -1},
     {"tcp",        &test_tcp_runner,        -1},
+    {"tcp_proxy",  &test_tcp_proxy_runner,  -1},
+    {"codec",      &test_codec_runner,      -1},
     {"udp",        &test_udp_runner,        -1},
     {"icmp",       &test_icmp_runner,       -1},
     {"crash",      &test_crash_runner,      -1},
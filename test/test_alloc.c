@@ -0,0 +1,174 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "svx_alloc.h"
+#include "svx_looper.h"
+#include "svx_circlebuf.h"
+#include "svx_bufpool.h"
+#include "svx_errno.h"
+
+/* the hooks' own counters, to check that all the memory is allocated through them */
+typedef struct
+{
+    uint64_t mallocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    uint64_t tags[SVX_ALLOC_TAG_COUNT];
+} test_alloc_hooks_arg_t;
+
+static test_alloc_hooks_arg_t test_alloc_hooks_arg;
+
+static void *test_alloc_malloc_cb(size_t size, svx_alloc_tag_t tag, void *arg)
+{
+    test_alloc_hooks_arg_t *a = (test_alloc_hooks_arg_t *)arg;
+
+    a->mallocs++;
+    a->tags[tag]++;
+    return malloc(size);
+}
+
+static void *test_alloc_realloc_cb(void *ptr, size_t size, svx_alloc_tag_t tag, void *arg)
+{
+    test_alloc_hooks_arg_t *a = (test_alloc_hooks_arg_t *)arg;
+
+    a->reallocs++;
+    a->tags[tag]++;
+    return realloc(ptr, size);
+}
+
+static void test_alloc_free_cb(void *ptr, svx_alloc_tag_t tag, void *arg)
+{
+    test_alloc_hooks_arg_t *a = (test_alloc_hooks_arg_t *)arg;
+
+    (void)tag;
+    a->frees++;
+    free(ptr);
+}
+
+static void test_alloc_timer_run(void *arg)
+{
+    (void)arg;
+}
+
+static int test_alloc_check_stats(svx_alloc_tag_t tag, int64_t live_bytes)
+{
+    svx_alloc_stats_t stats;
+
+    if(svx_alloc_get_stats(tag, &stats)) return 1;
+    if(live_bytes != stats.live_bytes || stats.allocs < stats.frees ||
+       (live_bytes > 0 && stats.alloc_bytes < (uint64_t)live_bytes))
+    {
+        printf("check stats failed. tag:%s, allocs:%"PRIu64", frees:%"PRIu64", alloc_bytes:%"PRIu64
+               ", live_bytes:%"PRId64", expected live_bytes:%"PRId64"\n", svx_alloc_get_tag_name(tag),
+               stats.allocs, stats.frees, stats.alloc_bytes, stats.live_bytes, live_bytes);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_alloc_do()
+{
+    svx_alloc_hooks_t      hooks = {&test_alloc_malloc_cb, &test_alloc_realloc_cb, &test_alloc_free_cb,
+                                    &test_alloc_hooks_arg};
+    svx_alloc_stats_t      stats;
+    svx_looper_t          *looper = NULL;
+    svx_looper_timer_id_t  timer_id;
+    svx_circlebuf_t       *cb = NULL;
+    svx_bufpool_t         *pool = NULL;
+    uint8_t                data[4096];
+    uint8_t               *buf, *p;
+    size_t                 buf_len;
+    svx_alloc_tag_t        tag;
+
+    memset(&test_alloc_hooks_arg, 0, sizeof(test_alloc_hooks_arg));
+    memset(data, 'a', sizeof(data));
+
+    /* the hooks are required */
+    hooks.free_cb = NULL;
+    if(SVX_ERRNO_INVAL != svx_alloc_set_hooks(&hooks)) return 1;
+    hooks.free_cb = &test_alloc_free_cb;
+
+    /* must be called before anything is allocated */
+    if(svx_alloc_set_hooks(&hooks)) return 1;
+    if(svx_alloc_enable_stats(1)) return 1;
+
+    /* looper, timer and pending */
+    if(svx_looper_create(&looper)) return 1;
+    if(svx_looper_run_after(looper, &test_alloc_timer_run, NULL, NULL, 100000, &timer_id)) return 1;
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_LOOPER, &stats) || 0 == stats.live_bytes) return 1;
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_TIMER, &stats) || 1 != stats.allocs) return 1;
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_PENDING, &stats) || 0 == stats.live_bytes) return 1;
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_CHANNEL, &stats) || 0 == stats.live_bytes) return 1;
+
+    /* circlebuf, with realloc */
+    if(svx_circlebuf_create(&cb, 65536, 1024, 1024)) return 1;
+    if(svx_circlebuf_append_data(cb, data, sizeof(data))) return 1;
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_CIRCLEBUF, &stats) || stats.allocs < 3 || stats.live_bytes < (int64_t)sizeof(data))
+        return 1;
+    if(0 == test_alloc_hooks_arg.reallocs) return 1;
+
+    /* bufpool, with the aligned chunks */
+    if(svx_bufpool_create(&pool, 1024 * 1024, 0)) return 1;
+    if(svx_bufpool_alloc(pool, 1000, &buf, &buf_len)) return 1;
+    if(0 != (uintptr_t)buf % 64) return 1;
+    memset(buf, 0, buf_len);
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_BUF, &stats) || stats.live_bytes < (int64_t)buf_len) return 1;
+
+    /* the allocator can not be changed any more */
+    if(SVX_ERRNO_PERM != svx_alloc_set_hooks(NULL)) return 1;
+    if(SVX_ERRNO_PERM != svx_alloc_enable_stats(0)) return 1;
+
+    /* misc, including the aligned memory */
+    if(NULL == (p = svx_alloc_aligned(SVX_ALLOC_TAG_MISC, 256, 100))) return 1;
+    if(0 != (uintptr_t)p % 256) return 1;
+    if(test_alloc_check_stats(SVX_ALLOC_TAG_MISC, 100 + 256 + (int64_t)sizeof(void *))) return 1;
+    svx_alloc_aligned_free(SVX_ALLOC_TAG_MISC, p);
+    if(NULL == (p = (uint8_t *)svx_alloc_strdup(SVX_ALLOC_TAG_MISC, "libsvx"))) return 1;
+    if(0 != strcmp((char *)p, "libsvx")) return 1;
+    svx_alloc_free(SVX_ALLOC_TAG_MISC, p);
+    if(test_alloc_check_stats(SVX_ALLOC_TAG_MISC, 0)) return 1;
+
+    /* free all, nothing is leaked */
+    if(svx_bufpool_free(pool, buf, buf_len)) return 1;
+    if(svx_bufpool_del_ref(pool)) return 1;
+    if(svx_circlebuf_destroy(&cb)) return 1;
+    if(svx_looper_destroy(&looper)) return 1;
+
+    for(tag = 0; tag < SVX_ALLOC_TAG_COUNT; tag++)
+        if(test_alloc_check_stats(tag, 0)) return 1;
+
+    /* all of them went through the hooks */
+    if(test_alloc_hooks_arg.mallocs != test_alloc_hooks_arg.frees ||
+       0 == test_alloc_hooks_arg.tags[SVX_ALLOC_TAG_LOOPER] ||
+       0 == test_alloc_hooks_arg.tags[SVX_ALLOC_TAG_CIRCLEBUF] ||
+       0 == test_alloc_hooks_arg.tags[SVX_ALLOC_TAG_BUF])
+    {
+        printf("check hooks failed. mallocs:%"PRIu64", reallocs:%"PRIu64", frees:%"PRIu64"\n",
+               test_alloc_hooks_arg.mallocs, test_alloc_hooks_arg.reallocs, test_alloc_hooks_arg.frees);
+        return 1;
+    }
+
+    return 0;
+}
+
+int test_alloc_runner()
+{
+    int r = 0;
+
+    if(0 != (r = test_alloc_do())) goto end;
+
+ end:
+    fclose(stdin);
+    fclose(stdout);
+    fclose(stderr);
+    return r;
+}
@@ -0,0 +1,212 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "svx_bufpool.h"
+#include "svx_errno.h"
+
+#define TEST_BUFPOOL_CHUNK_CNT   64
+#define TEST_BUFPOOL_THD_CNT     4
+#define TEST_BUFPOOL_THD_CHUNKS  4096
+#define TEST_BUFPOOL_HUGE_LEN    (2 * 1024 * 1024)
+
+typedef struct
+{
+    svx_bufpool_t *pool;
+    uint8_t       *bufs[TEST_BUFPOOL_THD_CHUNKS];
+    size_t         buf_lens[TEST_BUFPOOL_THD_CHUNKS];
+} test_bufpool_thd_t;
+
+/* alloc and free chunks of different lengths, then alloc them again from the pool */
+static int test_bufpool_basic()
+{
+    svx_bufpool_t       *pool = NULL;
+    svx_bufpool_stats_t  stats;
+    uint8_t             *bufs[TEST_BUFPOOL_CHUNK_CNT];
+    size_t               buf_lens[TEST_BUFPOOL_CHUNK_CNT];
+    size_t               lens[TEST_BUFPOOL_CHUNK_CNT];
+    size_t               retained = 0;
+    int                  round, i;
+
+    for(i = 0; i < TEST_BUFPOOL_CHUNK_CNT; i++)
+        lens[i] = (size_t)(random() % 65536) + 1;
+
+    if(svx_bufpool_create(&pool, 64 * 1024 * 1024, 0)) return 1;
+
+    for(round = 0; round < 2; round++)
+    {
+        for(i = 0; i < TEST_BUFPOOL_CHUNK_CNT; i++)
+        {
+            if(svx_bufpool_alloc(pool, lens[i], &(bufs[i]), &(buf_lens[i]))) return 1;
+            if(buf_lens[i] < lens[i] || buf_lens[i] < 64 || 0 != (buf_lens[i] & (buf_lens[i] - 1)) ||
+               buf_lens[i] >= lens[i] * 2 + 64 || 0 != (uintptr_t)(bufs[i]) % 64)
+            {
+                printf("check chunk failed. len:%zu, buf_len:%zu, buf:%p\n", lens[i], buf_lens[i], bufs[i]);
+                return 1;
+            }
+            memset(bufs[i], i, buf_lens[i]);
+        }
+        for(i = 0; i < TEST_BUFPOOL_CHUNK_CNT; i++)
+        {
+            if(bufs[i][0] != (uint8_t)i || bufs[i][buf_lens[i] - 1] != (uint8_t)i)
+            {
+                printf("check chunk data failed\n");
+                return 1;
+            }
+            if(svx_bufpool_free(pool, bufs[i], buf_lens[i])) return 1;
+            if(0 == round) retained += buf_lens[i];
+        }
+    }
+
+    if(svx_bufpool_get_stats(pool, &stats)) return 1;
+    if(TEST_BUFPOOL_CHUNK_CNT != stats.misses || TEST_BUFPOOL_CHUNK_CNT != stats.hits ||
+       0 != stats.released || retained != stats.retained_bytes)
+    {
+        printf("check stats failed. hits:%"PRIu64", misses:%"PRIu64", released:%"PRIu64", retained:%zu\n",
+               stats.hits, stats.misses, stats.released, stats.retained_bytes);
+        return 1;
+    }
+
+    return svx_bufpool_del_ref(pool);
+}
+
+/* the chunks beyond the cap are returned to the system */
+static int test_bufpool_cap()
+{
+    svx_bufpool_t       *pool = NULL;
+    svx_bufpool_stats_t  stats;
+    uint8_t             *buf1, *buf2, *buf3;
+    size_t               buf1_len, buf2_len, buf3_len;
+
+    if(svx_bufpool_create(&pool, 1024, 0)) return 1;
+    if(svx_bufpool_alloc(pool, 1000, &buf1, &buf1_len)) return 1;
+    if(svx_bufpool_alloc(pool, 1000, &buf2, &buf2_len)) return 1;
+    if(svx_bufpool_alloc(pool, 100000000, &buf3, &buf3_len)) return 1; /* too large to be retained */
+    if(svx_bufpool_free(pool, buf1, buf1_len)) return 1;
+    if(svx_bufpool_free(pool, buf2, buf2_len)) return 1;
+    if(svx_bufpool_free(pool, buf3, buf3_len)) return 1;
+
+    if(svx_bufpool_get_stats(pool, &stats)) return 1;
+    if(2 != stats.released || 1024 != stats.retained_bytes)
+    {
+        printf("check cap failed. released:%"PRIu64", retained:%zu\n", stats.released, stats.retained_bytes);
+        return 1;
+    }
+
+    return svx_bufpool_del_ref(pool);
+}
+
+static void *test_bufpool_thd_func(void *arg)
+{
+    test_bufpool_thd_t *thd = (test_bufpool_thd_t *)arg;
+    int                 i;
+
+    for(i = 0; i < TEST_BUFPOOL_THD_CHUNKS; i++)
+        if(svx_bufpool_free(thd->pool, thd->bufs[i], thd->buf_lens[i])) exit(1);
+
+    return NULL;
+}
+
+/* the chunks are freed in other threads while the owner thread is allocating */
+static int test_bufpool_threads()
+{
+    svx_bufpool_t       *pool = NULL;
+    svx_bufpool_stats_t  stats;
+    test_bufpool_thd_t  *thds = NULL;
+    pthread_t            tids[TEST_BUFPOOL_THD_CNT];
+    uint8_t             *buf;
+    size_t               buf_len, total = 0;
+    uint64_t             misses;
+    int                  i, j;
+
+    if(NULL == (thds = malloc(sizeof(test_bufpool_thd_t) * TEST_BUFPOOL_THD_CNT))) return 1;
+    if(svx_bufpool_create(&pool, (size_t)1 << 30, 0)) return 1;
+
+    for(i = 0; i < TEST_BUFPOOL_THD_CNT; i++)
+    {
+        thds[i].pool = pool;
+        for(j = 0; j < TEST_BUFPOOL_THD_CHUNKS; j++)
+        {
+            if(svx_bufpool_alloc(pool, (size_t)(random() % 256) + 1, &(thds[i].bufs[j]), &(thds[i].buf_lens[j]))) return 1;
+            total += thds[i].buf_lens[j];
+        }
+    }
+
+    for(i = 0; i < TEST_BUFPOOL_THD_CNT; i++)
+        if(pthread_create(&(tids[i]), NULL, &test_bufpool_thd_func, &(thds[i]))) return 1;
+
+    /* take the chunks back while they are being returned */
+    for(i = 0; i < TEST_BUFPOOL_THD_CHUNKS; i++)
+    {
+        if(svx_bufpool_alloc(pool, 64, &buf, &buf_len)) return 1;
+        memset(buf, 0, buf_len);
+        if(svx_bufpool_free(pool, buf, buf_len)) return 1;
+    }
+
+    for(i = 0; i < TEST_BUFPOOL_THD_CNT; i++)
+        pthread_join(tids[i], NULL);
+
+    if(svx_bufpool_get_stats(pool, &stats)) return 1;
+    /* all the chunks are in the pool now, including the ones allocated by the owner thread's misses */
+    misses = stats.misses - TEST_BUFPOOL_THD_CNT * TEST_BUFPOOL_THD_CHUNKS;
+    if(stats.hits + stats.misses != (TEST_BUFPOOL_THD_CNT + 1) * TEST_BUFPOOL_THD_CHUNKS ||
+       stats.retained_bytes != total + misses * 64)
+    {
+        printf("check threads failed. hits:%"PRIu64", misses:%"PRIu64", total:%zu, retained:%zu\n",
+               stats.hits, stats.misses, total, stats.retained_bytes);
+        return 1;
+    }
+
+    free(thds);
+    return svx_bufpool_del_ref(pool);
+}
+
+/* the hugepages are used if possible, or fall back to the normal pages */
+static int test_bufpool_hugepages()
+{
+    svx_bufpool_t       *pool = NULL;
+    svx_bufpool_stats_t  stats;
+    uint8_t             *buf;
+    size_t               buf_len;
+    int                  i;
+
+    if(svx_bufpool_create(&pool, TEST_BUFPOOL_HUGE_LEN * 2, SVX_BUFPOOL_FLAG_HUGEPAGES)) return 1;
+    for(i = 0; i < 2; i++)
+    {
+        if(svx_bufpool_alloc(pool, TEST_BUFPOOL_HUGE_LEN, &buf, &buf_len)) return 1;
+        if(TEST_BUFPOOL_HUGE_LEN != buf_len) return 1;
+        memset(buf, 0, buf_len);
+        if(svx_bufpool_free(pool, buf, buf_len)) return 1;
+    }
+
+    if(svx_bufpool_get_stats(pool, &stats)) return 1;
+    if(1 != stats.hits || 1 != stats.misses) return 1;
+
+    return svx_bufpool_del_ref(pool);
+}
+
+int test_bufpool_runner()
+{
+    int r = 0;
+
+    if(0 != (r = test_bufpool_basic())) goto end;
+    if(0 != (r = test_bufpool_cap())) goto end;
+    if(0 != (r = test_bufpool_threads())) goto end;
+    if(0 != (r = test_bufpool_hugepages())) goto end;
+
+ end:
+    fclose(stdin);
+    fclose(stdout);
+    fclose(stderr);
+    return r;
+}
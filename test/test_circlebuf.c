@@ -12,6 +12,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include "svx_circlebuf.h"
+#include "svx_errno.h"
 
 #define TEST_CIRCLEBUF_BLOCK_TEST      10240
 #define TEST_CIRCLEBUF_MAX_LEN         1231
@@ -22,17 +23,170 @@
 #define TEST_CIRCLEBUF_PAYLOAD_CHAR    '#'
 #define TEST_CIRCLEBUF_PAYLOAD_LEN_MAX 10
 
+#define TEST_CIRCLEBUF_TRICKLE_LEN     20000
+#define TEST_CIRCLEBUF_TRICKLE_BUF_LEN 256
+#define TEST_CIRCLEBUF_TRICKLE_CHARS   "ab\r\n"
+#define TEST_CIRCLEBUF_TRICKLE_ENDING  "\r\n\r\nab\r\n"
+
+#define TEST_CIRCLEBUF_TYPE_NORMAL     0
+#define TEST_CIRCLEBUF_TYPE_MIRRORED   1
+#define TEST_CIRCLEBUF_TYPE_POOLED     2
+
 typedef struct
 {
     uint64_t payload_len;
     uint8_t  ending[TEST_CIRCLEBUF_ENDING_LEN];
 }__attribute__((packed)) test_circlebuf_header_t;
 
-int test_circlebuf_runner()
+static svx_bufpool_t *test_circlebuf_pool = NULL;
+
+static int test_circlebuf_create(svx_circlebuf_t **cb, int type, size_t max_len, size_t min_len, size_t min_step)
+{
+    switch(type)
+    {
+    case TEST_CIRCLEBUF_TYPE_MIRRORED:
+        return svx_circlebuf_create_mirrored(cb, max_len, min_len, min_step);
+    case TEST_CIRCLEBUF_TYPE_POOLED:
+        return svx_circlebuf_create_pooled(cb, test_circlebuf_pool, max_len, min_len, min_step);
+    default:
+        return svx_circlebuf_create(cb, max_len, min_len, min_step);
+    }
+}
+
+/* append the data in small pieces, and search the ending after each piece,
+   check the result with memmem() on the whole data */
+static int test_circlebuf_trickle(int type, size_t ending_len)
+{
+    int              r = 0;
+    svx_circlebuf_t *cb = NULL;
+    uint8_t          data[TEST_CIRCLEBUF_TRICKLE_LEN];
+    const uint8_t   *ending = (const uint8_t *)TEST_CIRCLEBUF_TRICKLE_ENDING;
+    uint8_t         *buf = NULL;
+    size_t           buf_len = 0;
+    size_t           consumed = 0, appended = 0, freespace_len = 0, ret_len = 0, len = 0, i = 0;
+    size_t           off = 0, pos = 0, span1_len = 0, span2_len = 0;
+    const uint8_t   *span1 = NULL, *span2 = NULL;
+    uint8_t         *p = NULL;
+    int              cmp = 0;
+
+    for(i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)TEST_CIRCLEBUF_TRICKLE_CHARS[random() % 4];
+
+    if(0 != (r = test_circlebuf_create(&cb, type, TEST_CIRCLEBUF_TRICKLE_BUF_LEN, TEST_CIRCLEBUF_TRICKLE_BUF_LEN, 8)))
+    {
+        printf("svx_circlebuf_create() failed\n");
+        goto end;
+    }
+
+    /* the mirrored circlebuf is rounded up to pages, so get the real length */
+    if(0 != (r = svx_circlebuf_get_buf_len(cb, &buf_len)))
+    {
+        printf("svx_circlebuf_get_buf_len() failed\n");
+        goto end;
+    }
+    if(NULL == (buf = malloc(buf_len)))
+    {
+        printf("malloc() failed\n");
+        r = 1;
+        goto end;
+    }
+
+    while(appended < sizeof(data))
+    {
+        if(0 != (r = svx_circlebuf_get_freespace_len(cb, &freespace_len)))
+        {
+            printf("svx_circlebuf_get_freespace_len() failed\n");
+            goto end;
+        }
+
+        /* the buffer is full of data without the ending, drop some */
+        if(0 == freespace_len)
+        {
+            len = 1 + (size_t)(random() % 64);
+            if(0 != (r = svx_circlebuf_erase_data(cb, len)))
+            {
+                printf("svx_circlebuf_erase_data() failed\n");
+                goto end;
+            }
+            consumed += len;
+            continue;
+        }
+
+        len = 1 + (size_t)(random() % 16);
+        if(len > freespace_len) len = freespace_len;
+        if(len > sizeof(data) - appended) len = sizeof(data) - appended;
+        if(0 != (r = svx_circlebuf_append_data(cb, data + appended, len)))
+        {
+            printf("svx_circlebuf_append_data() failed\n");
+            goto end;
+        }
+        appended += len;
+
+        /* peek at a random offset */
+        off = (size_t)(random() % (appended - consumed));
+        len = (appended - consumed - off < 8 ? appended - consumed - off : 8);
+        if(0 != svx_circlebuf_peek(cb, off, buf, len) || 0 != memcmp(buf, data + consumed + off, len))
+        {
+            printf("check peek failed\n");
+            r = 1;
+            goto end;
+        }
+
+        while(1)
+        {
+            p = memmem(data + consumed, appended - consumed, ending, ending_len);
+
+            /* search in place, then check the data in place */
+            if(NULL != p)
+            {
+                off = (size_t)(p - (data + consumed));
+                if(0 != svx_circlebuf_search(cb, 0, ending, ending_len, &pos) || pos != off ||
+                   0 != svx_circlebuf_compare(cb, pos, ending, ending_len, &cmp) || 0 != cmp ||
+                   0 != svx_circlebuf_get_spans(cb, 0, pos + ending_len, &span1, &span1_len, &span2, &span2_len) ||
+                   0 != memcmp(span1, data + consumed, span1_len) ||
+                   (span2_len > 0 && 0 != memcmp(span2, data + consumed + span1_len, span2_len)) ||
+                   span1_len + span2_len != pos + ending_len)
+                {
+                    printf("check search in place failed\n");
+                    r = 1;
+                    goto end;
+                }
+            }
+
+            r = svx_circlebuf_get_data_by_ending(cb, ending, ending_len, buf, buf_len, &ret_len);
+            if(NULL == p)
+            {
+                if(SVX_ERRNO_NOTFND != r && SVX_ERRNO_NODATA != r)
+                {
+                    printf("check not found failed\n");
+                    r = 1;
+                    goto end;
+                }
+                r = 0;
+                break;
+            }
+            if(0 != r || (size_t)(p - (data + consumed)) + ending_len != ret_len ||
+               0 != memcmp(buf, data + consumed, ret_len))
+            {
+                printf("check found failed\n");
+                r = 1;
+                goto end;
+            }
+            consumed += ret_len;
+        }
+    }
+
+ end:
+    if(cb) svx_circlebuf_destroy(&cb);
+    if(buf) free(buf);
+    return r;
+}
+
+static int test_circlebuf_blocks(int type, size_t max_len, size_t min_len, size_t min_step)
 {
     int                      r  = 0;
     svx_circlebuf_t         *cb = NULL;
-    size_t                   cb_block_capacity = (TEST_CIRCLEBUF_MAX_LEN / (sizeof(test_circlebuf_header_t) + TEST_CIRCLEBUF_PAYLOAD_LEN_MAX));
+    size_t                   cb_block_capacity = (max_len / (sizeof(test_circlebuf_header_t) + TEST_CIRCLEBUF_PAYLOAD_LEN_MAX));
     size_t                   cb_block_used = 0;
     uint8_t                  block_send[sizeof(test_circlebuf_header_t) + TEST_CIRCLEBUF_PAYLOAD_LEN_MAX];
     test_circlebuf_header_t *block_send_header = (test_circlebuf_header_t *)block_send;
@@ -56,7 +210,7 @@ int test_circlebuf_runner()
     for(i = 0; i < TEST_CIRCLEBUF_BLOCK_TEST; i++)
         block_payload_len_saved[i] = (uint64_t)(random() % (TEST_CIRCLEBUF_PAYLOAD_LEN_MAX + 1));
 
-    if(0 != (r = svx_circlebuf_create(&cb, TEST_CIRCLEBUF_MAX_LEN, TEST_CIRCLEBUF_MIN_LEN, TEST_CIRCLEBUF_MIN_STEP)))
+    if(0 != (r = test_circlebuf_create(&cb, type, max_len, min_len, min_step)))
     {
         printf("svx_circlebuf_create() failed\n");
         goto end;
@@ -99,6 +253,12 @@ int test_circlebuf_runner()
                     printf("no freespace\n");
                     goto end;
                 }
+                if(TEST_CIRCLEBUF_TYPE_MIRRORED == type && NULL != buf2)
+                {
+                    r = 1;
+                    printf("check mirrored freespace continuity failed\n");
+                    goto end;
+                }
 
                 if(buf1_len >= block_len)
                 {
@@ -173,6 +333,12 @@ int test_circlebuf_runner()
                     printf("check data length failed\n");
                     goto end;
                 }
+                if(TEST_CIRCLEBUF_TYPE_MIRRORED == type && NULL != buf2)
+                {
+                    r = 1;
+                    printf("check mirrored data continuity failed\n");
+                    goto end;
+                }
                 if(buf1_len >= block_len)
                 {
                     memcpy(block_recv, buf1, block_len);
@@ -215,7 +381,7 @@ int test_circlebuf_runner()
             /* shrink buffer */
             if(0 == block_recv_cnt % 5)
             {
-                if(0 != (r = svx_circlebuf_shrink(cb, TEST_CIRCLEBUF_MIN_STEP)))
+                if(0 != (r = svx_circlebuf_shrink(cb, min_step)))
                 {
                     printf("svx_circlebuf_shrink() failed\n");
                     goto end;
@@ -256,15 +422,67 @@ int test_circlebuf_runner()
         goto end;
     }
 
+    /* search the ending while the data is trickling in */
+    for(i = 1; i <= strlen(TEST_CIRCLEBUF_TRICKLE_ENDING); i++)
+        if(0 != (r = test_circlebuf_trickle(type, i))) goto end;
+
  end:
     if(cb)
     {
-        if(0 != (r = svx_circlebuf_destroy(&cb)) || NULL != cb)
+        /* do NOT overwrite the error number of the failed check */
+        if(0 != svx_circlebuf_destroy(&cb) || NULL != cb)
         {
             printf("svx_callqueue_destroy() failed\n");
+            if(0 == r) r = 1;
         }
     }
+    return r;
+}
 
+int test_circlebuf_runner()
+{
+    svx_circlebuf_t     *cb        = NULL;
+    svx_bufpool_stats_t  stats;
+    size_t               page_size = (size_t)sysconf(_SC_PAGESIZE);
+    int                  r         = 0;
+
+    if(0 != (r = test_circlebuf_blocks(TEST_CIRCLEBUF_TYPE_NORMAL, TEST_CIRCLEBUF_MAX_LEN, TEST_CIRCLEBUF_MIN_LEN,
+                                       TEST_CIRCLEBUF_MIN_STEP)))
+        goto end;
+
+    /* the pooled circlebuf replaces its chunk on each expand and shrink */
+    if(0 != (r = svx_bufpool_create(&test_circlebuf_pool, 1024 * 1024, 0)))
+    {
+        printf("svx_bufpool_create() failed\n");
+        goto end;
+    }
+    if(0 != (r = test_circlebuf_blocks(TEST_CIRCLEBUF_TYPE_POOLED, TEST_CIRCLEBUF_MAX_LEN, TEST_CIRCLEBUF_MIN_LEN,
+                                       TEST_CIRCLEBUF_MIN_STEP)))
+        goto end;
+    svx_bufpool_get_stats(test_circlebuf_pool, &stats);
+    if(0 == stats.hits || 0 == stats.retained_bytes)
+    {
+        r = 1;
+        printf("check bufpool stats failed\n");
+        goto end;
+    }
+
+    /* the mirrored circlebuf expands and shrinks by pages */
+    if(SVX_ERRNO_NOTSPT == (r = svx_circlebuf_create_mirrored(&cb, page_size * 8, page_size, page_size)))
+    {
+        r = 0;
+        goto end;
+    }
+    if(0 != r)
+    {
+        printf("svx_circlebuf_create_mirrored() failed\n");
+        goto end;
+    }
+    svx_circlebuf_destroy(&cb);
+    if(0 != (r = test_circlebuf_blocks(TEST_CIRCLEBUF_TYPE_MIRRORED, page_size * 8, page_size, page_size))) goto end;
+
+ end:
+    if(test_circlebuf_pool) svx_bufpool_del_ref(test_circlebuf_pool);
     fclose(stdin);
     fclose(stdout);
     fclose(stderr);
@@ -0,0 +1,322 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "svx_looper.h"
+#include "svx_inetaddr.h"
+#include "svx_tcp_server.h"
+#include "svx_circlebuf.h"
+#include "svx_codec.h"
+#include "svx_log.h"
+#include "svx_util.h"
+
+#define TEST_CODEC_IP           "127.0.0.1"
+#define TEST_CODEC_PORT         20020
+
+#define TEST_CODEC_FRAMES       2000
+#define TEST_CODEC_PAYLOAD_MAX  300
+#define TEST_CODEC_BUF_LEN      512
+#define TEST_CODEC_DELIM        "\r\n"
+#define TEST_CODEC_DELIM_LEN    2
+
+#define TEST_EXIT do {SVX_LOG_ERR("exit(1). line: %d. errno:%d.\n", __LINE__, errno); exit(1);} while(0)
+
+typedef struct
+{
+    size_t  payload_len[TEST_CODEC_FRAMES];
+    size_t  recved;
+    size_t  split;
+} test_codec_ctx_t;
+
+static svx_looper_t     *test_codec_looper = NULL;
+static svx_tcp_server_t *test_codec_server = NULL;
+static svx_codec_t      *test_codec_server_codec = NULL;
+
+static uint8_t test_codec_get_byte(size_t frame, size_t i)
+{
+    /* never be '\r' or '\n' */
+    return (uint8_t)('a' + (frame + i) % 26);
+}
+
+static size_t test_codec_encode(svx_codec_len_type_t len_type, int crc32c, int delim,
+                                size_t frame, size_t len, uint8_t *buf)
+{
+    size_t   n = 0, i, v;
+    uint32_t crc;
+
+    if(!delim)
+    {
+        switch(len_type)
+        {
+        case SVX_CODEC_LEN_U8:
+            buf[n++] = (uint8_t)len;
+            break;
+        case SVX_CODEC_LEN_U16:
+            buf[n++] = (uint8_t)(len >> 8);
+            buf[n++] = (uint8_t)len;
+            break;
+        case SVX_CODEC_LEN_U32:
+            buf[n++] = (uint8_t)(len >> 24);
+            buf[n++] = (uint8_t)(len >> 16);
+            buf[n++] = (uint8_t)(len >> 8);
+            buf[n++] = (uint8_t)len;
+            break;
+        case SVX_CODEC_LEN_VARINT:
+            for(v = len; v >= 0x80; v >>= 7)
+                buf[n++] = (uint8_t)(v | 0x80);
+            buf[n++] = (uint8_t)v;
+            break;
+        }
+    }
+
+    for(i = 0; i < len; i++)
+        buf[n + i] = test_codec_get_byte(frame, i);
+
+    if(delim)
+    {
+        memcpy(buf + n + len, TEST_CODEC_DELIM, TEST_CODEC_DELIM_LEN);
+        return n + len + TEST_CODEC_DELIM_LEN;
+    }
+
+    if(crc32c)
+    {
+        crc = svx_codec_crc32c(0, buf + n, len);
+        buf[n + len + 0] = (uint8_t)(crc >> 24);
+        buf[n + len + 1] = (uint8_t)(crc >> 16);
+        buf[n + len + 2] = (uint8_t)(crc >> 8);
+        buf[n + len + 3] = (uint8_t)crc;
+        return n + len + 4;
+    }
+
+    return n + len;
+}
+
+static int test_codec_frame_cb(svx_tcp_connection_t *conn, const uint8_t *buf1, size_t buf1_len,
+                               const uint8_t *buf2, size_t buf2_len, void *arg)
+{
+    test_codec_ctx_t *ctx = (test_codec_ctx_t *)arg;
+    size_t            i;
+
+    SVX_UTIL_UNUSED(conn);
+
+    if(ctx->recved >= TEST_CODEC_FRAMES) TEST_EXIT;
+    if(buf1_len + buf2_len != ctx->payload_len[ctx->recved]) TEST_EXIT;
+    if((NULL == buf2) != (0 == buf2_len)) TEST_EXIT;
+
+    for(i = 0; i < buf1_len; i++)
+        if(buf1[i] != test_codec_get_byte(ctx->recved, i)) TEST_EXIT;
+    for(i = 0; i < buf2_len; i++)
+        if(buf2[i] != test_codec_get_byte(ctx->recved, buf1_len + i)) TEST_EXIT;
+
+    if(buf2_len > 0) ctx->split++;
+    ctx->recved++;
+    return 0;
+}
+
+/* feed the encoded frames into a small circlebuf in random pieces, so that lots of frames wrap around */
+static void test_codec_decode(svx_codec_len_type_t len_type, int crc32c, int delim, size_t payload_max)
+{
+    test_codec_ctx_t      ctx;
+    svx_codec_t          *codec = NULL;
+    svx_circlebuf_t      *cb    = NULL;
+    svx_tcp_connection_t *conn  = (svx_tcp_connection_t *)&ctx; /* never be used for valid frames */
+    uint8_t              *stream;
+    size_t                stream_len = 0, stream_sent, freespace_len, len, i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    for(i = 0; i < TEST_CODEC_FRAMES; i++)
+        ctx.payload_len[i] = (i < 3 ? i : (size_t)random() % (payload_max + 1));
+
+    if(delim)
+    {
+        if(svx_codec_create_delimiter(&codec, (const uint8_t *)TEST_CODEC_DELIM, TEST_CODEC_DELIM_LEN,
+                                      payload_max, test_codec_frame_cb, &ctx)) TEST_EXIT;
+    }
+    else
+    {
+        if(svx_codec_create_length_prefixed(&codec, len_type, payload_max, crc32c,
+                                            test_codec_frame_cb, &ctx)) TEST_EXIT;
+    }
+    if(svx_circlebuf_create(&cb, TEST_CODEC_BUF_LEN, TEST_CODEC_BUF_LEN, 8)) TEST_EXIT;
+
+    /* the frames are fed without waiting for the circlebuf becoming empty */
+    if(NULL == (stream = malloc(TEST_CODEC_FRAMES * TEST_CODEC_BUF_LEN))) TEST_EXIT;
+    for(i = 0; i < TEST_CODEC_FRAMES; i++)
+        stream_len += test_codec_encode(len_type, crc32c, delim, i, ctx.payload_len[i], stream + stream_len);
+    for(stream_sent = 0; stream_sent < stream_len; stream_sent += len)
+    {
+        if(svx_circlebuf_get_freespace_len(cb, &freespace_len)) TEST_EXIT;
+        if(0 == freespace_len) TEST_EXIT;
+        len = 1 + (size_t)random() % (freespace_len < stream_len - stream_sent ? freespace_len : stream_len - stream_sent);
+        if(svx_circlebuf_append_data(cb, stream + stream_sent, len)) TEST_EXIT;
+        svx_codec_read_cb(conn, cb, codec);
+    }
+    free(stream);
+    if(TEST_CODEC_FRAMES != ctx.recved) TEST_EXIT;
+
+    if(svx_circlebuf_get_data_len(cb, &len)) TEST_EXIT;
+    if(0 != len) TEST_EXIT;
+    if(0 == ctx.split) TEST_EXIT;
+
+    if(svx_circlebuf_destroy(&cb)) TEST_EXIT;
+    if(svx_codec_destroy(&codec)) TEST_EXIT;
+}
+
+static void test_codec_crc32c()
+{
+    uint8_t  buf[1000];
+    uint32_t crc;
+    size_t   i;
+
+    /* the check value of CRC-32C */
+    if(0xE3069283 != svx_codec_crc32c(0, (const uint8_t *)"123456789", 9)) TEST_EXIT;
+    if(0 != svx_codec_crc32c(0, NULL, 0)) TEST_EXIT;
+
+    /* incremental */
+    for(i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)random();
+    for(crc = 0, i = 0; i < sizeof(buf); i++)
+        crc = svx_codec_crc32c(crc, buf + i, 1);
+    if(crc != svx_codec_crc32c(0, buf, sizeof(buf))) TEST_EXIT;
+    if(crc != svx_codec_crc32c(svx_codec_crc32c(0, buf, 333), buf + 333, sizeof(buf) - 333)) TEST_EXIT;
+}
+
+static int test_codec_echo_cb(svx_tcp_connection_t *conn, const uint8_t *buf1, size_t buf1_len,
+                              const uint8_t *buf2, size_t buf2_len, void *arg)
+{
+    uint8_t buf[TEST_CODEC_PAYLOAD_MAX];
+
+    SVX_UTIL_UNUSED(arg);
+
+    memcpy(buf, buf1, buf1_len);
+    if(buf2_len > 0) memcpy(buf + buf1_len, buf2, buf2_len);
+    if(svx_codec_write(test_codec_server_codec, conn, buf, buf1_len + buf2_len)) TEST_EXIT;
+    return 0;
+}
+
+static void test_codec_exit(void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_server_stop(test_codec_server)) TEST_EXIT;
+    if(svx_looper_quit(test_codec_looper)) TEST_EXIT;
+}
+
+static void test_codec_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_looper_dispatch(test_codec_looper, test_codec_exit, NULL, NULL, 0)) TEST_EXIT;
+}
+
+static void *test_codec_looper_thd(void *arg)
+{
+    svx_inetaddr_t listen_addr;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_inetaddr_from_ipport(&listen_addr, TEST_CODEC_IP, TEST_CODEC_PORT)) TEST_EXIT;
+    if(svx_tcp_server_create(&test_codec_server, test_codec_looper, listen_addr)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(test_codec_server, svx_codec_read_cb, test_codec_server_codec)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(test_codec_server, test_codec_closed_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_mirrored_read_buf(test_codec_server, 1)) TEST_EXIT;
+    if(svx_tcp_server_start(test_codec_server)) TEST_EXIT;
+
+    /* blocked here until svx_looper_quit() */
+    if(svx_looper_loop(test_codec_looper)) TEST_EXIT;
+
+    if(svx_tcp_server_destroy(&test_codec_server)) TEST_EXIT;
+
+    return NULL;
+}
+
+static void test_codec_read_all(int fd, uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0)
+    {
+        if((n = read(fd, buf, len)) <= 0) TEST_EXIT;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/* echo frames through a TCP server, then an invalid frame closes the connection */
+static void test_codec_echo()
+{
+    pthread_t          tid;
+    struct sockaddr_in addr;
+    int                fd, i;
+    uint8_t            frame[TEST_CODEC_BUF_LEN], echo[TEST_CODEC_BUF_LEN];
+    size_t             frame_len, n;
+
+    if(svx_codec_create_length_prefixed(&test_codec_server_codec, SVX_CODEC_LEN_VARINT, TEST_CODEC_PAYLOAD_MAX, 1,
+                                        test_codec_echo_cb, NULL)) TEST_EXIT;
+    if(svx_looper_create(&test_codec_looper)) TEST_EXIT;
+    if(pthread_create(&tid, NULL, &test_codec_looper_thd, NULL)) TEST_EXIT;
+
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) TEST_EXIT;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(TEST_CODEC_PORT);
+    if(1 != inet_pton(AF_INET, TEST_CODEC_IP, &addr.sin_addr)) TEST_EXIT;
+    for(i = 0; 0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr)); i++)
+    {
+        if(ECONNREFUSED != errno || i >= 100) TEST_EXIT;
+        usleep(10 * 1000); /* wait for the TCP server to start */
+    }
+
+    for(i = 0; i < 100; i++)
+    {
+        frame_len = test_codec_encode(SVX_CODEC_LEN_VARINT, 1, 0, (size_t)i, (size_t)i * 3, frame);
+        if(write(fd, frame, frame_len) != (ssize_t)frame_len) TEST_EXIT;
+        test_codec_read_all(fd, echo, frame_len);
+        if(0 != memcmp(frame, echo, frame_len)) TEST_EXIT;
+    }
+
+    /* bad CRC32C */
+    frame_len = test_codec_encode(SVX_CODEC_LEN_VARINT, 1, 0, 0, 10, frame);
+    frame[frame_len - 1] ^= 0xFF;
+    if(write(fd, frame, frame_len) != (ssize_t)frame_len) TEST_EXIT;
+    if(0 != (n = (size_t)read(fd, echo, sizeof(echo)))) TEST_EXIT;
+
+    if(pthread_join(tid, NULL)) TEST_EXIT;
+    if(svx_looper_destroy(&test_codec_looper)) TEST_EXIT;
+    if(svx_codec_destroy(&test_codec_server_codec)) TEST_EXIT;
+    close(fd);
+}
+
+int test_codec_runner()
+{
+    svx_log_level_stdout = SVX_LOG_LEVEL_WARNING;
+
+    test_codec_crc32c();
+
+    test_codec_decode(SVX_CODEC_LEN_U8,     0, 0, 200);
+    test_codec_decode(SVX_CODEC_LEN_U16,    1, 0, TEST_CODEC_PAYLOAD_MAX);
+    test_codec_decode(SVX_CODEC_LEN_U32,    0, 0, TEST_CODEC_PAYLOAD_MAX);
+    test_codec_decode(SVX_CODEC_LEN_VARINT, 1, 0, TEST_CODEC_PAYLOAD_MAX);
+    test_codec_decode(SVX_CODEC_LEN_VARINT, 0, 1, TEST_CODEC_PAYLOAD_MAX);
+
+    test_codec_echo();
+
+    fclose(stdin);
+    fclose(stdout);
+    fclose(stderr);
+    return 0;
+}
@@ -11,14 +11,22 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "svx_poller.h"
 #include "svx_looper.h"
 #include "svx_inetaddr.h"
 #include "svx_tcp_server.h"
 #include "svx_tcp_client.h"
 #include "svx_threadpool.h"
+#include "svx_buf.h"
+#include "svx_alloc.h"
+#include "svx_errno.h"
 #include "svx_log.h"
 #include "svx_util.h"
 
@@ -26,15 +34,76 @@
 #define TEST_TCP_LISTEN_IPV6               "::1"
 #define TEST_TCP_LISTEN_PORT               20000
 #define TEST_TCP_LISTEN_PORT2              20001
+#define TEST_TCP_FIXTURE_PORT              20002
 
 #define TEST_TCP_READ_BUF_MIN_LEN          128
 #define TEST_TCP_READ_BUF_MAX_LEN          (16 * 1024)
 #define TEST_TCP_WRITE_BUF_MIN_LEN         128
 #define TEST_TCP_WRITE_BUF_HIGH_WATER_MARK (16 * 1024)
+#define TEST_TCP_WRITE_FLOW_LOW_MARK       (1 * 1024)
+#define TEST_TCP_WRITE_FLOW_HIGH_MARK      (8 * 1024)
+#define TEST_TCP_WRITE_FLOW_HARD_CAP       (4 * 1024 * 1024)
+#define TEST_TCP_RATE                      (16 * 1024 * 1024)
+#define TEST_TCP_RATE_BURST                (256 * 1024)
+#define TEST_TCP_TOTAL_RATE                (64 * 1024 * 1024)
+#define TEST_TCP_TOTAL_RATE_BURST          (1024 * 1024)
+#define TEST_TCP_READ_QUOTA_BYTES          (8 * 1024)
+#define TEST_TCP_READ_QUOTA_CALLBACKS      4
+#define TEST_TCP_IDLE_TIMEOUT_MS           (30 * 1000)
+#define TEST_TCP_WRITE_TIMEOUT_MS          (30 * 1000)
+#define TEST_TCP_SHORT_IDLE_TIMEOUT_MS     200
+#define TEST_TCP_SHORT_READ_DEADLINE_MS    100
 
 #define TEST_TCP_SMALL_BODY_MAX_LEN        64
 #define TEST_TCP_LARGE_BODY_MAX_LEN        (1 * 1024 * 1024)
 
+#define TEST_TCP_OFFLOAD_THREADS_CNT       4
+#define TEST_TCP_OFFLOAD_LIMIT             3
+#define TEST_TCP_OFFLOAD_REQS              200
+
+#define TEST_TCP_BROADCAST_CONNS           6
+#define TEST_TCP_BROADCAST_LEN             (256 * 1024)
+
+#define TEST_TCP_WRITEV_LEN                (4 * 1024 * 1024) /* larger than the socket buffers */
+#define TEST_TCP_WRITEV_SMALL_LEN          (64 * 1024)
+
+#define TEST_TCP_OWNED_LEN                 (4 * 1024 * 1024) /* larger than the socket buffers */
+#define TEST_TCP_OWNED_SMALL_LEN           (64 * 1024)
+
+#define TEST_TCP_CORK_ROUNDS               10
+
+#define TEST_TCP_ZEROCOPY_THRESHOLD        4096
+#define TEST_TCP_ZEROCOPY_LEN              (4 * 1024 * 1024) /* larger than the socket buffers */
+
+#define TEST_TCP_SHAPING_RATE              (1024 * 1024)
+#define TEST_TCP_SHAPING_BURST             (64 * 1024)
+#define TEST_TCP_SHAPING_LEN               (512 * 1024)
+#define TEST_TCP_SHAPING_MIN_MS            ((TEST_TCP_SHAPING_LEN - TEST_TCP_SHAPING_BURST) * 800LL / TEST_TCP_SHAPING_RATE)
+#define TEST_TCP_SHAPING_MAX_MS            (5 * 1000)
+
+#define TEST_TCP_QUOTA_BYTES               1024
+#define TEST_TCP_QUOTA_CALLBACKS           4
+#define TEST_TCP_QUOTA_WEIGHT              2
+#define TEST_TCP_QUOTA_LEN                 (256 * 1024)
+#define TEST_TCP_QUOTA_BUF_LEN             (8 * 1024)
+#define TEST_TCP_QUOTA_HOLD_SPACE          256 /* the free space of read_buf while the data is held */
+#define TEST_TCP_QUOTA_HOLD_ITERS          32
+#define TEST_TCP_QUOTA_MSG_LEN             16
+#define TEST_TCP_QUOTA_MSGS                256 /* all sent at once, read by one readv() */
+
+#define TEST_TCP_ADAPTIVE_BUF_MAX_LEN      (1024 * 1024)
+#define TEST_TCP_ADAPTIVE_BURST_LEN        (96 * 1024) /* fits in the socket's receive buffer */
+#define TEST_TCP_ADAPTIVE_CHUNK_LEN        (4 * 1024)
+#define TEST_TCP_ADAPTIVE_CHUNKS           128
+#define TEST_TCP_ADAPTIVE_SMALL_LEN        64
+#define TEST_TCP_ADAPTIVE_SMALLS           64
+
+#define TEST_TCP_FLOW_LOW_MARK             (16 * 1024)
+#define TEST_TCP_FLOW_HIGH_MARK            (64 * 1024)
+#define TEST_TCP_FLOW_HARD_CAP             (256 * 1024)
+#define TEST_TCP_FLOW_CHUNK_LEN            (64 * 1024)
+#define TEST_TCP_FLOW_CHUNKS               1024 /* far more than the socket buffers and the hard cap */
+
 #define TEST_TCP_CLIENT_LOOPER_CNT         5 /* how many loopers(threads) for clients? */
 #define TEST_TCP_CLIENT_CNT_PER_LOOPER     3 /* how many clients per looper? */
 #define TEST_TCP_CLIENT_ROUND_PER_CLIENT   2 /* how many rounds for each client */
@@ -78,6 +147,8 @@ typedef struct
     uint32_t client_idx;
     uint32_t body_len;
     uint32_t body_idx; /* hold the body index uploaded or downloaded */
+    uint32_t produce_cnt;
+    size_t   read_lowat;
 } test_tcp_server_ctx_t;
 
 typedef struct
@@ -191,6 +262,27 @@ static int test_tcp_check_msg_buf(uint8_t *buf, size_t buf_len, uint8_t cmd, uin
     return 0; /* OK */
 }
 
+static void test_tcp_sendfile_done_cb(int fd, int errnum, void *arg)
+{
+    SVX_UTIL_UNUSED(errnum);
+    SVX_UTIL_UNUSED(arg);
+
+    close(fd);
+}
+
+/* send the buffer via a temporary file by sendfile() */
+static void test_tcp_server_sendfile(svx_tcp_connection_t *conn, uint8_t *buf, size_t len)
+{
+    char path[] = "/tmp/libsvx_test_tcp_XXXXXX";
+    int  fd;
+
+    if((fd = mkstemp(path)) < 0) TEST_EXIT;
+    if(unlink(path)) TEST_EXIT;
+    if(len != (size_t)write(fd, buf, len)) TEST_EXIT;
+    /* transfer the ownership of fd to conn */
+    if(svx_tcp_connection_sendfile(conn, fd, 0, len, test_tcp_sendfile_done_cb, NULL)) TEST_EXIT;
+}
+
 static void test_tcp_server_send_response_header(svx_tcp_connection_t *conn,
                                                  uint8_t cmd, uint32_t looper_idx,
                                                  uint32_t client_idx, uint32_t body_len)
@@ -199,9 +291,105 @@ static void test_tcp_server_send_response_header(svx_tcp_connection_t *conn,
     if(svx_tcp_connection_write(conn, (uint8_t *)&header, sizeof(header))) TEST_EXIT;
 }
 
+/* the upload body has been received to a temporary file */
+static void test_tcp_server_recv_to_fd_done_cb(svx_tcp_connection_t *conn, int fd, int errnum, void *arg)
+{
+    test_tcp_server_ctx_t *ctx;
+    uint8_t               *tmp = NULL;
+    uint8_t                cmd;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(0 != errnum) TEST_EXIT;
+    svx_tcp_connection_get_context(conn, (void *)&ctx);
+
+    /* check the file */
+    if(NULL == (tmp = malloc(ctx->body_len))) TEST_EXIT;
+    if(ctx->body_len != (size_t)pread(fd, tmp, ctx->body_len, 0)) TEST_EXIT;
+    if(test_tcp_check_msg_buf(tmp, ctx->body_len, ctx->cmd, ctx->looper_idx, ctx->client_idx)) TEST_CHECK_FAILED;
+    free(tmp);
+    close(fd);
+
+    /* send upload response */
+    ctx->body_idx = ctx->body_len;
+    cmd = ctx->cmd;
+    ctx->cmd = 0; /* finished */
+    test_tcp_server_send_response_header(conn, cmd, ctx->looper_idx, ctx->client_idx, 0);
+}
+
+/* receive the upload body to a temporary file by svx_tcp_connection_recv_to_fd() */
+static void test_tcp_server_recv_to_fd(svx_tcp_connection_t *conn, size_t len)
+{
+    char path[] = "/tmp/libsvx_test_tcp_XXXXXX";
+    int  fd;
+
+    if((fd = mkstemp(path)) < 0) TEST_EXIT;
+    if(unlink(path)) TEST_EXIT;
+    if(svx_tcp_connection_recv_to_fd(conn, fd, len, test_tcp_server_recv_to_fd_done_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_server_resume_stream_run(void *arg)
+{
+    svx_tcp_connection_t *conn = *((svx_tcp_connection_t **)arg);
+
+    svx_tcp_connection_resume_stream(conn);
+    svx_tcp_connection_del_ref(conn);
+}
+static void test_tcp_server_resume_stream_clean(void *arg)
+{
+    svx_tcp_connection_t *conn = *((svx_tcp_connection_t **)arg);
+
+    svx_tcp_connection_del_ref(conn);
+}
+
+/* produce the download body for svx_tcp_connection_write_stream() */
+static int test_tcp_server_produce_cb(svx_tcp_connection_t *conn, uint8_t *buf, size_t len,
+                                      size_t *ret_len, int *eof, void *arg)
+{
+    test_tcp_server_ctx_t *ctx;
+    svx_looper_t          *looper;
+    size_t                 n;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(NULL == buf) return 0; /* the connection closed before the end of stream */
+
+    svx_tcp_connection_get_context(conn, (void *)&ctx);
+
+    /* have no data for now sometimes, resume the stream later (only for test) */
+    if(0 == (++(ctx->produce_cnt) % 5))
+    {
+        if(svx_tcp_connection_get_looper(conn, &looper)) TEST_EXIT;
+        svx_tcp_connection_add_ref(conn);
+        if(svx_looper_dispatch(looper, test_tcp_server_resume_stream_run, test_tcp_server_resume_stream_clean, &conn, sizeof(conn))) TEST_EXIT;
+        *ret_len = 0;
+        return 0;
+    }
+
+    n = ((ctx->body_len - ctx->body_idx) > len ? len : (ctx->body_len - ctx->body_idx));
+    if(n > 0) test_tcp_build_msg_buf(buf, n, ctx->cmd, ctx->looper_idx, ctx->client_idx);
+    ctx->body_idx += n;
+    *ret_len = n;
+    if(ctx->body_idx == ctx->body_len)
+    {
+        /* download finished */
+        *eof = 1;
+        ctx->cmd = 0; /* finished */
+    }
+
+    return 0;
+}
+
+static void test_tcp_server_set_read_lowat(svx_tcp_connection_t *conn, test_tcp_server_ctx_t *ctx, size_t lowat)
+{
+    if(svx_tcp_connection_set_read_lowat(conn, lowat)) TEST_EXIT;
+    ctx->read_lowat = lowat;
+}
+
 static void test_tcp_server_established_cb(svx_tcp_connection_t *conn, void *arg)
 {
     test_tcp_server_ctx_t *ctx;
+    int                    fd;
 
     SVX_UTIL_UNUSED(arg);
 
@@ -219,6 +407,13 @@ static void test_tcp_server_established_cb(svx_tcp_connection_t *conn, void *arg
     svx_tcp_connection_set_context(conn, ctx);
 
     if(svx_tcp_connection_disable_write_completed(conn)) TEST_EXIT;
+
+    /* weighted read quota */
+    if(svx_tcp_connection_get_fd(conn, &fd)) TEST_EXIT;
+    if(svx_tcp_connection_set_read_weight(conn, (unsigned int)(1 + fd % 2))) TEST_EXIT;
+
+    /* wait for the whole request header */
+    test_tcp_server_set_read_lowat(conn, ctx, sizeof(test_tcp_proto_header_t));
 }
 
 static void test_tcp_server_write_completed_cb(svx_tcp_connection_t *conn, void *arg)
@@ -242,7 +437,14 @@ static void test_tcp_server_write_completed_cb(svx_tcp_connection_t *conn, void
     {
         if(NULL == (tmp = malloc(send_len))) TEST_EXIT;
         test_tcp_build_msg_buf(tmp, send_len, ctx->cmd, ctx->looper_idx, ctx->client_idx);
-        if(svx_tcp_connection_write(conn, tmp, send_len)) TEST_EXIT;
+        if(0 == (ctx->body_idx / tmp_max) % 2)
+        {
+            if(svx_tcp_connection_write(conn, tmp, send_len)) TEST_EXIT;
+        }
+        else
+        {
+            test_tcp_server_sendfile(conn, tmp, send_len);
+        }
         ctx->body_idx += send_len;
         free(tmp);
         tmp = NULL;
@@ -284,10 +486,14 @@ static void test_tcp_server_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t
     
     svx_tcp_connection_get_context(conn, (void *)&ctx);
 
+    /* the read callback is called only if there are enough data */
+    if(svx_circlebuf_get_data_len(buf, &data_len)) TEST_EXIT;
+    if(data_len < ctx->read_lowat) TEST_EXIT;
+
     if(0 == ctx->cmd)
     {
-        /* read command header */
-        if(svx_circlebuf_get_data(buf, (uint8_t *)&header, sizeof(header))) return; /* have not enough body */
+        /* read command header (the partial header is kept in buf if the read low-water mark is off) */
+        if(svx_circlebuf_get_data(buf, (uint8_t *)&header, sizeof(header))) return;
         if(1 != header.type) TEST_EXIT; /* not a request? */
         ctx->cmd        = header.cmd;
         ctx->looper_idx = ntohl(header.looper_idx);
@@ -313,7 +519,9 @@ static void test_tcp_server_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t
             }
             else
             {
-                return; /* have not enough body */
+                /* have not enough body, wait for the whole body */
+                test_tcp_server_set_read_lowat(conn, ctx, ctx->body_len);
+                return;
             }
         }
 
@@ -327,11 +535,19 @@ static void test_tcp_server_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t
             tmp = NULL;
         }
         ctx->cmd = 0; /* finished */
+        test_tcp_server_set_read_lowat(conn, ctx, sizeof(test_tcp_proto_header_t));
         break;
         
     case SVX_TEST_TCP_PROTO_CMD_UPLOAD:
         /* recv upload request */
         if(ctx->body_len != msg_upload[ctx->looper_idx][ctx->client_idx].len) TEST_EXIT;
+        if(ctx->read_lowat > 1) test_tcp_server_set_read_lowat(conn, ctx, 1);
+        if(1 == (ctx->client_idx % 2) && 0 == ctx->body_idx && ctx->body_len > 0)
+        {
+            /* the whole body will be received to a file (only for test) */
+            test_tcp_server_recv_to_fd(conn, ctx->body_len);
+            break;
+        }
         if(svx_circlebuf_get_data_len(buf, &data_len)) TEST_EXIT;
         if(data_len > tmp_max) TEST_EXIT;
         if(data_len > 0)
@@ -367,9 +583,18 @@ static void test_tcp_server_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t
     case SVX_TEST_TCP_PROTO_CMD_DOWNLOAD:
         /* recv download request */
         if(0 != ctx->body_len) TEST_EXIT;
+        if(ctx->read_lowat > 1) test_tcp_server_set_read_lowat(conn, ctx, 1);
         ctx->body_len = msg_download[ctx->looper_idx][ctx->client_idx].len;
 
         /* send download request */
+        if(2 == ctx->client_idx % 3)
+        {
+            /* the body is pulled from the producer (only for test) */
+            test_tcp_server_send_response_header(conn, ctx->cmd, ctx->looper_idx, ctx->client_idx, ctx->body_len);
+            ctx->produce_cnt = 0;
+            if(svx_tcp_connection_write_stream(conn, test_tcp_server_produce_cb, NULL)) TEST_EXIT;
+            break;
+        }
         if(svx_tcp_connection_enable_write_completed(conn)) TEST_EXIT; /* for continuous transmission */
         test_tcp_server_send_response_header(conn, ctx->cmd, ctx->looper_idx, ctx->client_idx, ctx->body_len);
         break;
@@ -390,20 +615,31 @@ static void test_tcp_server_high_water_mark_cb(svx_tcp_connection_t *conn, size_
 
 static void test_tcp_server_exit(void *arg)
 {
+    svx_tcp_connection_flow_stats_t stats;
+
     SVX_UTIL_UNUSED(arg);
     
+    /* all the paused reading has been resumed */
+    if(svx_tcp_server_get_write_flow_control_stats(test_tcp_server.tcp_server, &stats)) TEST_EXIT;
+    if(0 == stats.paused || stats.paused != stats.resumed || 0 != stats.aborted) TEST_EXIT;
+
     if(svx_tcp_server_stop(test_tcp_server.tcp_server)) TEST_EXIT;
     if(svx_looper_quit(test_tcp_server.looper)) TEST_EXIT;
 }
 
 static void test_tcp_server_closed_cb(svx_tcp_connection_t *conn, void *arg)
 {
-    test_tcp_server_ctx_t *ctx;
+    test_tcp_server_ctx_t             *ctx;
+    svx_tcp_connection_close_reason_t  reason;
 
     SVX_UTIL_UNUSED(arg);
     
     svx_tcp_connection_get_context(conn, (void *)&ctx);
 
+    /* closed by the client, never by the timeouts */
+    if(svx_tcp_connection_get_close_reason(conn, &reason)) TEST_EXIT;
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_PEER != reason && SVX_TCP_CONNECTION_CLOSE_REASON_ERROR != reason) TEST_EXIT;
+
     pthread_mutex_lock(&test_tcp_server_closed_conns_mutex);
     
     test_tcp_server_closed_conns++;
@@ -438,6 +674,18 @@ static void *test_tcp_server_main_thd(void *arg)
     if(svx_tcp_server_add_listener(server->tcp_server, listen_addr2)) TEST_EXIT;
     if(svx_tcp_server_set_io_loopers_num(server->tcp_server, server->io_loopers_num)) TEST_EXIT;
     if(svx_tcp_server_set_keepalive(server->tcp_server, 10, 1, 3)) TEST_EXIT;
+    if(svx_tcp_server_set_auto_cork(server->tcp_server, 1)) TEST_EXIT;
+    if(svx_tcp_server_set_fionread(server->tcp_server, 1)) TEST_EXIT;
+    if(svx_tcp_server_set_bufpool(server->tcp_server, 4 * 1024 * 1024, 0)) TEST_EXIT;
+    if(svx_tcp_server_set_zerocopy(server->tcp_server, 4096)) TEST_EXIT;
+    if(svx_tcp_server_set_write_flow_control(server->tcp_server, TEST_TCP_WRITE_FLOW_LOW_MARK,
+                                             TEST_TCP_WRITE_FLOW_HIGH_MARK, TEST_TCP_WRITE_FLOW_HARD_CAP)) TEST_EXIT;
+    if(svx_tcp_server_set_rate_limit(server->tcp_server, TEST_TCP_RATE, TEST_TCP_RATE_BURST,
+                                     TEST_TCP_RATE, TEST_TCP_RATE_BURST)) TEST_EXIT;
+    if(svx_tcp_server_set_total_rate_limit(server->tcp_server, TEST_TCP_TOTAL_RATE, TEST_TCP_TOTAL_RATE_BURST,
+                                           TEST_TCP_TOTAL_RATE, TEST_TCP_TOTAL_RATE_BURST)) TEST_EXIT;
+    if(svx_tcp_server_set_read_quota(server->tcp_server, TEST_TCP_READ_QUOTA_BYTES, TEST_TCP_READ_QUOTA_CALLBACKS)) TEST_EXIT;
+    if(svx_tcp_server_set_timeouts(server->tcp_server, TEST_TCP_IDLE_TIMEOUT_MS, 0, TEST_TCP_WRITE_TIMEOUT_MS)) TEST_EXIT;
     if(svx_tcp_server_set_read_buf_len(server->tcp_server, TEST_TCP_READ_BUF_MIN_LEN, TEST_TCP_READ_BUF_MAX_LEN)) TEST_EXIT;
     if(svx_tcp_server_set_write_buf_len(server->tcp_server, TEST_TCP_WRITE_BUF_MIN_LEN)) TEST_EXIT;
     if(svx_tcp_server_set_established_cb(server->tcp_server, test_tcp_server_established_cb, NULL)) TEST_EXIT;
@@ -448,6 +696,10 @@ static void *test_tcp_server_main_thd(void *arg)
 
     /* start TCP server */
     if(svx_tcp_server_start(server->tcp_server)) TEST_EXIT;
+
+    /* the shared token buckets can not be replaced while running */
+    if(SVX_ERRNO_PERM != svx_tcp_server_set_total_rate_limit(server->tcp_server, TEST_TCP_TOTAL_RATE, TEST_TCP_TOTAL_RATE_BURST,
+                                                             TEST_TCP_TOTAL_RATE, TEST_TCP_TOTAL_RATE_BURST)) TEST_EXIT;
     
     /* start looper (blocked here until svx_looper_quit()) */
     if(svx_looper_loop(server->looper)) TEST_EXIT;
@@ -539,6 +791,7 @@ static void test_tcp_client_write_completed_cb(svx_tcp_connection_t *conn, void
 {
     test_tcp_client_info_t *client_info = (test_tcp_client_info_t *)arg;
     test_tcp_client_ctx_t  *ctx;
+    svx_buf_t              *sbuf = NULL;
     uint8_t                *tmp = NULL;
     size_t                  tmp_max = TEST_TCP_WRITE_BUF_HIGH_WATER_MARK - 1;
     size_t                  send_len;
@@ -555,11 +808,15 @@ static void test_tcp_client_write_completed_cb(svx_tcp_connection_t *conn, void
     if(send_len > 0)
     {
         /* printf("[%d][%d] send upload request send_len:%zu (%u/%u)\n", client_info->looper_idx, client_info->client_idx, send_len, ctx->body_idx, ctx->body_len); */
-        if(NULL == (tmp = malloc(send_len))) TEST_EXIT;
+        if(svx_buf_create(&sbuf, NULL, send_len)) TEST_EXIT;
+        if(svx_buf_get_ptr(sbuf, &tmp, NULL)) TEST_EXIT;
         test_tcp_build_msg_buf(tmp, send_len, ctx->cmd_send, client_info->looper_idx, client_info->client_idx);
-        if(svx_tcp_connection_write(conn, tmp, send_len)) TEST_EXIT;
+        /* send the data by two slices of the shared buffer */
+        if(svx_tcp_connection_write_buf(conn, sbuf, 0, send_len / 2 + 1)) TEST_EXIT;
+        if(send_len > send_len / 2 + 1)
+            if(svx_tcp_connection_write_buf(conn, sbuf, send_len / 2 + 1, send_len - (send_len / 2 + 1))) TEST_EXIT;
         ctx->body_idx += send_len;
-        free(tmp);
+        if(svx_buf_del_ref(sbuf)) TEST_EXIT;
         tmp = NULL;
     }
 }
@@ -810,13 +1067,1292 @@ static void test_tcp_do(const char *tcp_server_ip, int tcp_server_io_loopers_num
         if(0 != test_tcp_clients[i].tcp_clients_alive_cnt) TEST_EXIT;
 }
 
-int test_tcp_runner()
+/* a TCP server in its own looper thread, shared by the single-feature tests below */
+typedef void (*test_tcp_fixture_setup_t)(svx_tcp_server_t *server);
+typedef void (*test_tcp_fixture_cleanup_t)(void);
+
+static svx_looper_t               *test_tcp_fixture_looper  = NULL;
+static svx_tcp_server_t           *test_tcp_fixture_server  = NULL;
+static test_tcp_fixture_setup_t    test_tcp_fixture_setup   = NULL;
+static test_tcp_fixture_cleanup_t  test_tcp_fixture_cleanup = NULL;
+static pthread_t                   test_tcp_fixture_tid;
+
+static void test_tcp_fixture_exit(void *arg)
 {
-    int            i, j;
-    struct timeval tv;
-    long           rand;
+    SVX_UTIL_UNUSED(arg);
 
-    svx_log_level_stdout = SVX_LOG_LEVEL_WARNING;
+    if(svx_tcp_server_stop(test_tcp_fixture_server)) TEST_EXIT;
+    if(svx_looper_quit(test_tcp_fixture_looper)) TEST_EXIT;
+}
+
+static void *test_tcp_fixture_looper_thd(void *arg)
+{
+    svx_inetaddr_t listen_addr;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_inetaddr_from_ipport(&listen_addr, TEST_TCP_LISTEN_IPV4, TEST_TCP_FIXTURE_PORT)) TEST_EXIT;
+    if(svx_tcp_server_create(&test_tcp_fixture_server, test_tcp_fixture_looper, listen_addr)) TEST_EXIT;
+    test_tcp_fixture_setup(test_tcp_fixture_server); /* the options and the callbacks of the test */
+    if(svx_tcp_server_start(test_tcp_fixture_server)) TEST_EXIT;
+
+    /* blocked here until svx_looper_quit() */
+    if(svx_looper_loop(test_tcp_fixture_looper)) TEST_EXIT;
+
+    if(svx_tcp_server_destroy(&test_tcp_fixture_server)) TEST_EXIT;
+    if(test_tcp_fixture_cleanup) test_tcp_fixture_cleanup();
+
+    return NULL;
+}
+
+/* cleanup (can be NULL) is called in the loop thread after the TCP server is destroyed */
+static void test_tcp_fixture_start(test_tcp_fixture_setup_t setup, test_tcp_fixture_cleanup_t cleanup)
+{
+    test_tcp_fixture_setup   = setup;
+    test_tcp_fixture_cleanup = cleanup;
+
+    if(svx_looper_create(&test_tcp_fixture_looper)) TEST_EXIT;
+    if(pthread_create(&test_tcp_fixture_tid, NULL, &test_tcp_fixture_looper_thd, NULL)) TEST_EXIT;
+}
+
+/* stop the TCP server and quit the looper, it can be called in any thread */
+static void test_tcp_fixture_quit()
+{
+    if(svx_looper_dispatch(test_tcp_fixture_looper, test_tcp_fixture_exit, NULL, NULL, 0)) TEST_EXIT;
+}
+
+static void test_tcp_fixture_join()
+{
+    if(pthread_join(test_tcp_fixture_tid, NULL)) TEST_EXIT;
+    if(svx_looper_destroy(&test_tcp_fixture_looper)) TEST_EXIT;
+}
+
+static void test_tcp_fixture_quit_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    test_tcp_fixture_quit();
+}
+
+static void test_tcp_fixture_discard_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    svx_circlebuf_erase_all_data(buf);
+}
+
+static int test_tcp_connect(uint16_t port)
+{
+    struct sockaddr_in addr;
+    int                fd, i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if(1 != inet_pton(AF_INET, TEST_TCP_LISTEN_IPV4, &addr.sin_addr)) TEST_EXIT;
+
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) TEST_EXIT;
+    for(i = 0; 0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr)); i++)
+    {
+        if(ECONNREFUSED != errno || i >= 100) TEST_EXIT;
+        usleep(10 * 1000); /* wait for the TCP server to start */
+    }
+
+    return fd;
+}
+
+static void test_tcp_wait(int *cnt, int expected)
+{
+    int i;
+
+    for(i = 0; i < 100; i++)
+    {
+        if(expected == __sync_add_and_fetch(cnt, 0)) return;
+        usleep(10 * 1000);
+    }
+    TEST_EXIT;
+}
+
+/* the first connection sends one byte every 20ms (slowloris), the second one sends nothing */
+static int                                test_tcp_timeout_conns       = 0;
+static int                                test_tcp_timeout_closed      = 0;
+static svx_tcp_connection_close_reason_t  test_tcp_timeout_reasons[2];
+
+static void test_tcp_timeout_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(test_tcp_timeout_conns >= 2) TEST_EXIT;
+    if(svx_tcp_connection_set_context(conn, (void *)((intptr_t)test_tcp_timeout_conns))) TEST_EXIT;
+
+    /* the first request MUST be received completely in time */
+    if(0 == test_tcp_timeout_conns)
+        if(svx_tcp_connection_set_read_deadline(conn, TEST_TCP_SHORT_READ_DEADLINE_MS)) TEST_EXIT;
+
+    test_tcp_timeout_conns++;
+}
+
+static void test_tcp_timeout_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    void *ctx;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_get_context(conn, &ctx)) TEST_EXIT;
+    if(svx_tcp_connection_get_close_reason(conn, &(test_tcp_timeout_reasons[(intptr_t)ctx]))) TEST_EXIT;
+
+    if(2 == ++test_tcp_timeout_closed) test_tcp_fixture_quit();
+}
+
+static void test_tcp_timeout_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_timeouts(server, TEST_TCP_SHORT_IDLE_TIMEOUT_MS, 0, 0)) TEST_EXIT;
+    if(svx_tcp_server_set_established_cb(server, test_tcp_timeout_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_timeout_closed_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_timeout()
+{
+    uint8_t   c = 0;
+    char      buf[16];
+    int       fd, i;
+    ssize_t   n = -1;
+
+    test_tcp_fixture_start(test_tcp_timeout_setup, NULL);
+
+    /* slowloris: it is never idle, but the request is never completed */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    for(i = 0; i < 100; i++)
+    {
+        if(send(fd, &c, 1, MSG_NOSIGNAL) < 0) break;
+        usleep(20 * 1000);
+        if(0 == (n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) || (n < 0 && EAGAIN != errno)) break;
+    }
+    if(i >= 100) TEST_EXIT;
+    close(fd);
+
+    /* idle: the connection will be closed by the server */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if(0 != read(fd, buf, sizeof(buf))) TEST_EXIT;
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_READ_TIMEOUT != test_tcp_timeout_reasons[0]) TEST_EXIT;
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_IDLE_TIMEOUT != test_tcp_timeout_reasons[1]) TEST_EXIT;
+}
+
+/* the connection is written and closed by handle in a non-loop thread, then the handle becomes stale */
+static svx_tcp_connection_handle_t  test_tcp_handle_cur    = SVX_TCP_CONNECTION_HANDLE_INVALID; /* atomic */
+static int                          test_tcp_handle_closed = 0; /* atomic */
+
+static void test_tcp_handle_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    svx_tcp_connection_handle_t handle;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_get_handle(conn, &handle)) TEST_EXIT;
+    if(SVX_TCP_CONNECTION_HANDLE_INVALID == handle) TEST_EXIT;
+    __sync_lock_test_and_set(&test_tcp_handle_cur, handle);
+}
+
+static void test_tcp_handle_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    svx_tcp_connection_handle_t handle;
+
+    SVX_UTIL_UNUSED(arg);
+
+    /* the handle has been invalidated before the closed callback */
+    if(svx_tcp_connection_get_handle(conn, &handle)) TEST_EXIT;
+    if(SVX_TCP_CONNECTION_HANDLE_INVALID != handle) TEST_EXIT;
+
+    if(2 == __sync_add_and_fetch(&test_tcp_handle_closed, 1)) test_tcp_fixture_quit();
+}
+
+static void test_tcp_handle_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_handle_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_handle_closed_cb, NULL)) TEST_EXIT;
+}
+
+static svx_tcp_connection_handle_t test_tcp_handle_wait_established()
+{
+    svx_tcp_connection_handle_t handle;
+    int                         i;
+
+    for(i = 0; i < 100; i++)
+    {
+        if(SVX_TCP_CONNECTION_HANDLE_INVALID != (handle = __sync_lock_test_and_set(&test_tcp_handle_cur, SVX_TCP_CONNECTION_HANDLE_INVALID)))
+            return handle;
+        usleep(10 * 1000);
+    }
+    TEST_EXIT;
+}
+
+static void test_tcp_handle()
+{
+    svx_tcp_connection_handle_t  handle1, handle2;
+    char                         buf[16];
+    int                          fd;
+
+    test_tcp_fixture_start(test_tcp_handle_setup, NULL);
+
+    if(SVX_ERRNO_NOTCONN != svx_tcp_connection_write_by_handle(SVX_TCP_CONNECTION_HANDLE_INVALID, (uint8_t *)"x", 1))
+        TEST_EXIT;
+
+    /* write and close by handle */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    handle1 = test_tcp_handle_wait_established();
+    if(svx_tcp_connection_write_by_handle(handle1, (uint8_t *)"hello", 5)) TEST_EXIT;
+    if(5 != recv(fd, buf, 5, MSG_WAITALL)) TEST_EXIT;
+    if(0 != memcmp(buf, "hello", 5)) TEST_EXIT;
+    if(svx_tcp_connection_close_by_handle(handle1)) TEST_EXIT;
+    if(0 != read(fd, buf, sizeof(buf))) TEST_EXIT;
+    close(fd);
+    test_tcp_wait(&test_tcp_handle_closed, 1);
+
+    /* the handle is stale now, even if its slot has been reused by a new connection */
+    if(SVX_ERRNO_NOTCONN != svx_tcp_connection_write_by_handle(handle1, (uint8_t *)"x", 1)) TEST_EXIT;
+    if(SVX_ERRNO_NOTCONN != svx_tcp_connection_close_by_handle(handle1)) TEST_EXIT;
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    handle2 = test_tcp_handle_wait_established();
+    if(handle1 == handle2) TEST_EXIT;
+    if(SVX_ERRNO_NOTCONN != svx_tcp_connection_write_by_handle(handle1, (uint8_t *)"x", 1)) TEST_EXIT;
+    if(svx_tcp_connection_write_by_handle(handle2, (uint8_t *)"world", 5)) TEST_EXIT;
+    if(5 != recv(fd, buf, 5, MSG_WAITALL)) TEST_EXIT;
+    if(0 != memcmp(buf, "world", 5)) TEST_EXIT;
+    close(fd);
+
+    test_tcp_fixture_join();
+    if(2 != test_tcp_handle_closed) TEST_EXIT;
+}
+
+/* the pipelined requests are offloaded to a threadpool and finished out of order,
+   but the responses MUST be sent in order */
+typedef struct
+{
+    uint32_t seq;
+    uint32_t delay_us;
+    uint32_t result;
+} test_tcp_offload_req_t;
+
+static svx_threadpool_t *test_tcp_offload_threadpool = NULL;
+static int               test_tcp_offload_inflight   = 0; /* atomic */
+static int               test_tcp_offload_inflight_max = 0;
+static int               test_tcp_offload_reached    = 0;
+
+static void test_tcp_offload_work_cb(svx_tcp_connection_handle_t handle, void *arg)
+{
+    test_tcp_offload_req_t *req = (test_tcp_offload_req_t *)arg;
+    int                     n;
+
+    if(SVX_TCP_CONNECTION_HANDLE_INVALID == handle) TEST_EXIT;
+
+    n = __sync_add_and_fetch(&test_tcp_offload_inflight, 1);
+    if(n > TEST_TCP_OFFLOAD_LIMIT) TEST_EXIT;
+    if(n > test_tcp_offload_inflight_max) test_tcp_offload_inflight_max = n;
+
+    usleep(req->delay_us);
+    req->result = req->seq * 2 + 1;
+
+    __sync_sub_and_fetch(&test_tcp_offload_inflight, 1);
+}
+
+static void test_tcp_offload_done_cb(svx_tcp_connection_t *conn, int errnum, void *arg)
+{
+    test_tcp_offload_req_t *req = (test_tcp_offload_req_t *)arg;
+
+    if(NULL == conn || 0 != errnum) TEST_EXIT;
+    if(svx_tcp_connection_write(conn, (uint8_t *)&(req->result), sizeof(req->result))) TEST_EXIT;
+    free(req);
+}
+
+static void test_tcp_offload_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    test_tcp_offload_req_t *req;
+    uint32_t                seq;
+    size_t                  len;
+    int                     r;
+
+    SVX_UTIL_UNUSED(arg);
+
+    while(0 == svx_circlebuf_get_data_len(buf, &len) && len >= sizeof(seq))
+    {
+        if(svx_circlebuf_peek(buf, 0, (uint8_t *)&seq, sizeof(seq))) TEST_EXIT;
+        if(NULL == (req = malloc(sizeof(test_tcp_offload_req_t)))) TEST_EXIT;
+        req->seq      = seq;
+        req->delay_us = (uint32_t)(random() % 2000);
+
+        if(0 != (r = svx_tcp_connection_offload(conn, test_tcp_offload_threadpool, test_tcp_offload_work_cb,
+                                                test_tcp_offload_done_cb, req)))
+        {
+            /* the rest of the requests will be delivered again after some of them are finished */
+            if(SVX_ERRNO_REACH != r) TEST_EXIT;
+            test_tcp_offload_reached++;
+            free(req);
+            return;
+        }
+        if(svx_circlebuf_erase_data(buf, sizeof(seq))) TEST_EXIT;
+    }
+}
+
+static void test_tcp_offload_setup(svx_tcp_server_t *server)
+{
+    if(svx_threadpool_create(&test_tcp_offload_threadpool, TEST_TCP_OFFLOAD_THREADS_CNT, 0)) TEST_EXIT;
+    if(svx_tcp_server_set_offload_limit(server, TEST_TCP_OFFLOAD_LIMIT)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_offload_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_offload_cleanup()
+{
+    if(svx_threadpool_destroy(&test_tcp_offload_threadpool)) TEST_EXIT;
+}
+
+static void test_tcp_offload()
+{
+    uint32_t  reqs[TEST_TCP_OFFLOAD_REQS];
+    uint32_t  resps[TEST_TCP_OFFLOAD_REQS];
+    int       fd, i;
+
+    test_tcp_fixture_start(test_tcp_offload_setup, test_tcp_offload_cleanup);
+
+    /* send all the requests at once (pipelining) */
+    for(i = 0; i < TEST_TCP_OFFLOAD_REQS; i++)
+        reqs[i] = (uint32_t)i;
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if(sizeof(reqs) != send(fd, reqs, sizeof(reqs), MSG_NOSIGNAL)) TEST_EXIT;
+
+    if(sizeof(resps) != recv(fd, resps, sizeof(resps), MSG_WAITALL)) TEST_EXIT;
+    for(i = 0; i < TEST_TCP_OFFLOAD_REQS; i++)
+        if(resps[i] != (uint32_t)i * 2 + 1) TEST_EXIT;
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    if(test_tcp_offload_inflight_max < 2 || 0 == test_tcp_offload_reached) TEST_EXIT;
+}
+
+/* broadcast to the connections of two I/O loopers, the ones with the odd peer port are filtered out */
+static int test_tcp_broadcast_established = 0; /* atomic */
+static int test_tcp_broadcast_closed      = 0; /* atomic */
+static int test_tcp_broadcast_filtered    = 0; /* atomic */
+
+static uint16_t test_tcp_broadcast_get_port(svx_inetaddr_t *addr)
+{
+    char     ip[SVX_INETADDR_STR_IP_LEN];
+    uint16_t port;
+
+    if(svx_inetaddr_get_ipport(addr, ip, sizeof(ip), &port)) TEST_EXIT;
+    return port;
+}
+
+static int test_tcp_broadcast_filter_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    svx_inetaddr_t addr;
+
+    if((void *)test_tcp_broadcast_filter_cb != arg) TEST_EXIT;
+
+    __sync_add_and_fetch(&test_tcp_broadcast_filtered, 1);
+    if(svx_tcp_connection_get_peer_addr(conn, &addr)) TEST_EXIT;
+    return (0 == test_tcp_broadcast_get_port(&addr) % 2);
+}
+
+static void test_tcp_broadcast_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    __sync_add_and_fetch(&test_tcp_broadcast_established, 1);
+}
+
+static void test_tcp_broadcast_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    if(TEST_TCP_BROADCAST_CONNS == __sync_add_and_fetch(&test_tcp_broadcast_closed, 1)) test_tcp_fixture_quit();
+}
+
+static void test_tcp_broadcast_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_io_loopers_num(server, 2)) TEST_EXIT;
+    if(svx_tcp_server_set_established_cb(server, test_tcp_broadcast_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_broadcast_closed_cb, NULL)) TEST_EXIT;
+}
+
+static int64_t test_tcp_broadcast_get_buf_bytes()
+{
+    svx_alloc_stats_t stats;
+
+    if(svx_alloc_get_stats(SVX_ALLOC_TAG_BUF, &stats)) TEST_EXIT;
+    return stats.live_bytes;
+}
+
+static void test_tcp_broadcast()
+{
+    svx_inetaddr_t  addr;
+    int             fds[TEST_TCP_BROADCAST_CONNS];
+    uint8_t        *data, *buf;
+    int64_t         buf_bytes;
+    ssize_t         n;
+    int             i, j;
+
+    if(NULL == (data = malloc(TEST_TCP_BROADCAST_LEN))) TEST_EXIT;
+    if(NULL == (buf = malloc(TEST_TCP_BROADCAST_LEN))) TEST_EXIT;
+    for(i = 0; i < TEST_TCP_BROADCAST_LEN; i++)
+        data[i] = (uint8_t)(i % 251);
+
+    test_tcp_fixture_start(test_tcp_broadcast_setup, NULL);
+
+    for(i = 0; i < TEST_TCP_BROADCAST_CONNS; i++)
+        fds[i] = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    test_tcp_wait(&test_tcp_broadcast_established, TEST_TCP_BROADCAST_CONNS);
+    buf_bytes = test_tcp_broadcast_get_buf_bytes();
+
+    /* the large one is only sent to the connections with the even peer port, then the small one to all */
+    if(svx_tcp_server_broadcast(test_tcp_fixture_server, test_tcp_broadcast_filter_cb,
+                                (void *)test_tcp_broadcast_filter_cb, data, TEST_TCP_BROADCAST_LEN)) TEST_EXIT;
+    if(svx_tcp_server_broadcast(test_tcp_fixture_server, NULL, NULL, (uint8_t *)"end", 3)) TEST_EXIT;
+
+    for(i = 0; i < TEST_TCP_BROADCAST_CONNS; i++)
+    {
+        if(svx_inetaddr_from_fd_local(&addr, fds[i])) TEST_EXIT;
+        if(0 == test_tcp_broadcast_get_port(&addr) % 2)
+        {
+            if(TEST_TCP_BROADCAST_LEN != recv(fds[i], buf, TEST_TCP_BROADCAST_LEN, MSG_WAITALL)) TEST_EXIT;
+            if(0 != memcmp(buf, data, TEST_TCP_BROADCAST_LEN)) TEST_EXIT;
+        }
+        if(3 != recv(fds[i], buf, 3, MSG_WAITALL)) TEST_EXIT;
+        if(0 != memcmp(buf, "end", 3)) TEST_EXIT;
+    }
+
+    /* nothing more */
+    usleep(10 * 1000);
+    for(i = 0; i < TEST_TCP_BROADCAST_CONNS; i++)
+        if(-1 != (n = recv(fds[i], buf, 1, MSG_DONTWAIT)) || EAGAIN != errno) TEST_EXIT;
+    if(TEST_TCP_BROADCAST_CONNS != test_tcp_broadcast_filtered) TEST_EXIT;
+
+    /* the shared buffers are released after the last connection has flushed them */
+    for(j = 0; j < 100 && buf_bytes != test_tcp_broadcast_get_buf_bytes(); j++)
+        usleep(10 * 1000);
+    if(j >= 100) TEST_EXIT;
+
+    for(i = 0; i < TEST_TCP_BROADCAST_CONNS; i++)
+        close(fds[i]);
+
+    test_tcp_fixture_join();
+
+    free(data);
+    free(buf);
+}
+
+/* a gather write in the loop thread copies only the unsent tail, a gather write in other threads
+   is flattened before it returns. The caller's buffers can be reused as soon as it returns */
+static svx_tcp_connection_t *test_tcp_writev_conn      = NULL; /* atomic */
+static uint8_t              *test_tcp_writev_data      = NULL;
+static size_t                test_tcp_writev_queue_len = 0;
+
+static void test_tcp_writev_fill(uint8_t *data, size_t len, uint8_t seed)
+{
+    size_t i;
+
+    for(i = 0; i < len; i++)
+        data[i] = (uint8_t)(seed + i % 251);
+}
+
+static void test_tcp_writev_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    struct iovec iov[4];
+
+    SVX_UTIL_UNUSED(arg);
+
+    /* unequal buffers, and an empty one */
+    iov[0].iov_base = test_tcp_writev_data;
+    iov[0].iov_len  = 1000;
+    iov[1].iov_base = test_tcp_writev_data + 1000;
+    iov[1].iov_len  = 0;
+    iov[2].iov_base = test_tcp_writev_data + 1000;
+    iov[2].iov_len  = TEST_TCP_WRITEV_LEN / 2;
+    iov[3].iov_base = test_tcp_writev_data + 1000 + TEST_TCP_WRITEV_LEN / 2;
+    iov[3].iov_len  = TEST_TCP_WRITEV_LEN - 1000 - TEST_TCP_WRITEV_LEN / 2;
+    if(svx_tcp_connection_writev(conn, iov, 4)) TEST_EXIT;
+    if(svx_tcp_connection_get_write_queue_len(conn, &test_tcp_writev_queue_len)) TEST_EXIT;
+    memset(test_tcp_writev_data, 0, TEST_TCP_WRITEV_LEN);
+
+    (void)__sync_lock_test_and_set(&test_tcp_writev_conn, conn);
+}
+
+static void test_tcp_writev_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_writev_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_writev_recv(int fd, size_t len, uint8_t seed)
+{
+    uint8_t *buf, *expected;
+
+    if(NULL == (buf = malloc(len))) TEST_EXIT;
+    if(NULL == (expected = malloc(len))) TEST_EXIT;
+    test_tcp_writev_fill(expected, len, seed);
+
+    if((ssize_t)len != recv(fd, buf, len, MSG_WAITALL)) TEST_EXIT;
+    if(0 != memcmp(buf, expected, len)) TEST_EXIT;
+
+    free(buf);
+    free(expected);
+}
+
+static void test_tcp_writev()
+{
+    svx_tcp_connection_t *conn = NULL;
+    struct iovec          iov[IOV_MAX + 1];
+    uint8_t              *small;
+    int                   fd, i;
+
+    if(NULL == (test_tcp_writev_data = malloc(TEST_TCP_WRITEV_LEN))) TEST_EXIT;
+    if(NULL == (small = malloc(TEST_TCP_WRITEV_SMALL_LEN))) TEST_EXIT;
+    test_tcp_writev_fill(test_tcp_writev_data, TEST_TCP_WRITEV_LEN, 1);
+
+    test_tcp_fixture_start(test_tcp_writev_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    for(i = 0; i < 100 && NULL == (conn = __sync_val_compare_and_swap(&test_tcp_writev_conn, NULL, NULL)); i++)
+        usleep(10 * 1000);
+    if(NULL == conn) TEST_EXIT;
+
+    /* the head was written directly, only the tail was queued */
+    if(0 == test_tcp_writev_queue_len || test_tcp_writev_queue_len >= TEST_TCP_WRITEV_LEN) TEST_EXIT;
+    test_tcp_writev_recv(fd, TEST_TCP_WRITEV_LEN, 1);
+
+    /* the iovcnt is out of range */
+    for(i = 0; i < IOV_MAX + 1; i++)
+    {
+        iov[i].iov_base = small;
+        iov[i].iov_len  = 1;
+    }
+    if(SVX_ERRNO_INVAL != svx_tcp_connection_writev(conn, iov, 0)) TEST_EXIT;
+    if(SVX_ERRNO_INVAL != svx_tcp_connection_writev(conn, iov, -1)) TEST_EXIT;
+    if(SVX_ERRNO_INVAL != svx_tcp_connection_writev(conn, iov, IOV_MAX + 1)) TEST_EXIT;
+
+    /* not in the loop thread */
+    test_tcp_writev_fill(small, TEST_TCP_WRITEV_SMALL_LEN, 7);
+    iov[0].iov_base = small;
+    iov[0].iov_len  = 100;
+    iov[1].iov_base = small + 100;
+    iov[1].iov_len  = TEST_TCP_WRITEV_SMALL_LEN - 100;
+    if(svx_tcp_connection_writev(conn, iov, 2)) TEST_EXIT;
+    memset(small, 0, TEST_TCP_WRITEV_SMALL_LEN);
+    test_tcp_writev_recv(fd, TEST_TCP_WRITEV_SMALL_LEN, 7);
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    free(small);
+    free(test_tcp_writev_data);
+}
+
+/* the buffer passed by reference is released exactly once: after a partial sending, after being
+   dispatched from another thread, and when the connection is closed with it still queued */
+static svx_tcp_connection_t *test_tcp_owned_conn      = NULL; /* atomic */
+static size_t                test_tcp_owned_queue_len = 0;
+static int                   test_tcp_owned_frees[4];         /* atomic */
+
+static void test_tcp_owned_free_cb(uint8_t *buf, void *arg)
+{
+    __sync_add_and_fetch((int *)arg, 1);
+    free(buf);
+}
+
+static void test_tcp_owned_write(svx_tcp_connection_t *conn, size_t len, int idx)
+{
+    uint8_t *buf;
+
+    if(NULL == (buf = malloc(len))) TEST_EXIT;
+    memset(buf, idx, len);
+    if(svx_tcp_connection_write_owned(conn, buf, len, test_tcp_owned_free_cb, &(test_tcp_owned_frees[idx]))) TEST_EXIT;
+}
+
+static void test_tcp_owned_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    test_tcp_owned_write(conn, TEST_TCP_OWNED_LEN, 0);
+    if(svx_tcp_connection_get_write_queue_len(conn, &test_tcp_owned_queue_len)) TEST_EXIT;
+    if(0 != __sync_add_and_fetch(&(test_tcp_owned_frees[0]), 0)) TEST_EXIT; /* still in use */
+
+    (void)__sync_lock_test_and_set(&test_tcp_owned_conn, conn);
+}
+
+static void test_tcp_owned_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_owned_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_owned_recv(int fd, size_t len, int idx)
+{
+    uint8_t *buf;
+    size_t   i;
+
+    if(NULL == (buf = malloc(len))) TEST_EXIT;
+    if((ssize_t)len != recv(fd, buf, len, MSG_WAITALL)) TEST_EXIT;
+    for(i = 0; i < len; i++)
+        if(idx != buf[i]) TEST_EXIT;
+    free(buf);
+}
+
+static void test_tcp_owned()
+{
+    svx_tcp_connection_t *conn = NULL;
+    int                   fd, i;
+
+    memset(test_tcp_owned_frees, 0, sizeof(test_tcp_owned_frees));
+    test_tcp_fixture_start(test_tcp_owned_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    for(i = 0; i < 100 && NULL == (conn = __sync_val_compare_and_swap(&test_tcp_owned_conn, NULL, NULL)); i++)
+        usleep(10 * 1000);
+    if(NULL == conn) TEST_EXIT;
+
+    /* sent in part, then the rest was sent from the write event */
+    if(0 == test_tcp_owned_queue_len || test_tcp_owned_queue_len >= TEST_TCP_OWNED_LEN) TEST_EXIT;
+    test_tcp_owned_recv(fd, TEST_TCP_OWNED_LEN, 0);
+    test_tcp_wait(&(test_tcp_owned_frees[0]), 1);
+
+    /* not in the loop thread */
+    test_tcp_owned_write(conn, TEST_TCP_OWNED_SMALL_LEN, 1);
+    test_tcp_owned_recv(fd, TEST_TCP_OWNED_SMALL_LEN, 1);
+    test_tcp_wait(&(test_tcp_owned_frees[1]), 1);
+
+    /* closed by the peer (RST, the data is not read) with the buffers still queued */
+    test_tcp_owned_write(conn, TEST_TCP_OWNED_LEN, 2);
+    test_tcp_owned_write(conn, TEST_TCP_OWNED_LEN, 3);
+    usleep(50 * 1000);
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    for(i = 0; i < 4; i++)
+        if(1 != test_tcp_owned_frees[i]) TEST_EXIT;
+}
+
+/* the data written in one read callback is queued, then flushed by one writev() at the end of the round */
+static uint64_t test_tcp_cork_iter    = 0;
+static int      test_tcp_cork_flushed = 0;
+
+static void test_tcp_cork_check_run(void *arg)
+{
+    svx_tcp_connection_t *conn = (svx_tcp_connection_t *)arg;
+    uint64_t              iter;
+    size_t                len;
+
+    /* the flush task was deferred before this one, in the same round */
+    if(svx_looper_get_iteration(test_tcp_fixture_looper, &iter)) TEST_EXIT;
+    if(iter != test_tcp_cork_iter) TEST_EXIT;
+    if(svx_tcp_connection_get_write_queue_len(conn, &len)) TEST_EXIT;
+    if(0 != len) TEST_EXIT;
+
+    test_tcp_cork_flushed++;
+    if(svx_tcp_connection_del_ref(conn)) TEST_EXIT;
+}
+
+static void test_tcp_cork_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    size_t len;
+
+    SVX_UTIL_UNUSED(arg);
+
+    svx_circlebuf_erase_all_data(buf);
+
+    if(svx_tcp_connection_write(conn, (uint8_t *)"a", 1)) TEST_EXIT;
+    if(svx_tcp_connection_write(conn, (uint8_t *)"bc", 2)) TEST_EXIT;
+    if(svx_tcp_connection_write(conn, (uint8_t *)"def", 3)) TEST_EXIT;
+
+    /* nothing has been sent */
+    if(svx_tcp_connection_get_write_queue_len(conn, &len)) TEST_EXIT;
+    if(6 != len) TEST_EXIT;
+
+    if(svx_looper_get_iteration(test_tcp_fixture_looper, &test_tcp_cork_iter)) TEST_EXIT;
+    if(svx_tcp_connection_add_ref(conn)) TEST_EXIT;
+    if(svx_looper_defer(test_tcp_fixture_looper, test_tcp_cork_check_run, NULL, conn)) TEST_EXIT;
+}
+
+static void test_tcp_cork_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_auto_cork(server, 1)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_cork_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_cork()
+{
+    char buf[8];
+    int  fd, i;
+
+    test_tcp_fixture_start(test_tcp_cork_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    for(i = 0; i < TEST_TCP_CORK_ROUNDS; i++)
+    {
+        if(1 != send(fd, "x", 1, MSG_NOSIGNAL)) TEST_EXIT;
+        if(6 != recv(fd, buf, 6, MSG_WAITALL)) TEST_EXIT;
+        if(0 != memcmp(buf, "abcdef", 6)) TEST_EXIT;
+    }
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    if(TEST_TCP_CORK_ROUNDS != test_tcp_cork_flushed) TEST_EXIT;
+}
+
+/* the buffer sent by MSG_ZEROCOPY is released after the completion, even if the fd is not in the poller,
+   or the connection has been closed while the kernel is still holding the data */
+static uint8_t *test_tcp_zerocopy_data   = NULL;
+static int      test_tcp_zerocopy_freed  = 0; /* atomic */
+static int      test_tcp_zerocopy_closed = 0; /* atomic */
+
+static void test_tcp_zerocopy_free_cb(uint8_t *buf, void *arg)
+{
+    svx_tcp_connection_t *conn = (svx_tcp_connection_t *)arg;
+
+    if(buf != test_tcp_zerocopy_data) TEST_EXIT;
+    __sync_add_and_fetch(&test_tcp_zerocopy_freed, 1);
+
+    /* let the idle connection see the peer's closing */
+    if(conn)
+        if(svx_tcp_connection_enable_read(conn)) TEST_EXIT;
+}
+
+static void test_tcp_zerocopy_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    uint8_t cmd;
+    int     freed, r;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_circlebuf_get_data(buf, &cmd, 1)) TEST_EXIT;
+    if(0 != (r = svx_tcp_connection_set_zerocopy(conn, TEST_TCP_ZEROCOPY_THRESHOLD)) && SVX_ERRNO_NOTSPT != r) TEST_EXIT;
+    freed = __sync_add_and_fetch(&test_tcp_zerocopy_freed, 0);
+
+    if('i' == cmd)
+    {
+        /* the fd will be removed from the poller after all the data is handed to the kernel */
+        if(svx_tcp_connection_disable_read(conn)) TEST_EXIT;
+        if(svx_tcp_connection_write_owned(conn, test_tcp_zerocopy_data, TEST_TCP_ZEROCOPY_LEN,
+                                          test_tcp_zerocopy_free_cb, conn)) TEST_EXIT;
+    }
+    else
+    {
+        /* closed while the kernel is holding a part of the data */
+        if(svx_tcp_connection_write_owned(conn, test_tcp_zerocopy_data, TEST_TCP_ZEROCOPY_LEN,
+                                          test_tcp_zerocopy_free_cb, NULL)) TEST_EXIT;
+        if(svx_tcp_connection_close(conn)) TEST_EXIT;
+    }
+
+    if(freed != __sync_add_and_fetch(&test_tcp_zerocopy_freed, 0)) TEST_EXIT;
+}
+
+static void test_tcp_zerocopy_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    __sync_add_and_fetch(&test_tcp_zerocopy_closed, 1);
+}
+
+static void test_tcp_zerocopy_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_read_cb(server, test_tcp_zerocopy_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_zerocopy_closed_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_zerocopy()
+{
+    uint8_t   *buf;
+    size_t     len;
+    ssize_t    n;
+    int        fd, i;
+
+    if(NULL == (test_tcp_zerocopy_data = malloc(TEST_TCP_ZEROCOPY_LEN))) TEST_EXIT;
+    if(NULL == (buf = malloc(TEST_TCP_ZEROCOPY_LEN))) TEST_EXIT;
+    for(i = 0; i < TEST_TCP_ZEROCOPY_LEN; i++)
+        test_tcp_zerocopy_data[i] = (uint8_t)(i % 251);
+
+    test_tcp_fixture_start(test_tcp_zerocopy_setup, NULL);
+
+    /* idle: the reading is disabled, and all the data has been sent */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if(1 != send(fd, "i", 1, MSG_NOSIGNAL)) TEST_EXIT;
+    usleep(50 * 1000);
+    if(0 != __sync_add_and_fetch(&test_tcp_zerocopy_freed, 0)) TEST_EXIT;
+    if(TEST_TCP_ZEROCOPY_LEN != recv(fd, buf, TEST_TCP_ZEROCOPY_LEN, MSG_WAITALL)) TEST_EXIT;
+    if(0 != memcmp(buf, test_tcp_zerocopy_data, TEST_TCP_ZEROCOPY_LEN)) TEST_EXIT;
+    test_tcp_wait(&test_tcp_zerocopy_freed, 1);
+    close(fd);
+    test_tcp_wait(&test_tcp_zerocopy_closed, 1);
+
+    /* closed: the data which has been handed to the kernel is still delivered */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if(1 != send(fd, "c", 1, MSG_NOSIGNAL)) TEST_EXIT;
+    test_tcp_wait(&test_tcp_zerocopy_closed, 2);
+    usleep(50 * 1000);
+    if(1 != __sync_add_and_fetch(&test_tcp_zerocopy_freed, 0)) TEST_EXIT;
+    for(len = 0; (n = recv(fd, buf + len, TEST_TCP_ZEROCOPY_LEN - len, 0)) > 0; len += (size_t)n);
+    if(0 != n || 0 == len) TEST_EXIT;
+    if(0 != memcmp(buf, test_tcp_zerocopy_data, len)) TEST_EXIT;
+    test_tcp_wait(&test_tcp_zerocopy_freed, 2);
+    close(fd);
+
+    test_tcp_fixture_quit();
+    test_tcp_fixture_join();
+
+    free(test_tcp_zerocopy_data);
+    free(buf);
+}
+
+/* both directions are limited to the rate after the burst, the parked reading and writing are resumed in time */
+static uint8_t *test_tcp_shaping_data     = NULL;
+static int64_t  test_tcp_shaping_start_ms = 0;
+static size_t   test_tcp_shaping_read     = 0;
+static int64_t  test_tcp_shaping_read_ms  = 0; /* atomic */
+
+static int64_t test_tcp_shaping_get_now_ms()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+static void test_tcp_shaping_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    size_t len;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_set_rate_limit(conn, TEST_TCP_SHAPING_RATE, TEST_TCP_SHAPING_BURST,
+                                         TEST_TCP_SHAPING_RATE, TEST_TCP_SHAPING_BURST)) TEST_EXIT;
+    test_tcp_shaping_start_ms = test_tcp_shaping_get_now_ms();
+
+    /* no more than the burst is written, the rest is queued until the tokens are refilled */
+    if(svx_tcp_connection_write(conn, test_tcp_shaping_data, TEST_TCP_SHAPING_LEN)) TEST_EXIT;
+    if(svx_tcp_connection_get_write_queue_len(conn, &len)) TEST_EXIT;
+    if(len < TEST_TCP_SHAPING_LEN - TEST_TCP_SHAPING_BURST) TEST_EXIT;
+}
+
+static void test_tcp_shaping_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    size_t len;
+
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_circlebuf_get_data_len(buf, &len)) TEST_EXIT;
+    if(svx_circlebuf_erase_all_data(buf)) TEST_EXIT;
+
+    test_tcp_shaping_read += len;
+    if(test_tcp_shaping_read > TEST_TCP_SHAPING_LEN) TEST_EXIT;
+    if(TEST_TCP_SHAPING_LEN == test_tcp_shaping_read)
+        __sync_lock_test_and_set(&test_tcp_shaping_read_ms, test_tcp_shaping_get_now_ms() - test_tcp_shaping_start_ms);
+}
+
+static void test_tcp_shaping_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_shaping_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_shaping_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_shaping()
+{
+    uint8_t   *buf;
+    int64_t    start_ms, write_ms, read_ms;
+    int        fd, i;
+
+    if(NULL == (test_tcp_shaping_data = malloc(TEST_TCP_SHAPING_LEN))) TEST_EXIT;
+    if(NULL == (buf = malloc(TEST_TCP_SHAPING_LEN))) TEST_EXIT;
+    for(i = 0; i < TEST_TCP_SHAPING_LEN; i++)
+        test_tcp_shaping_data[i] = (uint8_t)(i % 251);
+
+    test_tcp_fixture_start(test_tcp_shaping_setup, NULL);
+
+    /* upload and download at the same time */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    start_ms = test_tcp_shaping_get_now_ms();
+    if(TEST_TCP_SHAPING_LEN != send(fd, test_tcp_shaping_data, TEST_TCP_SHAPING_LEN, MSG_NOSIGNAL)) TEST_EXIT;
+    if(TEST_TCP_SHAPING_LEN != recv(fd, buf, TEST_TCP_SHAPING_LEN, MSG_WAITALL)) TEST_EXIT;
+    if(0 != memcmp(buf, test_tcp_shaping_data, TEST_TCP_SHAPING_LEN)) TEST_EXIT;
+    write_ms = test_tcp_shaping_get_now_ms() - start_ms;
+    for(i = 0; i < 100 && 0 == (read_ms = __sync_add_and_fetch(&test_tcp_shaping_read_ms, 0)); i++)
+        usleep(10 * 1000);
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    if(write_ms < TEST_TCP_SHAPING_MIN_MS || write_ms > TEST_TCP_SHAPING_MAX_MS) TEST_EXIT;
+    if(read_ms < TEST_TCP_SHAPING_MIN_MS || read_ms > TEST_TCP_SHAPING_MAX_MS) TEST_EXIT;
+
+    free(test_tcp_shaping_data);
+    free(buf);
+}
+
+/* a flooding connection is limited by its read quota in each loop iteration. The data is held in read_buf
+   for a while, so the quota can not be used up, then the carried over deficit MUST be capped at one quantum */
+static uint64_t     test_tcp_quota_iter       = UINT64_MAX;
+static size_t       test_tcp_quota_iter_bytes = 0;
+static unsigned int test_tcp_quota_iter_cbs   = 0;
+static unsigned int test_tcp_quota_iters      = 0;
+static size_t       test_tcp_quota_held       = 0;
+static size_t       test_tcp_quota_read       = 0; /* atomic */
+
+static void test_tcp_quota_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_set_read_quota(conn, TEST_TCP_QUOTA_BYTES, TEST_TCP_QUOTA_CALLBACKS)) TEST_EXIT;
+    if(svx_tcp_connection_set_read_weight(conn, TEST_TCP_QUOTA_WEIGHT)) TEST_EXIT;
+}
+
+static void test_tcp_quota_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    uint64_t iter;
+    size_t   len, n, keep;
+
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_circlebuf_get_data_len(buf, &len)) TEST_EXIT;
+    if(len < test_tcp_quota_held) TEST_EXIT;
+    n = len - test_tcp_quota_held;
+
+    if(svx_looper_get_iteration(test_tcp_fixture_looper, &iter)) TEST_EXIT;
+    if(iter != test_tcp_quota_iter)
+    {
+        test_tcp_quota_iter       = iter;
+        test_tcp_quota_iter_bytes = 0;
+        test_tcp_quota_iter_cbs   = 0;
+        test_tcp_quota_iters++;
+    }
+    test_tcp_quota_iter_bytes += n;
+    test_tcp_quota_iter_cbs++;
+
+    /* the quantum is (bytes * weight), the carried over deficit is capped at one more quantum */
+    if(test_tcp_quota_iter_cbs > TEST_TCP_QUOTA_CALLBACKS) TEST_EXIT;
+    if(test_tcp_quota_iter_bytes > TEST_TCP_QUOTA_BYTES * TEST_TCP_QUOTA_WEIGHT * 2) TEST_EXIT;
+
+    /* hold the data in the first iterations, only a little free space is left in read_buf */
+    keep = 0;
+    if(test_tcp_quota_iters <= TEST_TCP_QUOTA_HOLD_ITERS)
+        keep = (len < TEST_TCP_QUOTA_BUF_LEN - TEST_TCP_QUOTA_HOLD_SPACE ? len : TEST_TCP_QUOTA_BUF_LEN - TEST_TCP_QUOTA_HOLD_SPACE);
+    if(len > keep)
+        if(svx_circlebuf_erase_data(buf, len - keep)) TEST_EXIT;
+    test_tcp_quota_held = keep;
+
+    __sync_add_and_fetch(&test_tcp_quota_read, n);
+}
+
+static void test_tcp_quota_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_read_buf_len(server, TEST_TCP_READ_BUF_MIN_LEN, TEST_TCP_QUOTA_BUF_LEN)) TEST_EXIT;
+    if(svx_tcp_server_set_established_cb(server, test_tcp_quota_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_quota_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_quota()
+{
+    uint8_t   *data;
+    int        fd, i;
+
+    if(NULL == (data = calloc(1, TEST_TCP_QUOTA_LEN))) TEST_EXIT;
+
+    test_tcp_fixture_start(test_tcp_quota_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if(TEST_TCP_QUOTA_LEN != send(fd, data, TEST_TCP_QUOTA_LEN, MSG_NOSIGNAL)) TEST_EXIT;
+    for(i = 0; i < 100 && TEST_TCP_QUOTA_LEN != __sync_add_and_fetch(&test_tcp_quota_read, 0); i++)
+        usleep(10 * 1000);
+    if(i >= 100) TEST_EXIT;
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    /* the data is spread over the iterations */
+    if(test_tcp_quota_iters < TEST_TCP_QUOTA_HOLD_ITERS + TEST_TCP_QUOTA_LEN / (TEST_TCP_QUOTA_BYTES * TEST_TCP_QUOTA_WEIGHT * 2)) TEST_EXIT;
+
+    free(data);
+}
+
+/* the read callback takes one message each time, the messages read at once are delivered
+   in the following iterations within the quota of callbacks */
+static uint64_t     test_tcp_quota_msgs_iter     = UINT64_MAX;
+static unsigned int test_tcp_quota_msgs_iter_cbs = 0;
+static unsigned int test_tcp_quota_msgs_iters    = 0;
+static int          test_tcp_quota_msgs_read     = 0; /* atomic */
+
+static void test_tcp_quota_msgs_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_set_read_quota(conn, 0, TEST_TCP_QUOTA_CALLBACKS)) TEST_EXIT;
+    if(svx_tcp_connection_set_read_lowat(conn, TEST_TCP_QUOTA_MSG_LEN)) TEST_EXIT;
+}
+
+static void test_tcp_quota_msgs_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    uint64_t iter;
+
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_looper_get_iteration(test_tcp_fixture_looper, &iter)) TEST_EXIT;
+    if(iter != test_tcp_quota_msgs_iter)
+    {
+        test_tcp_quota_msgs_iter     = iter;
+        test_tcp_quota_msgs_iter_cbs = 0;
+        test_tcp_quota_msgs_iters++;
+    }
+    if(++test_tcp_quota_msgs_iter_cbs > TEST_TCP_QUOTA_CALLBACKS) TEST_EXIT;
+
+    if(svx_circlebuf_erase_data(buf, TEST_TCP_QUOTA_MSG_LEN)) return; /* a partial message */
+    __sync_add_and_fetch(&test_tcp_quota_msgs_read, 1);
+}
+
+static void test_tcp_quota_msgs_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_quota_msgs_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_quota_msgs_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_quota_msgs()
+{
+    uint8_t data[TEST_TCP_QUOTA_MSG_LEN * TEST_TCP_QUOTA_MSGS];
+    int     fd;
+
+    memset(data, 0, sizeof(data));
+    test_tcp_fixture_start(test_tcp_quota_msgs_setup, NULL);
+
+    /* no more data arrives after it */
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    if((ssize_t)sizeof(data) != send(fd, data, sizeof(data), MSG_NOSIGNAL)) TEST_EXIT;
+    test_tcp_wait(&test_tcp_quota_msgs_read, TEST_TCP_QUOTA_MSGS);
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    if(test_tcp_quota_msgs_iters < TEST_TCP_QUOTA_MSGS / TEST_TCP_QUOTA_CALLBACKS) TEST_EXIT;
+}
+
+/* the read buffer reserves a queued burst by FIONREAD in one step, grows geometrically for the held stream,
+   and shrinks back after the burst. The data is always read into it directly, without the second copy */
+static svx_tcp_connection_t *test_tcp_adaptive_conn        = NULL; /* atomic */
+static unsigned int          test_tcp_adaptive_idx         = 0;
+static size_t                test_tcp_adaptive_msg_read    = 0;
+static size_t                test_tcp_adaptive_held        = 0;
+static size_t                test_tcp_adaptive_buf_len     = 0;
+static unsigned int          test_tcp_adaptive_growths     = 0;
+static size_t                test_tcp_adaptive_max_buf_len = 0;
+static size_t                test_tcp_adaptive_end_buf_len = 0;
+
+/* the first message is the burst, then the chunks which are held in read_buf, then the small ones */
+static size_t test_tcp_adaptive_get_msg_len(unsigned int idx)
+{
+    if(0 == idx) return TEST_TCP_ADAPTIVE_BURST_LEN;
+    if(idx <= TEST_TCP_ADAPTIVE_CHUNKS) return TEST_TCP_ADAPTIVE_CHUNK_LEN;
+    return TEST_TCP_ADAPTIVE_SMALL_LEN;
+}
+
+static void test_tcp_adaptive_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    /* the burst is queued in the socket before the first reading */
+    if(svx_tcp_connection_set_fionread(conn, 1)) TEST_EXIT;
+    if(svx_tcp_connection_disable_read(conn)) TEST_EXIT;
+    (void)__sync_lock_test_and_set(&test_tcp_adaptive_conn, conn);
+}
+
+static void test_tcp_adaptive_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    svx_tcp_connection_read_stats_t stats;
+    size_t                          data_len, buf_len, msg_len;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_circlebuf_get_data_len(buf, &data_len)) TEST_EXIT;
+    if(svx_circlebuf_get_buf_len(buf, &buf_len)) TEST_EXIT;
+    if(svx_tcp_connection_get_read_stats(conn, &stats)) TEST_EXIT;
+    if(data_len < test_tcp_adaptive_held) TEST_EXIT;
+
+    /* never read into the stack buffer */
+    if(0 != stats.copied_reads) TEST_EXIT;
+
+    /* the whole burst is read at once */
+    if(0 == test_tcp_adaptive_idx && (1 != stats.reads || TEST_TCP_ADAPTIVE_BURST_LEN != data_len)) TEST_EXIT;
+
+    /* at least doubled each time (or up to the max_len) */
+    if(buf_len > test_tcp_adaptive_buf_len)
+    {
+        if(buf_len < test_tcp_adaptive_buf_len * 2 && buf_len != TEST_TCP_ADAPTIVE_BUF_MAX_LEN) TEST_EXIT;
+        test_tcp_adaptive_growths++;
+    }
+    test_tcp_adaptive_buf_len = buf_len;
+    if(buf_len > test_tcp_adaptive_max_buf_len) test_tcp_adaptive_max_buf_len = buf_len;
+
+    test_tcp_adaptive_msg_read += data_len - test_tcp_adaptive_held;
+    msg_len = test_tcp_adaptive_get_msg_len(test_tcp_adaptive_idx);
+    if(test_tcp_adaptive_msg_read > msg_len) TEST_EXIT;
+
+    /* the burst and the chunks are held until the last chunk */
+    if(test_tcp_adaptive_idx < TEST_TCP_ADAPTIVE_CHUNKS)
+        test_tcp_adaptive_held = data_len;
+    else
+    {
+        if(svx_circlebuf_erase_all_data(buf)) TEST_EXIT;
+        test_tcp_adaptive_held = 0;
+    }
+
+    if(test_tcp_adaptive_msg_read == msg_len)
+    {
+        test_tcp_adaptive_msg_read = 0;
+        test_tcp_adaptive_idx++;
+        test_tcp_adaptive_end_buf_len = buf_len;
+        if(svx_tcp_connection_write(conn, (uint8_t *)"k", 1)) TEST_EXIT;
+    }
+}
+
+static void test_tcp_adaptive_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_read_buf_len(server, TEST_TCP_READ_BUF_MIN_LEN, TEST_TCP_ADAPTIVE_BUF_MAX_LEN)) TEST_EXIT;
+    if(svx_tcp_server_set_established_cb(server, test_tcp_adaptive_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_adaptive_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_fixture_quit_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_adaptive()
+{
+    svx_tcp_connection_t *conn = NULL;
+    uint8_t              *data;
+    size_t                len;
+    char                  c;
+    int                   fd, i;
+
+    if(NULL == (data = calloc(1, TEST_TCP_ADAPTIVE_BURST_LEN))) TEST_EXIT;
+
+    test_tcp_fixture_start(test_tcp_adaptive_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    for(i = 0; i < 100 && NULL == (conn = __sync_val_compare_and_swap(&test_tcp_adaptive_conn, NULL, NULL)); i++)
+        usleep(10 * 1000);
+    if(NULL == conn) TEST_EXIT;
+
+    /* the burst is waiting in the socket's receive buffer, then the reading is enabled */
+    if(TEST_TCP_ADAPTIVE_BURST_LEN != send(fd, data, TEST_TCP_ADAPTIVE_BURST_LEN, MSG_NOSIGNAL)) TEST_EXIT;
+    usleep(50 * 1000);
+    if(svx_tcp_connection_enable_read(conn)) TEST_EXIT;
+    if(1 != recv(fd, &c, 1, MSG_WAITALL)) TEST_EXIT;
+
+    /* one message each time */
+    for(i = 1; i <= TEST_TCP_ADAPTIVE_CHUNKS + TEST_TCP_ADAPTIVE_SMALLS; i++)
+    {
+        len = test_tcp_adaptive_get_msg_len((unsigned int)i);
+        if((ssize_t)len != send(fd, data, len, MSG_NOSIGNAL)) TEST_EXIT;
+        if(1 != recv(fd, &c, 1, MSG_WAITALL)) TEST_EXIT;
+    }
+    close(fd);
+
+    test_tcp_fixture_join();
+
+    /* grown for the held data, then shrunk after the moving average has decayed */
+    if(test_tcp_adaptive_growths < 3) TEST_EXIT;
+    if(test_tcp_adaptive_max_buf_len < TEST_TCP_ADAPTIVE_BURST_LEN + TEST_TCP_ADAPTIVE_CHUNKS * TEST_TCP_ADAPTIVE_CHUNK_LEN) TEST_EXIT;
+    if(test_tcp_adaptive_end_buf_len > TEST_TCP_ADAPTIVE_SMALL_LEN * 16) TEST_EXIT;
+
+    free(data);
+}
+
+/* a slow reader makes the unsent data exceed the hard cap, the connection is closed at once */
+static svx_tcp_connection_flow_stats_t    test_tcp_flow_stats;
+static int                                test_tcp_flow_write_r       = 0;
+static int                                test_tcp_flow_write_again_r = 0;
+static int                                test_tcp_flow_enable_read_r = 0;
+static svx_tcp_connection_close_reason_t  test_tcp_flow_reason        = SVX_TCP_CONNECTION_CLOSE_REASON_NONE;
+
+static void test_tcp_flow_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    uint8_t *data;
+    int      i;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_set_write_flow_control(conn, TEST_TCP_FLOW_LOW_MARK, TEST_TCP_FLOW_HIGH_MARK,
+                                                 TEST_TCP_FLOW_HARD_CAP, &test_tcp_flow_stats)) TEST_EXIT;
+
+    /* the peer never reads */
+    if(NULL == (data = calloc(1, TEST_TCP_FLOW_CHUNK_LEN))) TEST_EXIT;
+    for(i = 0; i < TEST_TCP_FLOW_CHUNKS; i++)
+        if(0 != (test_tcp_flow_write_r = svx_tcp_connection_write(conn, data, TEST_TCP_FLOW_CHUNK_LEN))) break;
+
+    /* closed and rejected in the same round */
+    test_tcp_flow_write_again_r = svx_tcp_connection_write(conn, data, 1);
+    test_tcp_flow_enable_read_r = svx_tcp_connection_enable_read(conn);
+    free(data);
+}
+
+static void test_tcp_flow_closed_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_get_close_reason(conn, &test_tcp_flow_reason)) TEST_EXIT;
+    test_tcp_fixture_quit();
+}
+
+static void test_tcp_flow_setup(svx_tcp_server_t *server)
+{
+    if(svx_tcp_server_set_established_cb(server, test_tcp_flow_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(server, test_tcp_fixture_discard_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_closed_cb(server, test_tcp_flow_closed_cb, NULL)) TEST_EXIT;
+}
+
+static void test_tcp_flow()
+{
+    int fd;
+
+    memset(&test_tcp_flow_stats, 0, sizeof(test_tcp_flow_stats));
+    test_tcp_fixture_start(test_tcp_flow_setup, NULL);
+
+    fd = test_tcp_connect(TEST_TCP_FIXTURE_PORT);
+    test_tcp_fixture_join();
+    close(fd);
+
+    if(SVX_ERRNO_REACH != test_tcp_flow_write_r) TEST_EXIT;
+    if(SVX_ERRNO_REACH != test_tcp_flow_write_again_r) TEST_EXIT;
+    if(SVX_ERRNO_NOTCONN != test_tcp_flow_enable_read_r) TEST_EXIT;
+    if(1 != test_tcp_flow_stats.aborted) TEST_EXIT;
+    if(SVX_TCP_CONNECTION_CLOSE_REASON_WRITE_HARD_CAP != test_tcp_flow_reason) TEST_EXIT;
+}
+
+int test_tcp_runner()
+{
+    int            i, j;
+    struct timeval tv;
+    long           rand;
+
+    svx_log_level_stdout = SVX_LOG_LEVEL_WARNING;
+
+    /* for checking the shared buffers are released */
+    if(svx_alloc_enable_stats(1)) TEST_EXIT;
 
     gettimeofday(&tv, NULL);
     rand = tv.tv_sec + tv.tv_usec;
@@ -850,6 +2386,19 @@ int test_tcp_runner()
     test_tcp_do(TEST_TCP_LISTEN_IPV4, 2);
     test_tcp_do(TEST_TCP_LISTEN_IPV6, 0);
     test_tcp_do(TEST_TCP_LISTEN_IPV6, 2);
+    test_tcp_timeout();
+    test_tcp_handle();
+    test_tcp_offload();
+    test_tcp_broadcast();
+    test_tcp_writev();
+    test_tcp_owned();
+    test_tcp_cork();
+    test_tcp_zerocopy();
+    test_tcp_shaping();
+    test_tcp_quota();
+    test_tcp_quota_msgs();
+    test_tcp_adaptive();
+    test_tcp_flow();
 
     fclose(stdin);
     fclose(stdout);
@@ -0,0 +1,237 @@
+/*
+ * This source code has been dedicated to the public domain by the authors.
+ * Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+ * this source code, either in source code form or as a compiled binary,
+ * for any purpose, commercial or non-commercial, and by any means.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "svx_looper.h"
+#include "svx_inetaddr.h"
+#include "svx_tcp_server.h"
+#include "svx_tcp_client.h"
+#include "svx_tcp_proxy.h"
+#include "svx_log.h"
+#include "svx_util.h"
+
+#define TEST_TCP_PROXY_IP           "127.0.0.1"
+#define TEST_TCP_PROXY_FRONT_PORT   20010
+#define TEST_TCP_PROXY_BACKEND_PORT 20011
+
+#define TEST_TCP_PROXY_LEN_1TO2     (8 * 1024 * 1024 + 17)
+#define TEST_TCP_PROXY_LEN_2TO1     (3 * 1024 * 1024 + 5)
+
+#define TEST_EXIT do {SVX_LOG_ERR("exit(1). line: %d. errno:%d.\n", __LINE__, errno); exit(1);} while(0)
+
+typedef struct
+{
+    int    fd;
+    size_t len;
+    int    seed;
+} test_tcp_proxy_sender_t;
+
+static svx_looper_t         *test_tcp_proxy_looper     = NULL;
+static svx_tcp_server_t     *test_tcp_proxy_server     = NULL;
+static svx_tcp_client_t     *test_tcp_proxy_client     = NULL;
+static svx_tcp_connection_t *test_tcp_proxy_front_conn = NULL;
+static svx_tcp_proxy_t      *test_tcp_proxy            = NULL;
+static int                   test_tcp_proxy_closed     = 0;
+
+static uint8_t test_tcp_proxy_get_byte(size_t i, int seed)
+{
+    return (uint8_t)((i % 251) + (size_t)seed);
+}
+
+static void test_tcp_proxy_exit(void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_server_stop(test_tcp_proxy_server)) TEST_EXIT;
+    if(svx_looper_quit(test_tcp_proxy_looper)) TEST_EXIT;
+}
+
+static void test_tcp_proxy_closed_cb(svx_tcp_proxy_t *proxy, int errnum, void *arg)
+{
+    uint64_t bytes_1to2 = 0, bytes_2to1 = 0;
+
+    SVX_UTIL_UNUSED(arg);
+
+    /* both directions MUST reach the end of file */
+    if(0 != errnum) TEST_EXIT;
+    if(svx_tcp_proxy_get_bytes(proxy, &bytes_1to2, &bytes_2to1)) TEST_EXIT;
+    if(TEST_TCP_PROXY_LEN_1TO2 != bytes_1to2 || TEST_TCP_PROXY_LEN_2TO1 != bytes_2to1) TEST_EXIT;
+    test_tcp_proxy_closed = 1;
+
+    /* it is safe to destroy the proxy here */
+    if(svx_tcp_proxy_destroy(&test_tcp_proxy)) TEST_EXIT;
+    svx_tcp_connection_del_ref(test_tcp_proxy_front_conn);
+    test_tcp_proxy_front_conn = NULL;
+
+    if(svx_looper_dispatch(test_tcp_proxy_looper, test_tcp_proxy_exit, NULL, NULL, 0)) TEST_EXIT;
+}
+
+static void test_tcp_proxy_client_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_tcp_connection_disable_read(conn)) TEST_EXIT;
+
+    /* relay: front <==> backend */
+    if(svx_tcp_proxy_create(&test_tcp_proxy, test_tcp_proxy_front_conn, conn, test_tcp_proxy_closed_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_proxy_start(test_tcp_proxy)) TEST_EXIT;
+}
+
+static void test_tcp_proxy_server_established_cb(svx_tcp_connection_t *conn, void *arg)
+{
+    svx_inetaddr_t backend_addr;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(NULL != test_tcp_proxy_front_conn) TEST_EXIT;
+
+    /* do not read anything until the proxy is started */
+    if(svx_tcp_connection_disable_read(conn)) TEST_EXIT;
+    svx_tcp_connection_add_ref(conn);
+    test_tcp_proxy_front_conn = conn;
+
+    /* connect to the backend in the same looper */
+    if(svx_inetaddr_from_ipport(&backend_addr, TEST_TCP_PROXY_IP, TEST_TCP_PROXY_BACKEND_PORT)) TEST_EXIT;
+    if(svx_tcp_client_create(&test_tcp_proxy_client, test_tcp_proxy_looper, backend_addr)) TEST_EXIT;
+    if(svx_tcp_client_set_established_cb(test_tcp_proxy_client, test_tcp_proxy_client_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_client_connect(test_tcp_proxy_client)) TEST_EXIT;
+}
+
+static void test_tcp_proxy_read_cb(svx_tcp_connection_t *conn, svx_circlebuf_t *buf, void *arg)
+{
+    SVX_UTIL_UNUSED(conn);
+    SVX_UTIL_UNUSED(buf);
+    SVX_UTIL_UNUSED(arg);
+
+    /* all data MUST be relayed by the proxy */
+    TEST_EXIT;
+}
+
+static void *test_tcp_proxy_looper_thd(void *arg)
+{
+    svx_inetaddr_t listen_addr;
+
+    SVX_UTIL_UNUSED(arg);
+
+    if(svx_inetaddr_from_ipport(&listen_addr, TEST_TCP_PROXY_IP, TEST_TCP_PROXY_FRONT_PORT)) TEST_EXIT;
+    if(svx_tcp_server_create(&test_tcp_proxy_server, test_tcp_proxy_looper, listen_addr)) TEST_EXIT;
+    if(svx_tcp_server_set_established_cb(test_tcp_proxy_server, test_tcp_proxy_server_established_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_set_read_cb(test_tcp_proxy_server, test_tcp_proxy_read_cb, NULL)) TEST_EXIT;
+    if(svx_tcp_server_start(test_tcp_proxy_server)) TEST_EXIT;
+
+    /* blocked here until svx_looper_quit() */
+    if(svx_looper_loop(test_tcp_proxy_looper)) TEST_EXIT;
+
+    if(svx_tcp_client_destroy(&test_tcp_proxy_client)) TEST_EXIT;
+    if(svx_tcp_server_destroy(&test_tcp_proxy_server)) TEST_EXIT;
+
+    return NULL;
+}
+
+static void *test_tcp_proxy_sender_thd(void *arg)
+{
+    test_tcp_proxy_sender_t *sender = (test_tcp_proxy_sender_t *)arg;
+    uint8_t                  buf[10000];
+    size_t                   sent = 0, len, i;
+    ssize_t                  n;
+
+    while(sent < sender->len)
+    {
+        len = (sender->len - sent > sizeof(buf) ? sizeof(buf) : sender->len - sent);
+        for(i = 0; i < len; i++)
+            buf[i] = test_tcp_proxy_get_byte(sent + i, sender->seed);
+        if((n = write(sender->fd, buf, len)) <= 0) TEST_EXIT;
+        sent += (size_t)n;
+    }
+
+    /* half-close */
+    if(shutdown(sender->fd, SHUT_WR)) TEST_EXIT;
+
+    return NULL;
+}
+
+/* send from fd_from in a new thread, and receive from fd_to until the end of file */
+static void test_tcp_proxy_transfer(int fd_from, int fd_to, size_t len, int seed)
+{
+    test_tcp_proxy_sender_t sender = {fd_from, len, seed};
+    pthread_t               tid;
+    uint8_t                 buf[8192];
+    size_t                  recved = 0, i;
+    ssize_t                 n;
+
+    if(pthread_create(&tid, NULL, &test_tcp_proxy_sender_thd, &sender)) TEST_EXIT;
+
+    while((n = read(fd_to, buf, sizeof(buf))) > 0)
+    {
+        for(i = 0; i < (size_t)n; i++)
+            if(buf[i] != test_tcp_proxy_get_byte(recved + i, seed)) TEST_EXIT;
+        recved += (size_t)n;
+    }
+    if(n < 0 || recved != len) TEST_EXIT;
+
+    if(pthread_join(tid, NULL)) TEST_EXIT;
+}
+
+int test_tcp_proxy_runner()
+{
+    pthread_t          tid;
+    struct sockaddr_in addr;
+    int                listen_fd, front_fd, backend_fd;
+    int                on = 1, i;
+
+    svx_log_level_stdout = SVX_LOG_LEVEL_WARNING;
+
+    /* the backend */
+    if((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) TEST_EXIT;
+    if(setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))) TEST_EXIT;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(TEST_TCP_PROXY_BACKEND_PORT);
+    if(1 != inet_pton(AF_INET, TEST_TCP_PROXY_IP, &addr.sin_addr)) TEST_EXIT;
+    if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))) TEST_EXIT;
+    if(listen(listen_fd, 8)) TEST_EXIT;
+
+    /* the proxy */
+    if(svx_looper_create(&test_tcp_proxy_looper)) TEST_EXIT;
+    if(pthread_create(&tid, NULL, &test_tcp_proxy_looper_thd, NULL)) TEST_EXIT;
+
+    /* connect to the proxy */
+    if((front_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) TEST_EXIT;
+    addr.sin_port = htons(TEST_TCP_PROXY_FRONT_PORT);
+    for(i = 0; 0 != connect(front_fd, (struct sockaddr *)&addr, sizeof(addr)); i++)
+    {
+        if(ECONNREFUSED != errno || i >= 100) TEST_EXIT;
+        usleep(10 * 1000); /* wait for the TCP server to start */
+    }
+    if((backend_fd = accept(listen_fd, NULL, NULL)) < 0) TEST_EXIT;
+
+    /* front ==> backend, then backend ==> front */
+    test_tcp_proxy_transfer(front_fd, backend_fd, TEST_TCP_PROXY_LEN_1TO2, 3);
+    test_tcp_proxy_transfer(backend_fd, front_fd, TEST_TCP_PROXY_LEN_2TO1, 7);
+
+    if(pthread_join(tid, NULL)) TEST_EXIT;
+    if(!test_tcp_proxy_closed) TEST_EXIT;
+    if(svx_looper_destroy(&test_tcp_proxy_looper)) TEST_EXIT;
+
+    close(front_fd);
+    close(backend_fd);
+    close(listen_fd);
+
+    fclose(stdin);
+    fclose(stdout);
+    fclose(stderr);
+    return 0;
+}
@@ -5,15 +5,21 @@
  * for any purpose, commercial or non-commercial, and by any means.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include "svx_threadpool.h"
+#include "svx_looper.h"
 #include "svx_errno.h"
 
 #define TEST_THREADPOOL_THD_CNT  8
 #define TEST_THREADPOOL_TASK_CNT 1024
+#define TEST_THREADPOOL_BATCH_CNT  1000
+#define TEST_THREADPOOL_CANCEL_CNT 100
 
 static pthread_mutex_t test_threadpool_mutex           = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  test_threadpool_cond            = PTHREAD_COND_INITIALIZER;
@@ -96,6 +102,216 @@ static int test_threadpool_do(size_t max_task_queue_size)
     return 0;
 }
 
+/* the completions sent back to the looper */
+static svx_looper_t  *test_threadpool_looper         = NULL;
+static volatile int   test_threadpool_works_cnt      = 0; /* atomic */
+static int            test_threadpool_done_cnt       = 0;
+static int            test_threadpool_clean_cnt      = 0;
+static int            test_threadpool_wrong_thd_cnt  = 0;
+static uint64_t       test_threadpool_done_iter_min  = UINT64_MAX;
+static uint64_t       test_threadpool_done_iter_max  = 0;
+static intptr_t       test_threadpool_done_last      = -1;
+static int            test_threadpool_done_disorder  = 0;
+static volatile int   test_threadpool_blocker_state  = 0; /* 1: running, 2: released */
+
+static void test_threadpool_looper_work(void *arg)
+{
+    (void)arg;
+    __sync_add_and_fetch(&test_threadpool_works_cnt, 1);
+}
+
+static void test_threadpool_looper_blocker_work(void *arg)
+{
+    (void)arg;
+    test_threadpool_blocker_state = 1;
+    while(1 == test_threadpool_blocker_state) usleep(1000);
+}
+
+static void test_threadpool_looper_sleeper_work(void *arg)
+{
+    (void)arg;
+    test_threadpool_blocker_state = 1;
+    usleep(100 * 1000);
+}
+
+static void test_threadpool_looper_done(void *arg)
+{
+    uint64_t iter = 0;
+
+    if(!svx_looper_is_loop_thread(test_threadpool_looper)) test_threadpool_wrong_thd_cnt++;
+    svx_looper_get_iteration(test_threadpool_looper, &iter);
+    if(iter < test_threadpool_done_iter_min) test_threadpool_done_iter_min = iter;
+    if(iter > test_threadpool_done_iter_max) test_threadpool_done_iter_max = iter;
+    if((intptr_t)arg <= test_threadpool_done_last) test_threadpool_done_disorder++;
+    test_threadpool_done_last = (intptr_t)arg;
+
+    pthread_mutex_lock(&test_threadpool_mutex);
+    test_threadpool_done_cnt++;
+    pthread_cond_signal(&test_threadpool_cond);
+    pthread_mutex_unlock(&test_threadpool_mutex);
+}
+
+static void test_threadpool_looper_clean(void *arg)
+{
+    (void)arg;
+    if(!svx_looper_is_loop_thread(test_threadpool_looper)) test_threadpool_wrong_thd_cnt++;
+
+    pthread_mutex_lock(&test_threadpool_mutex);
+    test_threadpool_clean_cnt++;
+    pthread_cond_signal(&test_threadpool_cond);
+    pthread_mutex_unlock(&test_threadpool_mutex);
+}
+
+static void test_threadpool_looper_reset()
+{
+    test_threadpool_works_cnt     = 0;
+    test_threadpool_done_cnt      = 0;
+    test_threadpool_clean_cnt     = 0;
+    test_threadpool_wrong_thd_cnt = 0;
+    test_threadpool_done_iter_min = UINT64_MAX;
+    test_threadpool_done_iter_max = 0;
+    test_threadpool_done_last     = -1;
+    test_threadpool_done_disorder = 0;
+    test_threadpool_blocker_state = 0;
+}
+
+static void test_threadpool_looper_wait(int cnt)
+{
+    pthread_mutex_lock(&test_threadpool_mutex);
+    while(test_threadpool_done_cnt + test_threadpool_clean_cnt < cnt)
+        pthread_cond_wait(&test_threadpool_cond, &test_threadpool_mutex);
+    pthread_mutex_unlock(&test_threadpool_mutex);
+}
+
+/* in the loop thread: hold the loop thread until all the tasks are finished */
+static void test_threadpool_looper_batch_run(void *arg)
+{
+    svx_threadpool_t *threadpool = *((svx_threadpool_t **)arg);
+    intptr_t          i;
+
+    for(i = 0; i < TEST_THREADPOOL_BATCH_CNT; i++)
+        if(svx_threadpool_submit_to_looper(threadpool, test_threadpool_looper, test_threadpool_looper_work,
+                                           test_threadpool_looper_done, test_threadpool_looper_clean,
+                                           (void *)i, NULL)) exit(1);
+
+    while(TEST_THREADPOOL_BATCH_CNT != __sync_add_and_fetch(&test_threadpool_works_cnt, 0)) usleep(1000);
+    usleep(10 * 1000); /* the last ones are being posted */
+}
+
+static void *test_threadpool_looper_thd(void *arg)
+{
+    (void)arg;
+    if(svx_looper_loop(test_threadpool_looper)) exit(1);
+    return NULL;
+}
+
+/* a burst of finished tasks is completed in one round of the looper */
+static int test_threadpool_looper_batch()
+{
+    svx_threadpool_t *threadpool = NULL;
+
+    test_threadpool_looper_reset();
+
+    if(svx_threadpool_create(&threadpool, TEST_THREADPOOL_THD_CNT, 0)) return 1;
+    if(svx_looper_dispatch(test_threadpool_looper, test_threadpool_looper_batch_run, NULL,
+                           &threadpool, sizeof(threadpool))) return 1;
+    test_threadpool_looper_wait(TEST_THREADPOOL_BATCH_CNT);
+    if(svx_threadpool_destroy(&threadpool)) return 1;
+
+    if(TEST_THREADPOOL_BATCH_CNT != test_threadpool_done_cnt || 0 != test_threadpool_clean_cnt ||
+       0 != test_threadpool_wrong_thd_cnt || test_threadpool_done_iter_min != test_threadpool_done_iter_max)
+    {
+        printf("check batch failed. done:%d, clean:%d, wrong thread:%d, rounds:%"PRIu64"\n",
+               test_threadpool_done_cnt, test_threadpool_clean_cnt, test_threadpool_wrong_thd_cnt,
+               test_threadpool_done_iter_max - test_threadpool_done_iter_min + 1);
+        return 1;
+    }
+    return 0;
+}
+
+/* the canceled tasks and the tasks left in the destroyed threadpool are cleaned in the loop thread */
+static int test_threadpool_looper_cancel()
+{
+    svx_threadpool_t         *threadpool = NULL;
+    svx_threadpool_task_id_t  blocker_id;
+    svx_threadpool_task_id_t  ids[TEST_THREADPOOL_CANCEL_CNT];
+    intptr_t                  i;
+
+    /* cancel */
+    test_threadpool_looper_reset();
+    if(svx_threadpool_create(&threadpool, 1, 0)) return 1;
+    if(svx_threadpool_submit_to_looper(threadpool, test_threadpool_looper, test_threadpool_looper_blocker_work,
+                                       test_threadpool_looper_done, test_threadpool_looper_clean,
+                                       (void *)0, &blocker_id)) return 1;
+    for(i = 0; i < TEST_THREADPOOL_CANCEL_CNT; i++)
+        if(svx_threadpool_submit_to_looper(threadpool, test_threadpool_looper, test_threadpool_looper_work,
+                                           test_threadpool_looper_done, test_threadpool_looper_clean,
+                                           (void *)(i + 1), &(ids[i]))) return 1;
+    while(0 == test_threadpool_blocker_state) usleep(1000);
+
+    if(SVX_ERRNO_NOTFND != svx_threadpool_cancel(threadpool, blocker_id)) return 1;
+    for(i = 0; i < TEST_THREADPOOL_CANCEL_CNT; i += 2)
+        if(svx_threadpool_cancel(threadpool, ids[i])) return 1;
+    if(SVX_ERRNO_NOTFND != svx_threadpool_cancel(threadpool, ids[0])) return 1;
+    test_threadpool_blocker_state = 2;
+
+    test_threadpool_looper_wait(TEST_THREADPOOL_CANCEL_CNT + 1);
+    if(svx_threadpool_destroy(&threadpool)) return 1;
+
+    if(TEST_THREADPOOL_CANCEL_CNT / 2 + 1 != test_threadpool_done_cnt ||
+       TEST_THREADPOOL_CANCEL_CNT / 2 != test_threadpool_clean_cnt ||
+       TEST_THREADPOOL_CANCEL_CNT / 2 != test_threadpool_works_cnt ||
+       0 != test_threadpool_wrong_thd_cnt || 0 != test_threadpool_done_disorder)
+    {
+        printf("check cancel failed. done:%d, clean:%d, works:%d, wrong thread:%d, disorder:%d\n",
+               test_threadpool_done_cnt, test_threadpool_clean_cnt, test_threadpool_works_cnt,
+               test_threadpool_wrong_thd_cnt, test_threadpool_done_disorder);
+        return 1;
+    }
+
+    /* destroy the threadpool while the tasks are queued */
+    test_threadpool_looper_reset();
+    if(svx_threadpool_create(&threadpool, 1, 0)) return 1;
+    if(svx_threadpool_submit_to_looper(threadpool, test_threadpool_looper, test_threadpool_looper_sleeper_work,
+                                       test_threadpool_looper_done, test_threadpool_looper_clean,
+                                       (void *)0, NULL)) return 1;
+    for(i = 0; i < TEST_THREADPOOL_CANCEL_CNT; i++)
+        if(svx_threadpool_submit_to_looper(threadpool, test_threadpool_looper, test_threadpool_looper_work,
+                                           test_threadpool_looper_done, test_threadpool_looper_clean,
+                                           (void *)(i + 1), NULL)) return 1;
+    while(0 == test_threadpool_blocker_state) usleep(1000);
+    if(svx_threadpool_destroy(&threadpool)) return 1;
+
+    test_threadpool_looper_wait(TEST_THREADPOOL_CANCEL_CNT + 1);
+    if(1 != test_threadpool_done_cnt || TEST_THREADPOOL_CANCEL_CNT != test_threadpool_clean_cnt ||
+       0 != test_threadpool_wrong_thd_cnt)
+    {
+        printf("check destroy failed. done:%d, clean:%d, wrong thread:%d\n",
+               test_threadpool_done_cnt, test_threadpool_clean_cnt, test_threadpool_wrong_thd_cnt);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_threadpool_looper_do()
+{
+    pthread_t tid;
+    int       r = 0;
+
+    if(svx_looper_create(&test_threadpool_looper)) return 1;
+    if(pthread_create(&tid, NULL, &test_threadpool_looper_thd, NULL)) return 1;
+
+    if(0 != (r = test_threadpool_looper_batch())) goto end;
+    if(0 != (r = test_threadpool_looper_cancel())) goto end;
+
+ end:
+    if(svx_looper_quit(test_threadpool_looper)) return 1;
+    pthread_join(tid, NULL);
+    if(svx_looper_destroy(&test_threadpool_looper)) return 1;
+    return r;
+}
+
 int test_threadpool_runner()
 {
     int r = 0;
@@ -106,6 +322,9 @@ int test_threadpool_runner()
     /* test for limited task queue size */
     if(0 != (r = test_threadpool_do(32))) goto end;
 
+    /* test for the completions sent back to the looper */
+    if(0 != (r = test_threadpool_looper_do())) goto end;
+
  end:
     fclose(stdin);
     fclose(stdout);
@@ -93,3 +93,13 @@ target("httpserver")
     add_linkdirs("$(buildir)")
     add_links("svx", "pthread")
     add_files("benchmarks/httpserver/*.c")
+
+-- benchmarks: circlebuf
+target("circlebuf")
+    set_kind("binary")
+    add_deps("svx")
+    set_objectdir("$(buildir)/.objs")
+    add_includedirs("src")
+    add_linkdirs("$(buildir)")
+    add_links("svx", "pthread")
+    add_files("benchmarks/circlebuf/*.c")